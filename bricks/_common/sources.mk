@@ -106,11 +106,13 @@ PYBRICKS_PYBRICKS_SRC_C = $(addprefix pybricks/,\
 	util_pb/pb_conversions.c \
 	util_pb/pb_error.c \
 	util_pb/pb_serial_ev3dev.c \
+	util_pb/pb_serial_pup.c \
 	)
 
 # Pybricks I/O library
 
 PBIO_SRC_C = $(addprefix lib/pbio/,\
+	drv/adc/adc_filter.c \
 	drv/adc/adc_stm32_hal.c \
 	drv/adc/adc_stm32f0.c \
 	drv/battery/battery_adc.c \
@@ -135,6 +137,8 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	drv/button/button_test.c \
 	drv/button/button_virtual.c \
 	drv/charger/charger_mp2639a.c \
+	drv/charger/charger_session.c \
+	drv/charger/charger_test.c \
 	drv/clock/clock_ev3rt.c \
 	drv/clock/clock_linux.c \
 	drv/clock/clock_nxt.c \
@@ -160,6 +164,7 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	drv/legodev/legodev_nxt.c \
 	drv/legodev/legodev_pup.c \
 	drv/legodev/legodev_pup_uart.c \
+	drv/legodev/legodev_pup_uart_msg.c \
 	drv/legodev/legodev_spec.c \
 	drv/legodev/legodev_test.c \
 	drv/legodev/legodev_virtual.c \
@@ -180,10 +185,14 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	drv/resistor_ladder/resistor_ladder.c \
 	drv/sound/sound_nxt.c \
 	drv/sound/sound_stm32_hal_dac.c \
+	drv/telemetry/telemetry_linux_shm.c \
+	drv/uart/uart_ring.c \
 	drv/uart/uart_stm32f0.c \
 	drv/uart/uart_stm32f4_ll_irq.c \
 	drv/uart/uart_stm32l4_ll_dma.c \
 	drv/usb/usb_stm32.c \
+	drv/usb/usb_stm32_serial.c \
+	drv/usb/usb_test.c \
 	drv/virtual.c \
 	drv/watchdog/watchdog_stm32.c \
 	platform/$(PBIO_PLATFORM)/platform.c \
@@ -231,6 +240,7 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	sys/program_stop.c \
 	sys/status.c \
 	sys/supervisor.c \
+	sys/usb.c \
 	)
 
 # MicroPython math library
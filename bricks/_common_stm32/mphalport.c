@@ -11,6 +11,7 @@
 #include <pbdrv/config.h>
 #include <pbio/main.h>
 #include <pbsys/bluetooth.h>
+#include <pbsys/usb.h>
 
 #include "py/runtime.h"
 #include "py/mphal.h"
@@ -106,7 +107,7 @@ void mp_hal_stdout_tx_flush(void) {
 uintptr_t mp_hal_stdio_poll(uintptr_t poll_flags) {
     uintptr_t ret = 0;
 
-    if ((poll_flags & MP_STREAM_POLL_RD) && pbsys_bluetooth_rx_get_available()) {
+    if ((poll_flags & MP_STREAM_POLL_RD) && (pbsys_usb_rx_get_available() || pbsys_bluetooth_rx_get_available())) {
         ret |= MP_STREAM_POLL_RD;
     }
 
@@ -119,7 +120,8 @@ int mp_hal_stdin_rx_chr(void) {
     uint8_t c;
 
     // wait for rx interrupt
-    while (size = 1, pbsys_bluetooth_rx(&c, &size) != PBIO_SUCCESS) {
+    while (size = 1, pbsys_usb_rx(&c, &size) != PBIO_SUCCESS
+           && (size = 1, pbsys_bluetooth_rx(&c, &size) != PBIO_SUCCESS)) {
         MICROPY_EVENT_POLL_HOOK
     }
 
@@ -130,7 +132,13 @@ int mp_hal_stdin_rx_chr(void) {
 void mp_hal_stdout_tx_strn(const char *str, mp_uint_t len) {
     while (len) {
         uint32_t size = len;
-        pbio_error_t err = pbsys_bluetooth_tx((const uint8_t *)str, &size);
+
+        // USB is used instead of Bluetooth while a host has the port open.
+        pbio_error_t err = pbsys_usb_tx((const uint8_t *)str, &size);
+        if (err == PBIO_ERROR_INVALID_OP || err == PBIO_ERROR_NOT_SUPPORTED) {
+            size = len;
+            err = pbsys_bluetooth_tx((const uint8_t *)str, &size);
+        }
 
         if (err == PBIO_SUCCESS) {
             str += size;
@@ -139,8 +147,8 @@ void mp_hal_stdout_tx_strn(const char *str, mp_uint_t len) {
         }
 
         if (err != PBIO_ERROR_AGAIN) {
-            // Ignoring error for now. This means stdout lost if Bluetooth is
-            // disconnected.
+            // Ignoring error for now. This means stdout lost if neither USB
+            // nor Bluetooth is connected.
             return;
         }
 
@@ -149,7 +157,7 @@ void mp_hal_stdout_tx_strn(const char *str, mp_uint_t len) {
 }
 
 void mp_hal_stdout_tx_flush(void) {
-    while (!pbsys_bluetooth_tx_is_idle()) {
+    while (!pbsys_usb_tx_is_idle() || !pbsys_bluetooth_tx_is_idle()) {
         MICROPY_EVENT_POLL_HOOK
     }
 }
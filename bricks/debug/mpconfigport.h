@@ -45,5 +45,6 @@
 #define PYBRICKS_OPT_EXTRA_MOD                  (0)
 #define PYBRICKS_OPT_CUSTOM_IMPORT              (1)
 #define PYBRICKS_OPT_NATIVE_MOD                 (0)
+#define PYBRICKS_OPT_MATRIX_FIXED_POINT         (0)
 
 #include "../_common_stm32/mpconfigport.h"
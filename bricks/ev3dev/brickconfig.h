@@ -14,6 +14,15 @@
 // In this port, Pybricks runs on top of ev3dev.
 #define PYBRICKS_RUNS_ON_EV3DEV         (1)
 
+// Run the motor control loop in a thread with real-time (SCHED_FIFO) priority
+// below the kernel interrupt threads. The GIL then uses priority inheritance.
+// This is off by default: it needs permission to use real-time priorities,
+// such as running as root, and it locks all memory of the process in RAM.
+#define PYBRICKS_EV3DEV_RT_CONTROL_THREAD (0)
+
+// Play WAV files in-process instead of spawning aplay.
+#define PYBRICKS_EV3DEV_AUDIO_ENGINE    (1)
+
 // Pybricks modules
 #define PYBRICKS_PY_COMMON              (1)
 #define PYBRICKS_PY_COMMON_BLE          (0)
@@ -0,0 +1,647 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// In-process PCM playback for the EV3 speaker.
+//
+// Spawning aplay for every sound takes a few hundred milliseconds on the EV3,
+// which is too slow for sound effects. Instead, WAV files are loaded once and
+// kept in a small cache. A background thread feeds the samples to ALSA in
+// small chunks, so sound starts within a few milliseconds and the MicroPython
+// thread does not have to wait for playback to complete.
+//
+// The PCM device is kept open for a short while after playback, so that
+// sounds played in quick succession don't have to reopen it. Other users of
+// the sound device, such as aplay for text to speech, must call
+// ev3dev_audio_release() first.
+
+#include "py/mpconfig.h"
+
+#if PYBRICKS_EV3DEV_AUDIO_ENGINE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <alsa/asoundlib.h>
+
+#include "ev3dev_audio.h"
+
+// The default device takes care of rate and format conversion.
+#define AUDIO_DEVICE "default"
+
+// Size of the ALSA buffer. This is how long a stopped sound may keep playing.
+#define AUDIO_LATENCY_US (50000)
+
+// Samples are written in chunks of 10 ms.
+#define AUDIO_CHUNKS_PER_SECOND (100)
+
+// The device is closed when no sound was played for this long.
+#define AUDIO_IDLE_CLOSE_MS (2000)
+
+// Below the motor control thread and kernel interrupt threads, but above
+// the MicroPython thread so that a busy program does not cause underruns.
+#define AUDIO_THREAD_PRIORITY (40)
+
+// Cache limits. The cache only holds the most recently played files.
+#define CACHE_NUM_CLIPS (8)
+#define CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+#define WAVE_FORMAT_PCM        (0x0001)
+#define WAVE_FORMAT_EXTENSIBLE (0xFFFE)
+
+typedef struct {
+    // Number of references held by the cache, the pending slot and the
+    // playback thread. Protected by audio.lock.
+    unsigned int refs;
+    snd_pcm_format_t format;
+    unsigned int channels;
+    unsigned int rate;
+    size_t frame_size;
+    // Samples, pointing into file.
+    const uint8_t *data;
+    snd_pcm_uframes_t frames;
+    // Complete file contents.
+    uint8_t *file;
+    size_t file_size;
+} audio_clip_t;
+
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint32_t last_used;
+    audio_clip_t *clip;
+} cache_entry_t;
+
+static struct {
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // Clip that should be played next, if any.
+    audio_clip_t *pending;
+    // Incremented to interrupt the clip that is currently playing.
+    uint32_t generation;
+    // Whether the most recently requested clip is still playing.
+    bool busy;
+    // Result of the most recently requested clip.
+    int result;
+    bool release;
+    bool quit;
+    // The remaining fields are only used by the playback thread.
+    snd_pcm_t *pcm;
+    snd_pcm_format_t pcm_format;
+    unsigned int pcm_channels;
+    unsigned int pcm_rate;
+} audio = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static cache_entry_t cache[CACHE_NUM_CLIPS];
+static uint32_t cache_counter;
+static size_t cache_bytes;
+
+static uint16_t get_le16(const uint8_t *buf) {
+    return buf[0] | buf[1] << 8;
+}
+
+static uint32_t get_le32(const uint8_t *buf) {
+    return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+// Must be called with audio.lock held.
+static void clip_unref(audio_clip_t *clip) {
+    if (--clip->refs == 0) {
+        free(clip->file);
+        free(clip);
+    }
+}
+
+// Finds the samples in a RIFF WAVE file. Only uncompressed 8 or 16 bit mono
+// or stereo files are supported. Everything else is left to aplay.
+static int clip_parse_wav(audio_clip_t *clip) {
+    const uint8_t *buf = clip->file;
+    size_t size = clip->file_size;
+
+    if (size < 12 || memcmp(&buf[0], "RIFF", 4) != 0 || memcmp(&buf[8], "WAVE", 4) != 0) {
+        return -EPROTONOSUPPORT;
+    }
+
+    bool have_fmt = false;
+    size_t pos = 12;
+
+    while (pos <= size && size - pos >= 8) {
+        const uint8_t *chunk = &buf[pos];
+        size_t chunk_size = get_le32(&chunk[4]);
+        pos += 8;
+
+        // Truncated files are common, so play whatever is there.
+        if (chunk_size > size - pos) {
+            chunk_size = size - pos;
+        }
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16) {
+                return -EPROTONOSUPPORT;
+            }
+            uint16_t tag = get_le16(&buf[pos]);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 26) {
+                // First two bytes of the SubFormat GUID.
+                tag = get_le16(&buf[pos + 24]);
+            }
+            clip->channels = get_le16(&buf[pos + 2]);
+            clip->rate = get_le32(&buf[pos + 4]);
+            uint16_t bits = get_le16(&buf[pos + 14]);
+
+            if (tag != WAVE_FORMAT_PCM || clip->channels < 1 || clip->channels > 2 || clip->rate == 0) {
+                return -EPROTONOSUPPORT;
+            }
+            if (bits == 8) {
+                clip->format = SND_PCM_FORMAT_U8;
+            } else if (bits == 16) {
+                clip->format = SND_PCM_FORMAT_S16_LE;
+            } else {
+                return -EPROTONOSUPPORT;
+            }
+            clip->frame_size = clip->channels * bits / 8;
+            have_fmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt) {
+                return -EPROTONOSUPPORT;
+            }
+            clip->data = &buf[pos];
+            clip->frames = chunk_size / clip->frame_size;
+            return 0;
+        }
+
+        // Chunks are padded to an even size.
+        pos += chunk_size + (chunk_size & 1);
+    }
+
+    return -EPROTONOSUPPORT;
+}
+
+// Must be called with audio.lock held.
+static void cache_evict(cache_entry_t *entry) {
+    cache_bytes -= entry->clip->file_size;
+    clip_unref(entry->clip);
+    free(entry->path);
+    entry->clip = NULL;
+    entry->path = NULL;
+}
+
+// Returns a new reference to a cached clip, or NULL if the file is not cached
+// or was modified since it was cached.
+static audio_clip_t *cache_lookup(const char *path, const struct stat *st) {
+    audio_clip_t *clip = NULL;
+
+    pthread_mutex_lock(&audio.lock);
+
+    for (int i = 0; i < CACHE_NUM_CLIPS; i++) {
+        cache_entry_t *entry = &cache[i];
+        if (!entry->clip || strcmp(entry->path, path) != 0) {
+            continue;
+        }
+        if (entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size &&
+            entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            entry->last_used = ++cache_counter;
+            clip = entry->clip;
+            clip->refs++;
+        } else {
+            cache_evict(entry);
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&audio.lock);
+
+    return clip;
+}
+
+// Adds a clip to the cache, evicting the least recently used clips as needed.
+static void cache_insert(const char *path, const struct stat *st, audio_clip_t *clip) {
+    if (clip->file_size > CACHE_MAX_BYTES) {
+        return;
+    }
+
+    char *path_copy = strdup(path);
+    if (!path_copy) {
+        return;
+    }
+
+    pthread_mutex_lock(&audio.lock);
+
+    for (;;) {
+        cache_entry_t *free_entry = NULL;
+        cache_entry_t *oldest = NULL;
+
+        for (int i = 0; i < CACHE_NUM_CLIPS; i++) {
+            cache_entry_t *entry = &cache[i];
+            if (!entry->clip) {
+                free_entry = entry;
+            } else if (!oldest || entry->last_used < oldest->last_used) {
+                oldest = entry;
+            }
+        }
+
+        if (free_entry && cache_bytes + clip->file_size <= CACHE_MAX_BYTES) {
+            free_entry->path = path_copy;
+            free_entry->dev = st->st_dev;
+            free_entry->ino = st->st_ino;
+            free_entry->size = st->st_size;
+            free_entry->mtime = st->st_mtim;
+            free_entry->last_used = ++cache_counter;
+            free_entry->clip = clip;
+            clip->refs++;
+            cache_bytes += clip->file_size;
+            break;
+        }
+
+        cache_evict(oldest);
+    }
+
+    pthread_mutex_unlock(&audio.lock);
+}
+
+// Gets a reference to the clip for the given file, loading it if needed.
+static int clip_load(const char *path, audio_clip_t **clip_out) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        return -errno;
+    }
+
+    audio_clip_t *clip = cache_lookup(path, &st);
+    if (clip) {
+        *clip_out = clip;
+        return 0;
+    }
+
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        return -EPROTONOSUPPORT;
+    }
+
+    clip = calloc(1, sizeof(*clip));
+    if (!clip) {
+        return -ENOMEM;
+    }
+    clip->refs = 1;
+    clip->file_size = st.st_size;
+    clip->file = malloc(clip->file_size);
+    if (!clip->file) {
+        free(clip);
+        return -ENOMEM;
+    }
+
+    int err = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        err = -errno;
+    } else {
+        if (fread(clip->file, 1, clip->file_size, f) != clip->file_size) {
+            err = -EIO;
+        }
+        fclose(f);
+    }
+
+    if (err == 0) {
+        err = clip_parse_wav(clip);
+    }
+
+    if (err < 0) {
+        free(clip->file);
+        free(clip);
+        return err;
+    }
+
+    cache_insert(path, &st, clip);
+
+    *clip_out = clip;
+    return 0;
+}
+
+// Playback thread only.
+static void audio_close(void) {
+    if (audio.pcm) {
+        snd_pcm_close(audio.pcm);
+        audio.pcm = NULL;
+    }
+}
+
+// Opens the PCM device if needed and prepares it for the given clip. Reopening
+// and reconfiguring is skipped if the previous clip had the same format.
+// Playback thread only.
+static int audio_configure(const audio_clip_t *clip) {
+    int err;
+
+    if (!audio.pcm) {
+        err = snd_pcm_open(&audio.pcm, AUDIO_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
+        if (err < 0) {
+            audio.pcm = NULL;
+            return err;
+        }
+        audio.pcm_rate = 0;
+    }
+
+    if (audio.pcm_format == clip->format && audio.pcm_channels == clip->channels && audio.pcm_rate == clip->rate) {
+        return snd_pcm_prepare(audio.pcm);
+    }
+
+    err = snd_pcm_set_params(audio.pcm, clip->format, SND_PCM_ACCESS_RW_INTERLEAVED,
+        clip->channels, clip->rate, 1, AUDIO_LATENCY_US);
+    if (err < 0) {
+        audio_close();
+        return err;
+    }
+
+    audio.pcm_format = clip->format;
+    audio.pcm_channels = clip->channels;
+    audio.pcm_rate = clip->rate;
+
+    return 0;
+}
+
+static bool audio_interrupted(uint32_t generation) {
+    pthread_mutex_lock(&audio.lock);
+    bool interrupted = generation != audio.generation || audio.quit;
+    pthread_mutex_unlock(&audio.lock);
+    return interrupted;
+}
+
+// Writes the clip to the device. Playback thread only.
+static int audio_play_clip(const audio_clip_t *clip, uint32_t generation) {
+    int err = audio_configure(clip);
+    if (err < 0) {
+        return err;
+    }
+
+    snd_pcm_uframes_t chunk = clip->rate / AUDIO_CHUNKS_PER_SECOND ?: 1;
+    const uint8_t *data = clip->data;
+    snd_pcm_uframes_t remaining = clip->frames;
+
+    while (remaining) {
+        if (audio_interrupted(generation)) {
+            // Discard what is still in the buffer.
+            snd_pcm_drop(audio.pcm);
+            return 0;
+        }
+
+        snd_pcm_sframes_t written = snd_pcm_writei(audio.pcm, data, remaining < chunk ? remaining : chunk);
+        if (written < 0) {
+            // Recovers from underruns, e.g. when the CPU is very busy.
+            err = snd_pcm_recover(audio.pcm, written, 1);
+            if (err < 0) {
+                audio_close();
+                return err;
+            }
+            continue;
+        }
+
+        data += written * clip->frame_size;
+        remaining -= written;
+    }
+
+    err = snd_pcm_drain(audio.pcm);
+    if (err < 0) {
+        audio_close();
+        return err;
+    }
+
+    return 0;
+}
+
+static void *audio_thread(void *arg) {
+    struct sched_param param = {
+        .sched_priority = AUDIO_THREAD_PRIORITY,
+    };
+
+    // This is allowed to fail. Playback just becomes more prone to underruns.
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    pthread_mutex_lock(&audio.lock);
+
+    while (!audio.quit) {
+        if (audio.pending) {
+            audio_clip_t *clip = audio.pending;
+            audio.pending = NULL;
+            uint32_t generation = audio.generation;
+            pthread_mutex_unlock(&audio.lock);
+
+            int err = audio_play_clip(clip, generation);
+
+            pthread_mutex_lock(&audio.lock);
+            clip_unref(clip);
+            // Only report the result if nothing else was requested since.
+            if (generation == audio.generation) {
+                audio.busy = false;
+                audio.result = err;
+            }
+            continue;
+        }
+
+        if (audio.release) {
+            audio_close();
+            audio.release = false;
+            pthread_cond_broadcast(&audio.cond);
+            continue;
+        }
+
+        if (!audio.pcm) {
+            pthread_cond_wait(&audio.cond, &audio.lock);
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += AUDIO_IDLE_CLOSE_MS / 1000;
+        deadline.tv_nsec += (AUDIO_IDLE_CLOSE_MS % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        if (pthread_cond_timedwait(&audio.cond, &audio.lock, &deadline) == ETIMEDOUT && !audio.pending) {
+            audio_close();
+        }
+    }
+
+    audio_close();
+    pthread_mutex_unlock(&audio.lock);
+
+    return NULL;
+}
+
+static int audio_start(void) {
+    if (audio.started) {
+        return 0;
+    }
+
+    // Idle timeout should not be affected by changes to the wall clock.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&audio.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    audio.quit = false;
+
+    int err = pthread_create(&audio.thread, NULL, audio_thread, NULL);
+    if (err) {
+        pthread_cond_destroy(&audio.cond);
+        return -err;
+    }
+
+    audio.started = true;
+    return 0;
+}
+
+/**
+ * Starts playing a WAV file in the background. Anything that was playing
+ * is stopped.
+ *
+ * @param [in]  path    Path to the file.
+ * @return              0 on success, -EPROTONOSUPPORT if the file format is
+ *                      not supported, or another negative error code.
+ */
+int ev3dev_audio_play_file(const char *path) {
+    audio_clip_t *clip;
+    int err = clip_load(path, &clip);
+    if (err < 0) {
+        return err;
+    }
+
+    err = audio_start();
+
+    pthread_mutex_lock(&audio.lock);
+
+    if (err < 0) {
+        clip_unref(clip);
+        pthread_mutex_unlock(&audio.lock);
+        return err;
+    }
+
+    if (audio.pending) {
+        clip_unref(audio.pending);
+    }
+    audio.pending = clip;
+    audio.generation++;
+    audio.busy = true;
+    audio.result = 0;
+    pthread_cond_broadcast(&audio.cond);
+
+    pthread_mutex_unlock(&audio.lock);
+
+    return 0;
+}
+
+/**
+ * Tests if the most recently started sound is still playing.
+ */
+bool ev3dev_audio_is_busy(void) {
+    pthread_mutex_lock(&audio.lock);
+    bool busy = audio.busy;
+    pthread_mutex_unlock(&audio.lock);
+    return busy;
+}
+
+/**
+ * Gets the result of the most recently started sound: 0 on success or a
+ * negative error code.
+ */
+int ev3dev_audio_get_result(void) {
+    pthread_mutex_lock(&audio.lock);
+    int result = audio.result;
+    pthread_mutex_unlock(&audio.lock);
+    return result;
+}
+
+/**
+ * Gets a description of an error code returned by this module.
+ */
+const char *ev3dev_audio_strerror(int err) {
+    return snd_strerror(err);
+}
+
+/**
+ * Stops playback. The device stays open.
+ */
+void ev3dev_audio_stop(void) {
+    if (!audio.started) {
+        return;
+    }
+
+    pthread_mutex_lock(&audio.lock);
+
+    audio.generation++;
+    if (audio.pending) {
+        clip_unref(audio.pending);
+        audio.pending = NULL;
+    }
+    audio.busy = false;
+    audio.result = 0;
+    pthread_cond_broadcast(&audio.cond);
+
+    pthread_mutex_unlock(&audio.lock);
+}
+
+/**
+ * Stops playback and waits for the device to be closed, so that other
+ * processes can use it.
+ */
+void ev3dev_audio_release(void) {
+    if (!audio.started) {
+        return;
+    }
+
+    ev3dev_audio_stop();
+
+    pthread_mutex_lock(&audio.lock);
+
+    audio.release = true;
+    pthread_cond_broadcast(&audio.cond);
+    while (audio.release) {
+        pthread_cond_wait(&audio.cond, &audio.lock);
+    }
+
+    pthread_mutex_unlock(&audio.lock);
+}
+
+/**
+ * Stops playback, closes the device and frees the cache.
+ */
+void ev3dev_audio_deinit(void) {
+    if (!audio.started) {
+        return;
+    }
+
+    ev3dev_audio_stop();
+
+    pthread_mutex_lock(&audio.lock);
+    audio.quit = true;
+    pthread_cond_broadcast(&audio.cond);
+    pthread_mutex_unlock(&audio.lock);
+
+    pthread_join(audio.thread, NULL);
+    pthread_cond_destroy(&audio.cond);
+    audio.started = false;
+
+    pthread_mutex_lock(&audio.lock);
+    for (int i = 0; i < CACHE_NUM_CLIPS; i++) {
+        if (cache[i].clip) {
+            cache_evict(&cache[i]);
+        }
+    }
+    pthread_mutex_unlock(&audio.lock);
+}
+
+#endif // PYBRICKS_EV3DEV_AUDIO_ENGINE
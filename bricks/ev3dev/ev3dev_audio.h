@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// In-process PCM playback for the EV3 speaker.
+
+#ifndef _EV3DEV_AUDIO_H_
+#define _EV3DEV_AUDIO_H_
+
+#include <stdbool.h>
+
+int ev3dev_audio_play_file(const char *path);
+
+bool ev3dev_audio_is_busy(void);
+
+int ev3dev_audio_get_result(void);
+
+const char *ev3dev_audio_strerror(int err);
+
+void ev3dev_audio_stop(void);
+
+void ev3dev_audio_release(void);
+
+void ev3dev_audio_deinit(void);
+
+#endif // _EV3DEV_AUDIO_H_
@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// EV3 mailbox protocol, used by pybricks.messaging.
+//
+// Messages are EV3 VM system commands without reply:
+//
+//  Offset  Size        Description
+//  0       2           Size of the rest of the message (little-endian)
+//  2       2           Message counter (little-endian)
+//  4       1           Command type (SYSTEM_COMMAND_NO_REPLY)
+//  5       1           System command (WRITEMAILBOX)
+//  6       1           Size of the mailbox name, including null terminator
+//  7       n           Mailbox name, null-terminated
+//  7 + n   2           Size of the payload (little-endian)
+//  9 + n   m           Payload
+//
+// Connected sockets are watched by the pbio event loop. When data arrives, the
+// messaging process reads it into a preallocated buffer for each connection
+// and stores complete messages in a preallocated mailbox table, so receiving
+// needs no threads, locks or allocations.
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <contiki.h>
+#include <glib.h>
+
+#include <pbdrv/clock.h>
+
+#include "py/mpconfig.h"
+
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
+#include "py/obj.h"
+#include "py/objstr.h"
+#include "py/runtime.h"
+
+// EV3 VM bytecodes
+#define SYSTEM_COMMAND_NO_REPLY 0x81
+#define WRITEMAILBOX            0x9E
+
+// Size of the message header, up to and including the mailbox name size.
+#define HEADER_SIZE 7
+
+// Largest payload that can be sent or received.
+#define MAX_PAYLOAD_SIZE 1024
+
+// Largest message, including the size field.
+#define MAX_MESSAGE_SIZE (2 + HEADER_SIZE + UINT8_MAX + 2 + MAX_PAYLOAD_SIZE)
+
+// The EV3 supports up to 7 Bluetooth connections.
+#define NUM_CONNECTIONS 7
+
+#define NUM_MAILBOXES 16
+
+// Longest mailbox name, including null terminator.
+#define MAX_NAME_SIZE 32
+
+typedef struct {
+    // Socket file descriptor or -1 if not connected.
+    int fd;
+    // Set by the event loop when the socket is readable.
+    volatile bool readable;
+    // Bytes of an oversized message that still have to be skipped.
+    size_t skip;
+    // Number of bytes in buf.
+    size_t len;
+    uint8_t buf[MAX_MESSAGE_SIZE];
+} messaging_connection_t;
+
+typedef struct {
+    // Null-terminated name or empty if this entry is free.
+    char name[MAX_NAME_SIZE];
+    // Number of messages received. Zero means no value yet.
+    uint32_t count;
+    uint16_t size;
+    uint8_t data[MAX_PAYLOAD_SIZE];
+} messaging_mailbox_t;
+
+static messaging_connection_t connections[NUM_CONNECTIONS] = {
+    [0 ... NUM_CONNECTIONS - 1] = { .fd = -1 },
+};
+
+static messaging_mailbox_t mailboxes[NUM_MAILBOXES];
+
+// Outgoing messages are packed here. This is only used while holding the GIL
+// or while send_busy is set.
+static uint8_t send_buf[MAX_MESSAGE_SIZE];
+static bool send_busy;
+
+PROCESS(messaging_process, "messaging");
+
+// Packs a mailbox message into buf, which must hold MAX_MESSAGE_SIZE bytes.
+// Returns the size of the message.
+static size_t messaging_pack(uint8_t *buf, mp_obj_t mbox_in, mp_obj_t payload_in) {
+    size_t mbox_len;
+    const char *mbox = mp_obj_str_get_data(mbox_in, &mbox_len);
+
+    // Payload can be str or any bytes-like object.
+    mp_buffer_info_t payload;
+    if (mp_obj_is_str(payload_in)) {
+        payload.buf = (void *)mp_obj_str_get_data(payload_in, &payload.len);
+    } else {
+        mp_get_buffer_raise(payload_in, &payload, MP_BUFFER_READ);
+    }
+
+    // Name is sent with null terminator.
+    size_t name_size = mbox_len + 1;
+    if (name_size > UINT8_MAX || payload.len > MAX_PAYLOAD_SIZE) {
+        mp_raise_ValueError(MP_ERROR_TEXT("message too long"));
+    }
+
+    size_t send_len = HEADER_SIZE + name_size + payload.len;
+
+    buf[0] = send_len & 0xff;
+    buf[1] = send_len >> 8;
+    buf[2] = 1;
+    buf[3] = 0;
+    buf[4] = SYSTEM_COMMAND_NO_REPLY;
+    buf[5] = WRITEMAILBOX;
+    buf[6] = name_size;
+    memcpy(&buf[7], mbox, mbox_len);
+    buf[7 + mbox_len] = '\0';
+    buf[7 + name_size] = payload.len & 0xff;
+    buf[8 + name_size] = payload.len >> 8;
+    memcpy(&buf[9 + name_size], payload.buf, payload.len);
+
+    return 2 + send_len;
+}
+
+// Parses the body of a mailbox message, i.e. everything after the size field.
+// Returns NULL on success or the reason the message is invalid.
+static mp_rom_error_text_t messaging_unpack(const uint8_t *buf, size_t len,
+    const uint8_t **name, size_t *name_size, const uint8_t **data, size_t *data_size) {
+
+    if (len < HEADER_SIZE - 2) {
+        return MP_ERROR_TEXT("Bad message size");
+    }
+    if (buf[2] != SYSTEM_COMMAND_NO_REPLY) {
+        return MP_ERROR_TEXT("Bad message type");
+    }
+    if (buf[3] != WRITEMAILBOX) {
+        return MP_ERROR_TEXT("Bad command");
+    }
+
+    *name_size = buf[4];
+    *name = &buf[5];
+
+    if (len < 7 + *name_size) {
+        return MP_ERROR_TEXT("Bad message size");
+    }
+
+    *data_size = buf[5 + *name_size] | buf[6 + *name_size] << 8;
+    *data = &buf[7 + *name_size];
+
+    // Be lenient with senders that get the size wrong, like the Python
+    // implementation that this replaces.
+    if (*data_size > len - 7 - *name_size) {
+        *data_size = len - 7 - *name_size;
+    }
+
+    // Strip null terminator(s) from the name.
+    while (*name_size && (*name)[*name_size - 1] == '\0') {
+        (*name_size)--;
+    }
+
+    return NULL;
+}
+
+// Gets the mailbox with the given name, optionally adding it to the table.
+static messaging_mailbox_t *messaging_get_mailbox(const char *name, size_t name_size, bool add) {
+    if (name_size >= MAX_NAME_SIZE) {
+        return NULL;
+    }
+
+    messaging_mailbox_t *free_mbox = NULL;
+
+    for (size_t i = 0; i < NUM_MAILBOXES; i++) {
+        messaging_mailbox_t *mbox = &mailboxes[i];
+
+        if (mbox->name[0] == '\0') {
+            if (!free_mbox) {
+                free_mbox = mbox;
+            }
+            continue;
+        }
+
+        if (strncmp(mbox->name, name, name_size) == 0 && mbox->name[name_size] == '\0') {
+            return mbox;
+        }
+    }
+
+    if (!add || !free_mbox || name_size == 0) {
+        return NULL;
+    }
+
+    memcpy(free_mbox->name, name, name_size);
+    free_mbox->name[name_size] = '\0';
+    free_mbox->count = 0;
+    free_mbox->size = 0;
+
+    return free_mbox;
+}
+
+// Handles one complete message. Invalid messages and messages for mailboxes
+// that don't fit in the table are dropped.
+static void messaging_receive_message(const uint8_t *buf, size_t len) {
+    const uint8_t *name;
+    const uint8_t *data;
+    size_t name_size;
+    size_t data_size;
+
+    if (messaging_unpack(buf, len, &name, &name_size, &data, &data_size) || data_size > MAX_PAYLOAD_SIZE) {
+        return;
+    }
+
+    messaging_mailbox_t *mbox = messaging_get_mailbox((const char *)name, name_size, true);
+
+    if (!mbox) {
+        return;
+    }
+
+    memcpy(mbox->data, data, data_size);
+    mbox->size = data_size;
+    mbox->count++;
+
+    // Wake up the MicroPython thread in case it is waiting for this mailbox.
+    g_main_context_wakeup(NULL);
+}
+
+// Handles all complete messages in the receive buffer of a connection.
+static void messaging_receive_messages(messaging_connection_t *conn) {
+    size_t pos = 0;
+
+    for (;;) {
+        if (conn->skip) {
+            size_t skip = MIN(conn->skip, conn->len - pos);
+            pos += skip;
+            conn->skip -= skip;
+            if (conn->skip) {
+                break;
+            }
+        }
+
+        if (conn->len - pos < 2) {
+            break;
+        }
+
+        size_t size = conn->buf[pos] | conn->buf[pos + 1] << 8;
+
+        if (2 + size > sizeof(conn->buf)) {
+            // Too big to ever fit in the buffer, so drop it.
+            conn->skip = 2 + size;
+            continue;
+        }
+
+        if (conn->len - pos < 2 + size) {
+            break;
+        }
+
+        messaging_receive_message(&conn->buf[pos + 2], size);
+        pos += 2 + size;
+    }
+
+    memmove(conn->buf, &conn->buf[pos], conn->len - pos);
+    conn->len -= pos;
+}
+
+static void messaging_close_connection(messaging_connection_t *conn) {
+    pbdrv_clock_linux_remove_fd(conn->fd);
+    conn->fd = -1;
+}
+
+// Reads everything that is available on a connection without blocking.
+static void messaging_receive(messaging_connection_t *conn) {
+    for (;;) {
+        ssize_t ret = recv(conn->fd, &conn->buf[conn->len], sizeof(conn->buf) - conn->len, MSG_DONTWAIT);
+
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+
+        if (ret <= 0) {
+            // The remote closed the connection or it failed. Sending raises
+            // an error from here on.
+            messaging_close_connection(conn);
+            return;
+        }
+
+        conn->len += ret;
+        messaging_receive_messages(conn);
+    }
+}
+
+// Called by the event loop, which may not hold the GIL.
+static void messaging_fd_callback(void *context, uint32_t events) {
+    messaging_connection_t *conn = context;
+    conn->readable = true;
+    process_poll(&messaging_process);
+}
+
+PROCESS_THREAD(messaging_process, ev, data) {
+    PROCESS_BEGIN();
+
+    for (;;) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        for (size_t i = 0; i < NUM_CONNECTIONS; i++) {
+            messaging_connection_t *conn = &connections[i];
+
+            if (conn->fd != -1 && conn->readable) {
+                conn->readable = false;
+                messaging_receive(conn);
+            }
+        }
+    }
+
+    PROCESS_END();
+}
+
+static int messaging_get_fd(mp_obj_t sock_in) {
+    mp_obj_t dest[2];
+    mp_load_method(sock_in, MP_QSTR_fileno, dest);
+    int fd = mp_obj_get_int(mp_call_method_n_kw(0, 0, dest));
+
+    if (fd < 0) {
+        mp_raise_OSError(MP_EBADF);
+    }
+
+    return fd;
+}
+
+static messaging_connection_t *messaging_get_connection(int fd) {
+    for (size_t i = 0; i < NUM_CONNECTIONS; i++) {
+        if (connections[i].fd == fd) {
+            return &connections[i];
+        }
+    }
+    return NULL;
+}
+
+// Starts receiving messages from a connected socket.
+STATIC mp_obj_t ev3dev_messaging_attach(mp_obj_t sock_in) {
+    int fd = messaging_get_fd(sock_in);
+
+    if (messaging_get_connection(fd)) {
+        return mp_const_none;
+    }
+
+    messaging_connection_t *conn = messaging_get_connection(-1);
+    if (!conn) {
+        mp_raise_OSError(MP_EMFILE);
+    }
+
+    if (!process_is_running(&messaging_process)) {
+        process_start(&messaging_process);
+    }
+
+    conn->len = 0;
+    conn->skip = 0;
+    conn->readable = false;
+
+    if (pbdrv_clock_linux_add_fd(fd, EPOLLIN | EPOLLRDHUP, messaging_fd_callback, conn) != PBIO_SUCCESS) {
+        mp_raise_OSError(MP_EMFILE);
+    }
+
+    conn->fd = fd;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ev3dev_messaging_attach_obj, ev3dev_messaging_attach);
+
+// Stops receiving messages from a socket. This must be called before the
+// socket is closed.
+STATIC mp_obj_t ev3dev_messaging_detach(mp_obj_t sock_in) {
+    messaging_connection_t *conn = messaging_get_connection(messaging_get_fd(sock_in));
+
+    if (conn) {
+        messaging_close_connection(conn);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ev3dev_messaging_detach_obj, ev3dev_messaging_detach);
+
+// Returns the last payload received by a mailbox or None.
+STATIC mp_obj_t ev3dev_messaging_read(mp_obj_t mbox_in) {
+    size_t name_size;
+    const char *name = mp_obj_str_get_data(mbox_in, &name_size);
+
+    messaging_mailbox_t *mbox = messaging_get_mailbox(name, name_size, false);
+
+    if (!mbox || !mbox->count) {
+        return mp_const_none;
+    }
+
+    return mp_obj_new_bytes(mbox->data, mbox->size);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ev3dev_messaging_read_obj, ev3dev_messaging_read);
+
+// Waits until a mailbox receives a message.
+STATIC mp_obj_t ev3dev_messaging_wait(mp_obj_t mbox_in) {
+    size_t name_size;
+    const char *name = mp_obj_str_get_data(mbox_in, &name_size);
+
+    messaging_mailbox_t *mbox = messaging_get_mailbox(name, name_size, true);
+
+    if (!mbox) {
+        mp_raise_ValueError(MP_ERROR_TEXT("too many mailboxes"));
+    }
+
+    uint32_t count = mbox->count;
+
+    while (mbox->count == count) {
+        MICROPY_EVENT_POLL_HOOK
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ev3dev_messaging_wait_obj, ev3dev_messaging_wait);
+
+// Sends the message in send_buf. The GIL is released while waiting for the
+// socket to accept more data.
+static void messaging_send(int fd, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = send(fd, &send_buf[done], len - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (ret >= 0) {
+            done += ret;
+            continue;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            mp_raise_OSError(errno);
+        }
+
+        struct pollfd pfd = {
+            .fd = fd,
+            .events = POLLOUT,
+        };
+
+        MP_THREAD_GIL_EXIT();
+        poll(&pfd, 1, 100);
+        MP_THREAD_GIL_ENTER();
+
+        mp_handle_pending(true);
+    }
+}
+
+// Packs a mailbox message into a reusable buffer and sends it on a socket.
+STATIC mp_obj_t ev3dev_messaging_send(mp_obj_t sock_in, mp_obj_t mbox_in, mp_obj_t payload_in) {
+    int fd = messaging_get_fd(sock_in);
+
+    // Another thread may be waiting for its message to be sent.
+    while (send_busy) {
+        mp_hal_delay_ms(1);
+    }
+
+    size_t len = messaging_pack(send_buf, mbox_in, payload_in);
+
+    send_busy = true;
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        messaging_send(fd, len);
+        nlr_pop();
+    }
+
+    send_busy = false;
+
+    if (nlr.ret_val) {
+        nlr_jump(nlr.ret_val);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(ev3dev_messaging_send_obj, ev3dev_messaging_send);
+
+// Packs a mailbox message into a bytes object that can be sent as-is.
+STATIC mp_obj_t ev3dev_messaging_pack(mp_obj_t mbox_in, mp_obj_t payload_in) {
+    uint8_t buf[MAX_MESSAGE_SIZE];
+    size_t len = messaging_pack(buf, mbox_in, payload_in);
+    return mp_obj_new_bytes(buf, len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(ev3dev_messaging_pack_obj, ev3dev_messaging_pack);
+
+// Unpacks the body of a mailbox message, i.e. everything after the size
+// field. Returns a (name, payload) tuple.
+STATIC mp_obj_t ev3dev_messaging_unpack(mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+
+    const uint8_t *name;
+    const uint8_t *data;
+    size_t name_size;
+    size_t data_size;
+
+    mp_rom_error_text_t error = messaging_unpack(bufinfo.buf, bufinfo.len, &name, &name_size, &data, &data_size);
+    if (error) {
+        mp_raise_ValueError(error);
+    }
+
+    mp_obj_t ret[] = {
+        mp_obj_new_str((const char *)name, name_size),
+        mp_obj_new_bytes(data, data_size),
+    };
+    return mp_obj_new_tuple(MP_ARRAY_SIZE(ret), ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ev3dev_messaging_unpack_obj, ev3dev_messaging_unpack);
+
+STATIC const mp_rom_map_elem_t ev3dev_messaging_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_messaging_c) },
+    { MP_ROM_QSTR(MP_QSTR_attach), MP_ROM_PTR(&ev3dev_messaging_attach_obj) },
+    { MP_ROM_QSTR(MP_QSTR_detach), MP_ROM_PTR(&ev3dev_messaging_detach_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&ev3dev_messaging_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wait), MP_ROM_PTR(&ev3dev_messaging_wait_obj) },
+    { MP_ROM_QSTR(MP_QSTR_send), MP_ROM_PTR(&ev3dev_messaging_send_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pack), MP_ROM_PTR(&ev3dev_messaging_pack_obj) },
+    { MP_ROM_QSTR(MP_QSTR_unpack), MP_ROM_PTR(&ev3dev_messaging_unpack_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(ev3dev_messaging_globals, ev3dev_messaging_globals_table);
+
+const mp_obj_module_t pb_module_messaging = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t *)&ev3dev_messaging_globals,
+};
+
+MP_REGISTER_MODULE(MP_QSTR_messaging_c, pb_module_messaging);
@@ -1,7 +1,7 @@
 """The experimental module contains unstable APIs for development and testing.
 """
 
-from _experimental import pthread_raise
+from _experimental import loop_jitter, pthread_raise
 from _thread import start_new_thread, get_ident, allocate_lock
 from usignal import pthread_kill, SIGUSR2
 
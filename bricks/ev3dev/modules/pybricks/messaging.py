@@ -1,17 +1,10 @@
 # SPDX-License-Identifier: MIT
 # Copyright (c) 2020 The Pybricks Authors
 
-from _thread import allocate_lock
-from uerrno import ECONNRESET
+from messaging_c import attach, detach, read, send, wait
 from ustruct import pack, unpack
 
-from pybricks.bluetooth import (
-    resolve,
-    BDADDR_ANY,
-    ThreadingRFCOMMServer,
-    ThreadingRFCOMMClient,
-    StreamRequestHandler,
-)
+from pybricks.bluetooth import resolve, BDADDR_ANY, RFCOMMServer, RFCOMMClient
 
 
 class Mailbox:
@@ -133,54 +126,25 @@ class TextMailbox(Mailbox):
 # EV3 standard firmware is hard-coded to use channel 1
 EV3_RFCOMM_CHANNEL = 1
 
-# EV3 VM bytecodes
-SYSTEM_COMMAND_NO_REPLY = 0x81
-WRITEMAILBOX = 0x9E
-
-
-class MailboxHandler(StreamRequestHandler):
-    def handle(self):
-        with self.server._lock:
-            self.server._clients[self.client_address[0]] = self.request
-        while True:
-            try:
-                buf = self.rfile.read(2)
-            except OSError as ex:
-                # The client disconnected the connection
-                if ex.errno == ECONNRESET:
-                    break
-                raise
-            (size,) = unpack("<H", buf)
-            buf = self.rfile.read(size)
-            msg_count, cmd_type, cmd, name_size = unpack("<HBBB", buf)
-            if cmd_type != SYSTEM_COMMAND_NO_REPLY:
-                raise ValueError("Bad message type")
-            if cmd != WRITEMAILBOX:
-                raise ValueError("Bad command")
-            mbox = buf[5 : 5 + name_size].decode().strip("\0")
-            (data_size,) = unpack("<H", buf[5 + name_size : 7 + name_size])
-            data = buf[7 + name_size : 7 + name_size + data_size]
-
-            with self.server._lock:
-                self.server._mailboxes[mbox] = data
-                update_lock = self.server._updates.get(mbox)
-                if update_lock:
-                    update_lock.release()
-
 
 class MailboxHandlerMixIn:
     def __init__(self):
-        # protects against concurrent access of other attributes
-        self._lock = allocate_lock()
-        # map of mailbox name to raw data
-        self._mailboxes = {}
-        # map of device name/address to object with send() method
+        # map of device address to connected socket
         self._clients = {}
-        # map of mailbox name to mutex lock
-        self._updates = {}
         # map of names to addresses
         self._addresses = {}
 
+    def _attach(self, request, client_address):
+        # Incoming messages are received by the event loop from here on.
+        attach(request)
+        self._clients[client_address[0]] = request
+
+    def _close_clients(self):
+        for request in self._clients.values():
+            detach(request)
+            request.close()
+        self._clients.clear()
+
     def read_from_mailbox(self, mbox):
         """Reads the current raw data from a mailbox.
 
@@ -193,8 +157,7 @@ class MailboxHandlerMixIn:
                 The current mailbox raw data or ``None`` if nothing has ever
                 been delivered to the mailbox.
         """
-        with self._lock:
-            return self._mailboxes.get(mbox)
+        return read(mbox)
 
     def send_to_mailbox(self, brick, mbox, payload):
         """Sends a mailbox value using raw bytes data.
@@ -208,48 +171,24 @@ class MailboxHandlerMixIn:
             payload (bytes):
                 A bytes-like object that will be sent to the mailbox.
         """
-        mbox_len = len(mbox) + 1
-        payload_len = len(payload)
-        send_len = 7 + mbox_len + payload_len
-        fmt = "<HHBBB{}sH{}s".format(mbox_len, payload_len)
-        data = pack(
-            fmt,
-            send_len,
-            1,
-            SYSTEM_COMMAND_NO_REPLY,
-            WRITEMAILBOX,
-            mbox_len,
-            mbox,
-            payload_len,
-            payload,
-        )
-        with self._lock:
-            if brick is None:
-                for client in self._clients.values():
-                    client.send(data)
-            else:
-                addr = self._addresses.get(brick)
-                if addr is None:
-                    addr = resolve(brick)
-                    self._addresses[brick] = addr
-                if addr is None:
-                    raise ValueError('no paired devices matching "{}"'.format(brick))
-                self._clients[addr].send(data)
+        if brick is None:
+            for request in self._clients.values():
+                send(request, mbox, payload)
+        else:
+            addr = self._addresses.get(brick)
+            if addr is None:
+                addr = resolve(brick)
+                self._addresses[brick] = addr
+            if addr is None:
+                raise ValueError('no paired devices matching "{}"'.format(brick))
+            send(self._clients[addr], mbox, payload)
 
     def wait_for_mailbox_update(self, mbox):
         """Waits until ``mbox`` receives a value."""
-        lock = allocate_lock()
-        lock.acquire()
-        with self._lock:
-            self._updates[mbox] = lock
-        try:
-            return lock.acquire()
-        finally:
-            with self._lock:
-                del self._updates[mbox]
-
-
-class BluetoothMailboxServer(MailboxHandlerMixIn, ThreadingRFCOMMServer):
+        wait(mbox)
+
+
+class BluetoothMailboxServer(MailboxHandlerMixIn, RFCOMMServer):
     def __init__(self):
         """Object that represents an incoming Bluetooth connection from another
         EV3.
@@ -257,10 +196,15 @@ class BluetoothMailboxServer(MailboxHandlerMixIn, ThreadingRFCOMMServer):
         The remote EV3 can either be running MicroPython or the standard EV3
         firmware.
         """
-        super().__init__()
-        super(ThreadingRFCOMMServer, self).__init__(
-            (BDADDR_ANY, EV3_RFCOMM_CHANNEL), MailboxHandler
-        )
+        MailboxHandlerMixIn.__init__(self)
+        RFCOMMServer.__init__(self, (BDADDR_ANY, EV3_RFCOMM_CHANNEL), None)
+
+    def process_request(self, request, client_address):
+        self._attach(request, client_address)
+
+    def server_close(self):
+        self._close_clients()
+        RFCOMMServer.server_close(self)
 
     def wait_for_connection(self, count=1):
         """Waits for a :class:`BluetoothMailboxClient` on a remote device to
@@ -278,16 +222,13 @@ class BluetoothMailboxServer(MailboxHandlerMixIn, ThreadingRFCOMMServer):
             self.handle_request()
 
 
-class MailboxRFCOMMClient(ThreadingRFCOMMClient):
+class MailboxRFCOMMClient(RFCOMMClient):
     def __init__(self, parent, bdaddr):
         self.parent = parent
-        super().__init__((bdaddr, EV3_RFCOMM_CHANNEL), MailboxHandler)
-
-    def send(self, data):
-        self.socket.send(data)
+        super().__init__((bdaddr, EV3_RFCOMM_CHANNEL), None)
 
-    def finish_request(self, request, client_address):
-        self.RequestHandlerClass(request, client_address, self.parent)
+    def process_request(self, request, client_address):
+        self.parent._attach(request, client_address)
 
 
 class BluetoothMailboxClient(MailboxHandlerMixIn):
@@ -326,17 +267,10 @@ class BluetoothMailboxClient(MailboxHandlerMixIn):
         addr = resolve(brick)
         if addr is None:
             raise ValueError('no paired devices matching "{}"'.format(brick))
-        client = MailboxRFCOMMClient(self, addr)
-        if self._clients.setdefault(addr, client) is not client:
+        if addr in self._clients:
             raise ValueError("connection with this address already exists")
-        try:
-            client.handle_request()
-        except:
-            del self._clients[addr]
-            raise
+        MailboxRFCOMMClient(self, addr).handle_request()
 
     def close(self):
         """Closes the connections."""
-        for client in self._clients.values():
-            client.client_close()
-        self._clients.clear()
+        self._close_clients()
@@ -399,8 +399,10 @@ struct _mp_bluetooth_nimble_malloc_t;
 #endif
 
 #define MICROPY_VM_HOOK_LOOP do { \
-        extern int pbio_do_one_event(void); \
-        pbio_do_one_event(); \
+        extern int pybricks_do_one_event(void); \
+        pybricks_do_one_event(); \
+        extern void pb_ev3dev_Image_flush_screen_if_due(void); \
+        pb_ev3dev_Image_flush_screen_if_due(); \
 } while (0);
 
 #include <glib.h>
@@ -408,8 +410,10 @@ struct _mp_bluetooth_nimble_malloc_t;
 #define MICROPY_EVENT_POLL_HOOK do { \
         extern void mp_handle_pending(bool); \
         mp_handle_pending(true); \
-        extern int pbio_do_one_event(void); \
-        while (pbio_do_one_event()) { } \
+        extern int pybricks_do_one_event(void); \
+        while (pybricks_do_one_event()) { } \
+        extern void pb_ev3dev_Image_flush_screen(void); \
+        pb_ev3dev_Image_flush_screen(); \
         MP_THREAD_GIL_EXIT(); \
         g_main_context_iteration(g_main_context_get_thread_default(), TRUE); \
         MP_THREAD_GIL_ENTER(); \
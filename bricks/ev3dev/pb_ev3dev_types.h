@@ -24,6 +24,13 @@ GrxFont *pb_ev3dev_Font_obj_get_font(mp_const_obj_t obj);
 
 extern const mp_obj_type_t pb_type_ev3dev_Image;
 
+// Copies changes made by images of the screen to the actual screen.
+void pb_ev3dev_Image_flush_screen(void);
+
+// Same as pb_ev3dev_Image_flush_screen, but only if no frame has been shown
+// for a while.
+void pb_ev3dev_Image_flush_screen_if_due(void);
+
 // class Speaker
 
 extern const mp_obj_type_t pb_type_ev3dev_Speaker;
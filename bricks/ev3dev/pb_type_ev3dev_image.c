@@ -6,6 +6,10 @@
 //
 // Image manipulation on ev3dev using the GRX3 graphics library. This can be
 // used for both in-memory images and writing directly to the screen.
+//
+// Images of the screen draw into an off-screen buffer. The area that changed
+// is copied to the screen once per frame, so that drawing many small things
+// doesn't update the screen for every call.
 
 #include <string.h>
 
@@ -30,7 +34,6 @@ typedef struct _ev3dev_Image_obj_t {
     mp_obj_base_t base;
     mp_obj_t width;
     mp_obj_t height;
-    mp_obj_t buffer; // only used by _screen_
     gboolean cleared; // only used by _screen_
     GrxContext *context;
     void *mem; // don't touch - needed for GC pressure
@@ -39,6 +42,127 @@ typedef struct _ev3dev_Image_obj_t {
     gint print_y;
 } ev3dev_Image_obj_t;
 
+// Minimum time between copying the off-screen buffer to the screen while
+// drawing.
+#define SCREEN_FRAME_TIME_US (20 * G_TIME_SPAN_MILLISECOND)
+
+// Off-screen buffer shared by all images of the screen, the bounding box of
+// the area that has changed since the last flush, and the time of that flush.
+STATIC struct {
+    GrxContext *context;
+    gint64 flush_time;
+    gboolean dirty;
+    gint x1;
+    gint y1;
+    gint x2;
+    gint y2;
+} screen_buffer;
+
+STATIC GrxContext *get_screen_buffer(void) {
+    if (!screen_buffer.context) {
+        gint w = grx_get_screen_width();
+        gint h = grx_get_screen_height();
+
+        // This lives as long as the program, so it is not allocated on the
+        // MicroPython heap.
+        GrxFrameMemory mem;
+        mem.plane0 = g_malloc(grx_screen_get_context_size(w, h));
+        screen_buffer.context = grx_context_new(w, h, &mem, NULL);
+        if (!screen_buffer.context) {
+            g_free(mem.plane0);
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("failed to allocate context for screen"));
+        }
+
+        // Start with whatever is currently on the screen.
+        grx_context_bit_blt(screen_buffer.context, 0, 0, grx_get_screen_context(), 0, 0,
+            w - 1, h - 1, GRX_COLOR_MODE_WRITE);
+    }
+    return screen_buffer.context;
+}
+
+// Marks an area as changed, if the image is the screen or part of it.
+// Coordinates are relative to the image.
+STATIC void mark_dirty(ev3dev_Image_obj_t *self, gint x1, gint y1, gint x2, gint y2) {
+    GrxContext *context = self->context;
+
+    // Images made with sub=True share the memory of the root context and are
+    // offset from its origin.
+    if (!screen_buffer.context ||
+        (context != screen_buffer.context && context->root != screen_buffer.context)) {
+        return;
+    }
+
+    gint max_x = grx_context_get_max_x(context);
+    gint max_y = grx_context_get_max_y(context);
+
+    gint left = MAX(MIN(x1, x2), 0);
+    gint top = MAX(MIN(y1, y2), 0);
+    gint right = MIN(MAX(x1, x2), max_x);
+    gint bottom = MIN(MAX(y1, y2), max_y);
+
+    // Nothing visible changed.
+    if (left > right || top > bottom) {
+        return;
+    }
+
+    // Get screen coordinates.
+    if (context != screen_buffer.context) {
+        x1 = left + context->x_offset;
+        y1 = top + context->y_offset;
+        x2 = right + context->x_offset;
+        y2 = bottom + context->y_offset;
+    } else {
+        x1 = left;
+        y1 = top;
+        x2 = right;
+        y2 = bottom;
+    }
+
+    if (screen_buffer.dirty) {
+        screen_buffer.x1 = MIN(screen_buffer.x1, x1);
+        screen_buffer.y1 = MIN(screen_buffer.y1, y1);
+        screen_buffer.x2 = MAX(screen_buffer.x2, x2);
+        screen_buffer.y2 = MAX(screen_buffer.y2, y2);
+    } else {
+        screen_buffer.x1 = x1;
+        screen_buffer.y1 = y1;
+        screen_buffer.x2 = x2;
+        screen_buffer.y2 = y2;
+        screen_buffer.dirty = TRUE;
+    }
+
+    // Drawing used to go straight to the screen, so show it now unless a
+    // frame was shown very recently.
+    pb_ev3dev_Image_flush_screen_if_due();
+}
+
+STATIC void mark_all_dirty(ev3dev_Image_obj_t *self) {
+    mark_dirty(self, 0, 0, grx_context_get_max_x(self->context), grx_context_get_max_y(self->context));
+}
+
+void pb_ev3dev_Image_flush_screen(void) {
+    if (!screen_buffer.dirty) {
+        return;
+    }
+
+    grx_context_bit_blt(grx_get_screen_context(), screen_buffer.x1, screen_buffer.y1,
+        screen_buffer.context, screen_buffer.x1, screen_buffer.y1, screen_buffer.x2, screen_buffer.y2,
+        GRX_COLOR_MODE_WRITE);
+
+    screen_buffer.dirty = FALSE;
+    screen_buffer.flush_time = g_get_monotonic_time();
+}
+
+// Flushes the screen if no frame has been shown for a while. This is called
+// after drawing and from the VM loop, so drawing is shown without waiting for
+// the program to poll for events, while bursts of drawing are still combined.
+void pb_ev3dev_Image_flush_screen_if_due(void) {
+    if (screen_buffer.dirty &&
+        g_get_monotonic_time() - screen_buffer.flush_time >= SCREEN_FRAME_TIME_US) {
+        pb_ev3dev_Image_flush_screen();
+    }
+}
+
 // map Pybricks color type to GRX color value.
 STATIC GrxColor map_color(mp_obj_t obj) {
     if (obj == mp_const_none) {
@@ -64,7 +188,7 @@ STATIC mp_obj_t ev3dev_Image_new(GrxContext *context) {
     self->text_options = grx_text_options_new(font, GRX_COLOR_BLACK);
 
     // only the screen needs to be cleared on first use
-    self->cleared = context != grx_get_screen_context();
+    self->cleared = context != screen_buffer.context;
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -87,8 +211,8 @@ STATIC mp_obj_t ev3dev_Image_make_new(const mp_obj_type_t *type, size_t n_args,
 
     mp_obj_t source_in = arg_vals[ARG_source].u_obj;
     if (mp_obj_is_qstr(source_in) && MP_OBJ_QSTR_VALUE(source_in) == MP_QSTR__screen_) {
-        // special case '_screen_' creates image that draws directly to screen
-        context = grx_context_ref(grx_get_screen_context());
+        // special case '_screen_' creates image that draws to the screen
+        context = grx_context_ref(get_screen_buffer());
     } else if (mp_obj_is_str(source_in)) {
         const char *filename = mp_obj_str_get_str(source_in);
 
@@ -192,6 +316,7 @@ STATIC void clear_once(ev3dev_Image_obj_t *self) {
         return;
     }
     grx_context_clear(self->context, GRX_COLOR_WHITE);
+    mark_all_dirty(self);
     self->cleared = TRUE;
 }
 
@@ -199,6 +324,7 @@ STATIC mp_obj_t ev3dev_Image_clear(mp_obj_t self_in) {
     ev3dev_Image_obj_t *self = MP_OBJ_TO_PTR(self_in);
     clear_once(self);
     grx_context_clear(self->context, GRX_COLOR_WHITE);
+    mark_all_dirty(self);
     self->print_x = 0;
     self->print_y = 0;
     return mp_const_none;
@@ -219,6 +345,7 @@ STATIC mp_obj_t ev3dev_Image_draw_pixel(size_t n_args, const mp_obj_t *pos_args,
     clear_once(self);
     grx_set_current_context(self->context);
     grx_draw_pixel(x, y, color);
+    mark_dirty(self, x, y, x, y);
 
     return mp_const_none;
 }
@@ -249,6 +376,7 @@ STATIC mp_obj_t ev3dev_Image_draw_line(size_t n_args, const mp_obj_t *pos_args,
         GrxLineOptions options = { .color = color, .width = width };
         grx_draw_line_with_options(x1, y1, x2, y2, &options);
     }
+    mark_dirty(self, MIN(x1, x2) - width, MIN(y1, y2) - width, MAX(x1, x2) + width, MAX(y1, y2) + width);
 
     return mp_const_none;
 }
@@ -287,6 +415,7 @@ STATIC mp_obj_t ev3dev_Image_draw_box(size_t n_args, const mp_obj_t *pos_args, m
             grx_draw_box(x1, y1, x2, y2, color);
         }
     }
+    mark_dirty(self, x1, y1, x2, y2);
 
     return mp_const_none;
 }
@@ -314,6 +443,7 @@ STATIC mp_obj_t ev3dev_Image_draw_circle(size_t n_args, const mp_obj_t *pos_args
     } else {
         grx_draw_circle(x, y, r, color);
     }
+    mark_dirty(self, x - r, y - r, x + r, y + r);
 
     return mp_const_none;
 }
@@ -343,6 +473,7 @@ STATIC mp_obj_t ev3dev_Image_draw_image(size_t n_args, const mp_obj_t *pos_args,
     grx_context_bit_blt(self->context, x, y, source->context, 0, 0,
         grx_context_get_max_x(source->context), grx_context_get_max_y(source->context),
         transparent == GRX_COLOR_NONE ? GRX_COLOR_MODE_WRITE : grx_color_to_image_mode(transparent));
+    mark_dirty(self, x, y, x + grx_context_get_max_x(source->context), y + grx_context_get_max_y(source->context));
 
     return mp_const_none;
 }
@@ -365,28 +496,8 @@ STATIC mp_obj_t ev3dev_Image_load_image(mp_obj_t self_in, mp_obj_t source_in) {
     mp_obj_t x = mp_obj_new_int((mp_obj_get_int(self->width) - mp_obj_get_int(source->width)) / 2);
     mp_obj_t y = mp_obj_new_int((mp_obj_get_int(self->height) - mp_obj_get_int(source->height)) / 2);
 
-    // if the destination is the screen, then we double-buffer to prevent flicker
-    if (self->context == grx_get_screen_context()) {
-        if (self->buffer == MP_OBJ_NULL) {
-            mp_obj_t args[2] = { self->width, self->height };
-            mp_map_t kw_args;
-            mp_map_init(&kw_args, 0);
-            self->buffer = ev3dev_Image_empty(MP_ARRAY_SIZE(args), args, &kw_args);
-        }
-
-        ev3dev_Image_clear(self->buffer);
-
-        mp_obj_t args[4] = { self->buffer, x, y, source_in };
-        mp_map_t kw_args;
-        mp_map_init(&kw_args, 0);
-        ev3dev_Image_draw_image(MP_ARRAY_SIZE(args), args, &kw_args);
-
-        source_in = self->buffer;
-        x = MP_OBJ_NEW_SMALL_INT(0);
-        y = MP_OBJ_NEW_SMALL_INT(0);
-    } else {
-        ev3dev_Image_clear(self_in);
-    }
+    // The screen is already double-buffered, so this doesn't flicker.
+    ev3dev_Image_clear(self_in);
 
     mp_obj_t args[4] = { self_in, x, y, source_in };
     mp_map_t kw_args;
@@ -425,13 +536,14 @@ STATIC mp_obj_t ev3dev_Image_draw_text(size_t n_args, const mp_obj_t *pos_args,
     grx_set_current_context(self->context);
     grx_text_options_set_fg_color(self->text_options, text_color);
     grx_text_options_set_bg_color(self->text_options, background_color);
+    GrxFont *font = grx_text_options_get_font(self->text_options);
+    gint w = grx_font_get_text_width(font, text);
+    gint h = grx_font_get_text_height(font, text);
     if (background_color != GRX_COLOR_NONE) {
-        GrxFont *font = grx_text_options_get_font(self->text_options);
-        gint w = grx_font_get_text_width(font, text);
-        gint h = grx_font_get_text_height(font, text);
         grx_draw_filled_box(x, y, x + w - 1, y + h - 1, background_color);
     }
     grx_draw_text(text, x, y, self->text_options);
+    mark_dirty(self, x, y, x + w - 1, y + h - 1);
 
     return mp_const_none;
 }
@@ -510,12 +622,14 @@ STATIC mp_obj_t ev3dev_Image_print(size_t n_args, const mp_obj_t *pos_args, mp_m
                 }
             }
             self->print_y -= over;
+            mark_all_dirty(self);
         }
         gint w = grx_font_get_text_width(font, *l);
         gint h = grx_font_get_text_height(font, *l);
         grx_draw_filled_box(self->print_x, self->print_y,
             self->print_x + w - 1, self->print_y + h - 1, GRX_COLOR_WHITE);
         grx_draw_text(*l, self->print_x, self->print_y, self->text_options);
+        mark_dirty(self, self->print_x, self->print_y, self->print_x + w - 1, self->print_y + h - 1);
         self->print_x += w;
     }
     g_strfreev(lines);
@@ -8,8 +8,9 @@
 // There are two ways to create sounds. One is to use the "Beep" device to
 // create tones with a given frequency. This is done using the Linux input
 // device so that the sound is played on the EV3. The other is to use ALSA
-// for PCM playback of sampled sounds. To keep the code simple, we just
-// invoke `aplay` in a subprocess (same with espeak for text to speech).
+// for PCM playback of sampled sounds. WAV files are played in-process by
+// ev3dev_audio.c so that they start without delay. Other file types are played
+// by invoking `aplay` in a subprocess (same with espeak for text to speech).
 
 #include <errno.h>
 #include <fcntl.h>
@@ -29,7 +30,9 @@
 #include "py/obj.h"
 #include "py/runtime.h"
 
+#include "ev3dev_audio.h"
 #include "pb_ev3dev_types.h"
+#include <pybricks/tools/pb_type_awaitable.h>
 #include <pybricks/util_mp/pb_kwarg_helper.h>
 #include <pybricks/util_mp/pb_obj_helper.h>
 
@@ -57,6 +60,12 @@ typedef struct _ev3dev_Speaker_obj_t {
 
 STATIC ev3dev_Speaker_obj_t ev3dev_speaker_singleton;
 
+#if PYBRICKS_EV3DEV_AUDIO_ENGINE
+// List of awaitables associated with the speaker, so that playing a new sound
+// can cancel the previous one. The speaker itself is not on the heap.
+MP_REGISTER_ROOT_POINTER(mp_obj_t ev3dev_speaker_awaitables);
+#endif
+
 
 STATIC mp_obj_t ev3dev_Speaker_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     ev3dev_Speaker_obj_t *self = &ev3dev_speaker_singleton;
@@ -85,6 +94,13 @@ STATIC mp_obj_t ev3dev_Speaker_make_new(const mp_obj_type_t *type, size_t n_args
 
         self->initialized = true;
     }
+
+    #if PYBRICKS_EV3DEV_AUDIO_ENGINE
+    if (MP_STATE_PORT(ev3dev_speaker_awaitables) == MP_OBJ_NULL) {
+        MP_STATE_PORT(ev3dev_speaker_awaitables) = mp_obj_new_list(0, NULL);
+    }
+    #endif
+
     return MP_OBJ_FROM_PTR(self);
 }
 
@@ -352,13 +368,70 @@ STATIC void ev3dev_Speaker_aplay_callback(GObject *source_object, GAsyncResult *
     self->aplay_busy = FALSE;
 }
 
+#if PYBRICKS_EV3DEV_AUDIO_ENGINE
+
+STATIC bool ev3dev_Speaker_play_file_test_completion(mp_obj_t self_in, uint32_t end_time) {
+    if (ev3dev_audio_is_busy()) {
+        return false;
+    }
+
+    int err = ev3dev_audio_get_result();
+    if (err < 0) {
+        mp_raise_msg_varg(&mp_type_RuntimeError,
+            MP_ERROR_TEXT("Playing file failed: %s"), ev3dev_audio_strerror(err));
+    }
+
+    return true;
+}
+
+STATIC void ev3dev_Speaker_play_file_cancel(mp_obj_t self_in) {
+    ev3dev_audio_stop();
+}
+
+#endif // PYBRICKS_EV3DEV_AUDIO_ENGINE
+
 STATIC mp_obj_t ev3dev_Speaker_play_file(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         ev3dev_Speaker_obj_t, self,
-        PB_ARG_REQUIRED(file));
+        PB_ARG_REQUIRED(file),
+        PB_ARG_DEFAULT_TRUE(wait));
 
     const char *file = mp_obj_str_get_str(file_in);
 
+    #if PYBRICKS_EV3DEV_AUDIO_ENGINE
+    int err = ev3dev_audio_play_file(file);
+    if (err == 0) {
+        if (!mp_obj_is_true(wait_in)) {
+            return mp_const_none;
+        }
+
+        // Make sure the sound stops if waiting is interrupted.
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t ret = pb_type_awaitable_await_or_wait(
+                MP_OBJ_FROM_PTR(self),
+                MP_STATE_PORT(ev3dev_speaker_awaitables),
+                pb_type_awaitable_end_time_none,
+                ev3dev_Speaker_play_file_test_completion,
+                pb_type_awaitable_return_none,
+                ev3dev_Speaker_play_file_cancel,
+                PB_TYPE_AWAITABLE_OPT_CANCEL_ALL);
+            nlr_pop();
+            return ret;
+        } else {
+            ev3dev_audio_stop();
+            nlr_jump(nlr.ret_val);
+        }
+    }
+    if (err != -EPROTONOSUPPORT) {
+        mp_raise_msg_varg(&mp_type_RuntimeError,
+            MP_ERROR_TEXT("Playing file failed: %s"), ev3dev_audio_strerror(err));
+    }
+
+    // Not a format we can play ourselves, so let aplay have the device.
+    ev3dev_audio_release();
+    #endif // PYBRICKS_EV3DEV_AUDIO_ENGINE
+
     // FIXME: This function needs to be protected agains re-entrancy to make it
     // thread-safe.
 
@@ -448,6 +521,11 @@ STATIC mp_obj_t ev3dev_Speaker_say(size_t n_args, const mp_obj_t *pos_args, mp_m
 
     const char *text = mp_obj_str_get_str(text_in);
 
+    #if PYBRICKS_EV3DEV_AUDIO_ENGINE
+    // aplay needs the sound device.
+    ev3dev_audio_release();
+    #endif
+
     // FIXME: This function needs to be protected against re-entrancy to make it
     // thread-safe.
 
@@ -587,6 +665,17 @@ STATIC mp_obj_t ev3dev_Speaker_set_speech_options(size_t n_args, const mp_obj_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(ev3dev_Speaker_set_speech_options_obj, 1, ev3dev_Speaker_set_speech_options);
 
+// amixer process that is setting the default volume, if any.
+STATIC GSubprocess *ev3dev_Speaker_amixer_default;
+
+STATIC void ev3dev_Speaker_amixer_callback(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GSubprocess *subprocess = G_SUBPROCESS(source_object);
+    // Errors are ignored, as for the default volume in make_new.
+    g_subprocess_communicate_utf8_finish(subprocess, res, NULL, NULL, NULL);
+    g_object_unref(subprocess);
+    ev3dev_Speaker_amixer_default = NULL;
+}
+
 STATIC mp_obj_t ev3dev_Speaker_set_volume(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         ev3dev_Speaker_obj_t, self,
@@ -618,6 +707,12 @@ STATIC mp_obj_t ev3dev_Speaker_set_volume(size_t n_args, const mp_obj_t *pos_arg
         mp_raise_ValueError(MP_ERROR_TEXT("which must be one of '_all_', 'Beep', 'PCM'"));
     }
 
+    // Don't let the default volume override the requested volume. The main
+    // loop has to run for the default volume to be written to amixer.
+    while (ev3dev_Speaker_amixer_default) {
+        MICROPY_EVENT_POLL_HOOK
+    }
+
     GError *error = NULL;
     GSubprocess *amixer = g_subprocess_new(
         G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_PIPE,
@@ -629,6 +724,15 @@ STATIC mp_obj_t ev3dev_Speaker_set_volume(size_t n_args, const mp_obj_t *pos_arg
         g_error_free(error);
         nlr_raise(ex);
     }
+
+    // The default volume is set each time the speaker is first created,
+    // which is usually during startup. Don't wait for amixer to finish.
+    if (strcmp(which, "_default_") == 0) {
+        ev3dev_Speaker_amixer_default = amixer;
+        g_subprocess_communicate_utf8_async(amixer, amixer_stdin, NULL, ev3dev_Speaker_amixer_callback, NULL);
+        return mp_const_none;
+    }
+
     char *amixer_stderr = NULL;
     if (!g_subprocess_communicate_utf8(amixer, amixer_stdin, NULL, NULL, &amixer_stderr, &error)) {
         const char *msg = amixer_stderr == NULL ? error->message : amixer_stderr;
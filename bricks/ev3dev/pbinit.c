@@ -3,20 +3,24 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/time.h>
-#include <sys/timerfd.h>
 
 #include <contiki.h>
 
 #include <glib.h>
 #include <grx-3.0.h>
 
+#include <pbdrv/clock.h>
+
 #include <pbio/dcmotor.h>
 #include <pbio/color.h>
 #include <pbio/config.h>
@@ -27,33 +31,232 @@
 #include <pybricks/common.h>
 
 #include "py/mpconfig.h"
+#include "py/mpstate.h"
 #include "py/mpthread.h"
 
+#include "ev3dev_audio.h"
+#include "pb_ev3dev_types.h"
 #include "pbinit.h"
 
-// Flag that indicates whether we are busy stopping the thread
-static volatile bool stopping_thread = false;
 static pthread_t task_caller_thread;
 
+// Commands from the MicroPython thread to the task caller.
+typedef enum {
+    // Stop the task caller thread.
+    TASK_CALLER_CMD_STOP,
+    // Start measuring loop jitter again.
+    TASK_CALLER_CMD_RESET_JITTER,
+} task_caller_cmd_t;
+
+#define TASK_CALLER_NUM_CMD (8)
+
+// Lock-free command mailbox. Commands are only posted while holding the GIL,
+// so there is a single producer and the task caller is the single consumer.
+static struct {
+    uint8_t cmd[TASK_CALLER_NUM_CMD];
+    uint32_t head;
+    uint32_t tail;
+} command_mailbox;
+
+// Lock-free state mailbox with the lateness of the task caller with respect
+// to event timer deadlines. The task caller is the only writer. The sequence
+// number is odd while it is writing, so readers never wait for it.
+static struct {
+    uint32_t seq;
+    uint32_t count;
+    uint32_t mean_us;
+    uint32_t max_us;
+} state_mailbox;
+
+// Posts a command to the task caller and wakes it up. Returns false if the
+// mailbox is full.
+static bool task_caller_post(task_caller_cmd_t cmd) {
+    uint32_t head = command_mailbox.head;
+
+    if (head - __atomic_load_n(&command_mailbox.tail, __ATOMIC_ACQUIRE) == TASK_CALLER_NUM_CMD) {
+        return false;
+    }
+
+    command_mailbox.cmd[head % TASK_CALLER_NUM_CMD] = cmd;
+    __atomic_store_n(&command_mailbox.head, head + 1, __ATOMIC_RELEASE);
+    pbdrv_clock_linux_wake();
+
+    return true;
+}
+
+// Takes the next command posted to the task caller. Returns false if there is
+// none.
+static bool task_caller_take(task_caller_cmd_t *cmd) {
+    uint32_t tail = command_mailbox.tail;
+
+    if (tail == __atomic_load_n(&command_mailbox.head, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    *cmd = command_mailbox.cmd[tail % TASK_CALLER_NUM_CMD];
+    __atomic_store_n(&command_mailbox.tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static void task_caller_publish_jitter(uint32_t count, uint32_t mean_us, uint32_t max_us) {
+    uint32_t seq = state_mailbox.seq;
+    __atomic_store_n(&state_mailbox.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&state_mailbox.count, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&state_mailbox.mean_us, mean_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&state_mailbox.max_us, max_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&state_mailbox.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+#if PYBRICKS_EV3DEV_RT_CONTROL_THREAD
+
+// Priority of the control thread. This is above all normal threads, but
+// below the default priority of kernel interrupt threads (50). The control
+// loop depends on sensor and motor I/O, so it must not delay those threads.
+#define TASK_CALLER_PRIORITY (40)
+
+// The control loop runs with the GIL held, like all other code that touches
+// pbio state. The MicroPython thread holds the GIL most of the time at normal
+// priority, which would make the real-time thread wait for as long as the
+// scheduler lets other threads preempt it. With priority inheritance, the
+// holder runs at the priority of the control thread until it releases the
+// GIL, so the wait is bounded by how long MicroPython holds it.
+//
+// This must be called while nobody holds the GIL. MICROPY_PORT_INIT_FUNC runs
+// after the GIL is created but before the main thread takes it.
+static void task_caller_set_gil_priority_inheritance(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+
+    int err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    if (!err) {
+        pthread_mutex_destroy(&MP_STATE_VM(gil_mutex));
+        err = pthread_mutex_init(&MP_STATE_VM(gil_mutex), &attr);
+    }
+    if (err) {
+        fprintf(stderr, "Could not enable priority inheritance for the GIL: %s\n", strerror(err));
+    }
+
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Makes the calling thread a real-time thread. This requires the RTPRIO
+// resource limit to be set, e.g. by running as root. If this fails, the thread
+// keeps running at normal priority.
+static void task_caller_set_realtime(void) {
+    // Avoid page faults in the control loop by keeping all memory resident.
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        perror("mlockall");
+    }
+
+    struct sched_param param = {
+        .sched_priority = TASK_CALLER_PRIORITY,
+    };
+
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err) {
+        fprintf(stderr, "Could not enable real-time motor control: %s\n", strerror(err));
+    }
+}
+
+#endif // PYBRICKS_EV3DEV_RT_CONTROL_THREAD
+
 // The background thread that keeps firing the task handler
 static void *task_caller(void *arg) {
-    struct timespec ts;
-    ts.tv_sec = 0;
-    ts.tv_nsec = 3300000;
+    #if PYBRICKS_EV3DEV_RT_CONTROL_THREAD
+    task_caller_set_realtime();
+    #endif
+
+    // Jitter statistics, only used by this thread.
+    uint32_t count = 0;
+    uint64_t total_us = 0;
+    uint32_t max_us = 0;
+
+    uint32_t deadline_us = 0;
+    bool measure = false;
 
-    while (!stopping_thread) {
+    for (;;) {
         MP_THREAD_GIL_ENTER();
+
+        // Measure after getting the GIL, since waiting for it is part of
+        // how late the control loop runs.
+        if (measure) {
+            int32_t late_us = pbdrv_clock_get_us() - deadline_us;
+            if (late_us >= 0) {
+                count++;
+                total_us += late_us;
+                max_us = MAX(max_us, (uint32_t)late_us);
+                task_caller_publish_jitter(count, total_us / count, max_us);
+            }
+        }
+
+        task_caller_cmd_t cmd;
+        bool stop = false;
+
+        while (task_caller_take(&cmd)) {
+            switch (cmd) {
+                case TASK_CALLER_CMD_STOP:
+                    stop = true;
+                    break;
+                case TASK_CALLER_CMD_RESET_JITTER:
+                    count = 0;
+                    total_us = 0;
+                    max_us = 0;
+                    task_caller_publish_jitter(0, 0, 0);
+                    break;
+            }
+        }
+
+        if (stop) {
+            MP_THREAD_GIL_EXIT();
+            break;
+        }
+
         while (pbio_do_one_event()) {
         }
+        pbdrv_clock_linux_arm();
+        deadline_us = etimer_pending() ? etimer_next_expiration_time() * 1000 : 0;
         MP_THREAD_GIL_EXIT();
 
-        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
-        etimer_request_poll();
+        // Sleep until the next timer deadline, a command or an event from
+        // the MicroPython thread.
+        measure = pbdrv_clock_linux_wait(-1, NULL) && deadline_us;
     }
 
     return NULL;
 }
 
+int pybricks_do_one_event(void) {
+    if (!process_nevents()) {
+        return 0;
+    }
+
+    int ret = pbio_do_one_event();
+
+    // The event may have changed the next timer deadline, so the task caller
+    // has to arm the timer again.
+    pbdrv_clock_linux_wake();
+
+    return ret;
+}
+
+void pybricks_get_loop_jitter(uint32_t *count, uint32_t *mean_us, uint32_t *max_us) {
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&state_mailbox.seq, __ATOMIC_ACQUIRE);
+        *count = __atomic_load_n(&state_mailbox.count, __ATOMIC_RELAXED);
+        *mean_us = __atomic_load_n(&state_mailbox.mean_us, __ATOMIC_RELAXED);
+        *max_us = __atomic_load_n(&state_mailbox.max_us, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&state_mailbox.seq, __ATOMIC_RELAXED));
+}
+
+void pybricks_reset_loop_jitter(void) {
+    task_caller_post(TASK_CALLER_CMD_RESET_JITTER);
+}
+
 // Pybricks initialization tasks
 void pybricks_init(void) {
     GError *error = NULL;
@@ -104,18 +307,34 @@ void pybricks_init(void) {
     extern void ev3dev_status_light_init(void);
     ev3dev_status_light_init();
     pb_package_pybricks_init(true);
+    #if PYBRICKS_EV3DEV_RT_CONTROL_THREAD
+    task_caller_set_gil_priority_inheritance();
+    #endif
     pthread_create(&task_caller_thread, NULL, task_caller, NULL);
 }
 
 // Pybricks deinitialization tasks
 void pybricks_deinit(void) {
-    // Signal motor thread to stop and wait for it to do so.
-    stopping_thread = true;
+    // Show anything that was drawn since the last frame.
+    pb_ev3dev_Image_flush_screen();
+
+    #if PYBRICKS_EV3DEV_AUDIO_ENGINE
+    ev3dev_audio_deinit();
+    #endif
+
+    // Signal motor thread to stop and wait for it to do so. The mailbox
+    // can't be full because the thread takes all commands each time it wakes.
+    task_caller_post(TASK_CALLER_CMD_STOP);
+    MP_THREAD_GIL_EXIT();
     pthread_join(task_caller_thread, NULL);
+    MP_THREAD_GIL_ENTER();
 }
 
 void pybricks_unhandled_exception(void) {
     pbio_stop_all(false);
     extern void _pb_ev3dev_speaker_beep_off(void);
     _pb_ev3dev_speaker_beep_off();
+    #if PYBRICKS_EV3DEV_AUDIO_ENGINE
+    ev3dev_audio_stop();
+    #endif
 }
@@ -4,8 +4,34 @@
 #ifndef MICROPY_INCLUDED_PBINIT_H
 #define MICROPY_INCLUDED_PBINIT_H
 
+#include <stdint.h>
+
 void pybricks_init(void);
 
 void pybricks_deinit(void);
 
+/**
+ * Handles one pending pbio event on the MicroPython thread and wakes up the
+ * background thread that runs the event loop.
+ *
+ * @return                  The number of events that are still pending.
+ */
+int pybricks_do_one_event(void);
+
+/**
+ * Gets how late the control loop thread woke up with respect to its deadlines.
+ *
+ * @param [out] count       Number of deadlines measured.
+ * @param [out] mean_us     Average lateness in microseconds.
+ * @param [out] max_us      Maximum lateness in microseconds.
+ */
+void pybricks_get_loop_jitter(uint32_t *count, uint32_t *mean_us, uint32_t *max_us);
+
+/**
+ * Starts measuring the control loop jitter again.
+ *
+ * The statistics are reset the next time the control loop runs.
+ */
+void pybricks_reset_loop_jitter(void);
+
 #endif // MICROPY_INCLUDED_PBINIT_H
@@ -52,6 +52,7 @@
 #define PYBRICKS_OPT_EXTRA_MOD                  (1)
 #define PYBRICKS_OPT_CUSTOM_IMPORT              (1)
 #define PYBRICKS_OPT_NATIVE_MOD                 (1)
+#define PYBRICKS_OPT_MATRIX_FIXED_POINT         (0)
 
 // Start with config shared by all Pybricks ports.
 #include "../_common/mpconfigport.h"
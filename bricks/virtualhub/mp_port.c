@@ -14,6 +14,7 @@
 
 #include <contiki.h>
 
+#include <pbdrv/clock.h>
 #include <pbio/main.h>
 #include <pbdrv/legodev.h>
 #include <pbsys/core.h>
@@ -121,6 +122,16 @@ start:
         goto start;
     }
 
+    #if PBDRV_CONFIG_CLOCK_LINUX_TIMERFD
+
+    // "sleep" until the next deadline or I/O with "interrupts" enabled
+    pbdrv_clock_linux_arm();
+    MP_THREAD_GIL_EXIT();
+    pbdrv_clock_linux_wait(1, &origmask);
+    MP_THREAD_GIL_ENTER();
+
+    #else
+
     struct timespec timeout = {
         .tv_sec = 0,
         .tv_nsec = 100000,
@@ -131,6 +142,8 @@ start:
     pselect(0, NULL, NULL, NULL, &timeout, &origmask);
     MP_THREAD_GIL_ENTER();
 
+    #endif
+
     // restore "interrupts"
     pthread_sigmask(SIG_SETMASK, &origmask, NULL);
 }
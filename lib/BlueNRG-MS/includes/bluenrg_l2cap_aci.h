@@ -50,6 +50,10 @@
 tBleStatus aci_l2cap_connection_parameter_update_request(uint16_t conn_handle, uint16_t interval_min,
 							 uint16_t interval_max, uint16_t slave_latency,
 							 uint16_t timeout_multiplier);
+void aci_l2cap_connection_parameter_update_request_begin(uint16_t conn_handle, uint16_t interval_min,
+							 uint16_t interval_max, uint16_t slave_latency,
+							 uint16_t timeout_multiplier);
+#define aci_l2cap_connection_parameter_update_request_end hci_le_command_end
 /**
  * @brief Accept or reject a connection update.
  * @note  This command should be sent in response to a @ref EVT_BLUE_L2CAP_CONN_UPD_REQ event from the controller.
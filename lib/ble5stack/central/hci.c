@@ -1,6 +1,7 @@
 
 #include <string.h>
 
+#include "hal_defs.h"
 #include "hci_tl.h"
 
 HCI_StatusCodes_t HCI_readBdaddr(void)
@@ -27,3 +28,17 @@ HCI_StatusCodes_t HCI_LE_setAdvertisingData(uint8_t len, uint8_t *data)
 
     return HCI_sendHCICommand(HCI_LE_SET_ADVERTISING_DATA, pData, len + 1);
 }
+
+HCI_StatusCodes_t HCI_LE_setDataLength(uint16_t connHandle, uint16_t txOctets, uint16_t txTime)
+{
+    uint8_t pData[6];
+
+    pData[0] = LO_UINT16(connHandle);
+    pData[1] = HI_UINT16(connHandle);
+    pData[2] = LO_UINT16(txOctets);
+    pData[3] = HI_UINT16(txOctets);
+    pData[4] = LO_UINT16(txTime);
+    pData[5] = HI_UINT16(txTime);
+
+    return HCI_sendHCICommand(HCI_LE_SET_DATA_LENGTH, pData, 6);
+}
@@ -99,6 +99,7 @@
 // Low energy commands
 #define HCI_LE_READ_ADVERTISING_CHANNEL_TX_POWER          0x2007	//!< opcode of @ref HCI_LE_readAdvertisingChannelTxPower
 #define HCI_LE_SET_ADVERTISING_DATA                       0x2008
+#define HCI_LE_SET_DATA_LENGTH                            0x2022
 
 /* HCI Status return types  */
 typedef enum
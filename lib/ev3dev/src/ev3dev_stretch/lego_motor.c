@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include <pbdrv/config.h>
+#include <pbio/config.h>
 #include <pbio/error.h>
 #include <pbdrv/legodev.h>
 #include <pbio/port.h>
@@ -18,10 +19,16 @@
 
 #define MAX_PATH_LENGTH 120
 
+// An unchanged duty cycle is written again after this many skipped writes,
+// which is about every 100 ms in the control loop. This detects unplugging.
+#define DUTY_CYCLE_MAX_SKIPS (100 / PBIO_CONFIG_CONTROL_LOOP_TIME_MS)
+
 typedef struct {
     int n_motor;
     bool connected;
     bool coasting;
+    int duty_cycle_last;
+    int duty_cycle_skips;
     pbdrv_legodev_type_id_t id;
     FILE *f_command;
     FILE *f_duty;
@@ -196,6 +203,14 @@ pbio_error_t ev3dev_motor_run(pbio_port_id_t port, int duty_cycle) {
             return ev3dev_motor_connect_status(mtr, err);
         }
         mtr->coasting = false;
+    } else if (duty_cycle == mtr->duty_cycle_last && mtr->duty_cycle_skips < DUTY_CYCLE_MAX_SKIPS) {
+        // The motor is already running at this duty cycle. The controller
+        // often requests the same value many times in a row, so we can skip
+        // the write to save a system call on each control loop update. A
+        // failed write is how we find out that the motor was unplugged, so
+        // the value is still written now and then.
+        mtr->duty_cycle_skips++;
+        return PBIO_SUCCESS;
     }
 
     // Set the duty cycle value
@@ -203,6 +218,8 @@ pbio_error_t ev3dev_motor_run(pbio_port_id_t port, int duty_cycle) {
     if (err != PBIO_SUCCESS) {
         return ev3dev_motor_connect_status(mtr, err);
     }
+    mtr->duty_cycle_last = duty_cycle;
+    mtr->duty_cycle_skips = 0;
 
     return PBIO_SUCCESS;
 }
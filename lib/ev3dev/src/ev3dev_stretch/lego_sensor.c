@@ -5,11 +5,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ev3dev_stretch/lego_port.h>
 #include <ev3dev_stretch/lego_sensor.h>
 #include <ev3dev_stretch/sysfs.h>
 
+#include <pbdrv/clock.h>
 #include <pbdrv/legodev.h>
 #include <pbio/port.h>
 #include <pbio/util.h>
@@ -27,6 +29,15 @@ struct _lego_sensor_t {
     FILE *f_num_values;
     FILE *f_bin_data_format;
     char modes[12][17];
+    // Sensor polling period or 0 if the data is pushed by the sensor.
+    uint32_t poll_us;
+    // Time of the last read and whether the bin_data buffer holds valid data.
+    uint32_t bin_data_time_us;
+    bool bin_data_valid;
+    // Earliest time at which the kernel polls the sensor again, valid only
+    // if the poll phase has been found from a change in the data.
+    uint32_t bin_data_next_us;
+    bool poll_phase_known;
     uint8_t bin_data[PBDRV_LEGODEV_MAX_DATA_SIZE]  __attribute__((aligned(32)));
 };
 // Initialize an ev3dev sensor by opening the relevant sysfs attributes
@@ -63,6 +74,21 @@ static pbio_error_t ev3_sensor_init(lego_sensor_t *sensor, pbio_port_id_t port)
         return err;
     }
 
+    // Sensors that are polled by the kernel have no new data until the next
+    // poll, so there is no point in reading them more often. Other sensors
+    // don't have this attribute.
+    sensor->poll_us = 0;
+    sensor->bin_data_valid = false;
+    sensor->poll_phase_known = false;
+    FILE *f_poll_ms;
+    if (sysfs_open_sensor_attr(&f_poll_ms, sensor->n_sensor, "poll_ms", "r") == PBIO_SUCCESS) {
+        int poll_ms;
+        if (sysfs_read_int(f_poll_ms, &poll_ms) == PBIO_SUCCESS && poll_ms > 0) {
+            sensor->poll_us = poll_ms * 1000;
+        }
+        fclose(f_poll_ms);
+    }
+
     FILE *f_modes;
     err = sysfs_open_sensor_attr(&f_modes, sensor->n_sensor, "modes", "r");
     if (err != PBIO_SUCCESS) {
@@ -288,19 +314,54 @@ pbio_error_t lego_sensor_set_mode(lego_sensor_t *sensor, uint8_t mode) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    // Data read in the previous mode is no longer valid and the kernel may
+    // restart polling with a different phase.
+    sensor->bin_data_valid = false;
+    sensor->poll_phase_known = false;
+
     return sysfs_write_str(sensor->f_mode, sensor->modes[mode]);
 }
 
 // Read 32 bytes from bin_data attribute
 pbio_error_t lego_sensor_get_bin_data(lego_sensor_t *sensor, uint8_t **bin_data) {
-    if (fseek(sensor->f_bin_data, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+    uint32_t now = pbdrv_clock_get_us();
+
+    // If the kernel has not polled the sensor since the last read, return the
+    // same data again without doing any I/O.
+    if (sensor->bin_data_valid && sensor->poll_phase_known &&
+        (int32_t)(now - sensor->bin_data_next_us) < 0) {
+        *bin_data = sensor->bin_data;
+        return PBIO_SUCCESS;
     }
 
-    if (fread(sensor->bin_data, 1, BIN_DATA_SIZE, sensor->f_bin_data) < BIN_DATA_SIZE) {
+    // The file is unbuffered, so read from the descriptor directly. This
+    // avoids a separate seek system call.
+    uint8_t data[BIN_DATA_SIZE];
+    if (pread(fileno(sensor->f_bin_data), data, BIN_DATA_SIZE, 0) < BIN_DATA_SIZE) {
+        sensor->bin_data_valid = false;
         return PBIO_ERROR_IO;
     }
 
+    if (sensor->poll_us == 0) {
+        // Data is pushed by the sensor, so it can't be cached.
+        sensor->poll_phase_known = false;
+    } else if (sensor->bin_data_valid && memcmp(data, sensor->bin_data, BIN_DATA_SIZE) != 0) {
+        // The kernel polled the sensor between the previous read and now, so
+        // the next poll is at least one period after the previous read. If
+        // that is already in the past, the phase can't be known.
+        sensor->bin_data_next_us = sensor->bin_data_time_us + sensor->poll_us;
+        sensor->poll_phase_known = (int32_t)(now - sensor->bin_data_next_us) < 0;
+    } else if (sensor->poll_phase_known && (int32_t)(now - sensor->bin_data_next_us) >= 0) {
+        // No change, so the sensor value is steady. Polls keep the same
+        // phase, so move the estimate to the first poll after now.
+        uint32_t late_us = now - sensor->bin_data_next_us;
+        sensor->bin_data_next_us += (late_us / sensor->poll_us + 1) * sensor->poll_us;
+    }
+
+    memcpy(sensor->bin_data, data, BIN_DATA_SIZE);
+    sensor->bin_data_time_us = now;
+    sensor->bin_data_valid = true;
+
     *bin_data = sensor->bin_data;
 
     return PBIO_SUCCESS;
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ev3dev_stretch/lego_sensor.h>
 
@@ -14,8 +15,64 @@
 #define MAX_PATH_LENGTH 60
 #define MAX_READ_LENGTH "60"
 
+// Number of remembered sysfs_get_number() results. Each port can be
+// looked up in a few classes, e.g. tacho-motor and lego-port.
+#define NUMBER_CACHE_SIZE (16)
+
+static struct {
+    // All callers pass string constants, so the pointer can be kept.
+    const char *rdir;
+    pbio_port_id_t port;
+    int sysfs_number;
+    char name[16];
+} number_cache[NUMBER_CACHE_SIZE];
+
+static int number_cache_next;
+
+// Read the port from the address attribute of a device in a class directory
+static pbio_error_t sysfs_read_address_port(const char *rdir, const char *name, pbio_port_id_t *port) {
+    char p_address[MAX_PATH_LENGTH];
+#pragma GCC diagnostic push
+#if (__GNUC__ > 7) || (__GNUC__ == 7 && __GNUC_MINOR__ >= 1)
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+#endif
+    snprintf(p_address, MAX_PATH_LENGTH, "%s/%s/address", rdir, name);
+#pragma GCC diagnostic pop
+    FILE *f_address = fopen(p_address, "r");
+    if (f_address == NULL) {
+        return PBIO_ERROR_IO;
+    }
+
+    char port_char;
+    int ret = fscanf(f_address, "ev3-ports:%*[a-z]%c", &port_char);
+    fclose(f_address);
+    if (ret < 1) {
+        return PBIO_ERROR_IO;
+    }
+
+    *port = port_char;
+    return PBIO_SUCCESS;
+}
+
 // Get the ev3dev sensor number for a given port
 pbio_error_t sysfs_get_number(pbio_port_id_t port, const char *rdir, int *sysfs_number) {
+    // Scanning the whole class directory is slow since it reads the address
+    // of every device, so try the device we found last time first. Devices
+    // are renumbered when they are plugged in again, so check that it is
+    // still on the same port.
+    for (int i = 0; i < NUMBER_CACHE_SIZE; i++) {
+        if (!number_cache[i].rdir || number_cache[i].port != port || strcmp(number_cache[i].rdir, rdir) != 0) {
+            continue;
+        }
+        pbio_port_id_t port_found;
+        if (sysfs_read_address_port(rdir, number_cache[i].name, &port_found) == PBIO_SUCCESS && port_found == port) {
+            *sysfs_number = number_cache[i].sysfs_number;
+            return PBIO_SUCCESS;
+        }
+        number_cache[i].rdir = NULL;
+        break;
+    }
+
     // Open lego-sensor directory in sysfs
     DIR *d_sensor;
     struct dirent *entry;
@@ -26,36 +83,33 @@ pbio_error_t sysfs_get_number(pbio_port_id_t port, const char *rdir, int *sysfs_
     // Find sensor number for given port
     while ((entry = readdir(d_sensor))) {
         // Ignore the . and .. folders
-        if (entry->d_name[0] != '.') {
-            // Open the address file to get the port number
-            char p_address[MAX_PATH_LENGTH];
-#pragma GCC diagnostic push
-#if (__GNUC__ > 7) || (__GNUC__ == 7 && __GNUC_MINOR__ >= 1)
-#pragma GCC diagnostic ignored "-Wformat-truncation"
-#endif
-            snprintf(p_address, MAX_PATH_LENGTH, "%s/%s/address", rdir, entry->d_name);
-#pragma GCC diagnostic pop
-            FILE *f_address = fopen(p_address, "r");
-            if (f_address == NULL) {
-                return PBIO_ERROR_IO;
-            }
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
 
-            char port_char;
-            if (fscanf(f_address, "ev3-ports:%*[a-z]%c", &port_char) < 1) {
-                return PBIO_ERROR_IO;
-            }
-            pbio_port_id_t port_found = port_char;
+        // Read the address file to get the port number
+        pbio_port_id_t port_found;
+        if (sysfs_read_address_port(rdir, entry->d_name, &port_found) != PBIO_SUCCESS) {
+            closedir(d_sensor);
+            return PBIO_ERROR_IO;
+        }
 
-            if (fclose(f_address) != 0) {
-                return PBIO_ERROR_IO;
+        // If the port matches the requested port, get where it was found.
+        if (port_found == port) {
+            sscanf(entry->d_name, "%*[a-z]%d",  sysfs_number);
+
+            // Remember it for next time, replacing the oldest entry.
+            if (strlen(entry->d_name) < sizeof(number_cache[0].name)) {
+                int i = number_cache_next;
+                number_cache_next = (number_cache_next + 1) % NUMBER_CACHE_SIZE;
+                number_cache[i].rdir = rdir;
+                number_cache[i].port = port;
+                number_cache[i].sysfs_number = *sysfs_number;
+                strcpy(number_cache[i].name, entry->d_name);
             }
 
-            // If the port matches the requested port, get where it was found.
-            if (port_found == port) {
-                sscanf(entry->d_name, "%*[a-z]%d",  sysfs_number);
-                closedir(d_sensor);
-                return PBIO_SUCCESS;
-            }
+            closedir(d_sensor);
+            return PBIO_SUCCESS;
         }
     }
     // No sensor was found at the requested port
@@ -108,11 +162,11 @@ pbio_error_t sysfs_read_str(FILE *file, char *dest) {
 
 // Write a string to a previously opened sysfs attribute
 pbio_error_t sysfs_write_str(FILE *file, const char *str) {
-    if (fseek(file, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
-    }
+    size_t len = strlen(str);
 
-    if (fprintf(file, "%s", str) != (int)strlen(str)) {
+    // Files are opened unbuffered, so we can write to the underlying file
+    // descriptor directly. This avoids a separate seek and formatting call.
+    if (pwrite(fileno(file), str, len, 0) != (ssize_t)len) {
         return PBIO_ERROR_IO;
     }
 
@@ -134,11 +188,25 @@ pbio_error_t sysfs_read_int(FILE *file, int *dest) {
 
 // Write a number to a previously opened sysfs attribute
 pbio_error_t sysfs_write_int(FILE *file, int val) {
-    if (fseek(file, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+    // Large enough for "-2147483648".
+    char buf[12];
+    char *str = &buf[sizeof(buf)];
+
+    // Format the number from the end of the buffer backwards. This is
+    // called on every control loop update, so we skip printf here.
+    unsigned int abs_val = val < 0 ? -(unsigned int)val : (unsigned int)val;
+    do {
+        *--str = '0' + abs_val % 10;
+        abs_val /= 10;
+    } while (abs_val);
+
+    if (val < 0) {
+        *--str = '-';
     }
 
-    if (fprintf(file, "%d", val) <= 0) {
+    size_t len = &buf[sizeof(buf)] - str;
+
+    if (pwrite(fileno(file), str, len, 0) != (ssize_t)len) {
         return PBIO_ERROR_IO;
     }
 
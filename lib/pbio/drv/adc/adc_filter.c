@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Filtering of analog values that are sampled in the background.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adc_filter.h"
+
+/**
+ * Initializes the filter state of a channel.
+ *
+ * @param [in]  filter      The filter.
+ * @param [in]  shift       The IIR filter coefficient is 1 / 2^@p shift. Larger
+ *                          values give less noise but a slower response.
+ */
+void pbdrv_adc_filter_init(pbdrv_adc_filter_t *filter, uint8_t shift) {
+    filter->state = 0;
+    filter->shift = shift;
+    filter->ready = false;
+}
+
+/**
+ * Gets the median of a block of samples.
+ *
+ * @param [in]  samples     Pointer to the first sample.
+ * @param [in]  num_samples Number of samples (1 to ::PBDRV_ADC_FILTER_MAX_SAMPLES).
+ * @param [in]  stride      Distance between samples, e.g. the number of
+ *                          channels in an interleaved DMA buffer.
+ * @return                  The median. For an even number of samples, this is
+ *                          the mean of the two middle samples.
+ */
+uint16_t pbdrv_adc_filter_median(const uint16_t *samples, uint32_t num_samples, uint32_t stride) {
+    uint16_t sorted[PBDRV_ADC_FILTER_MAX_SAMPLES];
+
+    if (num_samples > PBDRV_ADC_FILTER_MAX_SAMPLES) {
+        num_samples = PBDRV_ADC_FILTER_MAX_SAMPLES;
+    }
+
+    // Insertion sort is fastest for the few samples we have.
+    for (uint32_t i = 0; i < num_samples; i++) {
+        uint16_t value = samples[i * stride];
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    if (num_samples & 1) {
+        return sorted[num_samples / 2];
+    }
+
+    return (sorted[num_samples / 2 - 1] + sorted[num_samples / 2] + 1) / 2;
+}
+
+/**
+ * Updates the filter with a new block of samples.
+ *
+ * The first update sets the output to the median of the block, so there is
+ * no slow start from zero.
+ *
+ * @param [in]  filter      The filter.
+ * @param [in]  samples     Pointer to the first sample.
+ * @param [in]  num_samples Number of samples (1 to ::PBDRV_ADC_FILTER_MAX_SAMPLES).
+ * @param [in]  stride      Distance between samples.
+ */
+void pbdrv_adc_filter_update(pbdrv_adc_filter_t *filter, const uint16_t *samples, uint32_t num_samples, uint32_t stride) {
+    uint32_t median = pbdrv_adc_filter_median(samples, num_samples, stride);
+
+    if (!filter->ready) {
+        filter->state = median << filter->shift;
+        filter->ready = true;
+        return;
+    }
+
+    // Rounding here instead of truncating makes sure the output settles on the
+    // input instead of up to 1 LSB above it.
+    uint32_t half = filter->shift ? 1 << (filter->shift - 1) : 0;
+    filter->state = filter->state + median - ((filter->state + half) >> filter->shift);
+}
+
+/**
+ * Gets the filtered value.
+ *
+ * @param [in]  filter      The filter.
+ * @return                  The filtered value, rounded to the nearest integer,
+ *                          or 0 if the filter has not been updated yet.
+ */
+uint16_t pbdrv_adc_filter_get(const pbdrv_adc_filter_t *filter) {
+    if (filter->shift == 0) {
+        return filter->state;
+    }
+
+    return (filter->state + (1 << (filter->shift - 1))) >> filter->shift;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Filtering of analog values that are sampled in the background.
+//
+// Each update takes a block of raw samples of one channel from the DMA buffer,
+// decimates it to its median to reject spikes, such as those caused by motor
+// PWM switching, and feeds that into a first order IIR low pass filter.
+//
+// These functions have no hardware dependencies so they can be tested on the
+// host with recorded traces.
+
+#ifndef _INTERNAL_PBDRV_ADC_FILTER_H_
+#define _INTERNAL_PBDRV_ADC_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Maximum number of samples per update. */
+#define PBDRV_ADC_FILTER_MAX_SAMPLES 16
+
+/**
+ * Filter state of one channel.
+ */
+typedef struct {
+    /** Filtered value scaled by 2^shift. */
+    uint32_t state;
+    /** IIR filter coefficient is 1 / 2^shift. Zero disables the IIR filter. */
+    uint8_t shift;
+    /** False until the first update. */
+    bool ready;
+} pbdrv_adc_filter_t;
+
+void pbdrv_adc_filter_init(pbdrv_adc_filter_t *filter, uint8_t shift);
+
+void pbdrv_adc_filter_update(pbdrv_adc_filter_t *filter, const uint16_t *samples, uint32_t num_samples, uint32_t stride);
+
+uint16_t pbdrv_adc_filter_get(const pbdrv_adc_filter_t *filter);
+
+uint16_t pbdrv_adc_filter_median(const uint16_t *samples, uint32_t num_samples, uint32_t stride);
+
+#endif // _INTERNAL_PBDRV_ADC_FILTER_H_
@@ -33,13 +33,22 @@
 
 #include STM32_HAL_H
 
-#define PBDRV_ADC_PERIOD_MS 10  // polling period in milliseconds
+#include "adc_filter.h"
+
+// The timer triggers a conversion of all channels every sample period. The
+// DMA buffer holds a few samples of each channel, interleaved by channel.
+// Each time it is full, the samples are filtered.
+
+#define PBDRV_ADC_PERIOD_US 1250    // sample period in microseconds
+#define PBDRV_ADC_NUM_SAMPLES 8     // samples per channel in DMA buffer
+#define PBDRV_ADC_FILTER_SHIFT 1    // IIR time constant is 2 updates (20 ms)
 
 static TIM_HandleTypeDef pbdrv_adc_htim;
 static DMA_HandleTypeDef pbdrv_adc_hdma;
 static ADC_HandleTypeDef pbdrv_adc_hadc;
 
-static uint32_t pbdrv_adc_dma_buffer[PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS];
+static uint16_t pbdrv_adc_dma_buffer[PBDRV_ADC_NUM_SAMPLES * PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS];
+static pbdrv_adc_filter_t pbdrv_adc_filter[PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS];
 static uint32_t pbdrv_adc_error_count;
 static uint32_t pbdrv_adc_last_error;
 
@@ -50,7 +59,13 @@ pbio_error_t pbdrv_adc_get_ch(uint8_t ch, uint16_t *value) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
-    *value = pbdrv_adc_dma_buffer[ch];
+    if (!pbdrv_adc_filter[ch].ready) {
+        // no filtered value until the buffer is full the first time
+        *value = pbdrv_adc_dma_buffer[ch];
+        return PBIO_SUCCESS;
+    }
+
+    *value = pbdrv_adc_filter_get(&pbdrv_adc_filter[ch]);
 
     return PBIO_SUCCESS;
 }
@@ -69,7 +84,12 @@ void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc) {
 }
 
 static void pbdrv_adc_poll(void) {
-    // TODO: filter incoming analog values
+    // The next samples are already being written to the start of the buffer
+    // by the time this runs, but we only need the most recent ones anyway.
+    for (uint32_t i = 0; i < PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS; i++) {
+        pbdrv_adc_filter_update(&pbdrv_adc_filter[i], &pbdrv_adc_dma_buffer[i],
+            PBDRV_ADC_NUM_SAMPLES, PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS);
+    }
 }
 
 static void pbdrv_adc_exit(void) {
@@ -90,9 +110,9 @@ PROCESS_THREAD(pbdrv_adc_process, ev, data) {
     // Timer to trigger ADC
 
     pbdrv_adc_htim.Instance = PBDRV_CONFIG_ADC_STM32_HAL_TIMER_INSTANCE;
-    pbdrv_adc_htim.Init.Prescaler = SystemCoreClock / 1000000 - 1; // should give 1kHz clock
+    pbdrv_adc_htim.Init.Prescaler = SystemCoreClock / 1000000 - 1; // should give 1MHz clock
     pbdrv_adc_htim.Init.CounterMode = TIM_COUNTERMODE_UP;
-    pbdrv_adc_htim.Init.Period = PBDRV_ADC_PERIOD_MS * 1000 - 1;
+    pbdrv_adc_htim.Init.Period = PBDRV_ADC_PERIOD_US - 1;
     pbdrv_adc_htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
 
     HAL_TIM_Base_Init(&pbdrv_adc_htim);
@@ -116,8 +136,8 @@ PROCESS_THREAD(pbdrv_adc_process, ev, data) {
     pbdrv_adc_hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
     pbdrv_adc_hdma.Init.PeriphInc = DMA_PINC_DISABLE;
     pbdrv_adc_hdma.Init.MemInc = DMA_MINC_ENABLE;
-    pbdrv_adc_hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-    pbdrv_adc_hdma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    pbdrv_adc_hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    pbdrv_adc_hdma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
     pbdrv_adc_hdma.Init.Mode = DMA_CIRCULAR;
     pbdrv_adc_hdma.Init.Priority = DMA_PRIORITY_MEDIUM;
 
@@ -146,7 +166,11 @@ PROCESS_THREAD(pbdrv_adc_process, ev, data) {
     __HAL_LINKDMA(&pbdrv_adc_hadc, DMA_Handle, pbdrv_adc_hdma);
     HAL_NVIC_SetPriority(PBDRV_CONFIG_ADC_STM32_HAL_DMA_IRQ, 7, 0);
     HAL_NVIC_EnableIRQ(PBDRV_CONFIG_ADC_STM32_HAL_DMA_IRQ);
-    HAL_ADC_Start_DMA(&pbdrv_adc_hadc, pbdrv_adc_dma_buffer, PBIO_ARRAY_SIZE(pbdrv_adc_dma_buffer));
+    for (uint32_t i = 0; i < PBDRV_CONFIG_ADC_STM32_HAL_ADC_NUM_CHANNELS; i++) {
+        pbdrv_adc_filter_init(&pbdrv_adc_filter[i], PBDRV_ADC_FILTER_SHIFT);
+    }
+
+    HAL_ADC_Start_DMA(&pbdrv_adc_hadc, (uint32_t *)pbdrv_adc_dma_buffer, PBIO_ARRAY_SIZE(pbdrv_adc_dma_buffer));
     HAL_TIM_Base_Start(&pbdrv_adc_htim);
 
     while (true) {
@@ -12,13 +12,28 @@
 
 #include <pbio/config.h>
 #include <pbio/error.h>
+#include <pbio/util.h>
 
 #include "stm32f0xx.h"
 
+#include "adc_filter.h"
+
 #if PBDRV_CONFIG_ADC_STM32F0_RANDOM
 #include "../random/random_adc.h"
 #endif
 
+// The ADC converts the channels in PBDRV_CONFIG_ADC_STM32F0_CHANNELS over and
+// over in the background. The DMA buffer holds the last few samples of each
+// channel, interleaved in order of increasing channel number.
+
+#define PBDRV_ADC_NUM_CHANNELS __builtin_popcount(PBDRV_CONFIG_ADC_STM32F0_CHANNELS)
+#define PBDRV_ADC_NUM_SAMPLES 8     // samples per channel in DMA buffer
+#define PBDRV_ADC_PERIOD_MS 2       // filter update period in milliseconds
+#define PBDRV_ADC_FILTER_SHIFT 2    // IIR time constant is 4 update periods
+
+static volatile uint16_t pbdrv_adc_dma_buffer[PBDRV_ADC_NUM_SAMPLES * PBDRV_ADC_NUM_CHANNELS];
+static pbdrv_adc_filter_t pbdrv_adc_filter[PBDRV_ADC_NUM_CHANNELS];
+
 PROCESS(pbdrv_adc_process, "ADC");
 
 static void pbdrv_adc_calibrate(void) {
@@ -61,40 +76,77 @@ static void pbdrv_adc_init(void) {
     // TODO: LEGO firmware reads CH 3 during init 10 times and averages it.
     // Not sure what this is measuring or what it would be used for. Perhaps
     // some kind of ID resistor?
-}
 
-// does a single conversion for the specified channel
-pbio_error_t pbdrv_adc_get_ch(uint8_t ch, uint16_t *value) {
-    if (ch > ADC_CHSELR_CHSEL18_Pos) {
-        return PBIO_ERROR_INVALID_ARG;
+    // DMA1 channel 1 copies each conversion to the circular buffer.
+    #ifdef DMA1_CSELR_CH1_ADC
+    DMA1->CSELR = (DMA1->CSELR & ~DMA_CSELR_C1S) | DMA1_CSELR_CH1_ADC;
+    #endif
+    DMA1_Channel1->CCR = 0;
+    DMA1_Channel1->CPAR = (uint32_t)&ADC1->DR;
+    DMA1_Channel1->CMAR = (uint32_t)pbdrv_adc_dma_buffer;
+    DMA1_Channel1->CNDTR = PBIO_ARRAY_SIZE(pbdrv_adc_dma_buffer);
+    DMA1_Channel1->CCR = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+
+    // Continuous conversion with circular DMA. Overrun data is overwritten so
+    // conversions never stop if the DMA is held up by another transfer.
+    ADC1->CHSELR = PBDRV_CONFIG_ADC_STM32F0_CHANNELS;
+    ADC1->CFGR1 |= ADC_CFGR1_CONT | ADC_CFGR1_OVRMOD | ADC_CFGR1_DMACFG | ADC_CFGR1_DMAEN;
+    ADC1->CR |= ADC_CR_ADSTART;
+
+    for (uint32_t i = 0; i < PBDRV_ADC_NUM_CHANNELS; i++) {
+        pbdrv_adc_filter_init(&pbdrv_adc_filter[i], PBDRV_ADC_FILTER_SHIFT);
     }
 
-    ADC1->CFGR1 &= ~ADC_CFGR1_CONT;
-    ADC1->CHSELR = 1 << ch;
+    // Wait for one full buffer so that values are valid from the start.
+    while (!(DMA1->ISR & DMA_ISR_TCIF1)) {
+    }
 
-    ADC1->CR |= ADC_CR_ADSTART;
-    while (!(ADC1->ISR & ADC_ISR_EOC)) {
+    DMA1->IFCR = DMA_IFCR_CTCIF1;
+}
+
+// Feeds the most recent samples of each channel into its filter.
+static void pbdrv_adc_update(void) {
+    // The DMA keeps writing while we read, so we may get a mix of older and
+    // newer samples. This is fine since we only need the most recent ones.
+    const uint16_t *samples = (const uint16_t *)pbdrv_adc_dma_buffer;
+
+    for (uint32_t i = 0; i < PBDRV_ADC_NUM_CHANNELS; i++) {
+        pbdrv_adc_filter_update(&pbdrv_adc_filter[i], &samples[i], PBDRV_ADC_NUM_SAMPLES, PBDRV_ADC_NUM_CHANNELS);
+
+        #if PBDRV_CONFIG_ADC_STM32F0_RANDOM
+        pbdrv_random_adc_push_lsb(samples[i]);
+        #endif
     }
+}
 
-    *value = ADC1->DR;
+// gets the latest filtered value of the specified channel
+pbio_error_t pbdrv_adc_get_ch(uint8_t ch, uint16_t *value) {
+    if (ch > ADC_CHSELR_CHSEL18_Pos || !(PBDRV_CONFIG_ADC_STM32F0_CHANNELS & (1 << ch))) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
 
-    #if PBDRV_CONFIG_ADC_STM32F0_RANDOM
-    pbdrv_random_adc_push_lsb(*value);
-    #endif
+    // Index of the channel in the buffer is the number of lower channels.
+    uint32_t index = __builtin_popcount(PBDRV_CONFIG_ADC_STM32F0_CHANNELS & ((1 << ch) - 1));
+
+    *value = pbdrv_adc_filter_get(&pbdrv_adc_filter[index]);
 
     return PBIO_SUCCESS;
 }
 
 PROCESS_THREAD(pbdrv_adc_process, ev, data) {
-    // TODO: use DMA for background updates and add filtering
-    // PROCESS_POLLHANDLER(pbdrv_adc_poll());
+    static struct etimer timer;
 
     PROCESS_BEGIN();
 
     pbdrv_adc_init();
+    pbdrv_adc_update();
+
+    etimer_set(&timer, PBDRV_ADC_PERIOD_MS);
 
     while (true) {
-        PROCESS_WAIT_EVENT();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&timer));
+        etimer_reset(&timer);
+        pbdrv_adc_update();
     }
 
     PROCESS_END();
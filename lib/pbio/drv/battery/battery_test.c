@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2020-2022 The Pybricks Authors
+// Copyright (c) 2020-2023 The Pybricks Authors
 
 // Software battery implementation for simulating battery in tests
 
@@ -7,25 +7,54 @@
 
 #if PBDRV_CONFIG_BATTERY_TEST
 
+#include <stdint.h>
+
 #include <pbdrv/battery.h>
 #include <pbio/error.h>
 
+#include "battery_test.h"
+
+static pbdrv_battery_type_t test_battery_type = PBDRV_BATTERY_TYPE_LIION;
+static uint16_t test_battery_voltage = PBDRV_BATTERY_TEST_DEFAULT_VOLTAGE;
+static uint16_t test_battery_current = PBDRV_BATTERY_TEST_DEFAULT_CURRENT;
+
+/**
+ * Sets the battery type reported by the test battery.
+ * @param [in]  type    The battery type.
+ */
+void pbdrv_battery_test_set_type(pbdrv_battery_type_t type) {
+    test_battery_type = type;
+}
+
+/**
+ * Sets the voltage and current reported by the test battery.
+ *
+ * Tests can call this on every clock tick to simulate a load profile.
+ *
+ * @param [in]  voltage The battery voltage in mV.
+ * @param [in]  current The battery current in mA.
+ */
+void pbdrv_battery_test_set_voltage_and_current(uint16_t voltage, uint16_t current) {
+    test_battery_voltage = voltage;
+    test_battery_current = current;
+}
+
 void pbdrv_battery_init(void) {
 }
 
 pbio_error_t pbdrv_battery_get_voltage_now(uint16_t *value) {
-    *value = 7200;
+    *value = test_battery_voltage;
     return PBIO_SUCCESS;
 }
 
 pbio_error_t pbdrv_battery_get_type(pbdrv_battery_type_t *value) {
-    *value = PBDRV_BATTERY_TYPE_LIION;
+    *value = test_battery_type;
     return PBIO_SUCCESS;
 }
 
 pbio_error_t pbdrv_battery_get_current_now(uint16_t *value) {
-    *value = 0;
-    return PBIO_ERROR_NOT_SUPPORTED;
+    *value = test_battery_current;
+    return PBIO_SUCCESS;
 }
 
 pbio_error_t pbdrv_battery_get_temperature(uint32_t *value) {
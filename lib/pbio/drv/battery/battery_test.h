@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#ifndef _INTERNAL_PBDRV_BATTERY_TEST_H_
+#define _INTERNAL_PBDRV_BATTERY_TEST_H_
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_BATTERY_TEST
+
+#include <stdint.h>
+
+#include <pbdrv/battery.h>
+
+// Default values reported by the test battery.
+#define PBDRV_BATTERY_TEST_DEFAULT_VOLTAGE 7200
+#define PBDRV_BATTERY_TEST_DEFAULT_CURRENT 0
+
+// extra battery functions just for tests and synthetic load profiles
+void pbdrv_battery_test_set_type(pbdrv_battery_type_t type);
+void pbdrv_battery_test_set_voltage_and_current(uint16_t voltage, uint16_t current);
+
+#endif // PBDRV_CONFIG_BATTERY_TEST
+
+#endif // _INTERNAL_PBDRV_BATTERY_TEST_H_
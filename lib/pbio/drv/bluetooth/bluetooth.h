@@ -6,10 +6,55 @@
 #ifndef _INTERNAL_PBDRV_BLUETOOTH_H_
 #define _INTERNAL_PBDRV_BLUETOOTH_H_
 
+#include <stdint.h>
+
+#include <pbdrv/bluetooth.h>
 #include <pbdrv/config.h>
 
 #if PBDRV_CONFIG_BLUETOOTH
 
+/** Connection parameters in the units used by the Bluetooth spec. */
+typedef struct {
+    /** Minimum connection interval in 1.25 ms units. */
+    uint16_t interval_min;
+    /** Maximum connection interval in 1.25 ms units. */
+    uint16_t interval_max;
+    /** Peripheral latency in number of connection events. */
+    uint16_t latency;
+    /** Supervision timeout in 10 ms units. */
+    uint16_t timeout;
+} pbdrv_bluetooth_connection_parameters_t;
+
+/**
+ * Gets the connection parameters for an interval preset.
+ *
+ * The values follow the Apple Accessory Design Guidelines[1] so that they
+ * are accepted by all common centrals: the minimum interval is a multiple of
+ * 15 ms and the maximum is at least 15 ms more than the minimum unless both
+ * are 15 ms.
+ *
+ * [1]: https://developer.apple.com/accessories/Accessory-Design-Guidelines.pdf
+ *
+ * @param [in]  interval    The preset.
+ * @return                  The connection parameters.
+ */
+static inline const pbdrv_bluetooth_connection_parameters_t *pbdrv_bluetooth_get_connection_parameters(pbdrv_bluetooth_connection_interval_t interval) {
+    static const pbdrv_bluetooth_connection_parameters_t fast = {
+        .interval_min = 12, // 12 * 1.25 ms = 15 ms
+        .interval_max = 12, // 12 * 1.25 ms = 15 ms
+        .latency = 0,
+        .timeout = 500, // 500 * 10 ms = 5 s
+    };
+    static const pbdrv_bluetooth_connection_parameters_t idle = {
+        .interval_min = 24, // 24 * 1.25 ms = 30 ms
+        .interval_max = 48, // 48 * 1.25 ms = 60 ms
+        .latency = 0,
+        .timeout = 500, // 500 * 10 ms = 5 s
+    };
+
+    return interval == PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST ? &fast : &idle;
+}
+
 void pbdrv_bluetooth_init(void);
 
 #else // PBDRV_CONFIG_BLUETOOTH
@@ -21,6 +21,7 @@
 
 #include "bluetooth_btstack_run_loop_contiki.h"
 #include "bluetooth_btstack.h"
+#include "bluetooth.h"
 #include "genhdr/pybricks_service.h"
 #include "hci_transport_h4.h"
 #include "pybricks_service_server.h"
@@ -47,6 +48,7 @@
 
 typedef enum {
     CON_STATE_NONE,
+    CON_STATE_WAIT_SCAN,
     CON_STATE_WAIT_ADV_IND,
     CON_STATE_WAIT_SCAN_RSP,
     CON_STATE_WAIT_CONNECT,
@@ -80,6 +82,12 @@ typedef struct {
     bd_addr_t address;
     lwp3_hub_kind_t hub_kind;
     char name[20];
+    pbdrv_bluetooth_receive_handler_t notification_handler;
+    pbdrv_bluetooth_value_t *write_value;
+    // copy of the value being written, owned by the driver so that a write
+    // task can be canceled before the GATT client is done with it.
+    uint8_t write_data[ATT_DEFAULT_MTU - 3];
+    bool write_pending;
 } pup_handset_t;
 
 // hub name goes in special section so that it can be modified when flashing firmware
@@ -94,8 +102,7 @@ static hci_con_handle_t pybricks_con_handle = HCI_CON_HANDLE_INVALID;
 static hci_con_handle_t uart_con_handle = HCI_CON_HANDLE_INVALID;
 static pbdrv_bluetooth_on_event_t bluetooth_on_event;
 static pbdrv_bluetooth_receive_handler_t receive_handler;
-static pbdrv_bluetooth_receive_handler_t notification_handler;
-static pup_handset_t handset;
+static pup_handset_t handsets[PBDRV_BLUETOOTH_NUM_PERIPHERALS];
 static uint8_t *event_packet;
 static const pbdrv_bluetooth_btstack_platform_data_t *pdata = &pbdrv_bluetooth_btstack_platform_data;
 
@@ -160,28 +167,17 @@ static void nordic_can_send(void *context) {
 }
 
 /**
- * Queues a tasks and runs the first iteration if there is no other task already
- * running.
- *
- * @param [in]  task    An uninitialized task.
- * @param [in]  thread  The task thread to attach to the task.
- * @param [in]  context The context to attach to the task.
+ * Runs the tasks in the queue until one of them has to wait.
  */
-static void start_task(pbio_task_t *task, pbio_task_thread_t thread, void *context) {
-    pbio_task_init(task, thread, context);
+static void run_task_queue(void) {
+    static bool running;
 
-    if (list_head(task_queue) != NULL || !pbio_task_run_once(task)) {
-        list_add(task_queue, task);
+    // Cancel callbacks can be called from within a task.
+    if (running) {
+        return;
     }
-}
 
-/**
- * Runs tasks that may be waiting for event and notifies external subscriber.
- *
- * @param [in]  packet  Pointer to the raw packet data.
- */
-static void propagate_event(uint8_t *packet) {
-    event_packet = packet;
+    running = true;
 
     for (;;) {
         pbio_task_t *current_task = list_head(task_queue);
@@ -200,6 +196,44 @@ static void propagate_event(uint8_t *packet) {
         break;
     }
 
+    running = false;
+}
+
+/**
+ * Runs the task queue right away when a task is canceled instead of waiting
+ * for the next Bluetooth event, so the task can clean up.
+ *
+ * @param [in]  task    The task.
+ */
+static void cancel_task(pbio_task_t *task) {
+    run_task_queue();
+}
+
+/**
+ * Queues a tasks and runs the first iteration if there is no other task already
+ * running.
+ *
+ * @param [in]  task    An uninitialized task.
+ * @param [in]  thread  The task thread to attach to the task.
+ * @param [in]  context The context to attach to the task.
+ */
+static void start_task(pbio_task_t *task, pbio_task_thread_t thread, void *context) {
+    pbio_task_init(task, thread, context);
+    task->on_cancel = cancel_task;
+
+    if (list_head(task_queue) != NULL || !pbio_task_run_once(task)) {
+        list_add(task_queue, task);
+    }
+}
+
+/**
+ * Runs tasks that may be waiting for event and notifies external subscriber.
+ *
+ * @param [in]  packet  Pointer to the raw packet data.
+ */
+static void propagate_event(uint8_t *packet) {
+    event_packet = packet;
+    run_task_queue();
     event_packet = NULL;
 
     if (bluetooth_on_event) {
@@ -238,59 +272,123 @@ static void nordic_spp_packet_handler(uint8_t packet_type, uint16_t channel, uin
     propagate_event(packet);
 }
 
+/**
+ * Gets the peripheral slot that uses a connection.
+ *
+ * @param [in]  con_handle  The connection handle.
+ * @return                  The slot or NULL if no slot uses this connection.
+ */
+static pup_handset_t *get_handset(hci_con_handle_t con_handle) {
+    if (con_handle == HCI_CON_HANDLE_INVALID) {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < PBDRV_BLUETOOTH_NUM_PERIPHERALS; i++) {
+        if (handsets[i].con_handle == con_handle) {
+            return &handsets[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Gets the peripheral slot that is in the given connection state.
+ *
+ * Scanning and connecting is done by a task, and tasks run one at a time, so
+ * at most one slot can be in any of the scanning or connecting states.
+ *
+ * @param [in]  con_state   The connection state.
+ * @return                  The slot or NULL if no slot is in this state.
+ */
+static pup_handset_t *get_handset_in_state(con_state_t con_state) {
+    for (uint8_t i = 0; i < PBDRV_BLUETOOTH_NUM_PERIPHERALS; i++) {
+        if (handsets[i].con_state == con_state) {
+            return &handsets[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Tests if a device is already connected, or being connected to, by another slot.
+ *
+ * @param [in]  handset     The slot that is scanning.
+ * @param [in]  address     The address of the device.
+ * @return                  True if another slot uses the device.
+ */
+static bool is_address_in_use(pup_handset_t *handset, const bd_addr_t address) {
+    for (uint8_t i = 0; i < PBDRV_BLUETOOTH_NUM_PERIPHERALS; i++) {
+        if (&handsets[i] != handset && handsets[i].con_state != CON_STATE_NONE
+            && bd_addr_cmp(handsets[i].address, address) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 // REVISIT: does this need to be separate from packet_handler()?
 // currently, this function just handles the Powered Up handset control.
 static void handle_gatt_client_event(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
 
+    // All GATT client events start with the connection handle.
+    pup_handset_t *handset = get_handset(gatt_event_query_complete_get_handle(packet));
+
+    if (!handset) {
+        propagate_event(packet);
+        return;
+    }
+
     switch (hci_event_packet_get_type(packet)) {
         case GATT_EVENT_SERVICE_QUERY_RESULT:
-            gatt_event_service_query_result_get_service(packet, &handset.lwp3_service);
+            gatt_event_service_query_result_get_service(packet, &handset->lwp3_service);
             break;
 
         case GATT_EVENT_CHARACTERISTIC_QUERY_RESULT:
-            gatt_event_characteristic_query_result_get_characteristic(packet, &handset.lwp3_char);
+            gatt_event_characteristic_query_result_get_characteristic(packet, &handset->lwp3_char);
             break;
 
         case GATT_EVENT_QUERY_COMPLETE:
-            if (handset.con_state == CON_STATE_WAIT_DISCOVER_SERVICES) {
-                handset.btstack_error = gatt_client_discover_characteristics_for_service_by_uuid128(
-                    handle_gatt_client_event, handset.con_handle, &handset.lwp3_service, pbio_lwp3_hub_char_uuid);
-                if (handset.btstack_error == ERROR_CODE_SUCCESS) {
-                    handset.con_state = CON_STATE_WAIT_DISCOVER_CHARACTERISTICS;
+            if (handset->con_state == CON_STATE_WAIT_DISCOVER_SERVICES) {
+                handset->btstack_error = gatt_client_discover_characteristics_for_service_by_uuid128(
+                    handle_gatt_client_event, handset->con_handle, &handset->lwp3_service, pbio_lwp3_hub_char_uuid);
+                if (handset->btstack_error == ERROR_CODE_SUCCESS) {
+                    handset->con_state = CON_STATE_WAIT_DISCOVER_CHARACTERISTICS;
                 } else {
                     // configuration failed for some reason, so disconnect
-                    gap_disconnect(handset.con_handle);
-                    handset.con_state = CON_STATE_WAIT_DISCONNECT;
-                    handset.disconnect_reason = DISCONNECT_REASON_DISCOVER_CHARACTERISTIC_FAILED;
+                    gap_disconnect(handset->con_handle);
+                    handset->con_state = CON_STATE_WAIT_DISCONNECT;
+                    handset->disconnect_reason = DISCONNECT_REASON_DISCOVER_CHARACTERISTIC_FAILED;
                 }
-            } else if (handset.con_state == CON_STATE_WAIT_DISCOVER_CHARACTERISTICS) {
-                handset.btstack_error = gatt_client_write_client_characteristic_configuration(
-                    handle_gatt_client_event, handset.con_handle, &handset.lwp3_char,
+            } else if (handset->con_state == CON_STATE_WAIT_DISCOVER_CHARACTERISTICS) {
+                handset->btstack_error = gatt_client_write_client_characteristic_configuration(
+                    handle_gatt_client_event, handset->con_handle, &handset->lwp3_char,
                     GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
-                if (handset.btstack_error == ERROR_CODE_SUCCESS) {
+                if (handset->btstack_error == ERROR_CODE_SUCCESS) {
                     gatt_client_listen_for_characteristic_value_updates(
-                        &handset.notification, handle_gatt_client_event, handset.con_handle, &handset.lwp3_char);
-                    handset.con_state = CON_STATE_WAIT_ENABLE_NOTIFICATIONS;
+                        &handset->notification, handle_gatt_client_event, handset->con_handle, &handset->lwp3_char);
+                    handset->con_state = CON_STATE_WAIT_ENABLE_NOTIFICATIONS;
                 } else {
                     // configuration failed for some reason, so disconnect
-                    gap_disconnect(handset.con_handle);
-                    handset.con_state = CON_STATE_WAIT_DISCONNECT;
-                    handset.disconnect_reason = DISCONNECT_REASON_CONFIGURE_CHARACTERISTIC_FAILED;
+                    gap_disconnect(handset->con_handle);
+                    handset->con_state = CON_STATE_WAIT_DISCONNECT;
+                    handset->disconnect_reason = DISCONNECT_REASON_CONFIGURE_CHARACTERISTIC_FAILED;
                 }
-            } else if (handset.con_state == CON_STATE_WAIT_ENABLE_NOTIFICATIONS) {
-                handset.con_state = CON_STATE_CONNECTED;
+            } else if (handset->con_state == CON_STATE_WAIT_ENABLE_NOTIFICATIONS) {
+                handset->con_state = CON_STATE_CONNECTED;
+            } else if (handset->con_state == CON_STATE_CONNECTED) {
+                // the only query after connecting is write_remote_task()
+                handset->write_pending = false;
             }
             break;
 
         case GATT_EVENT_NOTIFICATION: {
-            if (gatt_event_notification_get_handle(packet) != handset.con_handle) {
-                break;
-            }
-
-            if (notification_handler != NULL) {
+            if (handset->notification_handler != NULL) {
                 uint16_t length = gatt_event_notification_get_value_length(packet);
                 const uint8_t *value = gatt_event_notification_get_value(packet);
-                notification_handler(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3, value, length);
+                handset->notification_handler(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(handset - handsets), value, length);
             }
             break;
         }
@@ -324,39 +422,46 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
                 // don't start advertising again on disconnect
                 gap_advertisements_enable(false);
             } else {
+                pup_handset_t *handset = get_handset_in_state(CON_STATE_WAIT_CONNECT);
+
                 // If we aren't waiting for a handset connection, this must be a different connection.
-                if (handset.con_state != CON_STATE_WAIT_CONNECT) {
+                if (!handset) {
                     break;
                 }
 
-                handset.con_handle = hci_subevent_le_connection_complete_get_connection_handle(packet);
+                handset->con_handle = hci_subevent_le_connection_complete_get_connection_handle(packet);
 
-                handset.btstack_error = gatt_client_discover_primary_services_by_uuid128(
-                    handle_gatt_client_event, handset.con_handle, pbio_lwp3_hub_service_uuid);
-                if (handset.btstack_error == ERROR_CODE_SUCCESS) {
-                    handset.con_state = CON_STATE_WAIT_DISCOVER_SERVICES;
+                handset->btstack_error = gatt_client_discover_primary_services_by_uuid128(
+                    handle_gatt_client_event, handset->con_handle, pbio_lwp3_hub_service_uuid);
+                if (handset->btstack_error == ERROR_CODE_SUCCESS) {
+                    handset->con_state = CON_STATE_WAIT_DISCOVER_SERVICES;
                 } else {
                     // configuration failed for some reason, so disconnect
-                    gap_disconnect(handset.con_handle);
-                    handset.con_state = CON_STATE_WAIT_DISCONNECT;
-                    handset.disconnect_reason = DISCONNECT_REASON_DISCOVER_SERVICE_FAILED;
+                    gap_disconnect(handset->con_handle);
+                    handset->con_state = CON_STATE_WAIT_DISCONNECT;
+                    handset->disconnect_reason = DISCONNECT_REASON_DISCOVER_SERVICE_FAILED;
                 }
             }
 
             break;
 
-        case HCI_EVENT_DISCONNECTION_COMPLETE:
-            if (hci_event_disconnection_complete_get_connection_handle(packet) == le_con_handle) {
+        case HCI_EVENT_DISCONNECTION_COMPLETE: {
+            hci_con_handle_t con_handle = hci_event_disconnection_complete_get_connection_handle(packet);
+            pup_handset_t *handset = get_handset(con_handle);
+
+            if (con_handle == le_con_handle) {
                 le_con_handle = HCI_CON_HANDLE_INVALID;
                 pybricks_con_handle = HCI_CON_HANDLE_INVALID;
                 uart_con_handle = HCI_CON_HANDLE_INVALID;
-            } else if (hci_event_disconnection_complete_get_connection_handle(packet) == handset.con_handle) {
-                gatt_client_stop_listening_for_characteristic_value_updates(&handset.notification);
-                handset.con_handle = HCI_CON_HANDLE_INVALID;
-                handset.con_state = CON_STATE_NONE;
+            } else if (handset) {
+                gatt_client_stop_listening_for_characteristic_value_updates(&handset->notification);
+                handset->con_handle = HCI_CON_HANDLE_INVALID;
+                handset->con_state = CON_STATE_NONE;
+                handset->write_pending = false;
             }
 
             break;
+        }
 
         case GAP_EVENT_ADVERTISING_REPORT: {
             uint8_t event_type = gap_event_advertising_report_get_advertising_event_type(packet);
@@ -371,7 +476,9 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
                 observe_callback(event_type, data, data_length, rssi);
             }
 
-            if (handset.con_state == CON_STATE_WAIT_ADV_IND) {
+            pup_handset_t *handset;
+
+            if ((handset = get_handset_in_state(CON_STATE_WAIT_ADV_IND))) {
                 // HACK: this is making major assumptions about how the advertising data
                 // is laid out. So far LEGO devices seem consistent in this.
                 // It is expected that the advertising data contains 3 values in
@@ -382,43 +489,48 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
                 //   - LEGO System A/S (0x0397) + 6 bytes
                 if (event_type == ADV_IND && data_length == 31
                     && pbio_uuid128_reverse_compare(&data[5], pbio_lwp3_hub_service_uuid)
-                    && data[26] == handset.hub_kind) {
+                    && data[26] == handset->hub_kind) {
 
-                    if (memcmp(address, handset.address, 6) == 0) {
+                    if (memcmp(address, handset->address, 6) == 0) {
                         // This was the same device as last time. If the scan response
                         // didn't match before, it probably won't match now and we
                         // should try a different device.
                         break;
                     }
 
-                    memcpy(handset.address, address, sizeof(bd_addr_t));
-                    handset.address_type = gap_event_advertising_report_get_address_type(packet);
-                    handset.con_state = CON_STATE_WAIT_SCAN_RSP;
+                    if (is_address_in_use(handset, address)) {
+                        // Already connected to this device in another slot.
+                        break;
+                    }
+
+                    memcpy(handset->address, address, sizeof(bd_addr_t));
+                    handset->address_type = gap_event_advertising_report_get_address_type(packet);
+                    handset->con_state = CON_STATE_WAIT_SCAN_RSP;
                 }
-            } else if (handset.con_state == CON_STATE_WAIT_SCAN_RSP) {
+            } else if ((handset = get_handset_in_state(CON_STATE_WAIT_SCAN_RSP))) {
                 // REVISIT: for now it is assumed that the saved Bluetooth address compare
                 //          is a sufficient check to check that scan response is from LWP3 device
                 // PREVIOUSLY: extra check: data_length == 30 for HANDSET
                 //                          data_length == 27 for MARIO
                 //                          data_length == 20 for SYSTEM_2IO ... etc
-                if (event_type == SCAN_RSP && bd_addr_cmp(address, handset.address) == 0) {
+                if (event_type == SCAN_RSP && bd_addr_cmp(address, handset->address) == 0) {
                     if (data[1] == BLUETOOTH_DATA_TYPE_COMPLETE_LOCAL_NAME) {
                         // if the name was passed in from the caller, then filter on name
-                        if (handset.name[0] != '\0' && strncmp(handset.name, (char *)&data[2], sizeof(handset.name)) != 0) {
-                            handset.con_state = CON_STATE_WAIT_ADV_IND;
+                        if (handset->name[0] != '\0' && strncmp(handset->name, (char *)&data[2], sizeof(handset->name)) != 0) {
+                            handset->con_state = CON_STATE_WAIT_ADV_IND;
                             break;
                         }
 
-                        memcpy(handset.name, &data[2], sizeof(handset.name));
+                        memcpy(handset->name, &data[2], sizeof(handset->name));
                     }
 
                     gap_stop_scan();
-                    handset.btstack_error = gap_connect(handset.address, handset.address_type);
+                    handset->btstack_error = gap_connect(handset->address, handset->address_type);
 
-                    if (handset.btstack_error == ERROR_CODE_SUCCESS) {
-                        handset.con_state = CON_STATE_WAIT_CONNECT;
+                    if (handset->btstack_error == ERROR_CODE_SUCCESS) {
+                        handset->con_state = CON_STATE_WAIT_CONNECT;
                     } else {
-                        handset.con_state = CON_STATE_NONE;
+                        handset->con_state = CON_STATE_NONE;
                     }
                 }
             }
@@ -457,7 +569,9 @@ void pbdrv_bluetooth_init(void) {
     static btstack_packet_callback_registration_t hci_event_callback_registration;
 
     // don't need to init the whole struct, so doing this here
-    handset.con_handle = HCI_CON_HANDLE_INVALID;
+    for (uint8_t i = 0; i < PBDRV_BLUETOOTH_NUM_PERIPHERALS; i++) {
+        handsets[i].con_handle = HCI_CON_HANDLE_INVALID;
+    }
 
     btstack_memory_init();
     btstack_run_loop_init(pbdrv_bluetooth_btstack_run_loop_contiki_get_instance());
@@ -508,9 +622,7 @@ void pbdrv_bluetooth_power_on(bool on) {
         pbio_task_t *task;
 
         while ((task = list_pop(task_queue)) != NULL) {
-            if (task->status == PBIO_ERROR_AGAIN) {
-                task->status = PBIO_ERROR_CANCELED;
-            }
+            pbio_task_abort(task);
         }
     }
 }
@@ -591,7 +703,9 @@ bool pbdrv_bluetooth_is_connected(pbdrv_bluetooth_connection_t connection) {
         return true;
     }
 
-    if (connection == PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3 && handset.con_handle != HCI_CON_HANDLE_INVALID) {
+    if (connection >= PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3
+        && connection < PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(PBDRV_BLUETOOTH_NUM_PERIPHERALS)
+        && handsets[connection - PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3].con_handle != HCI_CON_HANDLE_INVALID) {
         return true;
     }
 
@@ -608,6 +722,14 @@ void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context) {
     send_request.context = context;
 
     if (context->connection == PBDRV_BLUETOOTH_CONNECTION_PYBRICKS) {
+        // If the controller has buffer space, send right away instead of
+        // waiting for the can send now event so that more than one
+        // notification can go out in the same connection event.
+        if (att_server_can_send_packet_now(pybricks_con_handle)) {
+            pybricks_can_send(context);
+            return;
+        }
+
         send_request.callback = &pybricks_can_send;
         pybricks_service_server_request_can_send_now(&send_request, pybricks_con_handle);
     } else if (context->connection == PBDRV_BLUETOOTH_CONNECTION_UART) {
@@ -616,12 +738,30 @@ void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context) {
     }
 }
 
-void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    receive_handler = handler;
+uint16_t pbdrv_bluetooth_get_mtu_size(void) {
+    if (le_con_handle == HCI_CON_HANDLE_INVALID) {
+        return ATT_DEFAULT_MTU;
+    }
+
+    return att_server_get_mtu(le_con_handle);
 }
 
-void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    notification_handler = handler;
+void pbdrv_bluetooth_request_connection_interval(pbdrv_bluetooth_connection_interval_t interval) {
+    if (le_con_handle == HCI_CON_HANDLE_INVALID) {
+        return;
+    }
+
+    const pbdrv_bluetooth_connection_parameters_t *params = pbdrv_bluetooth_get_connection_parameters(interval);
+
+    // The CC2564C is a Bluetooth 4.1 controller, so unlike the other chips,
+    // the data length can't be increased. The negotiated MTU still allows
+    // sending larger notifications, they just get fragmented by L2CAP.
+    gap_request_connection_parameter_update(le_con_handle, params->interval_min,
+        params->interval_max, params->latency, params->timeout);
+}
+
+void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
+    receive_handler = handler;
 }
 
 static void start_observing(void) {
@@ -631,19 +771,19 @@ static void start_observing(void) {
 
 static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
     pbdrv_bluetooth_scan_and_connect_context_t *context = task->context;
+    pup_handset_t *handset = &handsets[context->peripheral];
 
     PT_BEGIN(pt);
 
-    memset(&handset, 0, sizeof(handset));
-    handset.con_handle = HCI_CON_HANDLE_INVALID;
-    memcpy(handset.name, context->name, sizeof(handset.name));
-    handset.hub_kind = context->hub_kind;
+    memcpy(handset->name, context->name, sizeof(handset->name));
+    handset->hub_kind = context->hub_kind;
+    handset->notification_handler = context->notification_handler;
 
     // active scanning to get scan response data.
     // scan interval: 48 * 0.625ms = 30ms
     gap_set_scan_params(1, 0x30, 0x30, 0);
     gap_start_scan();
-    handset.con_state = CON_STATE_WAIT_ADV_IND;
+    handset->con_state = CON_STATE_WAIT_ADV_IND;
 
     PT_WAIT_UNTIL(pt, ({
         if (task->cancel) {
@@ -652,30 +792,34 @@ static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
 
         // if there is any failure to connect or error while enumerating
         // attributes, con_state will be set to CON_STATE_NONE
-        if (handset.con_state == CON_STATE_NONE) {
+        if (handset->con_state == CON_STATE_NONE) {
             task->status = PBIO_ERROR_FAILED;
             PT_EXIT(pt);
         }
 
-        handset.con_state == CON_STATE_CONNECTED;
+        handset->con_state == CON_STATE_CONNECTED;
     }));
 
     // REVISIT: probably want to make a generic connection handle data structure
     // that includes handle, name, address, etc.
-    memcpy(context->name, handset.name, sizeof(context->name));
+    memcpy(context->name, handset->name, sizeof(context->name));
 
     task->status = PBIO_SUCCESS;
     goto out;
 
 cancel:
-    if (handset.con_state == CON_STATE_WAIT_ADV_IND || handset.con_state == CON_STATE_WAIT_SCAN_RSP) {
+    if (handset->con_state == CON_STATE_WAIT_ADV_IND || handset->con_state == CON_STATE_WAIT_SCAN_RSP) {
         gap_stop_scan();
-    } else if (handset.con_state == CON_STATE_WAIT_CONNECT) {
+    } else if (handset->con_state == CON_STATE_WAIT_CONNECT) {
         gap_connect_cancel();
-    } else if (handset.con_handle != HCI_CON_HANDLE_INVALID) {
-        gap_disconnect(handset.con_handle);
     }
-    handset.con_state = CON_STATE_NONE;
+    if (handset->con_handle != HCI_CON_HANDLE_INVALID) {
+        // The slot is freed when the disconnection is complete.
+        gap_disconnect(handset->con_handle);
+        handset->con_state = CON_STATE_WAIT_DISCONNECT;
+    } else {
+        handset->con_state = CON_STATE_NONE;
+    }
     task->status = PBIO_ERROR_CANCELED;
 
 out:
@@ -688,36 +832,78 @@ out:
 }
 
 void pbdrv_bluetooth_scan_and_connect(pbio_task_t *task, pbdrv_bluetooth_scan_and_connect_context_t *context) {
+    // Claim a free slot right away, so the next call can't get the same one
+    // while this task is still waiting in the queue.
+    pup_handset_t *handset = get_handset_in_state(CON_STATE_NONE);
+
+    if (!handset) {
+        task->status = PBIO_ERROR_BUSY;
+        return;
+    }
+
+    memset(handset, 0, sizeof(*handset));
+    handset->con_handle = HCI_CON_HANDLE_INVALID;
+    handset->con_state = CON_STATE_WAIT_SCAN;
+    context->peripheral = handset - handsets;
+
     start_task(task, scan_and_connect_task, context);
 }
 
 static PT_THREAD(write_remote_task(struct pt *pt, pbio_task_t *task)) {
-    pbdrv_bluetooth_value_t *value = task->context;
+    pup_handset_t *handset = task->context;
+    pbdrv_bluetooth_value_t *value = handset->write_value;
 
     PT_BEGIN(pt);
 
-    // TODO: Make connection handle and value handle part of pbdrv_bluetooth_value_t
-    // to allow for simultaneous connections.
+    // A previously canceled write may still be in progress.
+    PT_WAIT_UNTIL(pt, ({
+        if (task->cancel) {
+            task->status = PBIO_ERROR_CANCELED;
+            PT_EXIT(pt);
+        }
+        if (handset->con_handle == HCI_CON_HANDLE_INVALID) {
+            // disconnected
+            task->status = PBIO_ERROR_NO_DEV;
+            PT_EXIT(pt);
+        }
+        !handset->write_pending;
+    }));
+
+    if (value->size > sizeof(handset->write_data)) {
+        task->status = PBIO_ERROR_INVALID_ARG;
+        PT_EXIT(pt);
+    }
 
-    uint8_t err = gatt_client_write_value_of_characteristic(packet_handler,
-        handset.con_handle, handset.lwp3_char.value_handle, value->size, value->data);
+    // The GATT client uses the value until GATT_EVENT_QUERY_COMPLETE, so it
+    // gets a copy that stays valid if this task is canceled.
+    memcpy(handset->write_data, value->data, value->size);
+
+    uint8_t err = gatt_client_write_value_of_characteristic(handle_gatt_client_event,
+        handset->con_handle, handset->lwp3_char.value_handle, value->size, handset->write_data);
 
     if (err != ERROR_CODE_SUCCESS) {
         task->status = PBIO_ERROR_FAILED;
         PT_EXIT(pt);
     }
 
-    // NB: Value buffer must remain valid until GATT_EVENT_QUERY_COMPLETE, so
-    // this wait is not cancelable.
+    handset->write_pending = true;
+
     PT_WAIT_UNTIL(pt, ({
-        if (handset.con_handle == HCI_CON_HANDLE_INVALID) {
+        if (task->cancel) {
+            // The write request can't be taken back. handle_gatt_client_event()
+            // clears write_pending when it is done and the next write waits
+            // for that.
+            task->status = PBIO_ERROR_CANCELED;
+            PT_EXIT(pt);
+        }
+        if (handset->con_handle == HCI_CON_HANDLE_INVALID) {
             // disconnected
             task->status = PBIO_ERROR_NO_DEV;
             PT_EXIT(pt);
         }
         event_packet &&
         hci_event_packet_get_type(event_packet) == GATT_EVENT_QUERY_COMPLETE &&
-        gatt_event_query_complete_get_handle(event_packet) == handset.con_handle;
+        gatt_event_query_complete_get_handle(event_packet) == handset->con_handle;
     }));
 
     uint8_t status = gatt_event_query_complete_get_att_status(event_packet);
@@ -726,13 +912,18 @@ static PT_THREAD(write_remote_task(struct pt *pt, pbio_task_t *task)) {
     PT_END(pt);
 }
 
-void pbdrv_bluetooth_write_remote(pbio_task_t *task, pbdrv_bluetooth_value_t *value) {
-    start_task(task, write_remote_task, value);
+void pbdrv_bluetooth_write_remote(pbio_task_t *task, uint8_t peripheral, pbdrv_bluetooth_value_t *value) {
+    pup_handset_t *handset = &handsets[peripheral];
+
+    handset->write_value = value;
+    start_task(task, write_remote_task, handset);
 }
 
-void pbdrv_bluetooth_disconnect_remote(void) {
-    if (handset.con_handle != HCI_CON_HANDLE_INVALID) {
-        gap_disconnect(handset.con_handle);
+void pbdrv_bluetooth_disconnect_remote(uint8_t peripheral) {
+    pup_handset_t *handset = &handsets[peripheral];
+
+    if (handset->con_handle != HCI_CON_HANDLE_INVALID) {
+        gap_disconnect(handset->con_handle);
     }
 }
 
@@ -759,8 +950,15 @@ static PT_THREAD(start_broadcasting_task(struct pt *pt, pbio_task_t *task)) {
         is_broadcasting = true;
     }
 
-    // Wait advertising enable command to complete.
-    PT_WAIT_UNTIL(pt, event_packet && HCI_EVENT_IS_COMMAND_COMPLETE(event_packet, hci_le_set_advertising_data));
+    // Wait advertising enable command to complete. Advertising stays on if
+    // this is canceled, like it would if the caller had not waited.
+    PT_WAIT_UNTIL(pt, ({
+        if (task->cancel) {
+            task->status = PBIO_ERROR_CANCELED;
+            PT_EXIT(pt);
+        }
+        event_packet && HCI_EVENT_IS_COMMAND_COMPLETE(event_packet, hci_le_set_advertising_data);
+    }));
 
     task->status = PBIO_SUCCESS;
 
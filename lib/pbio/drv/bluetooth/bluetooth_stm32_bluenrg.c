@@ -35,6 +35,8 @@
 #include <hci_le.h>
 #include <hci_tl.h>
 
+#include "./bluetooth.h"
+
 // hub name goes in special section so that it can be modified when flashing firmware
 __attribute__((section(".name")))
 char pbdrv_bluetooth_hub_name[16] = "Pybricks Hub";
@@ -93,6 +95,8 @@ static bool hci_command_status;
 static bool advertising_data_received;
 // handle to connected Bluetooth device
 static uint16_t conn_handle;
+// connection interval to be requested by update_connection_parameters()
+static pbdrv_bluetooth_connection_interval_t conn_interval;
 // handle to connected remote control
 static uint16_t remote_handle;
 // handle to LWP3 characteristic on remote
@@ -227,8 +231,18 @@ static void spi_init(void) {
     NVIC_EnableIRQ(EXTI2_3_IRQn);
 }
 
+/**
+ * Wakes up the SPI process so that a canceled task can clean up right away.
+ *
+ * @param [in]  task    The task.
+ */
+static void cancel_task(pbio_task_t *task) {
+    process_poll(&pbdrv_bluetooth_spi_process);
+}
+
 static void start_task(pbio_task_t *task, pbio_task_thread_t thread, void *context) {
     pbio_task_init(task, thread, context);
+    task->on_cancel = cancel_task;
     list_add(task_queue, task);
     process_poll(&pbdrv_bluetooth_spi_process);
 }
@@ -403,12 +417,58 @@ void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context) {
     start_task(&task, send_value_notification, context);
 }
 
-void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    receive_handler = handler;
+uint16_t pbdrv_bluetooth_get_mtu_size(void) {
+    // BlueNRG-MS firmware does not support MTU exchange
+    return ATT_MTU;
+}
+
+/**
+ * Sends an L2CAP Connection Parameter Update Request to the central.
+ */
+static PT_THREAD(update_connection_parameters(struct pt *pt, pbio_task_t *task)) {
+    PT_BEGIN(pt);
+
+    if (!conn_handle) {
+        task->status = PBIO_ERROR_INVALID_OP;
+        PT_EXIT(pt);
+    }
+
+    PT_WAIT_WHILE(pt, write_xfer_size);
+
+    {
+        // conn_interval is read here rather than when the task is started
+        // since it may have been changed while waiting for the previous task
+        const pbdrv_bluetooth_connection_parameters_t *params =
+            pbdrv_bluetooth_get_connection_parameters(conn_interval);
+
+        aci_l2cap_connection_parameter_update_request_begin(conn_handle,
+            params->interval_min, params->interval_max, params->latency, params->timeout);
+    }
+    PT_WAIT_UNTIL(pt, hci_command_status);
+    task->status = ble_error_to_pbio_error(aci_l2cap_connection_parameter_update_request_end());
+
+    PT_END(pt);
 }
 
-void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    notification_handler = handler;
+void pbdrv_bluetooth_request_connection_interval(pbdrv_bluetooth_connection_interval_t interval) {
+    static pbio_task_t task;
+
+    if (!conn_handle) {
+        return;
+    }
+
+    conn_interval = interval;
+
+    // if a request is already queued, it will pick up the new interval
+    if (task.status == PBIO_ERROR_AGAIN) {
+        return;
+    }
+
+    start_task(&task, update_connection_parameters, NULL);
+}
+
+void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
+    receive_handler = handler;
 }
 
 static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
@@ -416,6 +476,14 @@ static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
 
     PT_BEGIN(pt);
 
+    // there is only one peripheral slot
+    if (remote_handle) {
+        task->status = PBIO_ERROR_BUSY;
+        PT_EXIT(pt);
+    }
+
+    notification_handler = context->notification_handler;
+
     // observing while connected to another device is not going to work
     if (is_observing) {
         task->status = PBIO_ERROR_INVALID_OP;
@@ -625,6 +693,7 @@ end_cancel:
 }
 
 void pbdrv_bluetooth_scan_and_connect(pbio_task_t *task, pbdrv_bluetooth_scan_and_connect_context_t *context) {
+    context->peripheral = 0;
     start_task(task, scan_and_connect_task, context);
 }
 
@@ -666,7 +735,7 @@ static PT_THREAD(write_remote_task(struct pt *pt, pbio_task_t *task)) {
     PT_END(pt);
 }
 
-void pbdrv_bluetooth_write_remote(pbio_task_t *task, pbdrv_bluetooth_value_t *value) {
+void pbdrv_bluetooth_write_remote(pbio_task_t *task, uint8_t peripheral, pbdrv_bluetooth_value_t *value) {
     start_task(task, write_remote_task, value);
 }
 
@@ -691,7 +760,7 @@ done:
     PT_END(pt);
 }
 
-void pbdrv_bluetooth_disconnect_remote(void) {
+void pbdrv_bluetooth_disconnect_remote(uint8_t peripheral) {
     static pbio_task_t task;
     start_task(&task, disconnect_remote_task, NULL);
 }
@@ -1450,10 +1519,8 @@ PROCESS_THREAD(pbdrv_bluetooth_spi_process, ev, data) {
 
         pbio_task_t *task;
         while ((task = list_pop(task_queue)) != NULL) {
-            if (task->status == PBIO_ERROR_AGAIN) {
-                task->status = PBIO_ERROR_CANCELED;
-                // REVISIT: may need to call done() callbacks here?
-            }
+            // REVISIT: may need to call done() callbacks here?
+            pbio_task_abort(task);
         }
 
         PROCESS_EXIT();
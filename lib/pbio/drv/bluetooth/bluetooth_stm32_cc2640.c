@@ -21,6 +21,7 @@
 #include <pbdrv/gpio.h>
 #include <pbdrv/random.h>
 #include <pbio/error.h>
+#include <pbio/int_math.h>
 #include <pbio/protocol.h>
 #include <pbio/task.h>
 #include <pbio/util.h>
@@ -42,6 +43,7 @@
 #include <util.h>
 
 #include "./bluetooth_stm32_cc2640.h"
+#include "./bluetooth.h"
 
 #define DEBUG 0
 #if DEBUG == 1
@@ -132,6 +134,10 @@ static bool device_discovery_done;
 static bool advertising_data_received;
 // handle to connected Bluetooth device
 static uint16_t conn_handle = NO_CONNECTION;
+// negotiated ATT MTU of connected Bluetooth device
+static uint16_t conn_mtu = ATT_MTU_SIZE;
+// connection interval to be requested by update_connection_parameters()
+static pbdrv_bluetooth_connection_interval_t conn_interval;
 // handle to connected remote control
 static uint16_t remote_handle = NO_CONNECTION;
 // handle to LWP3 characteristic on remote
@@ -182,8 +188,18 @@ static pbio_error_t ble_error_to_pbio_error(HCI_StatusCodes_t status) {
     }
 }
 
+/**
+ * Wakes up the SPI process so that a canceled task can clean up right away.
+ *
+ * @param [in]  task    The task.
+ */
+static void cancel_task(pbio_task_t *task) {
+    process_poll(&pbdrv_bluetooth_spi_process);
+}
+
 static void start_task(pbio_task_t *task, pbio_task_thread_t thread, void *context) {
     pbio_task_init(task, thread, context);
+    task->on_cancel = cancel_task;
     list_add(task_queue, task);
     process_poll(&pbdrv_bluetooth_spi_process);
 }
@@ -461,12 +477,90 @@ void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context) {
     start_task(&task, send_value_notification, context);
 }
 
-void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    receive_handler = handler;
+uint16_t pbdrv_bluetooth_get_mtu_size(void) {
+    return conn_mtu;
 }
 
-void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t handler) {
-    notification_handler = handler;
+/**
+ * Sends an L2CAP Connection Parameter Update Request to the central.
+ */
+static PT_THREAD(update_connection_parameters(struct pt *pt, pbio_task_t *task)) {
+    PT_BEGIN(pt);
+
+    if (conn_handle == NO_CONNECTION) {
+        task->status = PBIO_ERROR_INVALID_OP;
+        PT_EXIT(pt);
+    }
+
+    PT_WAIT_WHILE(pt, write_xfer_size);
+
+    {
+        // conn_interval is read here rather than when the task is started
+        // since it may have been changed while waiting for the previous task
+        const pbdrv_bluetooth_connection_parameters_t *params =
+            pbdrv_bluetooth_get_connection_parameters(conn_interval);
+
+        gapUpdateLinkParamReq_t req = {
+            .connectionHandle = conn_handle,
+            .intervalMin = params->interval_min,
+            .intervalMax = params->interval_max,
+            .connLatency = params->latency,
+            .connTimeout = params->timeout,
+        };
+        GAP_UpdateLinkParamReq(&req);
+    }
+    PT_WAIT_UNTIL(pt, hci_command_status);
+    // ignoring response data
+
+    task->status = PBIO_SUCCESS;
+
+    PT_END(pt);
+}
+
+void pbdrv_bluetooth_request_connection_interval(pbdrv_bluetooth_connection_interval_t interval) {
+    static pbio_task_t task;
+
+    if (conn_handle == NO_CONNECTION) {
+        return;
+    }
+
+    conn_interval = interval;
+
+    // if a request is already queued, it will pick up the new interval
+    if (task.status == PBIO_ERROR_AGAIN) {
+        return;
+    }
+
+    start_task(&task, update_connection_parameters, NULL);
+}
+
+/**
+ * Requests the largest link layer payload so that notifications using the
+ * negotiated MTU don't have to be split over several packets.
+ */
+static PT_THREAD(set_data_length(struct pt *pt, pbio_task_t *task)) {
+    PT_BEGIN(pt);
+
+    if (conn_handle == NO_CONNECTION) {
+        task->status = PBIO_ERROR_INVALID_OP;
+        PT_EXIT(pt);
+    }
+
+    PT_WAIT_WHILE(pt, write_xfer_size);
+    // 251 bytes is the maximum LL payload, 2120 us is the time it takes to
+    // send that many bytes on the LE 1M PHY.
+    HCI_LE_setDataLength(conn_handle, 251, 2120);
+    PT_WAIT_UNTIL(pt, hci_command_complete);
+    // ignoring response data - the central may not support it, in which case
+    // the default of 27 bytes is used
+
+    task->status = PBIO_SUCCESS;
+
+    PT_END(pt);
+}
+
+void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
+    receive_handler = handler;
 }
 
 static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
@@ -474,6 +568,14 @@ static PT_THREAD(scan_and_connect_task(struct pt *pt, pbio_task_t *task)) {
 
     PT_BEGIN(pt);
 
+    // there is only one peripheral slot
+    if (remote_handle != NO_CONNECTION) {
+        task->status = PBIO_ERROR_BUSY;
+        PT_EXIT(pt);
+    }
+
+    notification_handler = context->notification_handler;
+
     // temporarily stop observing so we can active scan
     if (is_observing) {
         PT_WAIT_WHILE(pt, write_xfer_size);
@@ -722,6 +824,7 @@ out:
 }
 
 void pbdrv_bluetooth_scan_and_connect(pbio_task_t *task, pbdrv_bluetooth_scan_and_connect_context_t *context) {
+    context->peripheral = 0;
     start_task(task, scan_and_connect_task, context);
 }
 
@@ -794,7 +897,7 @@ cancel:
     PT_END(pt);
 }
 
-void pbdrv_bluetooth_write_remote(pbio_task_t *task, pbdrv_bluetooth_value_t *value) {
+void pbdrv_bluetooth_write_remote(pbio_task_t *task, uint8_t peripheral, pbdrv_bluetooth_value_t *value) {
     start_task(task, write_remote_task, value);
 }
 
@@ -812,7 +915,7 @@ static PT_THREAD(disconnect_remote_task(struct pt *pt, pbio_task_t *task)) {
     PT_END(pt);
 }
 
-void pbdrv_bluetooth_disconnect_remote(void) {
+void pbdrv_bluetooth_disconnect_remote(uint8_t peripheral) {
     static pbio_task_t task;
     start_task(&task, disconnect_remote_task, NULL);
 }
@@ -1090,13 +1193,17 @@ static void handle_event(uint8_t *packet) {
 
             switch (event_code) {
                 case ATT_EVENT_EXCHANGE_MTU_REQ: {
-                    // uint16_t client_mtu = (data[7] << 8) | data[6];
+                    uint16_t client_mtu = (data[7] << 8) | data[6];
                     attExchangeMTURsp_t rsp;
 
                     rsp.serverRxMTU = PBDRV_BLUETOOTH_MAX_MTU_SIZE;
-                    // REVISIT: may need to keep a table of min(client_mtu, MAX_ATT_MTU_SIZE)
-                    // for each connection if any known clients have smaller MTU
                     ATT_ExchangeMTURsp(connection_handle, &rsp);
+
+                    // REVISIT: may need to keep a table of min(client_mtu, MAX_ATT_MTU_SIZE)
+                    // for each connection if we ever allow more than one central
+                    if (connection_handle == conn_handle) {
+                        conn_mtu = pbio_int_math_bind(client_mtu, ATT_MTU_SIZE, PBDRV_BLUETOOTH_MAX_MTU_SIZE);
+                    }
                 }
                 break;
 
@@ -1442,6 +1549,8 @@ static void handle_event(uint8_t *packet) {
                         conn_handle = (data[11] << 8) | data[10];
                         DBG("link: %04x", conn_handle);
 
+                        conn_mtu = ATT_MTU_SIZE;
+
                         // On 2019 and newer MacBooks, the default interval was
                         // measured to be 15 ms. This caused advertisement to
                         // not be received by the local Bluetooth chip when
@@ -1451,16 +1560,13 @@ static void handle_event(uint8_t *packet) {
                         // interval to presumably make more room for receiving
                         // advertising data. There are a number of requirements
                         // in the Apple spec, such as the interval must be a
-                        // multiple of 15 ms.
+                        // multiple of 15 ms. pbsys may request a shorter
+                        // interval later while there is a lot of traffic.
                         // [1]: https://developer.apple.com/accessories/Accessory-Design-Guidelines.pdf
-                        gapUpdateLinkParamReq_t req = {
-                            .connectionHandle = conn_handle,
-                            .intervalMin = 24, // 24 * 1.25 ms = 30 ms
-                            .intervalMax = 48, // 48 * 1.25 ms = 60 ms
-                            .connLatency = 0,
-                            .connTimeout = 500, // 500 * 10 ms = 5 s
-                        };
-                        GAP_UpdateLinkParamReq(&req);
+                        pbdrv_bluetooth_request_connection_interval(PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE);
+
+                        static pbio_task_t data_length_task;
+                        start_task(&data_length_task, set_data_length, NULL);
                     } else if (data[12] == GAP_PROFILE_CENTRAL) {
                         // we currently only allow connection to one LEGO Powered Up remote peripheral
                         remote_handle = (data[11] << 8) | data[10];
@@ -1471,6 +1577,7 @@ static void handle_event(uint8_t *packet) {
                     DBG("bye: %04x", connection_handle);
                     if (conn_handle == connection_handle) {
                         conn_handle = NO_CONNECTION;
+                        conn_mtu = ATT_MTU_SIZE;
                         pybricks_notify_en = false;
                         uart_tx_notify_en = false;
                     } else if (remote_handle == connection_handle) {
@@ -1975,14 +2082,13 @@ PROCESS_THREAD(pbdrv_bluetooth_spi_process, ev, data) {
         bluetooth_reset(RESET_STATE_OUT_LOW);
         bluetooth_ready = pybricks_notify_en = uart_tx_notify_en = is_broadcasting = is_observing = false;
         conn_handle = remote_handle = remote_lwp3_char_handle = NO_CONNECTION;
+        conn_mtu = ATT_MTU_SIZE;
 
         pbio_task_t *task;
         while ((task = list_pop(task_queue)) != NULL) {
-            if (task->status == PBIO_ERROR_AGAIN) {
-                task->status = PBIO_ERROR_CANCELED;
-                // REVISIT: some tasks have done() callback that probably needs
-                // to be called here
-            }
+            // REVISIT: some tasks have done() callback that probably needs
+            // to be called here
+            pbio_task_abort(task);
         }
 
         PROCESS_EXIT();
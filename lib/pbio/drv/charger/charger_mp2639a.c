@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2021-2022 The Pybricks Authors
+// Copyright (c) 2021-2023 The Pybricks Authors
 
 // driver for MPS MP2639A USB battery charger chip
 
@@ -20,7 +20,9 @@
 #include <contiki.h>
 
 #include <pbdrv/adc.h>
+#include <pbdrv/battery.h>
 #include <pbdrv/charger.h>
+#include <pbdrv/clock.h>
 #include <pbdrv/gpio.h>
 #if PBDRV_CONFIG_CHARGER_MP2639A_MODE_PWM | PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
 #include <pbdrv/pwm.h>
@@ -33,6 +35,7 @@
 
 #include "../core.h"
 #include "charger_mp2639a.h"
+#include "charger_session.h"
 
 #define platform pbdrv_charger_mp2639a_platform_data
 
@@ -47,6 +50,24 @@ static pbdrv_pwm_dev_t *iset_pwm;
 
 static pbdrv_charger_status_t pbdrv_charger_status;
 static bool mode_pin_is_low;
+// Charging requested by the system, i.e. a charger is connected.
+static bool charge_requested;
+// Charging allowed by the end-of-charge detection.
+static bool charge_allowed = true;
+// Current limit requested by the system.
+static pbdrv_charger_limit_t charge_limit;
+static pbdrv_charger_session_t session;
+
+#if PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
+// ISET duty cycle for each pbdrv_charger_limit_t. The values are hard-coded
+// for SPIKE Prime hardware.
+static const uint8_t iset_duty_cycle[] = {
+    [PBDRV_CHARGER_LIMIT_NONE] = 0,
+    [PBDRV_CHARGER_LIMIT_STD_MIN] = 2, // 100 mA
+    [PBDRV_CHARGER_LIMIT_STD_MAX] = 15, // 500 mA
+    [PBDRV_CHARGER_LIMIT_CHARGING] = 100, // max duty cycle
+};
+#endif
 
 void pbdrv_charger_init(void) {
     pbdrv_init_busy_up();
@@ -60,42 +81,31 @@ pbio_error_t pbdrv_charger_get_current_now(uint16_t *current) {
     }
 
     // Scaling from raw to mA determined empirically by measuring USB current
-    // on a few hubs.
-    *current = (*current * 35116 >> 16) - 123;
+    // on a few hubs. The offset would make small values wrap around.
+    int32_t scaled = (*current * 35116 >> 16) - 123;
+    *current = scaled < 0 ? 0 : scaled;
 
     return PBIO_SUCCESS;
 }
 
 pbdrv_charger_status_t pbdrv_charger_get_status(void) {
+    // MODE is high while charging is held off after the end of charge, which
+    // would otherwise look like discharging.
+    if (charge_requested && !charge_allowed) {
+        return PBDRV_CHARGER_STATUS_COMPLETE;
+    }
     return pbdrv_charger_status;
 }
 
-void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit) {
-    #if PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
-
-    // Set the current limit (ISET) based on the type of charger attached.
-    // The duty cycle values are hard-coded for SPIKE Prime hardware.
-
-    uint32_t duty_cycle;
-    switch (limit) {
-        case PBDRV_CHARGER_LIMIT_CHARGING:
-            duty_cycle = 100; // max duty cycle
-            break;
-        case PBDRV_CHARGER_LIMIT_STD_MAX:
-            duty_cycle = 15; // 500 mA
-            break;
-        case PBDRV_CHARGER_LIMIT_STD_MIN:
-            duty_cycle = 2; // 100 mA
-            break;
-        default:
-            duty_cycle = 0;
-            break;
-    }
-
-    pbdrv_pwm_set_duty(iset_pwm, platform.iset_pwm_ch, duty_cycle);
-
-    #endif // PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
+pbio_error_t pbdrv_charger_get_session(const pbdrv_charger_session_t **session_out) {
+    *session_out = &session;
+    return PBIO_SUCCESS;
+}
 
+/**
+ * Sets the MODE pin to start (low) or stop (high) charging.
+ */
+static void set_mode(bool enable) {
     #if PBDRV_CONFIG_CHARGER_MP2639A_MODE_PWM
 
     // REVISIT: only known use has max duty cycle of UINT16_MAX
@@ -116,6 +126,48 @@ void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit) {
     mode_pin_is_low = enable;
 }
 
+void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit) {
+    #if PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
+
+    // Set the current limit (ISET) based on the type of charger attached.
+    if (limit >= PBIO_ARRAY_SIZE(iset_duty_cycle)) {
+        limit = PBDRV_CHARGER_LIMIT_NONE;
+    }
+    pbdrv_pwm_set_duty(iset_pwm, platform.iset_pwm_ch, iset_duty_cycle[limit]);
+
+    #endif // PBDRV_CONFIG_CHARGER_MP2639A_ISET_PWM
+
+    charge_requested = enable;
+    charge_limit = limit;
+    set_mode(enable && charge_allowed);
+}
+
+/**
+ * Feeds the latest measurements to the charge session log.
+ */
+static void update_session(void) {
+    pbdrv_charger_session_input_t input = {
+        .time = pbdrv_clock_get_ms(),
+        .enable = charge_requested,
+        .status = pbdrv_charger_status,
+        .limit = charge_limit,
+    };
+
+    uint32_t temperature;
+    if (pbdrv_charger_get_current_now(&input.current) != PBIO_SUCCESS) {
+        input.current = 0;
+    }
+    if (pbdrv_battery_get_voltage_now(&input.voltage) != PBIO_SUCCESS) {
+        input.voltage = 0;
+    }
+    if (pbdrv_battery_get_temperature(&temperature) == PBIO_SUCCESS) {
+        input.temperature = temperature;
+    }
+
+    charge_allowed = pbdrv_charger_session_update(&session, &input) || !charge_requested;
+    set_mode(charge_requested && charge_allowed);
+}
+
 /**
  * Gets the current CHG signal status (inverted compared to /CHG pin state).
  */
@@ -150,6 +202,7 @@ PROCESS_THREAD(pbdrv_charger_mp2639a_process, ev, data) {
     }
     #endif
 
+    pbdrv_charger_session_reset(&session);
     pbdrv_charger_enable(false, PBDRV_CHARGER_LIMIT_NONE);
 
     #if !PBDRV_CONFIG_CHARGER_MP2639A_CHG_RESISTOR_LADDER
@@ -165,6 +218,7 @@ PROCESS_THREAD(pbdrv_charger_mp2639a_process, ev, data) {
 
     static bool chg_samples[7];
     static uint8_t chg_index = 0;
+    static uint8_t session_ticks = 0;
     static struct etimer timer;
 
     // sample at 4Hz
@@ -211,6 +265,12 @@ PROCESS_THREAD(pbdrv_charger_mp2639a_process, ev, data) {
         if (++chg_index >= PBIO_ARRAY_SIZE(chg_samples)) {
             chg_index = 0;
         }
+
+        // Update the session log once per second.
+        if (++session_ticks >= 4) {
+            session_ticks = 0;
+            update_session();
+        }
     }
 
     PROCESS_END();
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Charge session logging and end-of-charge detection.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CHARGER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/charger.h>
+#include <pbio/util.h>
+
+#include "charger_session.h"
+
+// Charging current in mA for each pbdrv_charger_limit_t.
+static const uint16_t limit_ma[] = {
+    [PBDRV_CHARGER_LIMIT_NONE] = 0,
+    [PBDRV_CHARGER_LIMIT_STD_MIN] = 100,
+    [PBDRV_CHARGER_LIMIT_STD_MAX] = 500,
+    [PBDRV_CHARGER_LIMIT_CHARGING] = 1500,
+};
+
+/**
+ * Appends a sample to the session history.
+ *
+ * If the history is full, every other sample is dropped first and the sample
+ * interval is doubled so that the history always covers the whole session.
+ */
+static void pbdrv_charger_session_add_sample(pbdrv_charger_session_t *session, const pbdrv_charger_session_input_t *input) {
+    if (session->num_samples == PBDRV_CHARGER_SESSION_HISTORY_SIZE) {
+        for (uint16_t i = 0; i < PBDRV_CHARGER_SESSION_HISTORY_SIZE / 2; i++) {
+            session->samples[i] = session->samples[i * 2];
+        }
+        session->num_samples = PBDRV_CHARGER_SESSION_HISTORY_SIZE / 2;
+        session->interval *= 2;
+    }
+
+    pbdrv_charger_sample_t *sample = &session->samples[session->num_samples++];
+    sample->time = session->duration / 1000;
+    sample->current = input->current;
+    sample->voltage = input->voltage;
+    sample->temperature = input->temperature / 100;
+}
+
+static void pbdrv_charger_session_start(pbdrv_charger_session_t *session, const pbdrv_charger_session_input_t *input) {
+    session->active = true;
+    session->end = PBDRV_CHARGER_SESSION_END_NONE;
+    session->duration = 0;
+    session->charge = 0;
+    session->charge_remainder = 0;
+    session->taper_time = 0;
+    session->interval = PBDRV_CHARGER_SESSION_INTERVAL;
+    session->num_samples = 0;
+    pbdrv_charger_session_add_sample(session, input);
+}
+
+static void pbdrv_charger_session_end(pbdrv_charger_session_t *session, pbdrv_charger_session_end_t end) {
+    session->active = false;
+    session->end = end;
+}
+
+/**
+ * Clears the session log.
+ *
+ * @param [in]  session     The session.
+ */
+void pbdrv_charger_session_reset(pbdrv_charger_session_t *session) {
+    *session = (pbdrv_charger_session_t) {
+        .end = PBDRV_CHARGER_SESSION_END_NONE,
+        .interval = PBDRV_CHARGER_SESSION_INTERVAL,
+    };
+}
+
+/**
+ * Gets the safety limit for the duration of a session.
+ *
+ * This is ::PBDRV_CHARGER_SESSION_MAX_TIME_MS, or twice the time it takes to
+ * charge an empty ::PBDRV_CHARGER_SESSION_CAPACITY_MAH battery at the limited
+ * current if that is longer, so that a normal charge from a standard USB port
+ * does not time out.
+ *
+ * @param [in]  limit       The current limit.
+ * @return                  The maximum duration in ms.
+ */
+uint32_t pbdrv_charger_session_get_max_time(pbdrv_charger_limit_t limit) {
+    if (limit >= PBIO_ARRAY_SIZE(limit_ma) || limit_ma[limit] == 0) {
+        return PBDRV_CHARGER_SESSION_MAX_TIME_MS;
+    }
+
+    uint32_t time = PBDRV_CHARGER_SESSION_CAPACITY_MAH * 2 * 3600 / limit_ma[limit] * 1000;
+    return time > PBDRV_CHARGER_SESSION_MAX_TIME_MS ? time : PBDRV_CHARGER_SESSION_MAX_TIME_MS;
+}
+
+/**
+ * Updates the session log and checks for the end of charge.
+ *
+ * This should be called periodically, about once per second.
+ *
+ * The charger chip ends charging on its own, but a hub that keeps drawing
+ * current from the charger can keep the chip from seeing the current taper
+ * off. So this also ends the session when the current stays low at the full
+ * charge voltage and then holds off charging until the battery voltage drops
+ * below ::PBDRV_CHARGER_SESSION_RECHARGE_MV or the charger is disconnected.
+ *
+ * @param [in]  session     The session.
+ * @param [in]  input       The latest measurements.
+ * @return                  True if the charger should be enabled.
+ */
+bool pbdrv_charger_session_update(pbdrv_charger_session_t *session, const pbdrv_charger_session_input_t *input) {
+    uint32_t elapsed = input->time - session->last_time;
+    session->last_time = input->time;
+
+    if (!input->enable) {
+        if (session->active) {
+            pbdrv_charger_session_end(session, PBDRV_CHARGER_SESSION_END_DISCONNECTED);
+        }
+        session->hold_off = false;
+        return false;
+    }
+
+    if (session->hold_off) {
+        // A battery that timed out is not charged again until the charger
+        // is reconnected.
+        if (session->end == PBDRV_CHARGER_SESSION_END_TIMEOUT || input->voltage >= PBDRV_CHARGER_SESSION_RECHARGE_MV) {
+            return false;
+        }
+        session->hold_off = false;
+    }
+
+    if (!session->active) {
+        if (input->status == PBDRV_CHARGER_STATUS_CHARGE) {
+            pbdrv_charger_session_start(session, input);
+        }
+        return true;
+    }
+
+    session->duration += elapsed;
+    session->charge_remainder += input->current * elapsed;
+    session->charge += session->charge_remainder / 1000;
+    session->charge_remainder %= 1000;
+
+    if (session->duration >= (uint32_t)session->num_samples * session->interval * 1000) {
+        pbdrv_charger_session_add_sample(session, input);
+    }
+
+    if (input->status == PBDRV_CHARGER_STATUS_FAULT) {
+        pbdrv_charger_session_end(session, PBDRV_CHARGER_SESSION_END_FAULT);
+        return true;
+    }
+
+    if (input->status == PBDRV_CHARGER_STATUS_COMPLETE) {
+        pbdrv_charger_session_end(session, PBDRV_CHARGER_SESSION_END_COMPLETE);
+        return true;
+    }
+
+    if (input->voltage >= PBDRV_CHARGER_SESSION_TAPER_MV && input->current < PBDRV_CHARGER_SESSION_TAPER_MA) {
+        session->taper_time += elapsed;
+        if (session->taper_time >= PBDRV_CHARGER_SESSION_TAPER_TIME_MS) {
+            pbdrv_charger_session_end(session, PBDRV_CHARGER_SESSION_END_TAPER);
+            session->hold_off = true;
+            return false;
+        }
+    } else {
+        session->taper_time = 0;
+    }
+
+    if (session->duration >= pbdrv_charger_session_get_max_time(input->limit)) {
+        pbdrv_charger_session_end(session, PBDRV_CHARGER_SESSION_END_TIMEOUT);
+        session->hold_off = true;
+        return false;
+    }
+
+    return true;
+}
+
+#endif // PBDRV_CONFIG_CHARGER
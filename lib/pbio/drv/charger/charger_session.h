@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Charge session logging and end-of-charge detection.
+//
+// These functions only depend on the inputs they are given, so the state
+// machine can be tested on the host with a simulated charger.
+
+#ifndef _INTERNAL_PBDRV_CHARGER_SESSION_H_
+#define _INTERNAL_PBDRV_CHARGER_SESSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/charger.h>
+
+/** Voltage above which the charger is in the constant voltage phase (2 cells). */
+#define PBDRV_CHARGER_SESSION_TAPER_MV          8200
+/** Current below which charging is considered done in the constant voltage phase. */
+#define PBDRV_CHARGER_SESSION_TAPER_MA          100
+/** How long the current has to stay below ::PBDRV_CHARGER_SESSION_TAPER_MA. */
+#define PBDRV_CHARGER_SESSION_TAPER_TIME_MS     (60 * 1000)
+/** Voltage below which charging is resumed after a session ended. */
+#define PBDRV_CHARGER_SESSION_RECHARGE_MV       8000
+/** Safety limit for the duration of a session at the full charging current. */
+#define PBDRV_CHARGER_SESSION_MAX_TIME_MS       (5 * 60 * 60 * 1000)
+/** Capacity of the largest battery that is charged, used to extend the safety limit at lower currents. */
+#define PBDRV_CHARGER_SESSION_CAPACITY_MAH      2100
+/** Initial time between history samples in seconds. */
+#define PBDRV_CHARGER_SESSION_INTERVAL          30
+
+/** Measurements passed to ::pbdrv_charger_session_update. */
+typedef struct {
+    /** Clock time in ms. */
+    uint32_t time;
+    /** True if the system wants to charge (i.e. a charger is connected). */
+    bool enable;
+    /** Status of the charger chip while charging is enabled. */
+    pbdrv_charger_status_t status;
+    /** Current limit given to ::pbdrv_charger_enable. */
+    pbdrv_charger_limit_t limit;
+    /** Charging current in mA. */
+    uint16_t current;
+    /** Battery voltage in mV. */
+    uint16_t voltage;
+    /** Battery temperature in millidegrees Celsius. */
+    int32_t temperature;
+} pbdrv_charger_session_input_t;
+
+void pbdrv_charger_session_reset(pbdrv_charger_session_t *session);
+
+uint32_t pbdrv_charger_session_get_max_time(pbdrv_charger_limit_t limit);
+
+bool pbdrv_charger_session_update(pbdrv_charger_session_t *session, const pbdrv_charger_session_input_t *input);
+
+#endif // _INTERNAL_PBDRV_CHARGER_SESSION_H_
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Software charger implementation for tests. It does not charge anything, but
+// records how the system configured it.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CHARGER_TEST
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/charger.h>
+#include <pbio/error.h>
+
+#include "charger_session.h"
+#include "charger_test.h"
+
+static bool test_charger_enable;
+static pbdrv_charger_limit_t test_charger_limit;
+static pbdrv_charger_session_t session;
+
+/**
+ * Gets the most recent arguments of ::pbdrv_charger_enable.
+ * @param [out] enable  Whether charging is enabled.
+ * @param [out] limit   The current limit.
+ */
+void pbdrv_charger_test_get_enable(bool *enable, pbdrv_charger_limit_t *limit) {
+    *enable = test_charger_enable;
+    *limit = test_charger_limit;
+}
+
+void pbdrv_charger_init(void) {
+    test_charger_enable = false;
+    test_charger_limit = PBDRV_CHARGER_LIMIT_NONE;
+    pbdrv_charger_session_reset(&session);
+}
+
+pbio_error_t pbdrv_charger_get_current_now(uint16_t *current) {
+    *current = 0;
+    return PBIO_SUCCESS;
+}
+
+pbdrv_charger_status_t pbdrv_charger_get_status(void) {
+    return PBDRV_CHARGER_STATUS_DISCHARGE;
+}
+
+void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit) {
+    test_charger_enable = enable;
+    test_charger_limit = limit;
+}
+
+pbio_error_t pbdrv_charger_get_session(const pbdrv_charger_session_t **session_out) {
+    *session_out = &session;
+    return PBIO_SUCCESS;
+}
+
+#endif // PBDRV_CONFIG_CHARGER_TEST
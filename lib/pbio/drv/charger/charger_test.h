@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#ifndef _INTERNAL_PBDRV_CHARGER_TEST_H_
+#define _INTERNAL_PBDRV_CHARGER_TEST_H_
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CHARGER_TEST
+
+#include <stdbool.h>
+
+#include <pbdrv/charger.h>
+
+// extra charger functions just for tests
+void pbdrv_charger_test_get_enable(bool *enable, pbdrv_charger_limit_t *limit);
+
+#endif // PBDRV_CONFIG_CHARGER_TEST
+
+#endif // _INTERNAL_PBDRV_CHARGER_TEST_H_
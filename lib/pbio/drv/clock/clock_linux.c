@@ -84,6 +84,215 @@ void pbdrv_clock_init(void) {
     }
 }
 
+#elif PBDRV_CONFIG_CLOCK_LINUX_TIMERFD
+
+// The TIMERFD option replaces the 1ms tick by a timer that is armed for the
+// next event timer deadline only. Together with other file descriptors such
+// as sensors, it is watched with epoll so the process sleeps until there is
+// work to do. The timer uses CLOCK_MONOTONIC, so it is not affected by changes
+// to the wall clock.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <contiki.h>
+
+#include <pbdrv/clock.h>
+#include <pbio/util.h>
+
+#define NSEC_PER_MSEC       1000000
+
+typedef struct {
+    int fd;
+    pbdrv_clock_linux_fd_callback_t callback;
+    void *context;
+} pbdrv_clock_linux_watch_t;
+
+static pbdrv_clock_linux_watch_t watches[PBDRV_CONFIG_CLOCK_LINUX_TIMERFD_NUM_FD];
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int wake_fd = -1;
+
+// Set while a wake up is written to wake_fd but not yet read.
+static bool wake_pending;
+
+void pbdrv_clock_init(void) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(watches); i++) {
+        watches[i].fd = -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        return;
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (timer_fd == -1) {
+        perror("timerfd_create");
+        return;
+    }
+
+    // The timer is the only event with a NULL pointer.
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == -1) {
+        perror("epoll_ctl");
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (wake_fd == -1) {
+        perror("eventfd");
+        return;
+    }
+
+    ev.data.ptr = &wake_fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        perror("epoll_ctl");
+    }
+}
+
+pbio_error_t pbdrv_clock_linux_add_fd(int fd, uint32_t events, pbdrv_clock_linux_fd_callback_t callback, void *context) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(watches); i++) {
+        pbdrv_clock_linux_watch_t *watch = &watches[i];
+
+        if (watch->fd != -1) {
+            continue;
+        }
+
+        watch->callback = callback;
+        watch->context = context;
+
+        struct epoll_event ev = {
+            .events = events,
+            .data.ptr = watch,
+        };
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            return PBIO_ERROR_IO;
+        }
+
+        watch->fd = fd;
+
+        return PBIO_SUCCESS;
+    }
+
+    return PBIO_ERROR_NO_DEV;
+}
+
+void pbdrv_clock_linux_remove_fd(int fd) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(watches); i++) {
+        if (watches[i].fd == fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            watches[i].fd = -1;
+            return;
+        }
+    }
+}
+
+void pbdrv_clock_linux_arm(void) {
+    // Zero value disarms the timer.
+    struct itimerspec its = { 0 };
+
+    if (etimer_pending()) {
+        // Event timer deadlines are on the pbdrv clock, so arm the timer with
+        // the remaining time instead of an absolute time. The deadline is in
+        // whole milliseconds, so compute the remaining time in microseconds
+        // to avoid waking up to 1 ms late.
+        int32_t remaining = (int32_t)(etimer_next_expiration_time() * 1000 - pbdrv_clock_get_us());
+
+        if (remaining <= 0) {
+            // Already expired, so handle it on the next event loop iteration.
+            etimer_request_poll();
+            remaining = 0;
+        }
+
+        // A zero value would disarm the timer, so expire as soon as possible.
+        its.it_value.tv_sec = remaining / 1000000;
+        its.it_value.tv_nsec = remaining % 1000000 * 1000 + (remaining ? 0 : 1);
+    }
+
+    if (timerfd_settime(timer_fd, 0, &its, NULL) == -1) {
+        perror("timerfd_settime");
+    }
+}
+
+void pbdrv_clock_linux_wake(void) {
+    // Only the first wake up before the next wait needs a system call. If two
+    // threads race here, both write, which just wakes up once more.
+    if (__atomic_load_n(&wake_pending, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    __atomic_store_n(&wake_pending, true, __ATOMIC_SEQ_CST);
+
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) == -1) {
+        perror("write");
+    }
+}
+
+bool pbdrv_clock_linux_wait(int timeout_ms, const sigset_t *sigmask) {
+    struct epoll_event events[PBDRV_CONFIG_CLOCK_LINUX_TIMERFD_NUM_FD + 2];
+    bool expired = false;
+
+    int count = epoll_pwait(epoll_fd, events, PBIO_ARRAY_SIZE(events), timeout_ms, sigmask);
+
+    if (count == -1) {
+        if (errno != EINTR) {
+            perror("epoll_pwait");
+        }
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        pbdrv_clock_linux_watch_t *watch = events[i].data.ptr;
+
+        if (!watch) {
+            // Clear the expiration count so the timer doesn't stay readable.
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                etimer_request_poll();
+                expired = true;
+            }
+            continue;
+        }
+
+        if (watch == (void *)&wake_fd) {
+            // Nothing to do except returning, so the caller handles the new
+            // events and arms the timer again. Drain the eventfd before
+            // clearing the flag. The other way around, a wake up in between
+            // would be drained too, and leave the flag set with nothing to
+            // read, so no later wake up would write again. A wake up that
+            // sees the flag still set here is fine to skip, since we are
+            // about to return and handle its events anyway.
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                perror("read");
+            }
+            __atomic_store_n(&wake_pending, false, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        if (watch->fd != -1 && watch->callback) {
+            watch->callback(watch->context, events[i].events);
+        }
+    }
+
+    return expired;
+}
+
 #else // PBDRV_CONFIG_CLOCK_LINUX_SIGNAL
 
 void pbdrv_clock_init(void) {
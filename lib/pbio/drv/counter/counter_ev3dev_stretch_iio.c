@@ -4,14 +4,29 @@
 // ev3dev-stretch PRU/IIO Quadrature Encoder Counter driver
 //
 // This driver uses the PRU quadrature encoder found in ev3dev-stretch.
+//
+// When PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED is enabled, the counts
+// of all channels are captured using the IIO buffer interface. The kernel
+// pushes binary samples with a timestamp to the character device on each
+// trigger, so all motors are updated with a single non-blocking read. If the
+// buffer can't be set up, the driver falls back to polling the text attributes
+// in sysfs for each channel.
+//
+// Finding the device with udev and setting up the buffer takes a while, so it
+// is postponed until a counter is first requested. Programs that don't use
+// motors don't pay for it.
 
 #include <pbdrv/config.h>
 
 #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <libudev.h>
 
@@ -28,23 +43,331 @@
 #define dbg_err(s)
 #endif
 
+// If values were read less than this long ago, return those again.
+#define COUNTER_CACHE_TIME_US (2000)
+
 struct _pbdrv_counter_dev_t {
     FILE *count;
     uint32_t time_us_last;
     int32_t rotations_last;
     int32_t millidegrees_last;
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED
+    /** Byte offset of this channel in a buffered scan sample. */
+    size_t scan_offset;
+    #endif
 };
 
 static pbdrv_counter_dev_t private_data[PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV];
 
+// Whether pbdrv_counter_setup() has been called.
+static bool setup_done;
+
+static void pbdrv_counter_setup(void);
+
+#if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED
+
+// Samples older than this are considered stale (e.g. trigger stopped), in
+// which case we fall back to reading the sysfs attribute.
+#define COUNTER_BUFFER_STALE_TIME_US (20000)
+
+// Number of samples the kernel may queue between two reads.
+#define COUNTER_BUFFER_LENGTH (16)
+
+// Each count is a 32-bit value and the timestamp is a 64-bit value aligned to
+// 8 bytes, so a full scan is never larger than this.
+#define COUNTER_SCAN_SIZE_MAX (PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV * sizeof(int32_t) + 2 * sizeof(int64_t))
+
+static struct {
+    /** Non-blocking file descriptor of the IIO character device or -1. */
+    int fd;
+    /** Size of one scan sample in bytes. */
+    size_t scan_size;
+    /** Byte offset of the timestamp in a scan sample. */
+    size_t timestamp_offset;
+    /** Time of the most recent sample on the pbdrv clock. */
+    uint32_t sample_time_us;
+    /** Whether at least one sample has been received. */
+    bool has_sample;
+    /** Latest raw counts of all channels. */
+    int32_t counts[PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV];
+} buffer = {
+    .fd = -1,
+};
+
+/**
+ * Reads all queued scans from the IIO buffer and keeps the latest one.
+ *
+ * @return  ::PBIO_SUCCESS if a recent sample is available, otherwise
+ *          ::PBIO_ERROR_AGAIN or ::PBIO_ERROR_IO.
+ */
+static pbio_error_t pbdrv_counter_buffer_update(void) {
+    uint8_t data[COUNTER_BUFFER_LENGTH * COUNTER_SCAN_SIZE_MAX];
+
+    // Drain everything the kernel has queued since the last update. Only the
+    // newest complete scan is relevant.
+    for (;;) {
+        ssize_t size = read(buffer.fd, data, sizeof(data));
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            return PBIO_ERROR_IO;
+        }
+
+        if ((size_t)size < buffer.scan_size) {
+            break;
+        }
+
+        const uint8_t *scan = &data[(size / buffer.scan_size - 1) * buffer.scan_size];
+
+        for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+            memcpy(&buffer.counts[i], &scan[private_data[i].scan_offset], sizeof(int32_t));
+        }
+
+        // Timestamps are in nanoseconds on CLOCK_MONOTONIC_RAW, the same
+        // clock used by pbdrv_clock_get_us, so they can be compared directly.
+        int64_t timestamp_ns;
+        memcpy(&timestamp_ns, &scan[buffer.timestamp_offset], sizeof(timestamp_ns));
+        buffer.sample_time_us = (uint32_t)(timestamp_ns / 1000);
+        buffer.has_sample = true;
+
+        if ((size_t)size < sizeof(data)) {
+            break;
+        }
+    }
+
+    if (!buffer.has_sample || pbdrv_clock_get_us() - buffer.sample_time_us > COUNTER_BUFFER_STALE_TIME_US) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+static int pbdrv_counter_write_attr(const char *syspath, const char *attr, const char *value) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+
+    int ret = fputs(value, f) < 0 ? -1 : 0;
+
+    if (fclose(f) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int pbdrv_counter_read_attr_int(const char *syspath, const char *attr, int *value) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    int ret = fscanf(f, "%d", value) == 1 ? 0 : -1;
+    fclose(f);
+
+    return ret;
+}
+
+/**
+ * Finds the name of the IIO trigger that belongs to the same parent device.
+ */
+static int pbdrv_counter_find_trigger(struct udev *udev, struct udev_device *iio_dev, char *name, size_t len) {
+    struct udev_device *parent = udev_device_get_parent(iio_dev);
+    if (!parent) {
+        return -1;
+    }
+
+    struct udev_enumerate *enumerate = udev_enumerate_new(udev);
+    if (!enumerate) {
+        return -1;
+    }
+
+    int ret = -1;
+
+    if (udev_enumerate_add_match_subsystem(enumerate, "iio") < 0 ||
+        udev_enumerate_add_match_sysname(enumerate, "trigger*") < 0 ||
+        udev_enumerate_add_match_parent(enumerate, parent) < 0 ||
+        udev_enumerate_scan_devices(enumerate) < 0) {
+        goto out;
+    }
+
+    struct udev_list_entry *entry = udev_enumerate_get_list_entry(enumerate);
+    if (!entry) {
+        goto out;
+    }
+
+    struct udev_device *trigger = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+    if (!trigger) {
+        goto out;
+    }
+
+    const char *trigger_name = udev_device_get_sysattr_value(trigger, "name");
+    if (trigger_name) {
+        snprintf(name, len, "%s", trigger_name);
+        ret = 0;
+    }
+
+    udev_device_unref(trigger);
+
+out:
+    udev_enumerate_unref(enumerate);
+    return ret;
+}
+
+/**
+ * Enables the IIO buffer for all count channels and a timestamp.
+ *
+ * On failure, the buffer stays disabled and the driver uses sysfs polling.
+ */
+static void pbdrv_counter_buffer_init(struct udev *udev, const char *syspath) {
+    char attr[64];
+    char trigger[64];
+
+    struct udev_device *iio_dev = udev_device_new_from_syspath(udev, syspath);
+    if (!iio_dev) {
+        dbg_err("udev_device_new_from_syspath failed");
+        return;
+    }
+
+    const char *devnode = udev_device_get_devnode(iio_dev);
+    if (!devnode) {
+        dbg_err("iio device has no device node");
+        goto out;
+    }
+
+    // Buffer must be disabled while it is being configured.
+    if (pbdrv_counter_write_attr(syspath, "buffer/enable", "0") == -1) {
+        dbg_err("failed to disable iio buffer");
+        goto out;
+    }
+
+    // Use the trigger provided by the tacho driver, if there is one.
+    // Otherwise keep whichever trigger is already assigned.
+    if (pbdrv_counter_find_trigger(udev, iio_dev, trigger, sizeof(trigger)) == 0 &&
+        pbdrv_counter_write_attr(syspath, "trigger/current_trigger", trigger) == -1) {
+        dbg_err("failed to set iio trigger");
+        goto out;
+    }
+
+    // Kernel timestamps on the same clock as pbdrv_clock_get_us. Older kernels
+    // don't have this attribute, in which case samples would be compared to
+    // the wrong clock, so we don't use the buffer at all.
+    if (pbdrv_counter_write_attr(syspath, "current_timestamp_clock", "monotonic_raw") == -1) {
+        dbg_err("failed to set iio timestamp clock");
+        goto out;
+    }
+
+    // Enable all channels and look up where they are in the scan. Each count
+    // is a 32-bit value, followed by a 64-bit timestamp aligned to 8 bytes.
+    int count_index[PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV];
+    int timestamp_index;
+
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        snprintf(attr, sizeof(attr), "scan_elements/in_count%d_en", (int)i);
+        if (pbdrv_counter_write_attr(syspath, attr, "1") == -1) {
+            dbg_err("failed to enable iio count channel");
+            goto out;
+        }
+        snprintf(attr, sizeof(attr), "scan_elements/in_count%d_index", (int)i);
+        if (pbdrv_counter_read_attr_int(syspath, attr, &count_index[i]) == -1) {
+            dbg_err("failed to read iio count channel index");
+            goto out;
+        }
+    }
+
+    if (pbdrv_counter_write_attr(syspath, "scan_elements/in_timestamp_en", "1") == -1 ||
+        pbdrv_counter_read_attr_int(syspath, "scan_elements/in_timestamp_index", &timestamp_index) == -1) {
+        dbg_err("failed to enable iio timestamp");
+        goto out;
+    }
+
+    // Channels appear in the scan in order of their index.
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        size_t preceding = 0;
+        for (size_t j = 0; j < PBIO_ARRAY_SIZE(private_data); j++) {
+            if (count_index[j] < count_index[i]) {
+                preceding++;
+            }
+        }
+        private_data[i].scan_offset = preceding * sizeof(int32_t);
+    }
+
+    size_t counts_size = PBIO_ARRAY_SIZE(private_data) * sizeof(int32_t);
+    buffer.timestamp_offset = (counts_size + sizeof(int64_t) - 1) / sizeof(int64_t) * sizeof(int64_t);
+    buffer.scan_size = buffer.timestamp_offset + sizeof(int64_t);
+
+    // The timestamp is always last, so it must have the highest index.
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        if (count_index[i] > timestamp_index) {
+            dbg_err("unexpected iio scan layout");
+            goto out;
+        }
+    }
+
+    snprintf(attr, sizeof(attr), "%d", COUNTER_BUFFER_LENGTH);
+    if (pbdrv_counter_write_attr(syspath, "buffer/length", attr) == -1) {
+        dbg_err("failed to set iio buffer length");
+        goto out;
+    }
+
+    buffer.fd = open(devnode, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (buffer.fd == -1) {
+        dbg_err("failed to open iio device");
+        goto out;
+    }
+
+    if (pbdrv_counter_write_attr(syspath, "buffer/enable", "1") == -1) {
+        dbg_err("failed to enable iio buffer");
+        close(buffer.fd);
+        buffer.fd = -1;
+    }
+
+out:
+    udev_device_unref(iio_dev);
+}
+
+#endif // PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED
+
 pbio_error_t pbdrv_counter_get_dev(uint8_t id, pbdrv_counter_dev_t **dev) {
     if (id >= PBIO_ARRAY_SIZE(private_data)) {
         return PBIO_ERROR_NO_DEV;
     }
+    if (!setup_done) {
+        setup_done = true;
+        pbdrv_counter_setup();
+    }
     *dev = &private_data[id];
     return PBIO_SUCCESS;
 }
 
+static pbio_error_t pbdrv_counter_read_count(pbdrv_counter_dev_t *priv, int32_t *count) {
+
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED
+    if (buffer.fd != -1 && pbdrv_counter_buffer_update() == PBIO_SUCCESS) {
+        *count = buffer.counts[priv - private_data];
+        return PBIO_SUCCESS;
+    }
+    #endif
+
+    if (fseek(priv->count, 0, SEEK_SET) == -1) {
+        return PBIO_ERROR_IO;
+    }
+
+    if (fscanf(priv->count, "%d", count) == EOF) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
+
 pbio_error_t pbdrv_counter_get_angle(pbdrv_counter_dev_t *dev, int32_t *rotations, int32_t *millidegrees) {
     pbdrv_counter_dev_t *priv = dev;
 
@@ -56,19 +379,16 @@ pbio_error_t pbdrv_counter_get_angle(pbdrv_counter_dev_t *dev, int32_t *rotation
 
     // If values were recently read, return those again.
     // This reduces unnecessary I/O operations.
-    if (time_now - priv->time_us_last < 2000) {
+    if (time_now - priv->time_us_last < COUNTER_CACHE_TIME_US) {
         *rotations = priv->rotations_last;
         *millidegrees = priv->millidegrees_last;
         return PBIO_SUCCESS;
     }
 
-    if (fseek(priv->count, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
-    }
-
     int32_t count;
-    if (fscanf(priv->count, "%d", &count) == EOF) {
-        return PBIO_ERROR_IO;
+    pbio_error_t err = pbdrv_counter_read_count(priv, &count);
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
 
     // ev3dev stretch provides 720 counts per rotation.
@@ -87,7 +407,8 @@ pbio_error_t pbdrv_counter_get_abs_angle(pbdrv_counter_dev_t *dev, int32_t *mill
     return PBIO_ERROR_NOT_SUPPORTED;
 }
 
-void pbdrv_counter_init(void) {
+// Finds the counter device and opens its attributes.
+static void pbdrv_counter_setup(void) {
     char buf[256];
     struct udev *udev;
     struct udev_enumerate *enumerate;
@@ -140,10 +461,18 @@ void pbdrv_counter_init(void) {
         setbuf(priv->count, NULL);
     }
 
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED
+    pbdrv_counter_buffer_init(udev, udev_list_entry_get_name(entry));
+    #endif
+
 free_enumerate:
     udev_enumerate_unref(enumerate);
 free_udev:
     udev_unref(udev);
 }
 
+void pbdrv_counter_init(void) {
+    // Setup is done on first use. See pbdrv_counter_get_dev().
+}
+
 #endif // PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO
@@ -26,6 +26,7 @@
 #include <pbdrv/counter.h>
 #include <pbdrv/ioport.h>
 #include <pbdrv/legodev.h>
+#include <pbdrv/uart.h>
 #include "../ioport/ioport_pup.h"
 
 #include "legodev_pup.h"
@@ -76,6 +77,8 @@ typedef struct {
     dcm_data_t dcm;
     struct etimer timer;
     pbio_angle_t angle;
+    /** The UART is used directly by someone else, so stay out of the way. */
+    bool uart_claimed;
 } ext_dev_t;
 
 static ext_dev_t ext_devs[PBDRV_CONFIG_LEGODEV_PUP_NUM_EXT_DEV];
@@ -356,19 +359,28 @@ static PT_THREAD(pbdrv_legodev_pup_thread(ext_dev_t * dev)) {
         etimer_set(&dev->timer, 2);
         PT_INIT(&dev->child);
         PT_WAIT_UNTIL(&dev->pt, ({
-            if (etimer_expired(&dev->timer)) {
+            if (!dev->uart_claimed && etimer_expired(&dev->timer)) {
                 etimer_reset(&dev->timer);
                 (void)PT_SCHEDULE(poll_dcm(dev));
                 debug_state_change(dev);
                 dev->dcm.prev_connected_type_id = dev->dcm.connected_type_id;
             }
-            dev->dcm.connected_type_id == PBDRV_LEGODEV_TYPE_ID_LPF2_UNKNOWN_UART;
+            dev->uart_claimed || dev->dcm.connected_type_id == PBDRV_LEGODEV_TYPE_ID_LPF2_UNKNOWN_UART;
         }));
 
         // UART device detected, so hand off control to that protocol until it
         // disconnects, as observed by the UART process not getting valid data.
+        // This is abandoned as soon as the UART is claimed for direct use.
         legodev_pup_enable_uart(dev->pins);
-        PT_SPAWN(&dev->pt, &dev->child, pbdrv_legodev_pup_uart_thread(&dev->child, dev->uart_dev));
+        PT_INIT(&dev->child);
+        PT_WAIT_WHILE(&dev->pt, !dev->uart_claimed && PT_SCHEDULE(pbdrv_legodev_pup_uart_thread(&dev->child, dev->uart_dev)));
+
+        // While claimed, there is no LEGO device here as far as we know.
+        if (dev->uart_claimed) {
+            pbdrv_legodev_pup_uart_reset(dev->uart_dev);
+            dev->dcm.connected_type_id = PBDRV_LEGODEV_TYPE_ID_NONE;
+            PT_WAIT_WHILE(&dev->pt, dev->uart_claimed);
+        }
     }
     PT_END(&dev->pt);
 }
@@ -603,6 +615,66 @@ pbio_error_t pbdrv_legodev_get_device(pbio_port_id_t port_id, pbdrv_legodev_type
     return PBIO_ERROR_NO_DEV;
 }
 
+static ext_dev_t *pbdrv_legodev_get_ext_dev(pbio_port_id_t port_id) {
+    for (uint8_t i = 0; i < PBDRV_CONFIG_LEGODEV_PUP_NUM_EXT_DEV; i++) {
+        if (ext_devs[i].pdata->port_id == port_id) {
+            return &ext_devs[i];
+        }
+    }
+    return NULL;
+}
+
+// Ends a write that the previous owner of the UART left in progress. Without
+// this, the driver would stay busy and refuse all later writes.
+static void legodev_pup_abandon_uart_write(pbdrv_uart_dev_t *uart) {
+    pbdrv_uart_write_cancel(uart);
+    (void)pbdrv_uart_write_end(uart);
+}
+
+pbio_error_t pbdrv_legodev_claim_uart(pbio_port_id_t port_id, pbdrv_uart_dev_t **uart) {
+    ext_dev_t *dev = pbdrv_legodev_get_ext_dev(port_id);
+    if (!dev) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (dev->uart_claimed) {
+        return PBIO_ERROR_BUSY;
+    }
+
+    pbio_error_t err = pbdrv_uart_get(pbdrv_ioport_pup_platform_data.ports[dev->pdata->ioport_index].uart_driver_index, uart);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // Device detection toggles the UART pins, so set them up right away
+    // instead of waiting for the legodev process to notice the claim. The
+    // LEGO UART thread is abandoned wherever it is, possibly mid-write.
+    dev->uart_claimed = true;
+    legodev_pup_enable_uart(dev->pins);
+    legodev_pup_abandon_uart_write(*uart);
+    pbdrv_uart_flush(*uart);
+    process_poll(&pbio_legodev_pup_process);
+
+    return PBIO_SUCCESS;
+}
+
+void pbdrv_legodev_release_uart(pbio_port_id_t port_id) {
+    ext_dev_t *dev = pbdrv_legodev_get_ext_dev(port_id);
+    if (!dev || !dev->uart_claimed) {
+        return;
+    }
+
+    // Give the LEGO UART thread an idle UART when device detection resumes.
+    pbdrv_uart_dev_t *uart;
+    if (pbdrv_uart_get(pbdrv_ioport_pup_platform_data.ports[dev->pdata->ioport_index].uart_driver_index, &uart) == PBIO_SUCCESS) {
+        legodev_pup_abandon_uart_write(uart);
+        pbdrv_uart_flush(uart);
+    }
+
+    dev->uart_claimed = false;
+    process_poll(&pbio_legodev_pup_process);
+}
+
 bool pbdrv_legodev_needs_permanent_power(pbdrv_legodev_dev_t *legodev) {
 
     // Known internal devices don't need permanent power.
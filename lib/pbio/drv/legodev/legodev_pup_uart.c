@@ -18,6 +18,7 @@
 #if PBDRV_CONFIG_LEGODEV_PUP_UART
 
 #include "legodev_pup_uart.h"
+#include "legodev_pup_uart_msg.h"
 #include "legodev_spec.h"
 
 #define DEBUG 0
@@ -50,7 +51,7 @@
 
 #include <pbio/dcmotor.h>
 
-#define EV3_UART_MAX_MESSAGE_SIZE   (LUMP_MAX_MSG_SIZE + 3)
+#define EV3_UART_MAX_MESSAGE_SIZE   PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE
 
 #define EV3_UART_MAX_DATA_ERR       6
 
@@ -268,76 +269,50 @@ static inline bool test_and_set_bit(uint8_t bit, uint32_t *flags) {
     return result;
 }
 
-static uint8_t ev3_uart_get_msg_size(uint8_t header) {
-    uint8_t size;
-
-    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_SYS) {
-        return 1;
-    }
-
-    size = LUMP_MSG_SIZE(header);
-    size += 2; /* header and checksum */
-    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_INFO) {
-        size++; /* extra command byte */
-
-    }
-    return size;
-}
-
-
 static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev) {
+    pbdrv_legodev_pup_uart_msg_t msg;
     uint32_t speed;
-    uint8_t msg_type, cmd, msg_size, mode, cmd2;
-
-    msg_type = ludev->rx_msg[0] & LUMP_MSG_TYPE_MASK;
-    cmd = ludev->rx_msg[0] & LUMP_MSG_CMD_MASK;
-    msg_size = ev3_uart_get_msg_size(ludev->rx_msg[0]);
-    mode = cmd;
-    cmd2 = ludev->rx_msg[1];
+    uint8_t mode;
+
+    pbio_error_t err = pbdrv_legodev_pup_uart_msg_parse(ludev->rx_msg, ludev->rx_msg_size, &msg);
+
+    if (err == PBIO_ERROR_IO) {
+        DBG_ERR(ludev->last_err = "Bad checksum");
+        // if INFO messages are done and we are now receiving data, it is
+        // OK to occasionally have a bad checksum
+        if (ludev->status == PBDRV_LEGODEV_PUP_UART_STATUS_DATA) {
+
+            // The LEGO EV3 color sensor sends bad checksums
+            // for RGB-RAW data (mode 4). The check here could be
+            // improved if someone can find a pattern.
+            if (ludev->device_info.type_id != PBDRV_LEGODEV_TYPE_ID_EV3_COLOR_SENSOR
+                || ludev->rx_msg[0] != (LUMP_MSG_TYPE_DATA | LUMP_MSG_SIZE_8 | 4)) {
+                return;
+            }
+        } else {
+            goto err;
+        }
+    } else if (err != PBIO_SUCCESS) {
+        // callers only pass complete messages of a valid size
+        DBG_ERR(ludev->last_err = "Bad message size");
+        goto err;
+    }
 
-    // The original EV3 spec only allowed for up to 8 modes (3-bit number).
-    // The Powered UP spec extents this by adding an extra flag to INFO commands.
     // Not sure that LUMP_INFO_MODE_PLUS_8 is used in practice, but rather
     // an extra (separate) LUMP_CMD_EXT_MODE message seems to be used instead
-    if (msg_type == LUMP_MSG_TYPE_INFO && (cmd2 & LUMP_INFO_MODE_PLUS_8)) {
+    mode = msg.cmd;
+    if (msg.type == LUMP_MSG_TYPE_INFO && msg.mode_plus_8) {
         mode += 8;
-        cmd2 &= ~LUMP_INFO_MODE_PLUS_8;
     } else {
         mode += ludev->ext_mode;
     }
 
-    if (msg_size > 1) {
-        uint8_t checksum = 0xFF;
-        for (int i = 0; i < msg_size - 1; i++) {
-            checksum ^= ludev->rx_msg[i];
-        }
-        if (checksum != ludev->rx_msg[msg_size - 1]) {
-            DBG_ERR(ludev->last_err = "Bad checksum");
-            // if INFO messages are done and we are now receiving data, it is
-            // OK to occasionally have a bad checksum
-            if (ludev->status == PBDRV_LEGODEV_PUP_UART_STATUS_DATA) {
-
-                // The LEGO EV3 color sensor sends bad checksums
-                // for RGB-RAW data (mode 4). The check here could be
-                // improved if someone can find a pattern.
-                if (ludev->device_info.type_id != PBDRV_LEGODEV_TYPE_ID_EV3_COLOR_SENSOR
-                    || ludev->rx_msg[0] != (LUMP_MSG_TYPE_DATA | LUMP_MSG_SIZE_8 | 4)) {
-                    return;
-                }
-            } else {
-                goto err;
-            }
-        }
-    }
-
-    switch (msg_type) {
+    switch (msg.type) {
         case LUMP_MSG_TYPE_SYS:
-            switch (cmd) {
+            switch (msg.cmd) {
                 case LUMP_SYS_SYNC:
-                    /* IR sensor (type 33) sends checksum after SYNC */
-                    if (msg_size > 1 && (cmd ^ cmd2) == 0xFF) {
-                        msg_size++;
-                    }
+                    // IR sensor (type 33) sends checksum after SYNC, but
+                    // that is skipped while waiting for the TYPE command.
                     break;
                 case LUMP_SYS_ACK:
                     #if PBDRV_CONFIG_LEGODEV_MODE_INFO
@@ -358,22 +333,26 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
             }
             break;
         case LUMP_MSG_TYPE_CMD:
-            switch (cmd) {
+            switch (msg.cmd) {
                 case LUMP_CMD_MODES:
                     #if PBDRV_CONFIG_LEGODEV_MODE_INFO
                     if (test_and_set_bit(EV3_UART_INFO_BIT_CMD_MODES, &ludev->info_flags)) {
                         DBG_ERR(ludev->last_err = "Received duplicate modes INFO");
                         goto err;
                     }
-                    if (cmd2 > LUMP_MAX_MODE) {
+                    if (msg.payload[0] > LUMP_MAX_MODE) {
                         DBG_ERR(ludev->last_err = "Number of modes is out of range");
                         goto err;
                     }
-                    ludev->device_info.num_modes = cmd2 + 1;
-                    if (msg_size > 5) {
+                    ludev->device_info.num_modes = msg.payload[0] + 1;
+                    if (msg.payload_size > 3) {
                         // Powered Up devices can have an extended mode message that
                         // includes modes > LUMP_MAX_MODE
-                        ludev->device_info.num_modes = ludev->rx_msg[3] + 1;
+                        if (msg.payload[2] > LUMP_MAX_EXT_MODE) {
+                            DBG_ERR(ludev->last_err = "Number of modes is out of range");
+                            goto err;
+                        }
+                        ludev->device_info.num_modes = msg.payload[2] + 1;
                     }
 
                     debug_pr("num_modes: %d\n", ludev->device_info.num_modes);
@@ -386,7 +365,11 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                         goto err;
                     }
                     #endif
-                    speed = pbio_get_uint32_le(ludev->rx_msg + 1);
+                    if (msg.payload_size < 4) {
+                        DBG_ERR(ludev->last_err = "Invalid speed message size");
+                        goto err;
+                    }
+                    speed = pbio_get_uint32_le(msg.payload);
                     if (speed < EV3_UART_SPEED_MIN || speed > EV3_UART_SPEED_MAX) {
                         DBG_ERR(ludev->last_err = "Speed is out of range");
                         goto err;
@@ -398,8 +381,8 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                     break;
                 case LUMP_CMD_WRITE:
                     #if PBDRV_CONFIG_LEGODEV_MODE_INFO
-                    if (cmd2 & 0x20) {
-                        // TODO: write_cmd_size = cmd2 & 0x3;
+                    if (msg.payload[0] & 0x20) {
+                        // TODO: write_cmd_size = msg.payload[0] & 0x3;
                         if (ludev->info_flags & PBDRV_LEGODEV_CAPABILITY_FLAG_HAS_MOTOR_REL_POS) {
                             // TODO: msg[3] and msg[4] probably give us useful information
                         } else {
@@ -411,7 +394,7 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                 case LUMP_CMD_EXT_MODE:
                     // Powered up devices can have modes > LUMP_MAX_MODE. This
                     // command precedes other commands to add the extra 8 to the mode
-                    ludev->ext_mode = ludev->rx_msg[1];
+                    ludev->ext_mode = msg.payload[0];
                     break;
                 case LUMP_CMD_VERSION:
                     #if PBDRV_CONFIG_LEGODEV_MODE_INFO
@@ -420,8 +403,8 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                         goto err;
                     }
                     // TODO: this might be useful someday
-                    debug_pr("fw version: %08" PRIx32 "\n", pbio_get_uint32_le(ludev->rx_msg + 1));
-                    debug_pr("hw version: %08" PRIx32 "\n", pbio_get_uint32_le(ludev->rx_msg + 5));
+                    debug_pr("fw version: %08" PRIx32 "\n", pbio_get_uint32_le(msg.payload));
+                    debug_pr("hw version: %08" PRIx32 "\n", pbio_get_uint32_le(msg.payload + 4));
                     #endif // LUMP_CMD_VERSION
                     break;
                 default:
@@ -431,10 +414,14 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
             break;
         #if PBDRV_CONFIG_LEGODEV_MODE_INFO
         case LUMP_MSG_TYPE_INFO:
-            switch (cmd2) {
+            if (mode >= PBDRV_LEGODEV_MAX_NUM_MODES) {
+                DBG_ERR(ludev->last_err = "Mode is out of range");
+                goto err;
+            }
+            switch (msg.info) {
                 case LUMP_INFO_NAME: {
                     ludev->info_flags &= ~EV3_UART_INFO_FLAG_ALL_INFO;
-                    if (ludev->rx_msg[2] < 'A' || ludev->rx_msg[2] > 'z') {
+                    if (msg.payload[0] < 'A' || msg.payload[0] > 'z') {
                         DBG_ERR(ludev->last_err = "Invalid name INFO");
                         goto err;
                     }
@@ -445,7 +432,7 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                     * ensure a null terminator for the string
                     * functions.
                     */
-                    ludev->rx_msg[msg_size - 1] = 0;
+                    ludev->rx_msg[msg.size - 1] = 0;
                     const char *name = (char *)(ludev->rx_msg + 2);
                     size_t name_len = strlen(name);
                     if (name_len > LUMP_MAX_NAME_SIZE) {
@@ -458,9 +445,9 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
 
                     // newer LEGO UART devices send additional 6 mode capability flags
                     uint8_t flags = 0;
-                    if (name_len <= LUMP_MAX_SHORT_NAME_SIZE && msg_size > LUMP_MAX_NAME_SIZE) {
+                    if (name_len <= LUMP_MAX_SHORT_NAME_SIZE && msg.size > LUMP_MAX_NAME_SIZE) {
                         // Only the first is used in practice.
-                        flags = ludev->rx_msg[8];
+                        flags = msg.payload[6];
                     } else {
                         // for newer devices that don't send it, set flags by device ID
                         // TODO: Look up from static info like we do for basic devices
@@ -491,8 +478,8 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
 
                     debug_pr("new_mode: %d\n", ludev->new_mode);
                     debug_pr("flags: %02X %02X %02X %02X %02X %02X\n",
-                        ludev->rx_msg[8 + 0], ludev->rx_msg[8 + 1], ludev->rx_msg[8 + 2],
-                        ludev->rx_msg[8 + 3], ludev->rx_msg[8 + 4], ludev->rx_msg[8 + 5]);
+                        msg.payload[6 + 0], msg.payload[6 + 1], msg.payload[6 + 2],
+                        msg.payload[6 + 3], msg.payload[6 + 4], msg.payload[6 + 5]);
                 }
                 break;
                 case LUMP_INFO_RAW:
@@ -510,11 +497,15 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                         goto err;
                     }
 
-                    // Mode supports writing if rx_msg[3] is nonzero.
-                    ludev->device_info.mode_info[mode].writable = ludev->rx_msg[3] != 0;
+                    if (msg.payload_size < 2) {
+                        DBG_ERR(ludev->last_err = "Invalid mapping message size");
+                        goto err;
+                    }
+
+                    // Mode supports writing if output mapping is nonzero.
+                    ludev->device_info.mode_info[mode].writable = msg.payload[1] != 0;
 
-                    debug_pr("mapping: in %02x out %02x\n", ludev->rx_msg[2], ludev->rx_msg[3]);
-                    debug_pr("mapping: in %02x out %02x\n", ludev->rx_msg[2], ludev->rx_msg[3]);
+                    debug_pr("mapping: in %02x out %02x\n", msg.payload[0], msg.payload[1]);
                     debug_pr("Writable: %d\n", ludev->device_info.mode_info[mode].writable);
 
                     break;
@@ -529,7 +520,7 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                     }
 
                     // REVISIT: this is potentially an array of combos
-                    debug_pr("mode combos: %04x\n", ludev->rx_msg[3] << 8 | ludev->rx_msg[2]);
+                    debug_pr("mode combos: %04x\n", msg.payload[1] << 8 | msg.payload[0]);
 
                     break;
                 case LUMP_INFO_UNK9:
@@ -544,8 +535,8 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
 
                     // first 3 parameters look like PID constants, 4th is max tacho_rate
                     debug_pr("motor parameters: %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n",
-                        pbio_get_uint32_le(ludev->rx_msg + 2), pbio_get_uint32_le(ludev->rx_msg + 6),
-                        pbio_get_uint32_le(ludev->rx_msg + 10), pbio_get_uint32_le(ludev->rx_msg + 14));
+                        pbio_get_uint32_le(msg.payload), pbio_get_uint32_le(msg.payload + 4),
+                        pbio_get_uint32_le(msg.payload + 8), pbio_get_uint32_le(msg.payload + 12));
 
                     break;
                 case LUMP_INFO_UNK11:
@@ -567,20 +558,20 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
                         DBG_ERR(ludev->last_err = "Received duplicate format INFO");
                         goto err;
                     }
-                    ludev->device_info.mode_info[mode].num_values = ludev->rx_msg[2];
-                    if (!ludev->device_info.mode_info[mode].num_values) {
-                        DBG_ERR(ludev->last_err = "Invalid number of data sets");
+                    if (msg.payload_size < 4) {
+                        DBG_ERR(ludev->last_err = "Invalid format message size");
                         goto err;
                     }
-                    if (msg_size < 7) {
-                        DBG_ERR(ludev->last_err = "Invalid format ludev->msg size");
+                    ludev->device_info.mode_info[mode].num_values = msg.payload[0];
+                    if (!ludev->device_info.mode_info[mode].num_values) {
+                        DBG_ERR(ludev->last_err = "Invalid number of data sets");
                         goto err;
                     }
                     if ((ludev->info_flags & EV3_UART_INFO_FLAG_REQUIRED) != EV3_UART_INFO_FLAG_REQUIRED) {
                         DBG_ERR(ludev->last_err = "Did not receive all required INFO");
                         goto err;
                     }
-                    ludev->device_info.mode_info[mode].data_type = ludev->rx_msg[3];
+                    ludev->device_info.mode_info[mode].data_type = msg.payload[1];
                     if (ludev->new_mode) {
                         ludev->new_mode--;
                     }
@@ -607,7 +598,7 @@ static void pbdrv_legodev_pup_uart_parse_msg(pbdrv_legodev_pup_uart_dev_t *ludev
 
             // Data is for requested mode.
             if (mode == ludev->mode_switch.desired_mode) {
-                memcpy(ludev->bin_data, ludev->rx_msg + 1, msg_size - 2);
+                memcpy(ludev->bin_data, msg.payload, msg.payload_size);
 
                 if (ludev->device_info.mode != mode) {
                     // First time getting data in this mode, so register time.
@@ -687,7 +678,7 @@ static void ev3_uart_prepare_tx_msg(pbdrv_legodev_pup_uart_dev_t *ludev, lump_ms
     ludev->tx_msg_size = offset + i + 2;
 }
 
-static void pbdrv_legodev_pup_uart_reset(pbdrv_legodev_pup_uart_dev_t *ludev) {
+void pbdrv_legodev_pup_uart_reset(pbdrv_legodev_pup_uart_dev_t *ludev) {
     ludev->status = PBDRV_LEGODEV_PUP_UART_STATUS_ERR;
     if (ludev->dcmotor != NULL && ludev->dcmotor->motor_driver != NULL) {
         pbdrv_motor_driver_coast(ludev->dcmotor->motor_driver);
@@ -836,7 +827,7 @@ sync:
             PT_EXIT(&ludev->pt);
         }
 
-        ludev->rx_msg_size = ev3_uart_get_msg_size(ludev->rx_msg[0]);
+        ludev->rx_msg_size = pbdrv_legodev_pup_uart_msg_get_size(ludev->rx_msg[0]);
         if (ludev->rx_msg_size > EV3_UART_MAX_MESSAGE_SIZE) {
             DBG_ERR(ludev->last_err = "Bad message size during info");
             ludev->err = PBIO_ERROR_IO;
@@ -1021,7 +1012,7 @@ static PT_THREAD(pbdrv_legodev_pup_uart_receive_data_thread(pbdrv_legodev_pup_ua
             break;
         }
 
-        ludev->rx_msg_size = ev3_uart_get_msg_size(ludev->rx_msg[0]);
+        ludev->rx_msg_size = pbdrv_legodev_pup_uart_msg_get_size(ludev->rx_msg[0]);
         if (ludev->rx_msg_size < 3 || ludev->rx_msg_size > EV3_UART_MAX_MESSAGE_SIZE) {
             DBG_ERR(ludev->last_err = "Bad data message size");
             continue;
@@ -23,6 +23,8 @@ pbdrv_legodev_pup_uart_dev_t *pbdrv_legodev_get_uart_dev(pbdrv_legodev_dev_t *le
 
 PT_THREAD(pbdrv_legodev_pup_uart_thread(struct pt *pt, pbdrv_legodev_pup_uart_dev_t *port_data));
 
+void pbdrv_legodev_pup_uart_reset(pbdrv_legodev_pup_uart_dev_t *ludev);
+
 void pbdrv_legodev_pup_uart_process_poll(void);
 
 #else // PBDRV_CONFIG_LEGODEV_PUP_UART
@@ -40,6 +42,9 @@ static inline PT_THREAD(pbdrv_legodev_pup_uart_thread(struct pt *pt, pbdrv_legod
     PT_END(pt);
 }
 
+static inline void pbdrv_legodev_pup_uart_reset(pbdrv_legodev_pup_uart_dev_t *ludev) {
+}
+
 static inline void pbdrv_legodev_pup_uart_process_poll(void) {
 }
 
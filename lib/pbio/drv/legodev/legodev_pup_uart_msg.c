@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Framing and checksum checking of LEGO UART Message Protocol (LUMP) messages.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <lego_uart.h>
+
+#include <pbio/error.h>
+
+#include "legodev_pup_uart_msg.h"
+
+/**
+ * Gets the size of a message from its header byte.
+ *
+ * @param [in]  header      The first byte of the message.
+ * @return                  The size of the whole message in bytes, including
+ *                          the header and checksum. This can be larger than
+ *                          ::PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE if the header
+ *                          is invalid.
+ */
+uint8_t pbdrv_legodev_pup_uart_msg_get_size(uint8_t header) {
+    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_SYS) {
+        return 1;
+    }
+
+    uint8_t size = LUMP_MSG_SIZE(header) + 2; // header and checksum
+
+    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_INFO) {
+        size++; // extra command byte
+    }
+
+    return size;
+}
+
+/**
+ * Checks the framing and checksum of a message at the start of @p buf.
+ *
+ * @p msg is filled in when the return value is ::PBIO_SUCCESS or
+ * ::PBIO_ERROR_IO. The message is never read beyond @p size bytes.
+ *
+ * @param [in]  buf         The received bytes, starting with a header byte.
+ * @param [in]  size        The number of bytes in @p buf.
+ * @param [out] msg         The parsed message.
+ * @return                  ::PBIO_SUCCESS if a valid message was parsed,
+ *                          ::PBIO_ERROR_AGAIN if @p buf does not contain the
+ *                          whole message yet, ::PBIO_ERROR_INVALID_ARG if the
+ *                          header has an invalid size (the stream is out of
+ *                          sync) or ::PBIO_ERROR_IO if the checksum is wrong.
+ */
+pbio_error_t pbdrv_legodev_pup_uart_msg_parse(const uint8_t *buf, uint32_t size, pbdrv_legodev_pup_uart_msg_t *msg) {
+    if (size == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    uint8_t msg_size = pbdrv_legodev_pup_uart_msg_get_size(buf[0]);
+
+    if (msg_size > PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (size < msg_size) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    msg->type = buf[0] & LUMP_MSG_TYPE_MASK;
+    msg->cmd = buf[0] & LUMP_MSG_CMD_MASK;
+    msg->info = 0;
+    msg->mode_plus_8 = false;
+    msg->size = msg_size;
+
+    switch (msg->type) {
+        case LUMP_MSG_TYPE_SYS:
+            msg->payload = &buf[1];
+            msg->payload_size = 0;
+            // SYS messages have no checksum
+            return PBIO_SUCCESS;
+        case LUMP_MSG_TYPE_INFO:
+            // The original EV3 spec only allowed for up to 8 modes (3-bit
+            // number). The Powered Up spec extends this by adding an extra
+            // flag to INFO messages.
+            msg->info = buf[1] & ~LUMP_INFO_MODE_PLUS_8;
+            msg->mode_plus_8 = buf[1] & LUMP_INFO_MODE_PLUS_8;
+            msg->payload = &buf[2];
+            msg->payload_size = msg_size - 3;
+            break;
+        default:
+            msg->payload = &buf[1];
+            msg->payload_size = msg_size - 2;
+            break;
+    }
+
+    uint8_t checksum = 0xFF;
+    for (uint8_t i = 0; i < msg_size - 1; i++) {
+        checksum ^= buf[i];
+    }
+
+    if (checksum != buf[msg_size - 1]) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Framing and checksum checking of LEGO UART Message Protocol (LUMP) messages.
+//
+// These functions only look at the bytes they are given and have no state,
+// so they can be fuzzed and tested on the host.
+
+#ifndef _INTERNAL_PBDRV_LEGODEV_PUP_UART_MSG_H_
+#define _INTERNAL_PBDRV_LEGODEV_PUP_UART_MSG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <lego_uart.h>
+
+#include <pbio/error.h>
+
+/** Size of the largest message: header, INFO command byte, payload and checksum. */
+#define PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE (LUMP_MAX_MSG_SIZE + 3)
+
+/**
+ * A received message split into its fields.
+ */
+typedef struct {
+    /** The message type (one of ::lump_msg_type_t). */
+    uint8_t type;
+    /** The command for SYS and CMD messages or the mode (0 to 7) for INFO and DATA messages. */
+    uint8_t cmd;
+    /** The INFO type with ::LUMP_INFO_MODE_PLUS_8 cleared. Only valid for INFO messages. */
+    uint8_t info;
+    /** True if ::LUMP_INFO_MODE_PLUS_8 was set. Only valid for INFO messages. */
+    bool mode_plus_8;
+    /** Pointer to the payload in the buffer that was parsed. */
+    const uint8_t *payload;
+    /** The size of the payload in bytes. */
+    uint8_t payload_size;
+    /** The size of the whole message in bytes, including header and checksum. */
+    uint8_t size;
+} pbdrv_legodev_pup_uart_msg_t;
+
+uint8_t pbdrv_legodev_pup_uart_msg_get_size(uint8_t header);
+
+pbio_error_t pbdrv_legodev_pup_uart_msg_parse(const uint8_t *buf, uint32_t size, pbdrv_legodev_pup_uart_msg_t *msg);
+
+#endif // _INTERNAL_PBDRV_LEGODEV_PUP_UART_MSG_H_
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#ifndef _INTERNAL_PBDRV_TELEMETRY_H_
+#define _INTERNAL_PBDRV_TELEMETRY_H_
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_TELEMETRY
+
+#include <pbdrv/telemetry.h>
+
+void pbdrv_telemetry_init(void);
+
+#else // PBDRV_CONFIG_TELEMETRY
+
+#define pbdrv_telemetry_init()
+
+#endif // PBDRV_CONFIG_TELEMETRY
+
+#endif // _INTERNAL_PBDRV_TELEMETRY_H_
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Publishes telemetry in POSIX shared memory, so that other processes on the
+// same machine can follow the control loops at full rate.
+//
+// See telemetry_shm.h for the layout and for the reader library.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_TELEMETRY_LINUX_SHM
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pbdrv/clock.h>
+#include <pbdrv/telemetry.h>
+
+#include "telemetry_shm.h"
+
+static pbdrv_telemetry_shm_t *shm;
+
+void pbdrv_telemetry_init(void) {
+    int fd = shm_open(PBDRV_TELEMETRY_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("Failed to open telemetry shared memory");
+        return;
+    }
+
+    if (ftruncate(fd, sizeof(pbdrv_telemetry_shm_t)) == -1) {
+        perror("Failed to size telemetry shared memory");
+        close(fd);
+        return;
+    }
+
+    void *addr = mmap(NULL, sizeof(pbdrv_telemetry_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("Failed to map telemetry shared memory");
+        return;
+    }
+
+    shm = addr;
+
+    // Readers that are still attached from a previous program see the magic
+    // disappear and should reopen.
+    __atomic_store_n(&shm->magic, 0, __ATOMIC_RELEASE);
+    memset(shm->slots, 0, sizeof(shm->slots));
+    shm->version = PBDRV_TELEMETRY_SHM_VERSION;
+    shm->num_slots = PBDRV_TELEMETRY_SHM_NUM_SLOTS;
+    __atomic_store_n(&shm->head, 0, __ATOMIC_RELAXED);
+    // Nothing is published until a reader shows up.
+    __atomic_store_n(&shm->reader_next, -PBDRV_TELEMETRY_SHM_READER_TIMEOUT, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->magic, PBDRV_TELEMETRY_SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+bool pbdrv_telemetry_is_active(void) {
+    if (!shm) {
+        return false;
+    }
+
+    // A reader that keeps up writes back a position close to the head. One
+    // that went away stops doing so, and the head moves away from it.
+    uint32_t head = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+    uint32_t reader_next = __atomic_load_n(&shm->reader_next, __ATOMIC_RELAXED);
+    return head - reader_next < PBDRV_TELEMETRY_SHM_READER_TIMEOUT;
+}
+
+void pbdrv_telemetry_publish(pbdrv_telemetry_source_t source, uint8_t index, const int32_t *values, uint8_t num_values) {
+    if (!shm) {
+        return;
+    }
+
+    if (num_values > PBDRV_TELEMETRY_SHM_MAX_VALUES) {
+        num_values = PBDRV_TELEMETRY_SHM_MAX_VALUES;
+    }
+
+    // There is only one writer, so head can't change under us.
+    uint32_t head = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+    pbdrv_telemetry_shm_slot_t *slot = &shm->slots[head % PBDRV_TELEMETRY_SHM_NUM_SLOTS];
+
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->sample.source = source;
+    slot->sample.index = index;
+    slot->sample.num_values = num_values;
+    slot->sample.count = head;
+    slot->sample.time = pbdrv_clock_get_us();
+    memcpy(slot->sample.values, values, num_values * sizeof(*values));
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif // PBDRV_CONFIG_TELEMETRY_LINUX_SHM
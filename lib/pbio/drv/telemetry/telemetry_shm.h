@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Layout of the telemetry shared memory object, and a small library for
+// reading it from other processes.
+//
+// This header does not depend on the rest of pbio, so other programs can
+// build against it together with telemetry_shm_reader.c:
+//
+//     cc -I lib/pbio/drv/telemetry myapp.c lib/pbio/drv/telemetry/telemetry_shm_reader.c -lrt
+//
+// The memory holds a ring of fixed size slots. Every slot is protected by a
+// sequence lock: the writer makes the sequence number odd before changing the
+// slot and even again afterwards. Readers copy the slot and retry if the
+// sequence number changed while they were copying. The writer never waits for
+// readers, so readers can't affect the control loop.
+//
+// Readers also write back how far they have read. The writer only publishes
+// while that is close to the head, so nothing is collected when nobody reads.
+// This needs write access, so readers must run as the same user as Pybricks.
+
+#ifndef _PBDRV_TELEMETRY_SHM_H_
+#define _PBDRV_TELEMETRY_SHM_H_
+
+#include <stdint.h>
+
+/** Name of the POSIX shared memory object. */
+#define PBDRV_TELEMETRY_SHM_NAME "/pybricks-telemetry"
+
+/** Value of pbdrv_telemetry_shm_t.magic. */
+#define PBDRV_TELEMETRY_SHM_MAGIC (0x54425950) // "PYBT"
+
+/** Value of pbdrv_telemetry_shm_t.version. Incremented on layout changes. */
+#define PBDRV_TELEMETRY_SHM_VERSION (2)
+
+/** Number of slots in the ring. Must be a power of two. */
+#define PBDRV_TELEMETRY_SHM_NUM_SLOTS (512)
+
+/**
+ * Publishing stops once this many samples were published after the sample
+ * that the most recent reader is at.
+ */
+#define PBDRV_TELEMETRY_SHM_READER_TIMEOUT (2 * PBDRV_TELEMETRY_SHM_NUM_SLOTS)
+
+/** Maximum number of values in one sample. */
+#define PBDRV_TELEMETRY_SHM_MAX_VALUES (12)
+
+/** One telemetry sample. */
+typedef struct {
+    /** Kind of object that published the sample (pbdrv_telemetry_source_t). */
+    uint8_t source;
+    /** Index of the object, e.g. servo index. */
+    uint8_t index;
+    /** Number of used entries in values. */
+    uint8_t num_values;
+    uint8_t reserved;
+    /** Sample number. Increments by one for every sample that is published. */
+    uint32_t count;
+    /** Time of publishing, in microseconds (CLOCK_MONOTONIC_RAW). */
+    uint32_t time;
+    /** The values. */
+    int32_t values[PBDRV_TELEMETRY_SHM_MAX_VALUES];
+} pbdrv_telemetry_sample_t;
+
+/** Slot in the ring. */
+typedef struct {
+    /** Sequence lock. Odd while the writer is updating the sample. */
+    uint32_t seq;
+    /** The sample. */
+    pbdrv_telemetry_sample_t sample;
+} pbdrv_telemetry_shm_slot_t;
+
+/** The shared memory object. */
+typedef struct {
+    /** Set to PBDRV_TELEMETRY_SHM_MAGIC once the header is valid. */
+    uint32_t magic;
+    /** Layout version. */
+    uint16_t version;
+    /** Number of slots. */
+    uint16_t num_slots;
+    /** Total number of samples published so far. */
+    uint32_t head;
+    /** Number of the next sample to read, written by readers. */
+    uint32_t reader_next;
+    /** The ring. Sample n is in slot n % num_slots. */
+    pbdrv_telemetry_shm_slot_t slots[PBDRV_TELEMETRY_SHM_NUM_SLOTS];
+} pbdrv_telemetry_shm_t;
+
+/** Reader state. */
+typedef struct {
+    /** The mapped shared memory. */
+    pbdrv_telemetry_shm_t *shm;
+    /** Number of the next sample to read. */
+    uint32_t next;
+} pbdrv_telemetry_shm_reader_t;
+
+int pbdrv_telemetry_shm_reader_open(pbdrv_telemetry_shm_reader_t *reader);
+
+void pbdrv_telemetry_shm_reader_close(pbdrv_telemetry_shm_reader_t *reader);
+
+int pbdrv_telemetry_shm_reader_next(pbdrv_telemetry_shm_reader_t *reader, pbdrv_telemetry_sample_t *sample, uint32_t *lost);
+
+#endif // _PBDRV_TELEMETRY_SHM_H_
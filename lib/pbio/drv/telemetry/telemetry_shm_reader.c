@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Reader for the telemetry shared memory object. This is not part of the
+// firmware. It is meant to be built into other programs that run alongside it.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry_shm.h"
+
+/**
+ * Opens the telemetry shared memory for reading.
+ *
+ * Reading starts at the most recent sample.
+ *
+ * @param [out] reader      The reader.
+ * @return                  0 on success or a negative error code. -ENOENT
+ *                          means that no Pybricks program has published yet.
+ */
+int pbdrv_telemetry_shm_reader_open(pbdrv_telemetry_shm_reader_t *reader) {
+    int fd = shm_open(PBDRV_TELEMETRY_SHM_NAME, O_RDWR, 0);
+    if (fd == -1) {
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+    if (st.st_size < (off_t)sizeof(pbdrv_telemetry_shm_t)) {
+        close(fd);
+        return -EPROTO;
+    }
+
+    void *addr = mmap(NULL, sizeof(pbdrv_telemetry_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -errno;
+    }
+
+    pbdrv_telemetry_shm_t *shm = addr;
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PBDRV_TELEMETRY_SHM_MAGIC ||
+        shm->version != PBDRV_TELEMETRY_SHM_VERSION ||
+        shm->num_slots != PBDRV_TELEMETRY_SHM_NUM_SLOTS) {
+        munmap(addr, sizeof(pbdrv_telemetry_shm_t));
+        return -EPROTO;
+    }
+
+    reader->shm = shm;
+    reader->next = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+
+    // Let the writer know that someone is reading.
+    __atomic_store_n(&shm->reader_next, reader->next, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Closes the reader.
+ *
+ * @param [in]  reader      The reader.
+ */
+void pbdrv_telemetry_shm_reader_close(pbdrv_telemetry_shm_reader_t *reader) {
+    if (reader->shm) {
+        munmap(reader->shm, sizeof(pbdrv_telemetry_shm_t));
+        reader->shm = NULL;
+    }
+}
+
+/**
+ * Gets the next sample.
+ *
+ * If the reader fell behind by more than the size of the ring, the oldest
+ * samples are skipped and counted in @p lost.
+ *
+ * The writer stops publishing if this is not called often enough to keep up.
+ * Publishing starts again with the next call.
+ *
+ * @param [in]  reader      The reader.
+ * @param [out] sample      The sample.
+ * @param [out] lost        Number of samples skipped before this one.
+ * @return                  1 if a sample was read, 0 if there are no new
+ *                          samples yet.
+ */
+int pbdrv_telemetry_shm_reader_next(pbdrv_telemetry_shm_reader_t *reader, pbdrv_telemetry_sample_t *sample, uint32_t *lost) {
+    pbdrv_telemetry_shm_t *shm = reader->shm;
+
+    *lost = 0;
+
+    for (;;) {
+        uint32_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+
+        // Skip ahead if the writer has lapped us. Leave one slot of margin
+        // since the writer may be busy with the oldest one.
+        if (head - reader->next > PBDRV_TELEMETRY_SHM_NUM_SLOTS - 1) {
+            uint32_t oldest = head - (PBDRV_TELEMETRY_SHM_NUM_SLOTS - 1);
+            *lost += oldest - reader->next;
+            reader->next = oldest;
+        }
+
+        // Keeps the writer publishing. This also restarts it if we were gone
+        // for so long that it stopped.
+        __atomic_store_n(&shm->reader_next, reader->next, __ATOMIC_RELAXED);
+
+        if (head == reader->next) {
+            return 0;
+        }
+
+        const pbdrv_telemetry_shm_slot_t *slot = &shm->slots[reader->next % PBDRV_TELEMETRY_SHM_NUM_SLOTS];
+
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            // Writer is busy with this slot, so it was overwritten.
+            continue;
+        }
+
+        memcpy(sample, &slot->sample, sizeof(*sample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq || sample->count != reader->next) {
+            // Overwritten while copying, try again with newer data.
+            continue;
+        }
+
+        reader->next++;
+        return 1;
+    }
+}
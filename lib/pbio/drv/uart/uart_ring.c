@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Receive buffer shared by the interrupt driven UART drivers.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_UART
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <contiki.h>
+#include <contiki-lib.h>
+
+#include <pbio/error.h>
+
+#include "uart_ring.h"
+
+/**
+ * Initializes an empty receive buffer.
+ *
+ * @param [in]  ring    The receive buffer.
+ */
+void pbdrv_uart_ring_init(pbdrv_uart_ring_t *ring) {
+    ringbuf_init(&ring->buf, ring->data, PBDRV_UART_RING_SIZE);
+    ring->overrun = false;
+}
+
+/**
+ * Adds a received byte. This is called from the interrupt handler.
+ *
+ * If the buffer is full, the byte is dropped and the overrun is reported by
+ * the next call to ::pbdrv_uart_ring_read.
+ *
+ * @param [in]  ring    The receive buffer.
+ * @param [in]  c       The received byte.
+ */
+void pbdrv_uart_ring_put(pbdrv_uart_ring_t *ring, uint8_t c) {
+    if (!ringbuf_put(&ring->buf, c)) {
+        ring->overrun = true;
+    }
+}
+
+/**
+ * Gets the number of bytes that can be read.
+ *
+ * @param [in]  ring    The receive buffer.
+ * @return              The number of bytes.
+ */
+uint32_t pbdrv_uart_ring_in_waiting(pbdrv_uart_ring_t *ring) {
+    return ringbuf_elements(&ring->buf);
+}
+
+/**
+ * Copies received bytes without waiting for more.
+ *
+ * @param [in]  ring    The receive buffer.
+ * @param [in]  msg     Buffer for the received data.
+ * @param [in]  length  Size of @p msg in bytes.
+ * @param [out] count   The number of bytes copied to @p msg.
+ * @return              ::PBIO_ERROR_IO if bytes were dropped since the last
+ *                      call, otherwise ::PBIO_SUCCESS. Nothing is copied on
+ *                      error. The bytes that were kept can be read by the
+ *                      next call.
+ */
+pbio_error_t pbdrv_uart_ring_read(pbdrv_uart_ring_t *ring, uint8_t *msg, uint32_t length, uint32_t *count) {
+    *count = 0;
+
+    if (ring->overrun) {
+        ring->overrun = false;
+        return PBIO_ERROR_IO;
+    }
+
+    while (*count < length) {
+        int c = ringbuf_get(&ring->buf);
+        if (c == -1) {
+            break;
+        }
+        msg[(*count)++] = c;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Discards all received bytes and clears the overrun.
+ *
+ * @param [in]  ring    The receive buffer.
+ */
+void pbdrv_uart_ring_flush(pbdrv_uart_ring_t *ring) {
+    while (ringbuf_get(&ring->buf) != -1) {
+    }
+    ring->overrun = false;
+}
+
+#endif // PBDRV_CONFIG_UART
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Receive buffer shared by the interrupt driven UART drivers.
+//
+// The interrupt handler puts received bytes in a ring buffer. If the buffer is
+// full, new bytes are dropped and the overrun is reported on the next read so
+// that lost data is never silent.
+
+#ifndef _INTERNAL_PBDRV_UART_RING_H_
+#define _INTERNAL_PBDRV_UART_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <contiki.h>
+#include <contiki-lib.h>
+
+#include <pbio/error.h>
+
+/** Size of the receive buffer of each UART. Must be a power of 2, at most 128. */
+#define PBDRV_UART_RING_SIZE 128
+
+typedef struct {
+    /** Received bytes that were not read yet. */
+    struct ringbuf buf;
+    /** Set by the interrupt handler when a byte was dropped. */
+    volatile bool overrun;
+    /** Storage for @p buf. */
+    uint8_t data[PBDRV_UART_RING_SIZE];
+} pbdrv_uart_ring_t;
+
+void pbdrv_uart_ring_init(pbdrv_uart_ring_t *ring);
+void pbdrv_uart_ring_put(pbdrv_uart_ring_t *ring, uint8_t c);
+uint32_t pbdrv_uart_ring_in_waiting(pbdrv_uart_ring_t *ring);
+pbio_error_t pbdrv_uart_ring_read(pbdrv_uart_ring_t *ring, uint8_t *msg, uint32_t length, uint32_t *count);
+void pbdrv_uart_ring_flush(pbdrv_uart_ring_t *ring);
+
+#endif // _INTERNAL_PBDRV_UART_RING_H_
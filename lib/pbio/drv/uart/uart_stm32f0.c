@@ -25,16 +25,13 @@
 #include "../core.h"
 
 #include "stm32f0xx.h"
+#include "uart_ring.h"
 #include "uart_stm32f0.h"
 
-#define UART_RING_BUF_SIZE 32   // must be a power of 2!
-
 typedef struct {
     pbdrv_uart_dev_t uart_dev;
     USART_TypeDef *USART;
-    uint8_t rx_ring_buf[UART_RING_BUF_SIZE];
-    volatile uint8_t rx_ring_buf_head;
-    uint8_t rx_ring_buf_tail;
+    pbdrv_uart_ring_t rx_ring;
     uint8_t *rx_buf;
     uint8_t rx_buf_size;
     uint8_t rx_buf_index;
@@ -176,21 +173,35 @@ void pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart_dev, uint32_t baud) {
 void pbdrv_uart_flush(pbdrv_uart_dev_t *uart_dev) {
     pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
     uart->rx_buf = NULL;
-    uart->rx_ring_buf_head = 0;
-    uart->rx_ring_buf_tail = 0;
+    pbdrv_uart_ring_flush(&uart->rx_ring);
     uart->rx_buf_size = 0;
     uart->rx_buf_index = 0;
 }
 
+uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart_dev) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+    return pbdrv_uart_ring_in_waiting(&uart->rx_ring);
+}
+
+pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uint32_t length, uint32_t *count) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+
+    if (uart->rx_buf) {
+        // read_begin() owns the ring buffer
+        *count = 0;
+        return PBIO_ERROR_BUSY;
+    }
+
+    return pbdrv_uart_ring_read(&uart->rx_ring, msg, length, count);
+}
+
 void pbdrv_uart_stm32f0_handle_irq(uint8_t id) {
     pbdrv_uart_t *uart = &pbdrv_uart[id];
     uint32_t isr = uart->USART->ISR;
 
     // receive next byte
     if (isr & USART_ISR_RXNE) {
-        // REVISIT: Do we need to have an overrun error when the ring buffer gets full?
-        uart->rx_ring_buf[uart->rx_ring_buf_head] = uart->USART->RDR;
-        uart->rx_ring_buf_head = (uart->rx_ring_buf_head + 1) & (UART_RING_BUF_SIZE - 1);
+        pbdrv_uart_ring_put(&uart->rx_ring, uart->USART->RDR);
         process_poll(&pbdrv_uart_process);
     }
 
@@ -219,9 +230,9 @@ static void handle_poll(void) {
         // if receive is pending and we have not received all bytes yet...
         if (uart->rx_buf && uart->rx_result == PBIO_ERROR_AGAIN && uart->rx_buf_index < uart->rx_buf_size) {
             // copy all available bytes to rx_buf
-            while (uart->rx_ring_buf_head != uart->rx_ring_buf_tail) {
-                uart->rx_buf[uart->rx_buf_index++] = uart->rx_ring_buf[uart->rx_ring_buf_tail];
-                uart->rx_ring_buf_tail = (uart->rx_ring_buf_tail + 1) & (UART_RING_BUF_SIZE - 1);
+            int c;
+            while ((c = ringbuf_get(&uart->rx_ring.buf)) != -1) {
+                uart->rx_buf[uart->rx_buf_index++] = c;
                 // when rx_buf is full, send out a notification
                 if (uart->rx_buf_index == uart->rx_buf_size) {
                     uart->rx_result = PBIO_SUCCESS;
@@ -262,6 +273,7 @@ PROCESS_THREAD(pbdrv_uart_process, ev, data) {
 
         uart->USART = pdata->uart,
         uart->irq = pdata->irq,
+        pbdrv_uart_ring_init(&uart->rx_ring);
 
         uart->USART->CR3 |= USART_CR3_OVRDIS;
         uart->USART->CR1 |= USART_CR1_RXNEIE | USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;
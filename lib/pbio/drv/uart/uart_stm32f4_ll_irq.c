@@ -22,18 +22,17 @@
 #include <pbio/util.h>
 
 #include "../core.h"
+#include "./uart_ring.h"
 #include "./uart_stm32f4_ll_irq.h"
 #include "../../src/processes.h"
 
-#define RX_DATA_SIZE 64 // must be power of 2 for ring buffer!
-
 typedef struct {
     /** Public UART device handle. */
     pbdrv_uart_dev_t uart_dev;
     /** Platform-specific data */
     const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata;
     /** Circular buffer for caching received bytes. */
-    struct ringbuf rx_buf;
+    pbdrv_uart_ring_t rx_ring;
     /** Timer for read timeout. */
     struct etimer read_timer;
     /** Timer for write timeout. */
@@ -53,7 +52,6 @@ typedef struct {
 } pbdrv_uart_t;
 
 static pbdrv_uart_t pbdrv_uart[PBDRV_CONFIG_UART_STM32F4_LL_IRQ_NUM_UART];
-static uint8_t pbdrv_uart_rx_data[PBDRV_CONFIG_UART_STM32F4_LL_IRQ_NUM_UART][RX_DATA_SIZE];
 
 PROCESS(pbdrv_uart_process, "UART");
 
@@ -86,6 +84,9 @@ pbio_error_t pbdrv_uart_read_begin(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uin
 
     etimer_set(&uart->read_timer, timeout);
 
+    // Data may already be waiting in the ring buffer.
+    process_poll(&pbdrv_uart_process);
+
     return PBIO_SUCCESS;
 }
 
@@ -179,6 +180,26 @@ void pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart_dev, uint32_t baud) {
 }
 
 void pbdrv_uart_flush(pbdrv_uart_dev_t *uart_dev) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+    uart->read_buf = NULL;
+    pbdrv_uart_ring_flush(&uart->rx_ring);
+}
+
+uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart_dev) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+    return pbdrv_uart_ring_in_waiting(&uart->rx_ring);
+}
+
+pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uint32_t length, uint32_t *count) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+
+    if (uart->read_buf) {
+        // read_begin() owns the ring buffer
+        *count = 0;
+        return PBIO_ERROR_BUSY;
+    }
+
+    return pbdrv_uart_ring_read(&uart->rx_ring, msg, length, count);
 }
 
 void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id) {
@@ -187,7 +208,7 @@ void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id) {
     uint32_t sr = USARTx->SR;
 
     if (sr & USART_SR_RXNE) {
-        ringbuf_put(&uart->rx_buf, LL_USART_ReceiveData8(USARTx));
+        pbdrv_uart_ring_put(&uart->rx_ring, LL_USART_ReceiveData8(USARTx));
         process_poll(&pbdrv_uart_process);
     }
 
@@ -217,7 +238,7 @@ static void handle_poll(void) {
 
         // if receive is pending and we have not received all bytes yet
         while (uart->read_buf && uart->read_pos < uart->read_length) {
-            int c = ringbuf_get(&uart->rx_buf);
+            int c = ringbuf_get(&uart->rx_ring.buf);
             if (c == -1) {
                 break;
             }
@@ -261,10 +282,9 @@ PROCESS_THREAD(pbdrv_uart_process, ev, data) {
 
     for (int i = 0; i < PBDRV_CONFIG_UART_STM32F4_LL_IRQ_NUM_UART; i++) {
         const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata = &pbdrv_uart_stm32f4_ll_irq_platform_data[i];
-        uint8_t *rx_data = pbdrv_uart_rx_data[i];
         pbdrv_uart_t *uart = &pbdrv_uart[i];
         uart->pdata = pdata;
-        ringbuf_init(&uart->rx_buf, rx_data, RX_DATA_SIZE);
+        pbdrv_uart_ring_init(&uart->rx_ring);
 
         // configure UART
 
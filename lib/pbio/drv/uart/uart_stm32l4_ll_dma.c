@@ -324,8 +324,49 @@ void pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart_dev, uint32_t baud) {
 
 void pbdrv_uart_flush(pbdrv_uart_dev_t *uart_dev) {
     pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+    const pbdrv_uart_stm32l4_ll_dma_platform_data_t *pdata = uart->pdata;
+
     uart->read_buf = NULL;
     uart->read_length = 0;
+
+    // discard everything DMA has written so far by moving the tail up to the head
+    uart->rx_tail = (RX_DATA_SIZE - LL_DMA_GetDataLength(pdata->rx_dma, pdata->rx_dma_ch)) & (RX_DATA_SIZE - 1);
+}
+
+uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart_dev) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+    const pbdrv_uart_stm32l4_ll_dma_platform_data_t *pdata = uart->pdata;
+
+    // head is the last position that DMA wrote to
+    uint32_t rx_head = RX_DATA_SIZE - LL_DMA_GetDataLength(pdata->rx_dma, pdata->rx_dma_ch);
+
+    return (rx_head - uart->rx_tail) & (RX_DATA_SIZE - 1);
+}
+
+pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uint32_t length, uint32_t *count) {
+    pbdrv_uart_t *uart = PBIO_CONTAINER_OF(uart_dev, pbdrv_uart_t, uart_dev);
+
+    *count = 0;
+
+    if (uart->read_buf) {
+        // read_begin() owns the ring buffer
+        return PBIO_ERROR_BUSY;
+    }
+
+    // REVISIT: DMA overwrites the oldest data when the buffer is full, so an
+    // overrun can't be detected here.
+    uint32_t available = pbdrv_uart_in_waiting(uart_dev);
+    if (available > length) {
+        available = length;
+    }
+
+    for (uint32_t i = 0; i < available; i++) {
+        msg[i] = uart->rx_data[uart->rx_tail];
+        uart->rx_tail = (uart->rx_tail + 1) & (RX_DATA_SIZE - 1);
+    }
+    *count = available;
+
+    return PBIO_SUCCESS;
 }
 
 void pbdrv_uart_stm32l4_ll_dma_handle_tx_dma_irq(uint8_t id) {
@@ -26,6 +26,9 @@ static USBD_HandleTypeDef husbd;
 static PCD_HandleTypeDef hpcd;
 static volatile bool vbus_active;
 static pbdrv_usb_bcd_t pbdrv_usb_bcd;
+static bool pbdrv_usb_started;
+
+extern USBD_DescriptorsTypeDef VCP_Desc;
 
 /**
  * Battery charger detection task.
@@ -128,7 +131,8 @@ void pbdrv_usb_init(void) {
     husbd.pData = &hpcd;
     hpcd.pData = &husbd;
 
-    USBD_Init(&husbd, NULL, 0);
+    USBD_Init(&husbd, &VCP_Desc, 0);
+    pbdrv_usb_stm32_serial_init(&husbd);
     process_start(&pbdrv_usb_process);
 
     // VBUS may already be active
@@ -150,6 +154,10 @@ PROCESS_THREAD(pbdrv_usb_process, ev, data) {
     PROCESS_POLLHANDLER({
         if (!bcd_busy && pbio_oneshot(!vbus_active, &no_vbus_oneshot)) {
             pbdrv_usb_bcd = PBDRV_USB_BCD_NONE;
+            if (pbdrv_usb_started) {
+                USBD_Stop(&husbd);
+                pbdrv_usb_started = false;
+            }
         }
 
         // pbdrv_usb_stm32_bcd_detect() needs to run completely to the end,
@@ -169,6 +177,14 @@ PROCESS_THREAD(pbdrv_usb_process, ev, data) {
 
         if (bcd_busy) {
             bcd_busy = PT_SCHEDULE(pbdrv_usb_stm32_bcd_detect(&bcd_pt));
+
+            // Only data ports have a host that we can talk to. Chargers may
+            // not like it if we pull up the data lines.
+            if (!bcd_busy && (pbdrv_usb_bcd == PBDRV_USB_BCD_STANDARD_DOWNSTREAM
+                              || pbdrv_usb_bcd == PBDRV_USB_BCD_CHARGING_DOWNSTREAM)) {
+                USBD_Start(&husbd);
+                pbdrv_usb_started = true;
+            }
         }
     }
 
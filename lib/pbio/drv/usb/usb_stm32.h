@@ -15,6 +15,9 @@
 void pbdrv_usb_stm32_handle_otg_fs_irq(void);
 void pbdrv_usb_stm32_handle_vbus_irq(bool active);
 
+struct _USBD_HandleTypeDef;
+void pbdrv_usb_stm32_serial_init(struct _USBD_HandleTypeDef *husbd);
+
 #endif // PBDRV_CONFIG_USB_STM32F4
 
 #endif // _INTERNAL_PBDRV_USB_STM32_H_
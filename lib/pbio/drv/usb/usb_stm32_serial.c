@@ -1,38 +1,57 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2020 The Pybricks Authors
+// Copyright (c) 2020-2023 The Pybricks Authors
 
 // USB serial port driver (CDC/ACM) for STM32 MCUs.
+//
+// Received packets are copied into a ring buffer from the interrupt handler
+// and handed to the receive handler from the USB serial process. Two packet
+// buffers are used for the OUT endpoint so that the next packet can already
+// be received while the previous one is being copied.
+//
+// Data to be sent is transmitted directly from the Tx ring buffer, so that
+// one transfer can be in flight while the next one is being written.
 
 #include <pbdrv/config.h>
 
-#if PBDRV_CONFIG_USB_STM32F4_CDC
+#if PBDRV_CONFIG_USB_STM32F4
 
 #include <stdbool.h>
 #include <stdint.h>
 
-#include <pbio/error.h>
-#include <pbio/util.h>
-
 #include <contiki.h>
-#include <contiki-lib.h>
-
+#include <lwrb/lwrb.h>
+#include <stm32f4xx_hal.h>
 #include <usbd_cdc.h>
 #include <usbd_core.h>
 
-PROCESS(pbdrv_usb_process, "USB");
+#include <pbdrv/usb.h>
+#include <pbio/util.h>
+
+#include "./usb_stm32.h"
+
+// Large enough for a few full size Pybricks messages + 1 byte for ring buf pointer.
+#define RX_RING_SIZE (1024 + 1)
+#define TX_RING_SIZE (2048 + 1)
+
+#define RX_PACKET_SIZE CDC_DATA_FS_OUT_PACKET_SIZE
 
-static uint8_t usb_in_buf[CDC_DATA_FS_MAX_PACKET_SIZE];
-static uint8_t usb_out_buf[CDC_DATA_FS_MAX_PACKET_SIZE - 1];
-static volatile bool usb_in_busy;
-static volatile bool usb_out_busy;
+PROCESS(pbdrv_usb_stm32_serial_process, "USB serial");
+
+static USBD_HandleTypeDef *pdev;
+
+static uint8_t rx_packet[2][RX_PACKET_SIZE];
+static uint8_t rx_packet_index;
+static volatile bool rx_armed;
+static lwrb_t rx_ring;
+
+static volatile bool tx_busy;
+static uint32_t tx_size;
+static lwrb_t tx_ring;
 
 static volatile bool usb_connected;
 
-// size must be power of 2 for ringbuf! also can't be > 255!
-static uint8_t stdout_data[128];
-static uint8_t stdin_data[128];
-static struct ringbuf stdout_buf;
-static struct ringbuf stdin_buf;
+static pbdrv_usb_receive_handler_t receive_handler;
+static pbdrv_usb_on_event_t on_event;
 
 static USBD_CDC_LineCodingTypeDef LineCoding = {
     .bitrate = 115200,
@@ -41,10 +60,20 @@ static USBD_CDC_LineCodingTypeDef LineCoding = {
     .datatype = 8,
 };
 
-// moved to usb_stm32.c
-// static USBD_HandleTypeDef USBD_Device;
 extern USBD_DescriptorsTypeDef VCP_Desc;
 
+/**
+ * Prepares the OUT endpoint to receive the next packet.
+ *
+ * Must be called with the USB interrupt disabled or from the interrupt.
+ */
+static void pbdrv_usb_stm32_serial_arm_rx(void) {
+    USBD_CDC_SetRxBuffer(pdev, rx_packet[rx_packet_index]);
+    if (USBD_CDC_ReceivePacket(pdev) == USBD_OK) {
+        rx_armed = true;
+    }
+}
+
 /**
   * @brief  CDC_Itf_Init
   *         Initializes the CDC media low layer
@@ -52,12 +81,12 @@ extern USBD_DescriptorsTypeDef VCP_Desc;
   * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
   */
 static int8_t CDC_Itf_Init(void) {
-    ringbuf_init(&stdin_buf, stdin_data, (uint8_t)PBIO_ARRAY_SIZE(stdin_data));
-    ringbuf_init(&stdout_buf, stdout_data, (uint8_t)PBIO_ARRAY_SIZE(stdout_data));
-    USBD_CDC_SetTxBuffer(&USBD_Device, usb_out_buf, 0);
-    USBD_CDC_SetRxBuffer(&USBD_Device, usb_in_buf);
-    usb_in_busy = false;
-    usb_out_busy = false;
+    lwrb_reset(&rx_ring);
+    rx_packet_index = 0;
+    // The CDC class arms the OUT endpoint right after this returns.
+    USBD_CDC_SetRxBuffer(pdev, rx_packet[rx_packet_index]);
+    rx_armed = true;
+    tx_busy = false;
     usb_connected = false;
 
     return USBD_OK;
@@ -71,6 +100,9 @@ static int8_t CDC_Itf_Init(void) {
   */
 static int8_t CDC_Itf_DeInit(void) {
     usb_connected = false;
+    rx_armed = false;
+    tx_busy = false;
+    process_poll(&pbdrv_usb_stm32_serial_process);
     return USBD_OK;
 }
 
@@ -118,9 +150,9 @@ static int8_t CDC_Itf_Control(uint8_t cmd, uint8_t *pbuf, uint16_t length) {
 
         case CDC_SET_CONTROL_LINE_STATE: {
             USBD_SetupReqTypedef *req = (void *)pbuf;
-            // REVISIT: MicroPython defers the connection state here to allow
-            // some time to disable local echo on the remote terminal
+            // The host sets DTR when a program opens the port.
             usb_connected = !!(req->wValue & CDC_CONTROL_LINE_DTR);
+            process_poll(&pbdrv_usb_stm32_serial_process);
             break;
         }
         case CDC_SEND_BREAK:
@@ -139,11 +171,23 @@ static int8_t CDC_Itf_Control(uint8_t cmd, uint8_t *pbuf, uint16_t length) {
   * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
   */
 static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len) {
-    for (int i = 0; i < *Len; i++) {
-        ringbuf_put(&stdin_buf, Buf[i]);
+    rx_armed = false;
+    rx_packet_index ^= 1;
+
+    // If there is room for this packet and the next one, receive the next
+    // packet into the other buffer while we copy this one.
+    if (lwrb_get_free(&rx_ring) >= 2 * RX_PACKET_SIZE) {
+        pbdrv_usb_stm32_serial_arm_rx();
+    }
+
+    lwrb_write(&rx_ring, Buf, *Len);
+
+    // Otherwise, the process will arm it once there is room again.
+    if (!rx_armed && lwrb_get_free(&rx_ring) >= RX_PACKET_SIZE) {
+        pbdrv_usb_stm32_serial_arm_rx();
     }
-    usb_in_busy = false;
-    // process_poll(&pbdrv_usb_process);
+
+    process_poll(&pbdrv_usb_stm32_serial_process);
     return USBD_OK;
 }
 
@@ -160,8 +204,8 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len) {
   * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
   */
 static int8_t CDC_Itf_TransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum) {
-    usb_out_busy = false;
-    // process_poll(&pbdrv_usb_process);
+    tx_busy = false;
+    process_poll(&pbdrv_usb_stm32_serial_process);
     return USBD_OK;
 }
 
@@ -173,93 +217,133 @@ static USBD_CDC_ItfTypeDef USBD_CDC_fops = {
     .TransmitCplt = CDC_Itf_TransmitCplt,
 };
 
-static void pbdrv_stm32_usb_serial_init(void) {
-    // This is now done in usb_stm32.c
-    // USBD_Init(&USBD_Device, &VCP_Desc, 0);
-    USBD_RegisterClass(&USBD_Device, USBD_CDC_CLASS);
-    USBD_CDC_RegisterInterface(&USBD_Device, &USBD_CDC_fops);
-    USBD_Start(&USBD_Device);
+/**
+ * Initializes the CDC class on the USB device.
+ *
+ * This must be called after USBD_Init() and before USBD_Start().
+ *
+ * @param [in]  husbd   The USB device handle.
+ */
+void pbdrv_usb_stm32_serial_init(USBD_HandleTypeDef *husbd) {
+    static uint8_t rx_data[RX_RING_SIZE];
+    static uint8_t tx_data[TX_RING_SIZE];
+
+    pdev = husbd;
+
+    lwrb_init(&rx_ring, rx_data, PBIO_ARRAY_SIZE(rx_data));
+    lwrb_init(&tx_ring, tx_data, PBIO_ARRAY_SIZE(tx_data));
+
+    USBD_RegisterClass(pdev, USBD_CDC_CLASS);
+    USBD_CDC_RegisterInterface(pdev, &USBD_CDC_fops);
+
+    process_start(&pbdrv_usb_stm32_serial_process);
 }
 
-static void pbdrv_stm32_usb_serial_transmit(void) {
-    static int tx_size = 0;
+/**
+ * Starts sending the next block from the Tx ring buffer.
+ *
+ * Data is sent directly from the ring buffer and is only removed from it
+ * once the transfer is complete.
+ */
+static void pbdrv_usb_stm32_serial_transmit(void) {
+    if (tx_busy) {
+        return;
+    }
 
-    if (usb_out_busy) {
+    if (tx_size) {
+        lwrb_skip(&tx_ring, tx_size);
+        tx_size = 0;
+    }
+
+    if (!usb_connected) {
+        // Nobody is listening, so drop the data instead of blocking the writer.
+        lwrb_reset(&tx_ring);
         return;
     }
 
-    // If tx_size > 0 it means we have a pending retry, otherwise we get as
-    // much as we can from the stdout buffer.
-    if (tx_size == 0) {
-        tx_size = ringbuf_elements(&stdout_buf);
-        if (tx_size > PBIO_ARRAY_SIZE(usb_out_buf)) {
-            tx_size = PBIO_ARRAY_SIZE(usb_out_buf);
-        }
-        if (tx_size > 0) {
-            for (int i = 0; i < tx_size; i++) {
-                usb_out_buf[i] = ringbuf_get(&stdout_buf);
-            }
-        }
+    uint32_t size = lwrb_get_linear_block_read_length(&tx_ring);
+    if (size == 0) {
+        return;
     }
 
-    if (tx_size > 0) {
-        USBD_CDC_SetTxBuffer(&USBD_Device, usb_out_buf, tx_size);
-        if (USBD_CDC_TransmitPacket(&USBD_Device) == USBD_OK) {
-            usb_out_busy = true;
-            tx_size = 0;
-        }
+    HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+    USBD_CDC_SetTxBuffer(pdev, lwrb_get_linear_block_read_address(&tx_ring), size);
+    if (USBD_CDC_TransmitPacket(pdev) == USBD_OK) {
+        tx_busy = true;
+        tx_size = size;
     }
+    HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
 }
 
-static void pbdrv_stm32_usb_serial_receive(void) {
-    if (usb_in_busy) {
-        return;
+/**
+ * Hands received data to the receive handler.
+ */
+static void pbdrv_usb_stm32_serial_receive(void) {
+    uint32_t size;
+
+    while ((size = lwrb_get_linear_block_read_length(&rx_ring))) {
+        if (receive_handler) {
+            receive_handler(lwrb_get_linear_block_read_address(&rx_ring), size);
+        }
+        lwrb_skip(&rx_ring, size);
     }
 
-    if (USBD_CDC_ReceivePacket(&USBD_Device) == USBD_OK) {
-        usb_in_busy = true;
+    if (!rx_armed && usb_connected) {
+        HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+        pbdrv_usb_stm32_serial_arm_rx();
+        HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
     }
 }
 
-// TODO: need to multiplex stdin/stdout with Bluetooth or remove USB serial
-
-// pbio_error_t pbsys_stdout_put_char(uint8_t c) {
-//     if (!usb_connected) {
-//         // don't lock up print() when USB not connected - data is discarded
-//         return PBIO_SUCCESS;
-//     }
-//     if (ringbuf_put(&stdout_buf, c) == 0) {
-//         return PBIO_SUCCESS;
-//     }
-//     return PBIO_SUCCESS;
-// }
-
-// pbio_error_t pbsys_stdin_get_char(uint8_t *c) {
-//     if (ringbuf_elements(&stdin_buf) == 0) {
-//         return PBIO_ERROR_AGAIN;
-//     }
-//     *c = ringbuf_get(&stdin_buf);
-//     return PBIO_SUCCESS;
-// }
-
-// TODO: This process needs to be started by the main USB code (we still want
-// a separate process for serial since it can be polled quite frequently).
-PROCESS_THREAD(pbdrv_usb_process, ev, data) {
-    static struct etimer timer;
+bool pbdrv_usb_is_connected(void) {
+    return usb_connected;
+}
 
-    PROCESS_BEGIN();
+void pbdrv_usb_set_receive_handler(pbdrv_usb_receive_handler_t handler) {
+    receive_handler = handler;
+}
 
-    pbdrv_stm32_usb_serial_init();
-    etimer_set(&timer, 5);
+void pbdrv_usb_set_on_event(pbdrv_usb_on_event_t callback) {
+    on_event = callback;
+}
+
+uint32_t pbdrv_usb_tx_get_free(void) {
+    return lwrb_get_free(&tx_ring);
+}
+
+uint32_t pbdrv_usb_tx(const uint8_t *data, uint32_t size) {
+    if (!usb_connected) {
+        return 0;
+    }
+
+    size = lwrb_write(&tx_ring, data, size);
+    process_poll(&pbdrv_usb_stm32_serial_process);
+    return size;
+}
+
+bool pbdrv_usb_tx_is_idle(void) {
+    if (!usb_connected) {
+        return true;
+    }
+
+    return !tx_busy && lwrb_get_full(&tx_ring) == 0;
+}
+
+PROCESS_THREAD(pbdrv_usb_stm32_serial_process, ev, data) {
+    PROCESS_BEGIN();
 
     for (;;) {
-        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || (ev == PROCESS_EVENT_TIMER && etimer_expired(&timer)));
-        etimer_reset(&timer);
-        pbdrv_stm32_usb_serial_transmit();
-        pbdrv_stm32_usb_serial_receive();
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        pbdrv_usb_stm32_serial_receive();
+        pbdrv_usb_stm32_serial_transmit();
+
+        if (on_event) {
+            on_event();
+        }
     }
 
     PROCESS_END();
 }
 
-#endif // PBDRV_CONFIG_USB_STM32F4_CDC
+#endif // PBDRV_CONFIG_USB_STM32F4
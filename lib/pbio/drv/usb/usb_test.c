@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_USB_TEST
+
+// USB implementation for tests. The test acts as the USB host: it writes to
+// the same ring buffer that the USB interrupt would fill and reads back what
+// was sent, so the layers above can be tested as a loopback.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <contiki.h>
+#include <lwrb/lwrb.h>
+
+#include <pbdrv/usb.h>
+#include <pbio/util.h>
+
+PROCESS(pbdrv_usb_test_process, "USB test");
+
+static bool usb_connected;
+static lwrb_t rx_ring;
+static lwrb_t tx_ring;
+static pbdrv_usb_receive_handler_t receive_handler;
+static pbdrv_usb_on_event_t on_event;
+
+/**
+ * Plugs in or unplugs the cable and opens or closes the port on the host.
+ * @param [in]  connected   The new connection state.
+ */
+void pbio_test_usb_connect(bool connected) {
+    usb_connected = connected;
+    if (!connected) {
+        lwrb_reset(&rx_ring);
+        lwrb_reset(&tx_ring);
+    }
+    process_poll(&pbdrv_usb_test_process);
+}
+
+/**
+ * Sends data from the host to the hub.
+ * @param [in]  data    The data.
+ * @param [in]  size    The size of @p data in bytes.
+ * @return              The number of bytes that fit in the buffer.
+ */
+uint32_t pbio_test_usb_host_write(const uint8_t *data, uint32_t size) {
+    size = lwrb_write(&rx_ring, data, size);
+    process_poll(&pbdrv_usb_test_process);
+    return size;
+}
+
+/**
+ * Reads data that the hub sent to the host.
+ * @param [in]  data    Buffer for the data.
+ * @param [in]  size    The size of @p data in bytes.
+ * @return              The number of bytes read.
+ */
+uint32_t pbio_test_usb_host_read(uint8_t *data, uint32_t size) {
+    size = lwrb_read(&tx_ring, data, size);
+    process_poll(&pbdrv_usb_test_process);
+    return size;
+}
+
+void pbdrv_usb_init(void) {
+    static uint8_t rx_data[1024 + 1];
+    static uint8_t tx_data[2048 + 1];
+
+    lwrb_init(&rx_ring, rx_data, PBIO_ARRAY_SIZE(rx_data));
+    lwrb_init(&tx_ring, tx_data, PBIO_ARRAY_SIZE(tx_data));
+    process_start(&pbdrv_usb_test_process);
+}
+
+pbdrv_usb_bcd_t pbdrv_usb_get_bcd(void) {
+    return usb_connected ? PBDRV_USB_BCD_STANDARD_DOWNSTREAM : PBDRV_USB_BCD_NONE;
+}
+
+bool pbdrv_usb_is_connected(void) {
+    return usb_connected;
+}
+
+void pbdrv_usb_set_receive_handler(pbdrv_usb_receive_handler_t handler) {
+    receive_handler = handler;
+}
+
+void pbdrv_usb_set_on_event(pbdrv_usb_on_event_t callback) {
+    on_event = callback;
+}
+
+uint32_t pbdrv_usb_tx_get_free(void) {
+    return lwrb_get_free(&tx_ring);
+}
+
+uint32_t pbdrv_usb_tx(const uint8_t *data, uint32_t size) {
+    if (!usb_connected) {
+        return 0;
+    }
+
+    size = lwrb_write(&tx_ring, data, size);
+    process_poll(&pbdrv_usb_test_process);
+    return size;
+}
+
+bool pbdrv_usb_tx_is_idle(void) {
+    // Data counts as sent as soon as it is queued for the host to read.
+    return true;
+}
+
+PROCESS_THREAD(pbdrv_usb_test_process, ev, data) {
+    PROCESS_BEGIN();
+
+    for (;;) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        uint32_t size;
+        while ((size = lwrb_get_linear_block_read_length(&rx_ring))) {
+            if (receive_handler) {
+                receive_handler(lwrb_get_linear_block_read_address(&rx_ring), size);
+            }
+            lwrb_skip(&rx_ring, size);
+        }
+
+        if (on_event) {
+            on_event();
+        }
+    }
+
+    PROCESS_END();
+}
+
+#endif // PBDRV_CONFIG_USB_TEST
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#ifndef _INTERNAL_PBDRV_USB_TEST_H_
+#define _INTERNAL_PBDRV_USB_TEST_H_
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_USB_TEST
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// extra USB functions just for tests
+void pbio_test_usb_connect(bool connected);
+uint32_t pbio_test_usb_host_write(const uint8_t *data, uint32_t size);
+uint32_t pbio_test_usb_host_read(uint8_t *data, uint32_t size);
+
+#endif // PBDRV_CONFIG_USB_TEST
+
+#endif // _INTERNAL_PBDRV_USB_TEST_H_
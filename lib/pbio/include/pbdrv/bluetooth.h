@@ -29,10 +29,31 @@ typedef enum {
     PBDRV_BLUETOOTH_CONNECTION_PYBRICKS,
     /** The Nordic UART service. */
     PBDRV_BLUETOOTH_CONNECTION_UART,
-    /** A LEGO Powered Up Handset peripheral connection. */
+    /**
+     * A LEGO Powered Up peripheral connection. This is the first of
+     * ::PBDRV_BLUETOOTH_NUM_PERIPHERALS peripheral connections. Use
+     * ::PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL to get the others.
+     */
     PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3,
 } pbdrv_bluetooth_connection_t;
 
+#ifdef PBDRV_CONFIG_BLUETOOTH_NUM_PERIPHERALS
+#if PBDRV_CONFIG_BLUETOOTH_NUM_PERIPHERALS < 1
+#error PBDRV_CONFIG_BLUETOOTH_NUM_PERIPHERALS out of range
+#endif
+#define PBDRV_BLUETOOTH_NUM_PERIPHERALS PBDRV_CONFIG_BLUETOOTH_NUM_PERIPHERALS
+#else
+/** The number of peripherals that can be connected at the same time. */
+#define PBDRV_BLUETOOTH_NUM_PERIPHERALS 1
+#endif
+
+/**
+ * Gets the connection identifier of a peripheral slot.
+ * @param [in]  peripheral  The slot index, less than ::PBDRV_BLUETOOTH_NUM_PERIPHERALS.
+ */
+#define PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(peripheral) \
+    ((pbdrv_bluetooth_connection_t)(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3 + (peripheral)))
+
 /** Data structure that holds context needed for sending BLE notifications. */
 typedef struct _pbdrv_bluetooth_send_context_t pbdrv_bluetooth_send_context_t;
 
@@ -82,6 +103,10 @@ typedef struct {
     uint8_t bdaddr_type;
     uint8_t bdaddr[6];
     char name[20];
+    /** Called when a notification is received from the peripheral. */
+    pbdrv_bluetooth_receive_handler_t notification_handler;
+    /** The peripheral slot that was assigned to this connection. */
+    uint8_t peripheral;
 } pbdrv_bluetooth_scan_and_connect_context_t;
 
 /** Advertisement types. */
@@ -109,6 +134,14 @@ typedef enum {
  */
 typedef void (*pbdrv_bluetooth_start_observing_callback_t)(pbdrv_bluetooth_ad_type_t type, const uint8_t *data, uint8_t length, int8_t rssi);
 
+/** Connection interval presets that can be requested from the central. */
+typedef enum {
+    /** Long connection interval for saving power when there is little traffic. */
+    PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE,
+    /** Short connection interval for high throughput and low latency. */
+    PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST,
+} pbdrv_bluetooth_connection_interval_t;
+
 #ifdef PBDRV_CONFIG_BLUETOOTH_MAX_MTU_SIZE
 #if PBDRV_CONFIG_BLUETOOTH_MAX_MTU_SIZE < 23 || PBDRV_CONFIG_BLUETOOTH_MAX_MTU_SIZE > 515
 #error PBDRV_CONFIG_BLUETOOTH_MAX_MTU_SIZE out of range
@@ -192,6 +225,27 @@ void pbdrv_bluetooth_set_on_event(pbdrv_bluetooth_on_event_t on_event);
  */
 void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context);
 
+/**
+ * Gets the ATT MTU that was negotiated with the connected central.
+ *
+ * The largest notification payload that can be sent is this value minus 3.
+ *
+ * @return                  The MTU size in bytes. This is 23 (the minimum) if
+ *                          there is no connection or no MTU exchange took place.
+ */
+uint16_t pbdrv_bluetooth_get_mtu_size(void);
+
+/**
+ * Requests that the connected central changes the connection interval.
+ *
+ * This is only a request, the central may choose to ignore it. There is no
+ * feedback on the outcome, so callers should avoid repeating requests too
+ * often. Does nothing if there is no connection.
+ *
+ * @param [in]  interval    The requested connection interval preset.
+ */
+void pbdrv_bluetooth_request_connection_interval(pbdrv_bluetooth_connection_interval_t interval);
+
 /**
  * Registers a callback that will be called when data is received via a
  * characteristic write.
@@ -200,9 +254,6 @@ void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context);
  */
 void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler);
 
-// TODO: combine this with pbdrv_bluetooth_set_receive_handler()
-void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t handler);
-
 /**
  * Starts scanning for a BLE device and connects to it.
  *
@@ -211,17 +262,23 @@ void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t
  *
  * When calling, @p context->bdaddr must be zeroed and @p context->name must
  * be zeroed or set to a name to filter advertising data based on the local
- * name.
+ * name. Notifications from the peripheral are passed to
+ * @p context->notification_handler.
+ *
+ * A free peripheral slot is assigned to @p context->peripheral before this
+ * function returns. If all slots are in use, the task fails with
+ * ::PBIO_ERROR_BUSY. The slot becomes available again when the connection
+ * fails or is disconnected.
  *
- * Currently, this function is hard-coded to only match LEGO Powered Up Handset
+ * Currently, this function is hard-coded to only match LEGO Powered Up
  * devices.
  */
 void pbdrv_bluetooth_scan_and_connect(pbio_task_t *task, pbdrv_bluetooth_scan_and_connect_context_t *context);
 
 // TODO: make this a generic write without response function
-void pbdrv_bluetooth_write_remote(pbio_task_t *task, pbdrv_bluetooth_value_t *value);
+void pbdrv_bluetooth_write_remote(pbio_task_t *task, uint8_t peripheral, pbdrv_bluetooth_value_t *value);
 // TODO: make this a generic disconnect
-void pbdrv_bluetooth_disconnect_remote(void);
+void pbdrv_bluetooth_disconnect_remote(uint8_t peripheral);
 
 /**
  * Starts broadcasting undirected, non-connectable, non-scannable advertisement
@@ -291,21 +348,25 @@ static inline void pbdrv_bluetooth_send(pbdrv_bluetooth_send_context_t *context)
     context->done();
 }
 
-static inline void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
+static inline uint16_t pbdrv_bluetooth_get_mtu_size(void) {
+    return 23;
 }
 
-static inline void pbdrv_bluetooth_set_notification_handler(pbdrv_bluetooth_receive_handler_t handler) {
+static inline void pbdrv_bluetooth_request_connection_interval(pbdrv_bluetooth_connection_interval_t interval) {
+}
+
+static inline void pbdrv_bluetooth_set_receive_handler(pbdrv_bluetooth_receive_handler_t handler) {
 }
 
 static inline void pbdrv_bluetooth_scan_and_connect(pbio_task_t *task, pbdrv_bluetooth_scan_and_connect_context_t *context) {
     task->status = PBIO_ERROR_NOT_SUPPORTED;
 }
 
-static inline void pbdrv_bluetooth_write_remote(pbio_task_t *task, pbdrv_bluetooth_value_t *value) {
+static inline void pbdrv_bluetooth_write_remote(pbio_task_t *task, uint8_t peripheral, pbdrv_bluetooth_value_t *value) {
     task->status = PBIO_ERROR_NOT_SUPPORTED;
 }
 
-static inline void pbdrv_bluetooth_disconnect_remote(void) {
+static inline void pbdrv_bluetooth_disconnect_remote(uint8_t peripheral) {
 }
 
 static inline void pbdrv_bluetooth_start_broadcasting(pbio_task_t *task, pbdrv_bluetooth_value_t *value) {
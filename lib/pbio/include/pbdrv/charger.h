@@ -10,6 +10,7 @@
 #define _PBDRV_CHARGER_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <pbdrv/config.h>
@@ -56,6 +57,69 @@ typedef enum {
     PBDRV_CHARGER_LIMIT_CHARGING,
 } pbdrv_charger_limit_t;
 
+/** Number of samples kept in the charge session history. */
+#define PBDRV_CHARGER_SESSION_HISTORY_SIZE (64)
+
+/** Reason why a charge session ended. */
+typedef enum {
+    /** The session is still in progress or no session has been started yet. */
+    PBDRV_CHARGER_SESSION_END_NONE,
+    /** The charger was disconnected. */
+    PBDRV_CHARGER_SESSION_END_DISCONNECTED,
+    /** The charger chip indicated that charging is complete. */
+    PBDRV_CHARGER_SESSION_END_COMPLETE,
+    /** The charging current tapered off at the full charge voltage. */
+    PBDRV_CHARGER_SESSION_END_TAPER,
+    /** Charging took longer than the safety time limit. */
+    PBDRV_CHARGER_SESSION_END_TIMEOUT,
+    /** The charger chip indicated a fault. */
+    PBDRV_CHARGER_SESSION_END_FAULT,
+} pbdrv_charger_session_end_t;
+
+/** One entry in the charge session history. */
+typedef struct {
+    /** Time since the start of the session in seconds. */
+    uint16_t time;
+    /** The charging current in mA. */
+    uint16_t current;
+    /** The battery voltage in mV. */
+    uint16_t voltage;
+    /** The battery temperature in 0.1 degrees Celsius. */
+    int16_t temperature;
+} pbdrv_charger_sample_t;
+
+/**
+ * Charge session log and end-of-charge state.
+ *
+ * A session starts when the charger starts charging and ends when charging
+ * stops for any reason. The history covers the whole session: when it fills
+ * up, every other sample is dropped and the sample interval is doubled.
+ */
+typedef struct {
+    /** True while a session is in progress. */
+    bool active;
+    /** True while charging is held off after the end of a session. */
+    bool hold_off;
+    /** Why the last session ended. */
+    pbdrv_charger_session_end_t end;
+    /** Duration of the session in ms. */
+    uint32_t duration;
+    /** Charge delivered to the battery in mAs. */
+    uint32_t charge;
+    /** Charge delivered in mA·ms that has not been added to charge yet. */
+    uint32_t charge_remainder;
+    /** Time of the previous update in ms. */
+    uint32_t last_time;
+    /** How long the current has been below the taper threshold in ms. */
+    uint32_t taper_time;
+    /** Time between history samples in seconds. */
+    uint16_t interval;
+    /** Number of valid entries in samples. */
+    uint16_t num_samples;
+    /** The current, voltage and temperature profile of the session. */
+    pbdrv_charger_sample_t samples[PBDRV_CHARGER_SESSION_HISTORY_SIZE];
+} pbdrv_charger_session_t;
+
 #if PBDRV_CONFIG_CHARGER
 
 /**
@@ -79,6 +143,14 @@ pbdrv_charger_status_t pbdrv_charger_get_status(void);
  */
 void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit);
 
+/**
+ * Gets the log of the current or most recent charge session.
+ * @param [out] session The session.
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_NOT_SUPPORTED if
+ *                      the charger driver is not enabled.
+ */
+pbio_error_t pbdrv_charger_get_session(const pbdrv_charger_session_t **session);
+
 #else
 
 static inline pbio_error_t pbdrv_charger_get_current_now(uint16_t *current) {
@@ -93,6 +165,11 @@ static inline pbdrv_charger_status_t pbdrv_charger_get_status(void) {
 static inline void pbdrv_charger_enable(bool enable, pbdrv_charger_limit_t limit) {
 }
 
+static inline pbio_error_t pbdrv_charger_get_session(const pbdrv_charger_session_t **session) {
+    *session = NULL;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
 #endif
 
 #endif // _PBDRV_CHARGER_H_
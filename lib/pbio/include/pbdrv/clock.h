@@ -11,6 +11,9 @@
 
 #include <stdint.h>
 
+#include <pbdrv/config.h>
+#include <pbio/error.h>
+
 /**
  * Gets the current clock time in milliseconds (1e-3 seconds).
  */
@@ -36,6 +39,75 @@ uint32_t pbdrv_clock_get_us(void);
  */
 void pbdrv_clock_delay_us(uint32_t us);
 
+#if PBDRV_CONFIG_CLOCK_LINUX_TIMERFD
+
+#include <signal.h>
+#include <stdbool.h>
+
+/**
+ * Callback for file descriptors that are watched by the Linux event loop.
+ *
+ * This is called from the thread that calls ::pbdrv_clock_linux_wait, which
+ * may not hold any locks, so it should only poll a process or set a flag.
+ *
+ * @param [in]  context     The context given to ::pbdrv_clock_linux_add_fd.
+ * @param [in]  events      The epoll events that occurred.
+ */
+typedef void (*pbdrv_clock_linux_fd_callback_t)(void *context, uint32_t events);
+
+/**
+ * Adds a file descriptor to the set that wakes up the Linux event loop.
+ *
+ * @param [in]  fd          The file descriptor, e.g. a sensor or socket.
+ * @param [in]  events      The epoll events to watch for, e.g. EPOLLIN.
+ * @param [in]  callback    Function called when any of the events occur.
+ * @param [in]  context     Argument passed to @p callback.
+ * @return                  ::PBIO_SUCCESS on success, ::PBIO_ERROR_NO_DEV if
+ *                          there are no free slots or ::PBIO_ERROR_IO if the
+ *                          file descriptor could not be added.
+ */
+pbio_error_t pbdrv_clock_linux_add_fd(int fd, uint32_t events, pbdrv_clock_linux_fd_callback_t callback, void *context);
+
+/**
+ * Removes a file descriptor added with ::pbdrv_clock_linux_add_fd.
+ *
+ * @param [in]  fd          The file descriptor.
+ */
+void pbdrv_clock_linux_remove_fd(int fd);
+
+/**
+ * Arms the timer for the next pending event timer deadline.
+ *
+ * This must be called with the same locks held as for pbio_do_one_event(),
+ * after all pending events have been handled.
+ */
+void pbdrv_clock_linux_arm(void);
+
+/**
+ * Wakes up a thread that is waiting in ::pbdrv_clock_linux_wait.
+ *
+ * Call this from another thread after handling events with pbio_do_one_event()
+ * so that the waiting thread arms the timer for any new deadlines instead of
+ * sleeping until the old one. This can be called from any thread.
+ */
+void pbdrv_clock_linux_wake(void);
+
+/**
+ * Sleeps until the armed deadline, a watched file descriptor is ready, a
+ * signal is received, ::pbdrv_clock_linux_wake is called or @p timeout_ms has
+ * passed, whichever comes first.
+ *
+ * If the deadline was reached, event timers are polled so that the next
+ * call to pbio_do_one_event() handles them.
+ *
+ * @param [in]  timeout_ms  Maximum time to wait or -1 to wait indefinitely.
+ * @param [in]  sigmask     Signal mask to apply while waiting or NULL.
+ * @return                  True if the armed deadline was reached.
+ */
+bool pbdrv_clock_linux_wait(int timeout_ms, const sigset_t *sigmask);
+
+#endif // PBDRV_CONFIG_CLOCK_LINUX_TIMERFD
+
 #endif /* _PBDRV_CLOCK_H_ */
 
 /** @} */
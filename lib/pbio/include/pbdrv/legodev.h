@@ -11,6 +11,7 @@
 
 #include <pbdrv/config.h>
 
+#include <pbdrv/uart.h>
 #include <pbio/angle.h>
 #include <pbio/port.h>
 
@@ -636,6 +637,40 @@ static inline pbio_error_t pbdrv_legodev_get_data(pbdrv_legodev_dev_t *legodev,
 
 #endif // PBDRV_CONFIG_LEGODEV
 
+#if PBDRV_CONFIG_LEGODEV_PUP
+
+/**
+ * Stops device detection on a port and gives direct access to its UART.
+ *
+ * This is used for custom devices that don't speak the LEGO protocol. The
+ * port stays claimed until it is released with ::pbdrv_legodev_release_uart.
+ *
+ * @param [in]  port_id   The requested port.
+ * @param [out] uart      The UART device of the port.
+ * @return                ::PBIO_SUCCESS on success.
+ *                        ::PBIO_ERROR_INVALID_ARG if the port has no UART.
+ *                        ::PBIO_ERROR_BUSY if the port is already claimed.
+ */
+pbio_error_t pbdrv_legodev_claim_uart(pbio_port_id_t port_id, pbdrv_uart_dev_t **uart);
+
+/**
+ * Returns a port claimed with ::pbdrv_legodev_claim_uart to device detection.
+ *
+ * @param [in]  port_id   The port.
+ */
+void pbdrv_legodev_release_uart(pbio_port_id_t port_id);
+
+#else // PBDRV_CONFIG_LEGODEV_PUP
+
+static inline pbio_error_t pbdrv_legodev_claim_uart(pbio_port_id_t port_id, pbdrv_uart_dev_t **uart) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+static inline void pbdrv_legodev_release_uart(pbio_port_id_t port_id) {
+}
+
+#endif // PBDRV_CONFIG_LEGODEV_PUP
+
 #endif // PBDRV_LEGODEV_H
 
 /** @} */
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+/**
+ * @addtogroup TelemetryDriver Driver: Telemetry export
+ *
+ * Publishes control loop state to other processes or devices.
+ * @{
+ */
+
+#ifndef _PBDRV_TELEMETRY_H_
+#define _PBDRV_TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/config.h>
+
+/** Kind of object that published a telemetry sample. */
+typedef enum {
+    /**
+     * Servo state. Values are the same as the columns of the servo logger,
+     * excluding the log time.
+     */
+    PBDRV_TELEMETRY_SOURCE_SERVO = 0,
+    /**
+     * Drivebase state. Values are: time (ticks), distance (mm), drive speed
+     * (mm/s), angle (deg), turn rate (deg/s), distance feedback torque (uNm),
+     * heading feedback torque (uNm).
+     */
+    PBDRV_TELEMETRY_SOURCE_DRIVEBASE = 1,
+} pbdrv_telemetry_source_t;
+
+#if PBDRV_CONFIG_TELEMETRY
+
+/**
+ * Tests if samples are being published.
+ *
+ * Callers can use this to skip collecting data if nobody would receive it.
+ *
+ * @return                  True if publishing is active, false otherwise.
+ */
+bool pbdrv_telemetry_is_active(void);
+
+/**
+ * Publishes one sample.
+ *
+ * @param [in]  source      Kind of object that this sample belongs to.
+ * @param [in]  index       Index of the object, e.g. the servo index.
+ * @param [in]  values      The values.
+ * @param [in]  num_values  The number of values.
+ */
+void pbdrv_telemetry_publish(pbdrv_telemetry_source_t source, uint8_t index, const int32_t *values, uint8_t num_values);
+
+#else // PBDRV_CONFIG_TELEMETRY
+
+static inline bool pbdrv_telemetry_is_active(void) {
+    return false;
+}
+
+static inline void pbdrv_telemetry_publish(pbdrv_telemetry_source_t source, uint8_t index, const int32_t *values, uint8_t num_values) {
+}
+
+#endif // PBDRV_CONFIG_TELEMETRY
+
+#endif // _PBDRV_TELEMETRY_H_
+
+/** @} */
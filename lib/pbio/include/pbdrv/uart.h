@@ -38,6 +38,31 @@ pbio_error_t pbdrv_uart_write_end(pbdrv_uart_dev_t *uart);
 void pbdrv_uart_write_cancel(pbdrv_uart_dev_t *uart);
 void pbdrv_uart_flush(pbdrv_uart_dev_t *uart);
 
+/**
+ * Gets the number of bytes that were received but not read yet.
+ * @param [in]  uart    The UART device
+ * @return              The number of bytes
+ */
+uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart);
+
+/**
+ * Copies bytes that were already received, without waiting for more.
+ *
+ * This is the non-blocking alternative to ::pbdrv_uart_read_begin for
+ * stream-like use of the UART. The two can't be used at the same time.
+ *
+ * @param [in]  uart    The UART device
+ * @param [in]  msg     Buffer for the received data
+ * @param [in]  length  Size of @p msg in bytes
+ * @param [out] count   The number of bytes copied to @p msg
+ * @return              ::PBIO_SUCCESS on success, ::PBIO_ERROR_IO if received
+ *                      bytes were lost because they were not read in time
+ *                      (nothing is copied, the next call continues with the
+ *                      bytes that were kept) or ::PBIO_ERROR_BUSY if a
+ *                      ::pbdrv_uart_read_begin is in progress.
+ */
+pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart, uint8_t *msg, uint32_t length, uint32_t *count);
+
 #else // PBDRV_CONFIG_UART
 
 static inline pbio_error_t pbdrv_uart_get(uint8_t id, pbdrv_uart_dev_t **uart_dev) {
@@ -64,6 +89,13 @@ static inline void pbdrv_uart_write_cancel(pbdrv_uart_dev_t *uart) {
 }
 static inline void pbdrv_uart_flush(pbdrv_uart_dev_t *uart) {
 }
+static inline uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart) {
+    return 0;
+}
+static inline pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart, uint8_t *msg, uint32_t length, uint32_t *count) {
+    *count = 0;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
 
 
 #endif // PBDRV_CONFIG_UART
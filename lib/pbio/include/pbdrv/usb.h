@@ -9,6 +9,9 @@
 #ifndef _PBDRV_USB_H_
 #define _PBDRV_USB_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <pbdrv/config.h>
 
 /**
@@ -27,6 +30,22 @@ typedef enum {
     PBDRV_USB_BCD_DEDICATED_CHARGING,
 } pbdrv_usb_bcd_t;
 
+/**
+ * Callback that is called when data is received from the USB host.
+ *
+ * This is called from the USB process, not from an interrupt.
+ *
+ * @param [in]  data    The data that was received.
+ * @param [in]  size    The size of @p data in bytes.
+ */
+typedef void (*pbdrv_usb_receive_handler_t)(const uint8_t *data, uint32_t size);
+
+/**
+ * Callback that is called when the USB connection state changes or when
+ * transmitted data has been sent.
+ */
+typedef void (*pbdrv_usb_on_event_t)(void);
+
 #if PBDRV_CONFIG_USB
 
 /**
@@ -35,12 +54,72 @@ typedef enum {
  */
 pbdrv_usb_bcd_t pbdrv_usb_get_bcd(void);
 
+/**
+ * Tests if a USB host has opened the serial port.
+ * @return              @c true if the port is open, otherwise @c false.
+ */
+bool pbdrv_usb_is_connected(void);
+
+/**
+ * Sets the callback for received data.
+ * @param [in]  handler The handler or @c NULL.
+ */
+void pbdrv_usb_set_receive_handler(pbdrv_usb_receive_handler_t handler);
+
+/**
+ * Sets the callback for USB events.
+ * @param [in]  on_event The callback or @c NULL.
+ */
+void pbdrv_usb_set_on_event(pbdrv_usb_on_event_t on_event);
+
+/**
+ * Gets the number of bytes that can be queued with ::pbdrv_usb_tx.
+ * @return              The number of bytes.
+ */
+uint32_t pbdrv_usb_tx_get_free(void);
+
+/**
+ * Queues data to be sent to the USB host.
+ * @param [in]  data    The data to send.
+ * @param [in]  size    The size of @p data in bytes.
+ * @return              The number of bytes that were queued.
+ */
+uint32_t pbdrv_usb_tx(const uint8_t *data, uint32_t size);
+
+/**
+ * Tests if all queued data has been sent to the USB host.
+ * @return              @c true if all data was sent, otherwise @c false.
+ */
+bool pbdrv_usb_tx_is_idle(void);
+
 #else // PBDRV_CONFIG_USB
 
 static inline pbdrv_usb_bcd_t pbdrv_usb_get_bcd(void) {
     return PBDRV_USB_BCD_NONE;
 }
 
+static inline bool pbdrv_usb_is_connected(void) {
+    return false;
+}
+
+static inline void pbdrv_usb_set_receive_handler(pbdrv_usb_receive_handler_t handler) {
+}
+
+static inline void pbdrv_usb_set_on_event(pbdrv_usb_on_event_t on_event) {
+}
+
+static inline uint32_t pbdrv_usb_tx_get_free(void) {
+    return 0;
+}
+
+static inline uint32_t pbdrv_usb_tx(const uint8_t *data, uint32_t size) {
+    return 0;
+}
+
+static inline bool pbdrv_usb_tx_is_idle(void) {
+    return true;
+}
+
 #endif // PBDRV_CONFIG_USB
 
 #endif // _PBDRV_USB_H_
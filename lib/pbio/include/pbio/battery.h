@@ -63,6 +63,43 @@ static inline int32_t pbio_battery_get_voltage_from_duty_pct(int32_t duty) {
 
 #endif // PBIO_CONFIG_BATTERY
 
+#if PBIO_CONFIG_BATTERY_SOC
+
+int32_t pbio_battery_get_state_of_charge(void);
+int32_t pbio_battery_get_capacity(void);
+pbio_error_t pbio_battery_set_capacity(int32_t capacity);
+int32_t pbio_battery_get_average_current(void);
+int32_t pbio_battery_get_open_circuit_voltage(void);
+int32_t pbio_battery_get_max_current(int32_t voltage);
+
+#else // PBIO_CONFIG_BATTERY_SOC
+
+static inline int32_t pbio_battery_get_state_of_charge(void) {
+    return 0;
+}
+
+static inline int32_t pbio_battery_get_capacity(void) {
+    return 0;
+}
+
+static inline pbio_error_t pbio_battery_set_capacity(int32_t capacity) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+static inline int32_t pbio_battery_get_average_current(void) {
+    return 0;
+}
+
+static inline int32_t pbio_battery_get_open_circuit_voltage(void) {
+    return 0;
+}
+
+static inline int32_t pbio_battery_get_max_current(int32_t voltage) {
+    return 0;
+}
+
+#endif // PBIO_CONFIG_BATTERY_SOC
+
 #endif // _PBIO_BATTERY_H_
 
 /** @} */
@@ -11,6 +11,11 @@
 #define PBIO_CONFIG_ENABLE_SYS (0)
 #endif
 
+// Battery state of charge estimation
+#ifndef PBIO_CONFIG_BATTERY_SOC
+#define PBIO_CONFIG_BATTERY_SOC (0)
+#endif
+
 // Control loop time
 #ifndef PBIO_CONFIG_CONTROL_LOOP_TIME_MS
 #define PBIO_CONFIG_CONTROL_LOOP_TIME_MS (5)
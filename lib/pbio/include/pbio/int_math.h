@@ -17,6 +17,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include <pbio/error.h>
+
 // Clamping and binding:
 
 int32_t pbio_int_math_bind(int32_t value, int32_t min, int32_t max);
@@ -37,6 +39,15 @@ int32_t pbio_int_math_mult_then_div(int32_t a, int32_t b, int32_t c);
 int32_t pbio_int_math_sqrt(int32_t n);
 int32_t pbio_int_math_sin_deg(int32_t x);
 int32_t pbio_int_math_cos_deg(int32_t x);
+int32_t pbio_int_math_sin_mdeg(int32_t x);
+int32_t pbio_int_math_cos_mdeg(int32_t x);
+
+// Q16.16 fixed point conversions.
+
+#define PBIO_INT_MATH_Q16_ONE (1 << 16)
+
+pbio_error_t pbio_int_math_q16_from_float(float x, int32_t *result);
+pbio_error_t pbio_int_math_q16_from_q32(int64_t x, int32_t *result);
 
 #endif // _PBIO_INT_MATH_H_
 
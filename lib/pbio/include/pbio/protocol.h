@@ -181,6 +181,65 @@ typedef enum {
     PBIO_PYBRICKS_EVENT_WRITE_STDOUT = 1,
 } pbio_pybricks_event_t;
 
+/**
+ * Message types used when the Pybricks protocol is carried over USB.
+ *
+ * USB CDC is a byte stream, so each message is framed as one byte with the
+ * message type, followed by the payload size as a 16-bit little-endian
+ * unsigned integer, followed by the payload.
+ */
+typedef enum {
+    /**
+     * Command from the host to the hub.
+     *
+     * The payload is the same as what is written to the Pybricks command/event
+     * characteristic. The hub replies to each command with a
+     * ::PBIO_PYBRICKS_USB_MSG_RESPONSE message.
+     *
+     * @since Pybricks Profile v1.3.0
+     */
+    PBIO_PYBRICKS_USB_MSG_COMMAND = 1,
+
+    /**
+     * Response from the hub to the host.
+     *
+     * The payload is one byte containing a ::pbio_pybricks_error_t.
+     *
+     * @since Pybricks Profile v1.3.0
+     */
+    PBIO_PYBRICKS_USB_MSG_RESPONSE = 2,
+
+    /**
+     * Event from the hub to the host.
+     *
+     * The payload is the same as a notification of the Pybricks command/event
+     * characteristic.
+     *
+     * @since Pybricks Profile v1.3.0
+     */
+    PBIO_PYBRICKS_USB_MSG_EVENT = 3,
+
+    /**
+     * Hub capabilities.
+     *
+     * Sent by the hub when the host opens the port. The payload is the same as
+     * the value of the Pybricks hub capabilities characteristic.
+     *
+     * @since Pybricks Profile v1.3.0
+     */
+    PBIO_PYBRICKS_USB_MSG_HUB_CAPABILITIES = 4,
+} pbio_pybricks_usb_msg_t;
+
+/**
+ * Size of the header of a USB message.
+ */
+#define PBIO_PYBRICKS_USB_MSG_HEADER_SIZE 3
+
+/**
+ * Maximum payload size of a USB message.
+ */
+#define PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE 512
+
 /**
  * Hub status indicators.
  *
@@ -12,6 +12,7 @@
 #define _PBIO_TASK_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <contiki.h>
 
@@ -23,6 +24,16 @@ typedef struct _pbio_task_t pbio_task_t;
 /** Task protothread function. */
 typedef PT_THREAD((*pbio_task_thread_t)(struct pt *pt, pbio_task_t *task));
 
+/**
+ * Callback that is called when cancellation of a task is requested.
+ *
+ * This is set by the driver that runs the task so that it can make the task
+ * run again right away instead of waiting for the next driver event.
+ *
+ * @param [in]  task    The task.
+ */
+typedef void (*pbio_task_cancel_callback_t)(pbio_task_t *task);
+
 /** Task data structure fields. */
 struct _pbio_task_t {
     /** Linked list node (internal use). */
@@ -41,11 +52,38 @@ struct _pbio_task_t {
     pbio_error_t status;
     /** Flag for requesting cancellation. */
     bool cancel;
+    /** Flag indicating that cancellation was requested because the deadline passed. */
+    bool timed_out;
+    /** Flag indicating that the deadline timer is in use (internal use). */
+    bool has_deadline;
+    /** Optional callback called by ::pbio_task_cancel. */
+    pbio_task_cancel_callback_t on_cancel;
+    /** Deadline timer (internal use). */
+    struct etimer deadline;
 };
 
+/** Maximum number of tasks in a ::pbio_task_group_t. */
+#define PBIO_TASK_GROUP_MAX_TASKS (4)
+
+/** Group of tasks that can be waited on or canceled at once. */
+typedef struct {
+    /** The tasks in the group. */
+    pbio_task_t *tasks[PBIO_TASK_GROUP_MAX_TASKS];
+    /** The number of tasks in the group. */
+    uint8_t num_tasks;
+} pbio_task_group_t;
+
 void pbio_task_init(pbio_task_t *task, pbio_task_thread_t thread, void *context);
 bool pbio_task_run_once(pbio_task_t *task);
 void pbio_task_cancel(pbio_task_t *task);
+void pbio_task_abort(pbio_task_t *task);
+void pbio_task_set_deadline(pbio_task_t *task, uint32_t timeout);
+
+void pbio_task_group_init(pbio_task_group_t *group);
+pbio_error_t pbio_task_group_add(pbio_task_group_t *group, pbio_task_t *task);
+pbio_error_t pbio_task_group_get_status(pbio_task_group_t *group);
+void pbio_task_group_cancel(pbio_task_group_t *group);
+void pbio_task_group_set_deadline(pbio_task_group_t *group, uint32_t timeout);
 
 #endif // _PBIO_TASK_H_
 
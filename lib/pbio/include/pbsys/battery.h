@@ -11,10 +11,36 @@
 
 #include <stdbool.h>
 
+#include <pbdrv/charger.h>
+#include <pbdrv/config.h>
+#include <pbdrv/usb.h>
+#include <pbio/error.h>
+
 void pbsys_battery_init(void);
 void pbsys_battery_poll(void);
 bool pbsys_battery_is_full(void);
 
+#if PBDRV_CONFIG_CHARGER
+
+void pbsys_battery_reset_charger_limits(void);
+pbio_error_t pbsys_battery_set_charger_limit(pbdrv_usb_bcd_t bcd, pbdrv_charger_limit_t limit);
+pbdrv_charger_limit_t pbsys_battery_get_charger_limit(pbdrv_usb_bcd_t bcd);
+
+#else
+
+static inline void pbsys_battery_reset_charger_limits(void) {
+}
+
+static inline pbio_error_t pbsys_battery_set_charger_limit(pbdrv_usb_bcd_t bcd, pbdrv_charger_limit_t limit) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+static inline pbdrv_charger_limit_t pbsys_battery_get_charger_limit(pbdrv_usb_bcd_t bcd) {
+    return PBDRV_CHARGER_LIMIT_NONE;
+}
+
+#endif
+
 #endif // _PBSYS_BATTERY_H_
 
 /** @} */
@@ -32,6 +32,7 @@ uint32_t pbsys_bluetooth_rx_get_available(void);
 pbio_error_t pbsys_bluetooth_rx(uint8_t *data, uint32_t *size);
 pbio_error_t pbsys_bluetooth_tx(const uint8_t *data, uint32_t *size);
 bool pbsys_bluetooth_tx_is_idle(void);
+uint32_t pbsys_bluetooth_tx_get_throughput(void);
 
 #else // PBSYS_CONFIG_BLUETOOTH
 
@@ -49,6 +50,9 @@ static inline pbio_error_t pbsys_bluetooth_tx(const uint8_t *data, uint32_t *siz
 static inline bool pbsys_bluetooth_tx_is_idle(void) {
     return false;
 }
+static inline uint32_t pbsys_bluetooth_tx_get_throughput(void) {
+    return 0;
+}
 
 #endif // PBSYS_CONFIG_BLUETOOTH
 
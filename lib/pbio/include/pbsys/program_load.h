@@ -12,8 +12,10 @@
 #ifndef _PBSYS_PROGRAM_LOAD_H_
 #define _PBSYS_PROGRAM_LOAD_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <pbio/config.h>
 #include <pbsys/config.h>
 
 #if PBSYS_CONFIG_PROGRAM_LOAD
@@ -49,6 +51,19 @@ typedef struct _pbsys_program_load_data_header_t {
      * Size of the application program (size of code only).
      */
     uint32_t program_size;
+    #if PBIO_CONFIG_BATTERY_SOC
+    /**
+     * Identifies this header layout. The fields below move the start of the
+     * program data, so stored data with a different value is from firmware
+     * with another layout. Its program is dropped instead of being run.
+     */
+    uint32_t layout_magic;
+    /**
+     * Battery capacity in mAh learned by the state of charge estimator. Any
+     * value out of range for the battery is ignored.
+     */
+    uint32_t battery_capacity;
+    #endif
 } pbsys_program_load_data_header_t;
 
 #define PBSYS_PROGRAM_LOAD_MAX_PROGRAM_SIZE (PBSYS_CONFIG_PROGRAM_LOAD_ROM_SIZE - sizeof(pbsys_program_load_data_header_t))
@@ -70,9 +85,25 @@ static inline pbio_error_t pbsys_program_load_get_user_data(uint32_t offset, uin
     return PBIO_ERROR_NOT_SUPPORTED;
 }
 
-
 #endif // PBSYS_CONFIG_PROGRAM_LOAD
 
+#if PBSYS_CONFIG_PROGRAM_LOAD && PBIO_CONFIG_BATTERY_SOC
+
+uint32_t pbsys_program_load_get_battery_capacity(void);
+
+void pbsys_program_load_set_battery_capacity(uint32_t capacity);
+
+#else
+
+static inline uint32_t pbsys_program_load_get_battery_capacity(void) {
+    return 0;
+}
+
+static inline void pbsys_program_load_set_battery_capacity(uint32_t capacity) {
+}
+
+#endif // PBSYS_CONFIG_PROGRAM_LOAD && PBIO_CONFIG_BATTERY_SOC
+
 #endif // _PBSYS_PROGRAM_LOAD_H_
 
 /** @} */
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2020-2021 The Pybricks Authors
+// Copyright (c) 2020-2023 The Pybricks Authors
 
 /**
  * @addtogroup SystemStatus System: Status
@@ -12,13 +12,65 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <contiki.h>
+
 #include <pbio/protocol.h>
 
+/** Number of status transitions kept in the history. */
+#define PBSYS_STATUS_HISTORY_SIZE (32)
+
+/**
+ * Callback that is called when a status indication changes.
+ *
+ * @param [in]  status  The status indication that changed.
+ * @param [in]  set     *true* if @p status is now set, otherwise *false*.
+ * @param [in]  time    The clock time in ms when @p status changed.
+ * @param [in]  context The subscriber context.
+ */
+typedef void (*pbsys_status_callback_t)(pbio_pybricks_status_t status, bool set, uint32_t time, void *context);
+
+/** Status subscriber. */
+typedef struct _pbsys_status_subscriber_t pbsys_status_subscriber_t;
+
+/** Status subscriber fields. */
+struct _pbsys_status_subscriber_t {
+    /** Linked list node (internal use). */
+    pbsys_status_subscriber_t *next;
+    /** The status indications of interest as ::PBIO_PYBRICKS_STATUS_FLAG bits. */
+    uint32_t flags;
+    /**
+     * If not 0, the callback is only called once the status indication has
+     * not changed for this many ms. Debounced subscribers can only have one
+     * flag set in @p flags.
+     */
+    uint32_t debounce;
+    /** The function that is called on each change. */
+    pbsys_status_callback_t callback;
+    /** Caller-defined context passed to the callback. */
+    void *context;
+    /** Debounce timer (internal use). */
+    struct etimer timer;
+};
+
+/** Entry in the status transition history. */
+typedef struct {
+    /** The clock time in ms when the status indication changed. */
+    uint32_t time;
+    /** The status indication. */
+    pbio_pybricks_status_t status;
+    /** *true* if it was set, *false* if it was cleared. */
+    bool set;
+} pbsys_status_transition_t;
+
 void pbsys_status_set(pbio_pybricks_status_t status);
 void pbsys_status_clear(pbio_pybricks_status_t status);
 bool pbsys_status_test(pbio_pybricks_status_t status);
 bool pbsys_status_test_debounce(pbio_pybricks_status_t status, bool state, uint32_t ms);
 uint32_t pbsys_status_get_flags(void);
+void pbsys_status_subscribe(pbsys_status_subscriber_t *subscriber);
+void pbsys_status_unsubscribe(pbsys_status_subscriber_t *subscriber);
+uint32_t pbsys_status_get_history_count(void);
+bool pbsys_status_get_history(uint32_t index, pbsys_status_transition_t *transition);
 
 #endif // _PBSYS_STATUS_H_
 
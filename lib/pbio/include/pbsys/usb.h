@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+/**
+ * @addtogroup SystemUsb System: USB
+ *
+ * Carries the Pybricks protocol over a USB serial port. When a host has the
+ * port open, stdio is routed over USB instead of Bluetooth.
+ *
+ * @{
+ */
+
+#ifndef _PBSYS_USB_H_
+#define _PBSYS_USB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/error.h>
+#include <pbsys/config.h>
+
+/**
+ * Callback function to handle stdin events.
+ * @param [in]  c   the character received
+ * @return          *true* if the character was handled and should not be placed
+ *                  in the stdin buffer, otherwise *false*.
+ */
+typedef bool (*pbsys_usb_stdin_event_callback_t)(uint8_t c);
+
+#if PBSYS_CONFIG_USB
+
+void pbsys_usb_init(void);
+void pbsys_usb_rx_set_callback(pbsys_usb_stdin_event_callback_t callback);
+void pbsys_usb_rx_flush(void);
+uint32_t pbsys_usb_rx_get_available(void);
+pbio_error_t pbsys_usb_rx(uint8_t *data, uint32_t *size);
+pbio_error_t pbsys_usb_tx(const uint8_t *data, uint32_t *size);
+bool pbsys_usb_tx_is_idle(void);
+
+#else // PBSYS_CONFIG_USB
+
+#define pbsys_usb_init()
+#define pbsys_usb_rx_set_callback(callback)
+#define pbsys_usb_rx_flush()
+#define pbsys_usb_rx_get_available() 0
+
+static inline pbio_error_t pbsys_usb_rx(uint8_t *data, uint32_t *size) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline pbio_error_t pbsys_usb_tx(const uint8_t *data, uint32_t *size) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline bool pbsys_usb_tx_is_idle(void) {
+    return true;
+}
+
+#endif // PBSYS_CONFIG_USB
+
+#endif // _PBSYS_USB_H_
+
+/** @} */
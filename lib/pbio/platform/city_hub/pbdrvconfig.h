@@ -5,6 +5,7 @@
 
 #define PBDRV_CONFIG_ADC                            (1)
 #define PBDRV_CONFIG_ADC_STM32F0                    (1)
+#define PBDRV_CONFIG_ADC_STM32F0_CHANNELS           ((1 << 10) | (1 << 11))
 #define PBDRV_CONFIG_ADC_STM32F0_RANDOM             (1)
 
 #define PBDRV_CONFIG_BATTERY                        (1)
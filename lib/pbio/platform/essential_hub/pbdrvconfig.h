@@ -27,6 +27,7 @@
 
 #define PBDRV_CONFIG_BLUETOOTH                      (1)
 #define PBDRV_CONFIG_BLUETOOTH_MAX_MTU_SIZE         515
+#define PBDRV_CONFIG_BLUETOOTH_NUM_PERIPHERALS      (2)
 #define PBDRV_CONFIG_BLUETOOTH_BTSTACK              (1)
 #define PBDRV_CONFIG_BLUETOOTH_BTSTACK_CONTROL_GPIO (1)
 #define PBDRV_CONFIG_BLUETOOTH_BTSTACK_STM32_UART   (1)
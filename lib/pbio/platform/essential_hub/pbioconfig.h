@@ -2,6 +2,7 @@
 // Copyright (c) 2019-2023 The Pybricks Authors
 
 #define PBIO_CONFIG_BATTERY                 (1)
+#define PBIO_CONFIG_BATTERY_SOC             (1)
 #define PBIO_CONFIG_DCMOTOR                 (1)
 #define PBIO_CONFIG_DCMOTOR_NUM_DEV         (2)
 #define PBIO_CONFIG_DRIVEBASE_SPIKE         (1)
@@ -13,3 +13,4 @@
 #define PBSYS_CONFIG_STATUS_LIGHT                   (1)
 #define PBSYS_CONFIG_STATUS_LIGHT_BATTERY           (1)
 #define PBSYS_CONFIG_PROGRAM_STOP                   (1)
+#define PBSYS_CONFIG_USB                            (1)
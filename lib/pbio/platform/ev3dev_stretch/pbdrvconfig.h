@@ -11,11 +11,14 @@
 
 #define PBDRV_CONFIG_CLOCK                                  (1)
 #define PBDRV_CONFIG_CLOCK_LINUX                            (1)
+#define PBDRV_CONFIG_CLOCK_LINUX_TIMERFD                    (1)
+#define PBDRV_CONFIG_CLOCK_LINUX_TIMERFD_NUM_FD             (8)
 
 #define PBDRV_CONFIG_COUNTER                                (1)
 #define PBDRV_CONFIG_COUNTER_NUM_DEV                        (4)
 #define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO             (1)
 #define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV     (4)
+#define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_BUFFERED    (1)
 
 #define PBDRV_CONFIG_IOPORT                                 (0)
 #define PBDRV_CONFIG_IOPORT_NUM_DEV                         (8)
@@ -30,6 +33,9 @@
 #define PBDRV_CONFIG_MOTOR_DRIVER_NUM_DEV                   (4)
 #define PBDRV_CONFIG_MOTOR_DRIVER_EV3DEV_STRETCH            (1)
 
+#define PBDRV_CONFIG_TELEMETRY                              (1)
+#define PBDRV_CONFIG_TELEMETRY_LINUX_SHM                    (1)
+
 #define PBDRV_CONFIG_HAS_PORT_A (1)
 #define PBDRV_CONFIG_HAS_PORT_B (1)
 #define PBDRV_CONFIG_HAS_PORT_C (1)
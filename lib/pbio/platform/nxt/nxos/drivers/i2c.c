@@ -28,9 +28,6 @@
 /** Length of the I2C pauses (in 4th of BUS_SPEED) */
 #define I2C_PAUSE_LEN 3
 
-/** Number of currently processed I2C transactions. */
-uint32_t i2c_txn_count = 0;
-
 struct i2c_txn_info
 {
   /* Bus control triggers, tells the state machine to issue start,
@@ -116,6 +113,16 @@ static volatile struct i2c_port {
   uint8_t p_ticks;
   uint8_t p_next;
 
+  /* Active transaction list, the request of the list that is being
+   * processed, and whether a periodic list is waiting for its next
+   * round. The isr ticks are counted from the start of each round.
+   */
+  i2c_txn_list *list;
+  uint8_t list_current;
+  bool list_waiting;
+  uint32_t list_ticks;
+  uint32_t list_period_ticks;
+
 } i2c_state[NXT_N_SENSORS];
 
 /* Forward declarations. */
@@ -211,6 +218,7 @@ void nx_i2c_register(uint32_t sensor, uint8_t address, bool lego_compat) {
 
 /** Unregister the device on the given sensor port. */
 void nx_i2c_unregister(uint32_t sensor) {
+  nx_i2c_stop_txn_list(sensor);
   nx__sensors_disable(sensor);
 }
 
@@ -244,9 +252,6 @@ static i2c_txn_err i2c_add_txn(uint32_t sensor, i2c_txn_mode mode,
 
   i2c_state[sensor].n_txns++;
 
-  /* TODO: find how to make this a critical code section. */
-  i2c_txn_count++;
-
   return I2C_ERR_OK;
 }
 
@@ -261,41 +266,32 @@ static i2c_txn_err i2c_trigger(uint32_t sensor) {
   return I2C_ERR_OK;
 }
 
-/** Start a new I2C transaction.
- *
- * If the I2C bus is available, a new transaction (consisting in 2 to 4
- * sub transactions) will be performed.
- *
- * For a write transaction, two sub transactions will be performed. The data
- * and data_size parameters must be provided, initialized and containing the
- * data to be sent on the bus (in most cases, the internal address in the
- * remote device and the value to put in this address).
- *
- * For a read transaction, four sub transactions will be performed. In
- * addition to the data and data_size parameters, the recv_buf and recv_size
- * parameters must be initialized. The recv_buf must be able to contain the
- * recv_size bytes that will be read from the bus.
- *
- * Returns an i2c_txn_err error code.
- */
-i2c_txn_err nx_i2c_start_transaction(uint32_t sensor, i2c_txn_mode mode,
-				     const uint8_t *data, uint32_t data_size,
-				     uint8_t *recv_buf, uint32_t recv_size)
+/** Checks the parameters of a transaction. */
+static bool i2c_txn_valid(i2c_txn_mode mode,
+			  const uint8_t *data, uint32_t data_size,
+			  uint8_t *recv_buf, uint32_t recv_size)
 {
-  volatile struct i2c_txn_info *t;
-
-  if (sensor >= NXT_N_SENSORS)
-    return I2C_ERR_UNKNOWN_SENSOR;
-
-  if (nx_i2c_busy(sensor))
-    return I2C_ERR_NOT_READY;
-
   /* In any case, data must be initialized, and with a known data size. */
   if (!data || !data_size)
-    return I2C_ERR_DATA;
+    return false;
 
   if (mode == TXN_MODE_READ && (!recv_buf || !recv_size))
-    return I2C_ERR_DATA;
+    return false;
+
+  return true;
+}
+
+/** Sets up the sub transactions of a transaction and triggers them.
+ *
+ * The parameters must have been checked with i2c_txn_valid(). This is
+ * called from nx_i2c_start_transaction() and from the isr for the
+ * requests of a transaction list.
+ */
+static void i2c_setup_txn(uint32_t sensor, i2c_txn_mode mode,
+			  const uint8_t *data, uint32_t data_size,
+			  uint8_t *recv_buf, uint32_t recv_size)
+{
+  volatile struct i2c_txn_info *t;
 
   i2c_state[sensor].bus_state = I2C_CONFIG;
 
@@ -320,9 +316,11 @@ i2c_txn_err nx_i2c_start_transaction(uint32_t sensor, i2c_txn_mode mode,
 
   /* If this is a read transaction, write the device address on the bus
    * and switch to read mode, storing the received bytes in the provided
-   * buffer ; ending with a STOP.
+   * buffer ; ending with a STOP. Received bits are ORed into the buffer,
+   * so it has to be cleared first.
    */
   if (mode == TXN_MODE_READ) {
+    memset(recv_buf, 0, recv_size);
     i2c_add_txn(sensor, TXN_MODE_WRITE,
                 (uint8_t*)&(i2c_state[sensor].addr[TXN_MODE_READ]), 1,
                 I2C_CONTROL_RESTART, I2C_CONTROL_NONE);
@@ -334,9 +332,180 @@ i2c_txn_err nx_i2c_start_transaction(uint32_t sensor, i2c_txn_mode mode,
   *AT91C_TC0_IER = AT91C_TC_CPCS;
 
   i2c_trigger(sensor);
+}
+
+/** Start a new I2C transaction.
+ *
+ * If the I2C bus is available, a new transaction (consisting in 2 to 4
+ * sub transactions) will be performed.
+ *
+ * For a write transaction, two sub transactions will be performed. The data
+ * and data_size parameters must be provided, initialized and containing the
+ * data to be sent on the bus (in most cases, the internal address in the
+ * remote device and the value to put in this address).
+ *
+ * For a read transaction, four sub transactions will be performed. In
+ * addition to the data and data_size parameters, the recv_buf and recv_size
+ * parameters must be initialized. The recv_buf must be able to contain the
+ * recv_size bytes that will be read from the bus.
+ *
+ * Returns an i2c_txn_err error code.
+ */
+i2c_txn_err nx_i2c_start_transaction(uint32_t sensor, i2c_txn_mode mode,
+				     const uint8_t *data, uint32_t data_size,
+				     uint8_t *recv_buf, uint32_t recv_size)
+{
+  if (sensor >= NXT_N_SENSORS)
+    return I2C_ERR_UNKNOWN_SENSOR;
+
+  if (nx_i2c_busy(sensor))
+    return I2C_ERR_NOT_READY;
+
+  if (!i2c_txn_valid(mode, data, data_size, recv_buf, recv_size))
+    return I2C_ERR_DATA;
+
+  i2c_setup_txn(sensor, mode, data, data_size, recv_buf, recv_size);
+  return I2C_ERR_OK;
+}
+
+/** Sets up the current request of the transaction list of the given
+ * sensor. */
+static void i2c_list_setup_req(uint32_t sensor) {
+  volatile struct i2c_port *p = &i2c_state[sensor];
+  i2c_txn_req *req = &p->list->reqs[p->list_current];
+
+  i2c_setup_txn(sensor, req->mode, req->data, req->data_size,
+                req->recv_buf, req->recv_size);
+}
+
+/** Called from the isr when the bus is idle and the sub transactions of
+ * the current list request are done. Stores the result of the request,
+ * and sets up the next one, or finishes the round.
+ */
+static void i2c_list_next(uint32_t sensor) {
+  volatile struct i2c_port *p = &i2c_state[sensor];
+  i2c_txn_list *list = p->list;
+  uint8_t i;
+
+  if (p->list_waiting) {
+    /* Periodic list waiting for its next round. */
+    if (p->list_ticks < p->list_period_ticks)
+      return;
+
+    p->list_waiting = false;
+    p->list_ticks = 0;
+    p->list_current = 0;
+    i2c_list_setup_req(sensor);
+    return;
+  }
+
+  /* The request failed if any of its sub transactions failed. Sub
+   * transactions that were bypassed after a failure are left as
+   * TXN_STAT_SUCCESS, so they don't hide the failure.
+   */
+  list->reqs[p->list_current].result = TXN_STAT_SUCCESS;
+  for (i = 0; i < p->n_txns; i++) {
+    if (p->txns[i].result == TXN_STAT_FAILED)
+      list->reqs[p->list_current].result = TXN_STAT_FAILED;
+  }
+
+  p->list_current++;
+  if (p->list_current < list->n_reqs) {
+    i2c_list_setup_req(sensor);
+    return;
+  }
+
+  /* All requests of this round are done. */
+  list->rounds++;
+
+  if (list->period_ms == 0) {
+    p->list = NULL;
+  } else {
+    p->list_waiting = true;
+  }
+
+  if (list->callback)
+    list->callback(sensor, list);
+}
+
+/** Tests if no port has a transaction list or sub transactions left, in
+ * which case the isr can be disabled.
+ */
+static bool i2c_all_idle(void) {
+  uint32_t sensor;
+
+  for (sensor = 0; sensor < NXT_N_SENSORS; sensor++) {
+    if (nx_i2c_busy(sensor))
+      return false;
+  }
+
+  return true;
+}
+
+i2c_txn_err nx_i2c_start_txn_list(uint32_t sensor, i2c_txn_list *list)
+{
+  volatile struct i2c_port *p;
+  uint32_t state;
+  uint8_t i;
+
+  if (sensor >= NXT_N_SENSORS)
+    return I2C_ERR_UNKNOWN_SENSOR;
+
+  if (nx_i2c_busy(sensor))
+    return I2C_ERR_NOT_READY;
+
+  if (!list || !list->reqs || !list->n_reqs)
+    return I2C_ERR_DATA;
+
+  for (i = 0; i < list->n_reqs; i++) {
+    i2c_txn_req *req = &list->reqs[i];
+
+    if (!i2c_txn_valid(req->mode, req->data, req->data_size,
+                       req->recv_buf, req->recv_size))
+      return I2C_ERR_DATA;
+
+    req->result = TXN_STAT_IN_PROGRESS;
+  }
+
+  p = &i2c_state[sensor];
+  list->rounds = 0;
+
+  /* The isr takes over as soon as the first request is set up. */
+  state = nx_interrupts_disable();
+  p->list = list;
+  p->list_current = 0;
+  p->list_waiting = false;
+  p->list_ticks = 0;
+  /* The isr runs at 4 times the bus speed. */
+  p->list_period_ticks = (uint64_t)list->period_ms * 4 * I2C_BUS_SPEED / 1000;
+  i2c_list_setup_req(sensor);
+  nx_interrupts_enable(state);
+
   return I2C_ERR_OK;
 }
 
+void nx_i2c_stop_txn_list(uint32_t sensor)
+{
+  volatile struct i2c_port *p;
+  uint32_t state;
+
+  if (sensor >= NXT_N_SENSORS)
+    return;
+
+  p = &i2c_state[sensor];
+
+  state = nx_interrupts_disable();
+  p->list = NULL;
+
+  /* A periodic list may be waiting for its next round, in which case
+   * the isr has nothing left to do. Otherwise, the isr disables itself
+   * once the sub transactions in progress are done.
+   */
+  if (i2c_all_idle())
+    *AT91C_TC0_IDR = AT91C_TC_CPCS;
+  nx_interrupts_enable(state);
+}
+
 /** Retrieve the transaction status for the given sensor.
  */
 i2c_txn_status nx_i2c_get_txn_status(uint32_t sensor)
@@ -373,7 +542,8 @@ bool nx_i2c_busy(uint32_t sensor)
     return false;
 
   return i2c_state[sensor].bus_state > I2C_IDLE
-    || i2c_state[sensor].current_txn < i2c_state[sensor].n_txns;
+    || i2c_state[sensor].current_txn < i2c_state[sensor].n_txns
+    || i2c_state[sensor].list;
 }
 
 /** Sets the I2C bus state for the given sensor to the provided state.
@@ -425,6 +595,17 @@ static void i2c_isr(void) {
   for (sensor=0; sensor<NXT_N_SENSORS; sensor++) {
     const nx__sensors_pins *pins = nx__sensors_get_pins(sensor);
     p = &i2c_state[sensor];
+
+    if (p->list) {
+      p->list_ticks++;
+
+      /* Move on to the next list request once the bus is idle and the
+       * sub transactions of the current request are done.
+       */
+      if (p->bus_state == I2C_IDLE && p->current_txn == p->n_txns)
+        i2c_list_next(sensor);
+    }
+
     t = &(p->txns[p->current_txn]);
 
     switch (p->bus_state)
@@ -723,16 +904,6 @@ static void i2c_isr(void) {
 
         i2c_set_bus_state(sensor, I2C_IDLE);
         p->txn_state = TXN_WAITING;
-
-        /* When the sub-transaction is done, decrement i2c_txn_count.
-         * If it reaches 0, disable the I2C interrupt.
-         *
-         * TODO: find how to make this a critical code section.
-         */
-        i2c_txn_count--;
-        if (i2c_txn_count == 0)
-          *AT91C_TC0_IDR = AT91C_TC_CPCS;
-
         break;
       }
 
@@ -743,4 +914,10 @@ static void i2c_isr(void) {
     if (sodr)
       *AT91C_PIOA_SODR = sodr;
   }
+
+  /* Disable the I2C interrupt when there is nothing left to do, including
+   * the pause after a STOP bit in LEGO compatibility mode.
+   */
+  if (i2c_all_idle())
+    *AT91C_TC0_IDR = AT91C_TC_CPCS;
 }
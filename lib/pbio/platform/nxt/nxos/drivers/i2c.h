@@ -75,6 +75,47 @@ typedef enum {
   I2C_CONTROL_STOP,
 } i2c_control;
 
+/** A read or write request in a transaction list.
+ *
+ * The fields have the same meaning as the arguments of
+ * nx_i2c_start_transaction(). @a result is set when the request is done.
+ */
+typedef struct {
+  i2c_txn_mode mode;
+  const uint8_t *data;
+  uint32_t data_size;
+  uint8_t *recv_buf;
+  uint32_t recv_size;
+  i2c_txn_status result;
+} i2c_txn_req;
+
+struct i2c_txn_list;
+
+/** Callback called from the I2C isr when all requests of a list are done.
+ *
+ * @param sensor The sensor port number.
+ * @param list The list that was completed.
+ */
+typedef void (*i2c_txn_list_callback)(uint32_t sensor, struct i2c_txn_list *list);
+
+/** A list of requests that are performed one after the other by the I2C isr.
+ *
+ * If @a period_ms is not 0, the list is started again every @a period_ms
+ * milliseconds, measured from the start of the previous round, until
+ * nx_i2c_stop_txn_list() is called. If a round takes longer than the
+ * period, the next round starts right away.
+ */
+typedef struct i2c_txn_list {
+  i2c_txn_req *reqs;
+  uint8_t n_reqs;
+  uint32_t period_ms;
+  i2c_txn_list_callback callback;
+  void *context;
+
+  /* Number of completed rounds, updated by the driver. */
+  volatile uint32_t rounds;
+} i2c_txn_list;
+
 /** Initialize the NXT to allow I2C communication.
  */
 void nx_i2c_init(void);
@@ -153,6 +194,39 @@ i2c_txn_status nx_i2c_get_txn_status(uint32_t sensor);
  */
 bool nx_i2c_busy(uint32_t sensor);
 
+/** Start performing the requests of @a list on port @a sensor.
+ *
+ * Each request is done the same way as with nx_i2c_start_transaction(), but
+ * the next request is started from the I2C isr as soon as the previous one
+ * completes, without waiting for the caller. A failed request does not stop
+ * the list; check the @a result of each request.
+ *
+ * @param sensor The sensor port number.
+ * @param list The requests to perform. The list and all buffers it refers
+ * to must stay valid until the list is done or stopped.
+ *
+ * @note Receive buffers are cleared before each request is started. When
+ * using a periodic list, copy the received data in the callback, before the
+ * next round starts.
+ *
+ * @note The port is busy while the list is active, so
+ * nx_i2c_start_transaction() can't be used at the same time.
+ *
+ * @return I2C_ERR_OK if the list was started. I2C_ERR_NOT_READY if the port
+ * is busy, I2C_ERR_DATA if a request is not valid.
+ */
+i2c_txn_err nx_i2c_start_txn_list(uint32_t sensor, i2c_txn_list *list);
+
+/** Stop the list of requests that is active on port @a sensor.
+ *
+ * A request that is in progress is completed, but its result is not stored
+ * and the callback is not called. It is safe to call this function if no
+ * list is active.
+ *
+ * @param sensor The sensor port number.
+ */
+void nx_i2c_stop_txn_list(uint32_t sensor);
+
 /*@}*/
 /*@}*/
 
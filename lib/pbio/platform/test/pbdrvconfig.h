@@ -11,6 +11,9 @@
 #define PBDRV_CONFIG_BLUETOOTH_BTSTACK              (1)
 #define PBDRV_CONFIG_BLUETOOTH_BTSTACK_HUB_KIND     0xff
 
+#define PBDRV_CONFIG_CHARGER                        (1)
+#define PBDRV_CONFIG_CHARGER_TEST                   (1)
+
 #define PBDRV_CONFIG_CLOCK                          (1)
 #define PBDRV_CONFIG_CLOCK_TEST                     (1)
 
@@ -38,6 +41,9 @@
 
 #define PBDRV_CONFIG_UART                           (1)
 
+#define PBDRV_CONFIG_USB                            (1)
+#define PBDRV_CONFIG_USB_TEST                       (1)
+
 #define PBDRV_CONFIG_HAS_PORT_A                     (1)
 #define PBDRV_CONFIG_HAS_PORT_B                     (1)
 #define PBDRV_CONFIG_HAS_PORT_C                     (1)
@@ -1,5 +1,6 @@
 
 #define PBIO_CONFIG_BATTERY                 (1)
+#define PBIO_CONFIG_BATTERY_SOC             (1)
 #define PBIO_CONFIG_DCMOTOR                 (1)
 #define PBIO_CONFIG_DCMOTOR_NUM_DEV         (6)
 #define PBIO_CONFIG_DRIVEBASE_SPIKE         (0)
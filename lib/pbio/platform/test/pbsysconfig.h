@@ -7,3 +7,4 @@
 #define PBSYS_CONFIG_PROGRAM_LOAD                   (0)
 #define PBSYS_CONFIG_STATUS_LIGHT                   (1)
 #define PBSYS_CONFIG_PROGRAM_STOP                   (0)
+#define PBSYS_CONFIG_USB                            (1)
@@ -9,10 +9,14 @@
 #if PBIO_CONFIG_BATTERY
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 #include <pbdrv/battery.h>
+#include <pbdrv/charger.h>
+#include <pbdrv/clock.h>
 #include <pbio/battery.h>
 #include <pbio/int_math.h>
+#include <pbio/util.h>
 
 // Slow moving average battery voltage.
 static int32_t battery_voltage_avg_scaled;
@@ -21,6 +25,293 @@ static int32_t battery_voltage_avg_scaled;
 // to reduce rounding errors in the moving average.
 #define SCALE (1024)
 
+#if PBIO_CONFIG_BATTERY_SOC
+
+// Battery current below which the battery is considered to be at rest (mA).
+#define SOC_REST_CURRENT (150)
+
+// Time at rest before the battery voltage is close to the open circuit
+// voltage so that it can be used to correct the state of charge (ms).
+#define SOC_REST_TIME (30000)
+
+// Time constant of the correction towards the open circuit voltage (ms).
+#define SOC_REST_CORRECTION_TIME (60000)
+
+// Minimum change in state of charge between two rest periods to learn the
+// capacity from the charge that flowed in between (permille).
+#define SOC_LEARN_MIN_CHANGE (200)
+
+/**
+ * Battery properties used to estimate the state of charge.
+ */
+typedef struct {
+    /** Open circuit voltage of one cell at 0%, 10%, ..., 100% (mV). */
+    uint16_t cell_ocv[11];
+    /** Number of cells in series. */
+    uint8_t num_cells;
+    /** Nominal capacity (mAh). */
+    uint16_t capacity;
+    /** Internal resistance of the whole battery including contacts (mOhm). */
+    uint16_t resistance;
+} pbio_battery_model_t;
+
+// LEGO rechargeable battery packs (2 Li-ion cells).
+static const pbio_battery_model_t model_liion = {
+    .cell_ocv = { 3000, 3600, 3680, 3730, 3770, 3800, 3840, 3900, 3970, 4050, 4150 },
+    .num_cells = 2,
+    .capacity = 2100,
+    .resistance = 150,
+};
+
+// Six AA or AAA batteries, assuming alkaline cells.
+static const pbio_battery_model_t model_alkaline = {
+    .cell_ocv = { 900, 1100, 1200, 1250, 1300, 1340, 1380, 1420, 1450, 1500, 1550 },
+    .num_cells = 6,
+    .capacity = 2000,
+    .resistance = 900,
+};
+
+static const pbio_battery_model_t *model = &model_alkaline;
+
+// Slow moving average battery current, scaled by SCALE. Positive values mean
+// that the battery is discharging.
+static int32_t battery_current_avg_scaled;
+
+// Remaining charge (mAs).
+static int32_t soc_charge;
+// Charge that has not yet been added to soc_charge (mA ms).
+static int32_t soc_charge_remainder;
+// Net charge taken from the battery since boot, without corrections (mAs).
+static int32_t soc_throughput;
+// Learned capacity (mAh), or 0 if not set yet.
+static int32_t soc_capacity;
+// Time of the previous update (ms).
+static uint32_t soc_prev_time;
+// Time since the battery has been at rest (ms).
+static uint32_t soc_rest_time;
+// State of charge from the open circuit voltage and throughput at the start of
+// the previous rest period. Used to learn the capacity.
+static bool soc_anchor_valid;
+static int32_t soc_anchor_ocv_soc;
+static int32_t soc_anchor_throughput;
+
+// Charge of a full battery (mAs).
+static int32_t soc_full_charge(void) {
+    return soc_capacity * 3600;
+}
+
+// Gets the state of charge (permille) from the open circuit voltage (mV).
+static int32_t soc_from_ocv(int32_t ocv) {
+    int32_t cell = ocv / model->num_cells;
+
+    if (cell <= model->cell_ocv[0]) {
+        return 0;
+    }
+
+    for (uint32_t i = 1; i < PBIO_ARRAY_SIZE(model->cell_ocv); i++) {
+        if (cell < model->cell_ocv[i]) {
+            return (i - 1) * 100 + (cell - model->cell_ocv[i - 1]) * 100 / (model->cell_ocv[i] - model->cell_ocv[i - 1]);
+        }
+    }
+
+    return 1000;
+}
+
+// Gets the net battery current. Positive values mean that the battery is
+// discharging.
+static int32_t soc_get_current_now(bool *charging) {
+    uint16_t current;
+    if (pbdrv_battery_get_current_now(&current) != PBIO_SUCCESS) {
+        current = 0;
+    }
+
+    int32_t net = current;
+    *charging = false;
+
+    #if PBDRV_CONFIG_CHARGER
+    pbdrv_charger_status_t status = pbdrv_charger_get_status();
+    if (status == PBDRV_CHARGER_STATUS_CHARGE) {
+        uint16_t charge_current;
+        if (pbdrv_charger_get_current_now(&charge_current) == PBIO_SUCCESS) {
+            net -= charge_current;
+        }
+        *charging = true;
+    } else if (status == PBDRV_CHARGER_STATUS_COMPLETE) {
+        // The charger knows best when the battery is full.
+        soc_charge = soc_full_charge();
+    }
+    #endif
+
+    return net;
+}
+
+// Learns the capacity from the charge that flowed since the previous rest
+// period and the change in open circuit voltage in between.
+static void soc_learn_capacity(int32_t ocv_soc) {
+    int32_t soc_change = soc_anchor_ocv_soc - ocv_soc;
+    int32_t charge_change = soc_throughput - soc_anchor_throughput;
+
+    if (soc_anchor_valid && pbio_int_math_abs(soc_change) >= SOC_LEARN_MIN_CHANGE &&
+        pbio_int_math_sign(soc_change) == pbio_int_math_sign(charge_change)) {
+        // 1 permille of capacity in mAh is 3.6 mAs per mAh.
+        int32_t measured = charge_change * 10 / 36 / soc_change;
+
+        // Only take a step towards it since the open circuit voltage curve
+        // is not exact.
+        pbio_battery_set_capacity((soc_capacity * 3 + measured) / 4);
+    }
+
+    soc_anchor_valid = true;
+    soc_anchor_ocv_soc = ocv_soc;
+    soc_anchor_throughput = soc_throughput;
+}
+
+static void soc_init(void) {
+    pbdrv_battery_type_t type;
+    if (pbdrv_battery_get_type(&type) == PBIO_SUCCESS && type == PBDRV_BATTERY_TYPE_LIION) {
+        model = &model_liion;
+    } else {
+        model = &model_alkaline;
+    }
+
+    // Keep learned capacity if it was already restored.
+    if (pbio_battery_set_capacity(soc_capacity) != PBIO_SUCCESS) {
+        soc_capacity = model->capacity;
+    }
+
+    bool charging;
+    battery_current_avg_scaled = soc_get_current_now(&charging) * SCALE;
+
+    // The hub has just been turned on, so the battery has been at rest.
+    soc_charge = pbio_int_math_mult_then_div(soc_from_ocv(pbio_battery_get_open_circuit_voltage()), soc_full_charge(), 1000);
+    soc_charge_remainder = 0;
+    soc_throughput = 0;
+    soc_rest_time = 0;
+    soc_anchor_valid = false;
+    soc_prev_time = pbdrv_clock_get_ms();
+}
+
+static void soc_update(void) {
+    uint32_t now = pbdrv_clock_get_ms();
+    int32_t elapsed = now - soc_prev_time;
+    soc_prev_time = now;
+
+    bool charging;
+    int32_t current = soc_get_current_now(&charging);
+    battery_current_avg_scaled = (battery_current_avg_scaled * 127 + current * SCALE) / 128;
+
+    // Count charge that flowed since the previous update.
+    soc_charge_remainder += current * elapsed;
+    int32_t used = soc_charge_remainder / 1000;
+    soc_charge_remainder -= used * 1000;
+    soc_throughput += used;
+    soc_charge = pbio_int_math_bind(soc_charge - used, 0, soc_full_charge());
+
+    // After some time at rest, the voltage is close to the open circuit
+    // voltage, which tells us the state of charge. Slowly correct the
+    // estimate towards it to undo drift of the coulomb counter.
+    if (charging || pbio_int_math_abs(battery_current_avg_scaled / SCALE) > SOC_REST_CURRENT) {
+        soc_rest_time = 0;
+        return;
+    }
+
+    bool was_rested = soc_rest_time >= SOC_REST_TIME;
+    soc_rest_time += elapsed;
+    if (soc_rest_time < SOC_REST_TIME) {
+        return;
+    }
+
+    int32_t ocv_soc = soc_from_ocv(pbio_battery_get_open_circuit_voltage());
+    if (!was_rested) {
+        soc_learn_capacity(ocv_soc);
+    }
+
+    int32_t target = pbio_int_math_mult_then_div(ocv_soc, soc_full_charge(), 1000);
+    soc_charge += pbio_int_math_mult_then_div(target - soc_charge, elapsed, SOC_REST_CORRECTION_TIME);
+}
+
+/**
+ * Gets the estimated state of charge of the battery.
+ *
+ * The estimate comes from counting the charge that flows in and out of the
+ * battery. It is corrected using the open circuit voltage whenever the
+ * battery has been at rest for a while.
+ *
+ * @return                  State of charge in the range 0 to 100 %.
+ */
+int32_t pbio_battery_get_state_of_charge(void) {
+    return soc_charge / (soc_capacity * 36);
+}
+
+/**
+ * Gets the estimated capacity of the battery.
+ *
+ * This starts at the nominal capacity of the battery type and is learned over
+ * time from the charge that flows between two rest periods.
+ *
+ * @return                  The capacity in mAh.
+ */
+int32_t pbio_battery_get_capacity(void) {
+    return soc_capacity;
+}
+
+/**
+ * Sets the capacity of the battery, such as a value that was learned during
+ * a previous session. The state of charge in percent is kept the same.
+ *
+ * @param [in]  capacity    The capacity in mAh.
+ * @return                  ::PBIO_SUCCESS on success or
+ *                          ::PBIO_ERROR_INVALID_ARG if the capacity is not
+ *                          within 50% to 150% of the nominal capacity.
+ */
+pbio_error_t pbio_battery_set_capacity(int32_t capacity) {
+    if (capacity < model->capacity / 2 || capacity > model->capacity * 3 / 2) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (soc_capacity) {
+        soc_charge = pbio_int_math_mult_then_div(soc_charge, capacity, soc_capacity);
+    }
+    soc_capacity = capacity;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the moving average battery current.
+ *
+ * @return                  The current in mA. Negative values mean that the
+ *                          battery is charging.
+ */
+int32_t pbio_battery_get_average_current(void) {
+    return battery_current_avg_scaled / SCALE;
+}
+
+/**
+ * Gets the estimated open circuit voltage of the battery. This is the average
+ * voltage corrected for the voltage drop across the internal resistance.
+ *
+ * @return                  The voltage in mV.
+ */
+int32_t pbio_battery_get_open_circuit_voltage(void) {
+    return battery_voltage_avg_scaled / SCALE + battery_current_avg_scaled / SCALE * model->resistance / 1000;
+}
+
+/**
+ * Gets the current that would make the battery voltage drop to @p voltage.
+ *
+ * This can be used to limit peak current to avoid brownouts.
+ *
+ * @param [in]  voltage     The minimum acceptable battery voltage in mV.
+ * @return                  The current in mA, or 0 if the battery voltage is
+ *                          already below @p voltage.
+ */
+int32_t pbio_battery_get_max_current(int32_t voltage) {
+    return pbio_int_math_max(0, (pbio_battery_get_open_circuit_voltage() - voltage) * 1000 / model->resistance);
+}
+
+#endif // PBIO_CONFIG_BATTERY_SOC
+
 /**
  * Initializes battery voltage state to first measurement.
  *
@@ -38,6 +329,10 @@ pbio_error_t pbio_battery_init(void) {
     // Initialize average voltage.
     battery_voltage_avg_scaled = (int32_t)battery_voltage_now_mv * SCALE;
 
+    #if PBIO_CONFIG_BATTERY_SOC
+    soc_init();
+    #endif
+
     return PBIO_SUCCESS;
 }
 
@@ -58,6 +353,10 @@ pbio_error_t pbio_battery_update(void) {
     // Update moving average.
     battery_voltage_avg_scaled = (battery_voltage_avg_scaled * 127 + ((int32_t)battery_voltage_now_mv) * SCALE) / 128;
 
+    #if PBIO_CONFIG_BATTERY_SOC
+    soc_update();
+    #endif
+
     return PBIO_SUCCESS;
 }
 
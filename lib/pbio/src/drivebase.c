@@ -7,11 +7,13 @@
 #include <stdlib.h>
 
 #include <pbdrv/clock.h>
+#include <pbdrv/telemetry.h>
 #include <pbio/error.h>
 #include <pbio/drivebase.h>
 #include <pbio/int_math.h>
 #include <pbio/imu.h>
 #include <pbio/servo.h>
+#include <pbio/util.h>
 
 #if PBIO_CONFIG_NUM_DRIVEBASES > 0
 
@@ -444,6 +446,20 @@ static pbio_error_t pbio_drivebase_update(pbio_drivebase_t *db) {
     // If either controller is paused, pause both.
     db->control_paused = distance_external_pause || heading_external_pause;
 
+    // Optionally publish drivebase state.
+    if (pbdrv_telemetry_is_active()) {
+        int32_t telemetry_data[] = {
+            time_now,
+            pbio_control_settings_ctl_to_app_long(&db->control_distance.settings, &state_distance.position),
+            pbio_control_settings_ctl_to_app(&db->control_distance.settings, state_distance.speed),
+            pbio_control_settings_ctl_to_app_long(&db->control_heading.settings, &state_heading.position),
+            pbio_control_settings_ctl_to_app(&db->control_heading.settings, state_heading.speed),
+            distance_torque,
+            heading_torque,
+        };
+        pbdrv_telemetry_publish(PBDRV_TELEMETRY_SOURCE_DRIVEBASE, db - drivebases, telemetry_data, PBIO_ARRAY_SIZE(telemetry_data));
+    }
+
     // If either controller coasts, coast both, thereby also stopping control.
     if (distance_actuation == PBIO_DCMOTOR_ACTUATION_COAST ||
         heading_actuation == PBIO_DCMOTOR_ACTUATION_COAST) {
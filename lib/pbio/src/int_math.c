@@ -120,7 +120,11 @@ int32_t pbio_int_math_clamp(int32_t value, int32_t abs_max) {
 }
 
 /**
- * Gets the square root.
+ * Gets the square root, rounded down.
+ *
+ * This computes one bit of the result per iteration without divisions or
+ * data dependent branches, so it always takes the same (short) time, also on
+ * hubs without a hardware divider.
  *
  * If @p n <= 0, it returns 0.
  *
@@ -128,87 +132,39 @@ int32_t pbio_int_math_clamp(int32_t value, int32_t abs_max) {
  * @return              The square root.
  */
 int32_t pbio_int_math_sqrt(int32_t n) {
-    if (n <= 0) {
-        return 0;
-    }
-    int32_t x0 = n;
-    int32_t x1;
-
-    while (true) {
-        x1 = (x0 + n / x0) / 2;
-        if (x1 == x0 || x1 == x0 + 1) {
-            return x0;
-        }
-        x0 = x1;
+    // Negative values become 0.
+    uint32_t remainder = n & ~(n >> 31);
+    uint32_t root = 0;
+
+    // Try each bit of the result, starting with the highest.
+    for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+        uint32_t trial = root + bit;
+        // All ones if the bit is set in the result, otherwise 0.
+        uint32_t mask = -(uint32_t)(remainder >= trial);
+        remainder -= trial & mask;
+        root = (root >> 1) + (bit & mask);
     }
+    return root;
 }
 
 /**
- * Points on a curve for linear interpolation.
+ * Angles atan(2^-i) in degrees, upscaled by 65536, for i = 0, 1, 2, ...
  */
-typedef struct {
-    int16_t x;
-    int16_t y;
-} point_t;
-
-/**
- * Sample points along the curve y = atan(x / 1024) * 8.
- *
- * This is used to get the atan2(b, a) curve in the first quadrant. The
- * intermediate scaling is used to avoid excessive rounding errors.
- *
- * x = Ratios b / a, upscaled by 1024.
- * y = Matching atan(b / b) output, upscaled by 8 * 180 / pi (eighth of a degree).
- */
-static const point_t atan_points[] = {
-    { .x = 0, .y = 0 },
-    { .x = 409, .y = 178 },
-    { .x = 972, .y = 348 },
-    { .x = 1638, .y = 472 },
-    { .x = 2560, .y = 545 },
-    { .x = 3891, .y = 605 },
-    { .x = 5120, .y = 632 },
-    { .x = 7168, .y = 660 },
-    { .x = 15360, .y = 692 },
-    { .x = 25600, .y = 705 },
+static const int32_t atan_cordic_angles[] = {
+    2949120, 1740967, 919879, 466945,
+    234379, 117304, 58666, 29335,
+    14668, 7334, 3667, 1833,
+    917, 458, 229, 115,
 };
 
-/**
- * Interpolates a constant set of (X, Y) sample points on a curve y = f(x)
- * to estimate y for given input value x.
- *
- * If x < x[first] then it returns y[first].
- * If x >= x[last] then it returns y[last].
- *
- * @param [in]   points  Data points between which to interpolate.
- * @param [in]   len     Number of data points.
- * @param [in]   x       Value for which to estimate y = f(x)
- * @return               Estimated value for y = f(x)
- */
-static int32_t pbio_int_math_interpolate(const point_t *points, size_t len, int32_t x) {
-
-    // If x is below the minimum x, return the minimum y.
-    if (x < points[0].x) {
-        return points[0].y;
-    }
-
-    // Find nearest match and interpolate.
-    for (size_t i = 0; i < len - 1; i++) {
-        const point_t *p0 = &points[i];
-        const point_t *p1 = &points[i + 1];
-
-        if (x < p1->x) {
-            return p0->y + (x - p0->x) * (p1->y - p0->y) / (p1->x - p0->x);
-        }
-    }
-
-    // If x is above the maximum x, return the maximum y.
-    return points[len - 1].y;
-}
-
 /**
  * Gets atan2 in degrees from integer inputs.
  *
+ * This uses the CORDIC algorithm, which rotates the vector (x, y) onto the
+ * x-axis in steps of atan(2^-i) using only shifts and additions. The sum of
+ * these steps is the angle of the vector. The result is rounded to the
+ * nearest degree.
+ *
  * @param [in]  y  Opposite side of the triangle.
  * @param [in]  x  Adjacent side of the triangle.
  * @return         atan2(y, x) in degrees.
@@ -225,28 +181,46 @@ int32_t pbio_int_math_atan2(int32_t y, int32_t x) {
         return 90 * pbio_int_math_sign(y);
     }
 
-    // Get absolute ratio of y / x, upscaled to preserve resolution.
-    int32_t ratio = 1024 * y / x;
-    if (ratio < 0) {
-        ratio = -ratio;
+    // The rotations only converge for angles between -90 and 90 degrees, so
+    // rotate by 180 degrees first if x is negative. This is folded into the
+    // operands before scaling, since scaling may round either of them to
+    // zero. Magnitudes are unsigned so that INT32_MIN can be negated.
+    int32_t angle = 0;
+    if (x < 0) {
+        angle = y > 0 ? 180 * 65536 : -180 * 65536;
     }
-
-    // Interpolate and scale to get corresponding atan value.
-    int32_t atan = pbio_int_math_interpolate(atan_points, PBIO_ARRAY_SIZE(atan_points), ratio) / 8;
-
-    // We took the absolute ratio, but must now account for sign.
-    // So, negate if x and y had opposite sign.
-    if ((x > 0) != (y > 0)) {
-        atan = -atan;
+    bool y_negative = (y < 0) != (x < 0);
+    uint32_t x_abs = x < 0 ? -(uint32_t)x : (uint32_t)x;
+    uint32_t y_abs = y < 0 ? -(uint32_t)y : (uint32_t)y;
+
+    // Scale the inputs so the largest is between 2^27 and 2^28. This keeps
+    // enough resolution for small inputs and leaves room for the vector to
+    // grow by a factor 1.65 during the rotations below.
+    int32_t shift = __builtin_clz(x_abs | y_abs) - 4;
+    if (shift >= 0) {
+        x_abs <<= shift;
+        y_abs <<= shift;
+    } else {
+        x_abs >>= -shift;
+        y_abs >>= -shift;
     }
-
-    // For small angles, we're done.
-    if (x > 0) {
-        return atan;
+    x = x_abs;
+    y = y_negative ? -(int32_t)y_abs : (int32_t)y_abs;
+
+    // Rotate towards y = 0, keeping track of the total rotation. The
+    // direction of each step is applied with a sign mask instead of a
+    // branch, since it changes unpredictably from one step to the next.
+    for (uint32_t i = 0; i < PBIO_ARRAY_SIZE(atan_cordic_angles); i++) {
+        // All ones if y is negative, so (v ^ mask) - mask is -v, otherwise v.
+        int32_t mask = y >> 31;
+        int32_t x_next = x + (((y >> i) ^ mask) - mask);
+        y -= ((x >> i) ^ mask) - mask;
+        angle += (atan_cordic_angles[i] ^ mask) - mask;
+        x = x_next;
     }
 
-    // Get atan2 result for larger angles.
-    return atan > 0 ? atan - 180 : atan + 180;
+    // Round to nearest degree.
+    return (angle + 32768) >> 16;
 }
 
 /**
@@ -296,44 +270,153 @@ int32_t pbio_int_math_mult_then_div(int32_t a, int32_t b, int32_t c) {
 }
 
 /**
- * Approximates first 90-degree segment of a sine in degrees, output
- * upscaled by 10000.
- *
- * @param [in]  x        Angle in degrees (0-90).
- * @returns              Approximately sin(x) * 10000.
+ * Sine of 0 to 90 degrees in steps of 1 degree, upscaled by 10000.
  */
-static int32_t pbio_int_math_sin_deg_branch0(int32_t x) {
-    return (201 - x) * x;
-}
-
-// integer sine approximation from degrees to (-10000, 10000)
+static const int16_t sin_table[] = {
+    0, 175, 349, 523, 698, 872, 1045, 1219, 1392, 1564,
+    1736, 1908, 2079, 2250, 2419, 2588, 2756, 2924, 3090, 3256,
+    3420, 3584, 3746, 3907, 4067, 4226, 4384, 4540, 4695, 4848,
+    5000, 5150, 5299, 5446, 5592, 5736, 5878, 6018, 6157, 6293,
+    6428, 6561, 6691, 6820, 6947, 7071, 7193, 7314, 7431, 7547,
+    7660, 7771, 7880, 7986, 8090, 8192, 8290, 8387, 8480, 8572,
+    8660, 8746, 8829, 8910, 8988, 9063, 9135, 9205, 9272, 9336,
+    9397, 9455, 9511, 9563, 9613, 9659, 9703, 9744, 9781, 9816,
+    9848, 9877, 9903, 9925, 9945, 9962, 9976, 9986, 9994, 9998,
+    10000,
+};
 
 /**
- * Approximates sine of an angle in degrees, output upscaled by 10000.
+ * Gets sine of an angle in degrees, output upscaled by 10000.
  *
  * @param [in]  x        Angle in degrees.
- * @returns              Approximately sin(x) * 10000.
+ * @returns              sin(x) * 10000, rounded to nearest.
  */
 int32_t pbio_int_math_sin_deg(int32_t x) {
-    x = x % 360;
+
+    // Bring angle in range 0 to 360 degrees.
+    x %= 360;
+    if (x < 0) {
+        x += 360;
+    }
+
+    // The table has the first quarter, the rest follows from symmetry.
     if (x < 90) {
-        return pbio_int_math_sin_deg_branch0(x);
+        return sin_table[x];
     }
     if (x < 180) {
-        return pbio_int_math_sin_deg_branch0(180 - x);
+        return sin_table[180 - x];
     }
     if (x < 270) {
-        return -pbio_int_math_sin_deg_branch0(x - 180);
+        return -sin_table[x - 180];
     }
-    return -pbio_int_math_sin_deg_branch0(360 - x);
+    return -sin_table[360 - x];
 }
 
 /**
- * Approximates cosine of an angle in degrees, output upscaled by 10000.
+ * Gets cosine of an angle in degrees, output upscaled by 10000.
  *
  * @param [in]  x        Angle in degrees.
- * @returns              Approximately cos(x) * 10000.
+ * @returns              cos(x) * 10000, rounded to nearest.
  */
 int32_t pbio_int_math_cos_deg(int32_t x) {
-    return pbio_int_math_sin_deg(x + 90);
+    return pbio_int_math_sin_deg(x % 360 + 90);
+}
+
+/**
+ * Approximates sine of an angle in millidegrees, output upscaled by 10000.
+ *
+ * This interpolates linearly between the whole degrees in the sine table,
+ * which is accurate to within one unit.
+ *
+ * @param [in]  x        Angle in millidegrees.
+ * @returns              Approximately sin(x) * 10000.
+ */
+int32_t pbio_int_math_sin_mdeg(int32_t x) {
+
+    // Bring angle in range 0 to 360 degrees.
+    x %= 360000;
+    if (x < 0) {
+        x += 360000;
+    }
+
+    // Use symmetry to get an angle in the first quarter.
+    int32_t sign = 1;
+    if (x >= 180000) {
+        x -= 180000;
+        sign = -1;
+    }
+    if (x > 90000) {
+        x = 180000 - x;
+    }
+
+    // Interpolate between the nearest whole degrees. The sine is increasing
+    // in the first quarter, so the rounding offset is always positive.
+    int32_t i = x / 1000;
+    int32_t fraction = x - i * 1000;
+    int32_t y = sin_table[i];
+    if (fraction) {
+        y += ((sin_table[i + 1] - y) * fraction + 500) / 1000;
+    }
+    return sign * y;
+}
+
+/**
+ * Approximates cosine of an angle in millidegrees, output upscaled by 10000.
+ *
+ * @param [in]  x        Angle in millidegrees.
+ * @returns              Approximately cos(x) * 10000.
+ */
+int32_t pbio_int_math_cos_mdeg(int32_t x) {
+    return pbio_int_math_sin_mdeg(x % 360000 + 90000);
+}
+
+/**
+ * Converts a floating point number to Q16.16 fixed point, rounded to nearest.
+ *
+ * Magnitudes below 2**-17 (about 7.6e-6) become zero.
+ *
+ * @param [in]  x        The value to convert.
+ * @param [out] result   The Q16.16 value, or 0 on error.
+ * @returns              ::PBIO_ERROR_INVALID_ARG if @p x is not a number or
+ *                       not in the range -32768 to 32768, otherwise
+ *                       ::PBIO_SUCCESS.
+ */
+pbio_error_t pbio_int_math_q16_from_float(float x, int32_t *result) {
+    *result = 0;
+
+    float scaled = x * PBIO_INT_MATH_Q16_ONE;
+
+    // Written so that NaN fails too.
+    if (!(scaled >= -2147483648.0f && scaled < 2147483648.0f)) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    // Round to nearest. Floats this close to the limits have no fractional
+    // part, so this stays in range.
+    *result = (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Converts a Q32.32 value to Q16.16, rounded to nearest.
+ *
+ * This is used for sums of products of two Q16.16 values.
+ *
+ * @param [in]  x        The value to convert.
+ * @param [out] result   The Q16.16 value, or 0 on error.
+ * @returns              ::PBIO_ERROR_INVALID_ARG if the result does not fit
+ *                       in Q16.16, otherwise ::PBIO_SUCCESS.
+ */
+pbio_error_t pbio_int_math_q16_from_q32(int64_t x, int32_t *result) {
+    *result = 0;
+
+    // Check the range of the rounded result before rounding, which could
+    // otherwise overflow too.
+    if (x >= ((int64_t)INT32_MAX << 16) + (1 << 15) ||
+        x < -((int64_t)1 << 47) - (1 << 15)) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    *result = (int32_t)((x + (1 << 15)) >> 16);
+    return PBIO_SUCCESS;
 }
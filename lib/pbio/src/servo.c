@@ -11,12 +11,14 @@
 #include <pbdrv/clock.h>
 #include <pbdrv/counter.h>
 #include <pbdrv/legodev.h>
+#include <pbdrv/telemetry.h>
 
 #include <pbio/angle.h>
 #include <pbio/int_math.h>
 #include <pbio/observer.h>
 #include <pbio/parent.h>
 #include <pbio/servo.h>
+#include <pbio/util.h>
 
 #if PBIO_CONFIG_SERVO
 
@@ -122,8 +124,9 @@ static pbio_error_t pbio_servo_update(pbio_servo_t *srv) {
     int32_t voltage;
     pbio_dcmotor_get_state(srv->dcmotor, &applied_actuation, &voltage);
 
-    // Optionally log servo state.
-    if (pbio_logger_is_active(&srv->log)) {
+    // Optionally log or publish servo state.
+    bool log_active = pbio_logger_is_active(&srv->log);
+    if (log_active || pbdrv_telemetry_is_active()) {
 
         // Get stall state
         bool stalled;
@@ -153,7 +156,10 @@ static pbio_error_t pbio_servo_update(pbio_servo_t *srv) {
             // Column 10: Observer error feedback voltage torque (mV).
             pbio_observer_get_feedback_voltage(&srv->observer, &state.position),
         };
-        pbio_logger_add_row(&srv->log, log_data);
+        if (log_active) {
+            pbio_logger_add_row(&srv->log, log_data);
+        }
+        pbdrv_telemetry_publish(PBDRV_TELEMETRY_SOURCE_SERVO, srv - servos, log_data, PBIO_ARRAY_SIZE(log_data));
     }
 
     // Update the state observer
@@ -5,12 +5,16 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <contiki.h>
 #include <contiki-lib.h>
 
 #include <pbio/error.h>
 #include <pbio/task.h>
+#include <pbio/util.h>
+
+PROCESS(pbio_task_process, "pbio task");
 
 /**
  * Initializes the @p task data structure.
@@ -24,6 +28,11 @@ void pbio_task_init(pbio_task_t *task, pbio_task_thread_t thread, void *context)
     PT_INIT(&task->pt);
     task->status = PBIO_ERROR_AGAIN;
     task->cancel = false;
+    task->timed_out = false;
+    task->has_deadline = false;
+    task->on_cancel = NULL;
+    task->deadline.next = NULL;
+    task->deadline.p = PROCESS_NONE;
 }
 
 /**
@@ -41,21 +50,185 @@ bool pbio_task_run_once(pbio_task_t *task) {
     }
 
     assert(task->status != PBIO_ERROR_AGAIN);
-    assert((task->status == PBIO_ERROR_CANCELED) == task->cancel);
+    // A task can still complete normally after cancellation was requested if
+    // it was past the point where it can be canceled.
+    assert(task->status != PBIO_ERROR_CANCELED || task->cancel);
+
+    if (task->has_deadline) {
+        task->has_deadline = false;
+        etimer_stop(&task->deadline);
+    }
+
+    if (task->status == PBIO_ERROR_CANCELED && task->timed_out) {
+        task->status = PBIO_ERROR_TIMEDOUT;
+    }
 
     return true;
 }
 
 /**
  * Sets cancel flag for @p task.
+ *
+ * If the task has a cancel callback, it is called the first time this is
+ * called on a running task so that the driver can run the task again
+ * right away. The task is done when its status is no longer
+ * ::PBIO_ERROR_AGAIN.
+ *
  * @param [in]  task The task.
  */
 void pbio_task_cancel(pbio_task_t *task) {
+    if (task->cancel || task->status != PBIO_ERROR_AGAIN) {
+        return;
+    }
+
     task->cancel = true;
-    // FIXME: need a way to poll the process that has the task queue to
-    // expedite the cancellation. e.g. if the task is not the first in the
-    // queue, it can just be removed from the queue. For btstack, we probably
-    // need to create a synthetic event. For other drivers, we can probably
-    // do something with contiki events. Since it is driver-specific, this
-    // means we probably need to add a cancel callback to the task struct.
+
+    if (task->on_cancel) {
+        task->on_cancel(task);
+    }
+}
+
+/**
+ * Ends @p task without running it again, e.g. when the driver is shut down.
+ *
+ * This does nothing if the task is already done.
+ *
+ * @param [in]  task    The task.
+ */
+void pbio_task_abort(pbio_task_t *task) {
+    if (task->status != PBIO_ERROR_AGAIN) {
+        return;
+    }
+
+    if (task->has_deadline) {
+        task->has_deadline = false;
+        etimer_stop(&task->deadline);
+    }
+
+    task->status = PBIO_ERROR_CANCELED;
+}
+
+/**
+ * Sets a deadline for @p task.
+ *
+ * When the deadline passes before the task is done, the task is canceled
+ * from the event loop and its status will be ::PBIO_ERROR_TIMEDOUT instead of
+ * ::PBIO_ERROR_CANCELED. The deadline timer is stopped when the task
+ * completes in ::pbio_task_run_once, so the task must not be freed or
+ * initialized again before it is done.
+ *
+ * @param [in]  task    The running task.
+ * @param [in]  timeout The timeout in milliseconds from now.
+ */
+void pbio_task_set_deadline(pbio_task_t *task, uint32_t timeout) {
+    if (task->status != PBIO_ERROR_AGAIN) {
+        return;
+    }
+
+    if (!process_is_running(&pbio_task_process)) {
+        process_start(&pbio_task_process);
+    }
+
+    task->has_deadline = true;
+
+    PROCESS_CONTEXT_BEGIN(&pbio_task_process);
+    etimer_set(&task->deadline, timeout);
+    PROCESS_CONTEXT_END(&pbio_task_process);
+}
+
+PROCESS_THREAD(pbio_task_process, ev, data) {
+    PROCESS_BEGIN();
+
+    for (;;) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+
+        struct etimer *timer = data;
+        pbio_task_t *task = PBIO_CONTAINER_OF(timer, pbio_task_t, deadline);
+
+        // The task may have completed (and even been reused) after the timer
+        // expired but before this event was delivered.
+        if (!task->has_deadline || !etimer_expired(timer)) {
+            continue;
+        }
+
+        task->has_deadline = false;
+
+        if (task->status == PBIO_ERROR_AGAIN) {
+            task->timed_out = true;
+            pbio_task_cancel(task);
+        }
+    }
+
+    PROCESS_END();
+}
+
+/**
+ * Initializes an empty task group.
+ * @param [in]  group   The uninitialized group.
+ */
+void pbio_task_group_init(pbio_task_group_t *group) {
+    group->num_tasks = 0;
+}
+
+/**
+ * Adds a task to a group.
+ * @param [in]  group   The group.
+ * @param [in]  task    The task.
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_INVALID_OP if the
+ *                      group is full.
+ */
+pbio_error_t pbio_task_group_add(pbio_task_group_t *group, pbio_task_t *task) {
+    if (group->num_tasks >= PBIO_ARRAY_SIZE(group->tasks)) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    group->tasks[group->num_tasks++] = task;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the combined status of all tasks in a group.
+ * @param [in]  group   The group.
+ * @return              ::PBIO_ERROR_AGAIN if any task is still running,
+ *                      otherwise the status of the first task that did not
+ *                      succeed or ::PBIO_SUCCESS if all tasks succeeded.
+ */
+pbio_error_t pbio_task_group_get_status(pbio_task_group_t *group) {
+    pbio_error_t status = PBIO_SUCCESS;
+
+    for (uint8_t i = 0; i < group->num_tasks; i++) {
+        pbio_task_t *task = group->tasks[i];
+
+        if (task->status == PBIO_ERROR_AGAIN) {
+            return PBIO_ERROR_AGAIN;
+        }
+
+        if (status == PBIO_SUCCESS) {
+            status = task->status;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Requests cancellation of all running tasks in a group.
+ * @param [in]  group   The group.
+ */
+void pbio_task_group_cancel(pbio_task_group_t *group) {
+    for (uint8_t i = 0; i < group->num_tasks; i++) {
+        pbio_task_cancel(group->tasks[i]);
+    }
+}
+
+/**
+ * Sets the same deadline for all running tasks in a group.
+ * @param [in]  group   The group.
+ * @param [in]  timeout The timeout in milliseconds from now.
+ */
+void pbio_task_group_set_deadline(pbio_task_group_t *group, uint32_t timeout) {
+    for (uint8_t i = 0; i < group->num_tasks; i++) {
+        pbio_task_set_deadline(group->tasks[i], timeout);
+    }
 }
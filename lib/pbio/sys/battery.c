@@ -3,16 +3,23 @@
 
 // Provides battery status indication and shutdown on low battery.
 
-// TODO: need to handle high battery current
 // TODO: need to handle battery pack switch and Li-ion batteries for Technic Hub and NXT
 
+#include <string.h>
+
 #include <pbdrv/battery.h>
 #include <pbdrv/charger.h>
 #include <pbdrv/config.h>
 #include <pbdrv/clock.h>
 #include <pbdrv/usb.h>
+#include <pbio/battery.h>
+#include <pbio/util.h>
+#include <pbsys/battery.h>
+#include <pbsys/program_load.h>
 #include <pbsys/status.h>
 
+#include "core.h"
+
 // period over which the battery voltage is averaged (in milliseconds)
 #define BATTERY_PERIOD_MS       2500
 
@@ -30,6 +37,27 @@
 static uint32_t prev_poll_time;
 static uint16_t avg_battery_voltage;
 
+#if PBIO_CONFIG_BATTERY_SOC
+static bool battery_capacity_restored;
+#endif
+
+#if PBDRV_CONFIG_CHARGER
+// Default charger current limit for each USB charger type.
+// REVISIT: The only current battery charger chip will automatically monitor
+// VBUS and limit the current if the VBUS voltage starts to drop, so these
+// limits are a bit looser than they could be.
+static const pbdrv_charger_limit_t charger_limits_default[] = {
+    [PBDRV_USB_BCD_NONE] = PBDRV_CHARGER_LIMIT_NONE,
+    [PBDRV_USB_BCD_NONSTANDARD] = PBDRV_CHARGER_LIMIT_CHARGING,
+    [PBDRV_USB_BCD_STANDARD_DOWNSTREAM] = PBDRV_CHARGER_LIMIT_STD_MAX,
+    [PBDRV_USB_BCD_CHARGING_DOWNSTREAM] = PBDRV_CHARGER_LIMIT_CHARGING,
+    [PBDRV_USB_BCD_DEDICATED_CHARGING] = PBDRV_CHARGER_LIMIT_CHARGING,
+};
+
+// Limits in use, which may be lowered by the user program.
+static pbdrv_charger_limit_t charger_limits[PBIO_ARRAY_SIZE(charger_limits_default)];
+#endif
+
 #if PBDRV_CONFIG_BATTERY_ADC_TYPE == 1
 // special case to reduce code size on Move hub
 #define battery_critical_mv BATTERY_CRITICAL_MV
@@ -45,6 +73,8 @@ static uint16_t battery_ok_mv;
  * Initializes the system battery monitor.
  */
 void pbsys_battery_init(void) {
+    pbsys_battery_reset_charger_limits();
+
     #if PBDRV_CONFIG_BATTERY_ADC_TYPE != 1
     pbdrv_battery_type_t type;
     if (pbdrv_battery_get_type(&type) == PBIO_SUCCESS && type == PBDRV_BATTERY_TYPE_LIION) {
@@ -100,33 +130,99 @@ void pbsys_battery_poll(void) {
         pbsys_status_clear(PBIO_PYBRICKS_STATUS_BATTERY_LOW_VOLTAGE_WARNING);
     }
 
+    #if PBIO_CONFIG_BATTERY_SOC
+
+    // The stored data is loaded from storage while pbsys is initializing, so
+    // the capacity saved in a previous session is only valid afterwards. Until
+    // then, don't overwrite it either.
+    if (!battery_capacity_restored && !pbsys_init_busy()) {
+        pbio_battery_set_capacity(pbsys_program_load_get_battery_capacity());
+        battery_capacity_restored = true;
+    }
+    if (battery_capacity_restored) {
+        pbsys_program_load_set_battery_capacity(pbio_battery_get_capacity());
+    }
+
+    // Warn when the current is high enough that the voltage will soon drop
+    // to the shutdown level. Programs can use this to limit peak current.
+    int32_t max_current = pbio_battery_get_max_current(battery_critical_mv);
+    int32_t current = pbio_battery_get_average_current();
+
+    if (current > max_current * 3 / 4) {
+        pbsys_status_set(PBIO_PYBRICKS_STATUS_BATTERY_HIGH_CURRENT);
+    } else if (current < max_current / 2) {
+        pbsys_status_clear(PBIO_PYBRICKS_STATUS_BATTERY_HIGH_CURRENT);
+    }
+
+    #endif // PBIO_CONFIG_BATTERY_SOC
+
     // REVISIT: we should be able to make this event driven rather than polled
     #if PBDRV_CONFIG_CHARGER
 
     pbdrv_usb_bcd_t bcd = pbdrv_usb_get_bcd();
     bool enable = bcd != PBDRV_USB_BCD_NONE;
-    pbdrv_charger_limit_t limit;
-
-    // REVISIT: The only current battery charger chip will automatically monitor
-    // VBUS and limit the current if the VBUS voltage starts to drop, so these
-    // limits are a bit looser than they could be.
-    switch (bcd) {
-        case PBDRV_USB_BCD_NONE:
-            limit = PBDRV_CHARGER_LIMIT_NONE;
-            break;
-        case PBDRV_USB_BCD_STANDARD_DOWNSTREAM:
-            limit = PBDRV_CHARGER_LIMIT_STD_MAX;
-            break;
-        default:
-            limit = PBDRV_CHARGER_LIMIT_CHARGING;
-            break;
-    }
 
-    pbdrv_charger_enable(enable, limit);
+    pbdrv_charger_enable(enable, charger_limits[bcd]);
 
     #endif // PBDRV_CONFIG_CHARGER
 }
 
+#if PBDRV_CONFIG_CHARGER
+
+/**
+ * Restores the default charger current limits for all USB charger types.
+ *
+ * This is called when the user program ends, so that lower limits set by a
+ * program don't stay in effect.
+ */
+void pbsys_battery_reset_charger_limits(void) {
+    memcpy(charger_limits, charger_limits_default, sizeof(charger_limits));
+}
+
+/**
+ * Sets the charger current limit that is used for a type of USB charger.
+ *
+ * The limit can be lowered, for example to reduce heating, but it can't be
+ * raised above what the USB standard allows for a standard downstream port.
+ *
+ * @param [in]  bcd     The USB charger type.
+ * @param [in]  limit   The new limit.
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_INVALID_ARG if the
+ *                      limit is not allowed for this charger type.
+ */
+pbio_error_t pbsys_battery_set_charger_limit(pbdrv_usb_bcd_t bcd, pbdrv_charger_limit_t limit) {
+    if (bcd > PBDRV_USB_BCD_DEDICATED_CHARGING || limit > PBDRV_CHARGER_LIMIT_CHARGING) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (bcd == PBDRV_USB_BCD_NONE && limit != PBDRV_CHARGER_LIMIT_NONE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (bcd == PBDRV_USB_BCD_STANDARD_DOWNSTREAM && limit > PBDRV_CHARGER_LIMIT_STD_MAX) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    charger_limits[bcd] = limit;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the charger current limit that is used for a type of USB charger.
+ *
+ * @param [in]  bcd     The USB charger type.
+ * @return              The limit.
+ */
+pbdrv_charger_limit_t pbsys_battery_get_charger_limit(pbdrv_usb_bcd_t bcd) {
+    if (bcd > PBDRV_USB_BCD_DEDICATED_CHARGING) {
+        return PBDRV_CHARGER_LIMIT_NONE;
+    }
+    return charger_limits[bcd];
+}
+
+#endif // PBDRV_CONFIG_CHARGER
+
 /**
  * Tests if the battery is "full".
  *
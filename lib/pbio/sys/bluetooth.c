@@ -14,16 +14,24 @@
 #include <lwrb/lwrb.h>
 
 #include <pbdrv/bluetooth.h>
+#include <pbdrv/clock.h>
 #include <pbio/error.h>
 #include <pbio/event.h>
+#include <pbio/int_math.h>
 #include <pbio/protocol.h>
 #include <pbio/util.h>
 #include <pbsys/bluetooth.h>
 #include <pbsys/command.h>
 #include <pbsys/status.h>
 
-// REVISIT: this can be the negotiated MTU - 3 to allow for better throughput
-#define MAX_CHAR_SIZE 20
+#include "bluetooth.h"
+
+// Largest notification payload that could be sent. The actual size is limited
+// by the MTU that was negotiated with the central.
+#define MAX_CHAR_SIZE (PBDRV_BLUETOOTH_MAX_MTU_SIZE - 3)
+
+// How often the connection manager checks for the idle timeout
+#define LINK_UPDATE_PERIOD_MS 250
 
 // REVISIT: this needs to be moved to a common place where it can be shared with USB
 static pbsys_bluetooth_stdin_event_callback_t stdin_event_callback;
@@ -40,6 +48,7 @@ typedef struct {
 static send_msg_t stdout_msg;
 LIST(send_queue);
 static bool send_busy;
+static pbsys_bluetooth_link_t central_link;
 
 PROCESS(pbsys_bluetooth_process, "Bluetooth");
 
@@ -89,6 +98,94 @@ void pbsys_bluetooth_rx_write(const uint8_t *data, uint32_t size) {
     }
 }
 
+/**
+ * Resets the connection manager state for a new connection.
+ * @param [in]  link    The connection manager state.
+ * @param [in]  now     The current time in milliseconds.
+ */
+void pbsys_bluetooth_link_reset(pbsys_bluetooth_link_t *link, uint32_t now) {
+    // The drivers either request the idle interval when a central connects
+    // or leave it up to the central, so there is no need to request it again.
+    link->interval = PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE;
+    link->requested_interval = PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE;
+    link->last_activity_time = now - PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS;
+    link->last_request_time = now - PBSYS_BLUETOOTH_LINK_REQUEST_PERIOD_MS;
+    link->window_start_time = now;
+    link->window_bytes = 0;
+    link->bytes_per_second = 0;
+}
+
+/**
+ * Notifies the connection manager that there is program download or stdout
+ * traffic, so a short connection interval is wanted.
+ * @param [in]  link    The connection manager state.
+ * @param [in]  now     The current time in milliseconds.
+ */
+void pbsys_bluetooth_link_activity(pbsys_bluetooth_link_t *link, uint32_t now) {
+    link->last_activity_time = now;
+    link->interval = PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST;
+}
+
+// Completes the throughput measurement window if it has elapsed.
+static void pbsys_bluetooth_link_update_throughput(pbsys_bluetooth_link_t *link, uint32_t now) {
+    uint32_t elapsed = now - link->window_start_time;
+
+    if (elapsed < PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS) {
+        return;
+    }
+
+    link->bytes_per_second = (uint64_t)link->window_bytes * 1000 / elapsed;
+    link->window_start_time = now;
+    link->window_bytes = 0;
+}
+
+/**
+ * Notifies the connection manager that a notification was sent.
+ * @param [in]  link    The connection manager state.
+ * @param [in]  now     The current time in milliseconds.
+ * @param [in]  size    The size of the notification payload in bytes.
+ */
+void pbsys_bluetooth_link_sent(pbsys_bluetooth_link_t *link, uint32_t now, uint32_t size) {
+    pbsys_bluetooth_link_update_throughput(link, now);
+    link->window_bytes += size;
+}
+
+/**
+ * Updates the connection manager state.
+ *
+ * This switches back to the idle interval after a period without activity
+ * and limits how often the central is asked to change the interval, since
+ * some centrals ignore requests that come in too quickly.
+ *
+ * @param [in]  link        The connection manager state.
+ * @param [in]  now         The current time in milliseconds.
+ * @param [out] interval    The interval to request if the return value is true.
+ * @return                  True if @p interval should be requested from the
+ *                          driver now, otherwise false.
+ */
+bool pbsys_bluetooth_link_update(pbsys_bluetooth_link_t *link, uint32_t now, pbdrv_bluetooth_connection_interval_t *interval) {
+    pbsys_bluetooth_link_update_throughput(link, now);
+
+    if (link->interval == PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST
+        && now - link->last_activity_time >= PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS) {
+        link->interval = PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE;
+    }
+
+    if (link->interval == link->requested_interval) {
+        return false;
+    }
+
+    if (now - link->last_request_time < PBSYS_BLUETOOTH_LINK_REQUEST_PERIOD_MS) {
+        return false;
+    }
+
+    link->requested_interval = link->interval;
+    link->last_request_time = now;
+    *interval = link->interval;
+
+    return true;
+}
+
 // Public API
 
 /**
@@ -195,6 +292,21 @@ bool pbsys_bluetooth_tx_is_idle(void) {
     return !send_busy && lwrb_get_full(&stdout_ring_buf) == 0;
 }
 
+/**
+ * Gets the throughput of notifications sent to the connected central.
+ *
+ * This is measured over windows of ::PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS.
+ *
+ * @returns The throughput in bytes per second or 0 if there is no connection.
+ */
+uint32_t pbsys_bluetooth_tx_get_throughput(void) {
+    if (!pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_LE)) {
+        return 0;
+    }
+
+    return central_link.bytes_per_second;
+}
+
 // Contiki process
 
 static void on_event(void) {
@@ -203,6 +315,9 @@ static void on_event(void) {
 
 static pbio_pybricks_error_t handle_receive(pbdrv_bluetooth_connection_t connection, const uint8_t *data, uint32_t size) {
     if (connection == PBDRV_BLUETOOTH_CONNECTION_PYBRICKS) {
+        // commands are mostly program downloads, so speed up the connection
+        pbsys_bluetooth_link_activity(&central_link, pbdrv_clock_get_ms());
+        process_poll(&pbsys_bluetooth_process);
         return pbsys_command(data, size);
     }
 
@@ -282,6 +397,7 @@ static PT_THREAD(pbsys_bluetooth_monitor_status(struct pt *pt)) {
 
 PROCESS_THREAD(pbsys_bluetooth_process, ev, data) {
     static struct etimer timer;
+    static struct etimer link_timer;
     static struct pt status_monitor_pt;
 
     PROCESS_BEGIN();
@@ -316,6 +432,9 @@ PROCESS_THREAD(pbsys_bluetooth_process, ev, data) {
 
         PT_INIT(&status_monitor_pt);
 
+        pbsys_bluetooth_link_reset(&central_link, pbdrv_clock_get_ms());
+        etimer_set(&link_timer, LINK_UPDATE_PERIOD_MS);
+
         while (pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_LE)
                && !pbsys_status_test(PBIO_PYBRICKS_STATUS_SHUTDOWN)) {
 
@@ -329,23 +448,40 @@ PROCESS_THREAD(pbsys_bluetooth_process, ev, data) {
                 PT_INIT(&status_monitor_pt);
             }
 
-            if (!send_busy) {
+            if (etimer_expired(&link_timer)) {
+                etimer_reset(&link_timer);
+            }
+
+            pbdrv_bluetooth_connection_interval_t interval;
+            if (pbsys_bluetooth_link_update(&central_link, pbdrv_clock_get_ms(), &interval)) {
+                pbdrv_bluetooth_request_connection_interval(interval);
+            }
+
+            // Drivers that can hand off a notification to the Bluetooth chip
+            // right away call send_done() before returning, so keep sending
+            // until the driver is busy to fill up the connection event.
+            while (!send_busy) {
                 // msg is removed from queue in send_done callback rather than here
                 send_msg_t *msg = list_head(send_queue);
-                if (msg) {
-                    msg->context.done = send_done;
-
-                    if (msg == &stdout_msg) {
-                        msg->payload[0] = PBIO_PYBRICKS_EVENT_WRITE_STDOUT;
-                        // REVISIT: use negotiated MTU instead of minimum safe size
-                        msg->context.size = lwrb_read(&stdout_ring_buf, &msg->payload[1], PBIO_ARRAY_SIZE(msg->payload) - 1) + 1;
-                        assert(msg->context.size > 1);
-                    }
-
-                    msg->context.data = &msg->payload[0];
-                    send_busy = true;
-                    pbdrv_bluetooth_send(&msg->context);
+                if (!msg) {
+                    break;
+                }
+
+                msg->context.done = send_done;
+
+                if (msg == &stdout_msg) {
+                    uint32_t max_size = pbio_int_math_min(pbdrv_bluetooth_get_mtu_size() - 3, PBIO_ARRAY_SIZE(msg->payload));
+                    msg->payload[0] = PBIO_PYBRICKS_EVENT_WRITE_STDOUT;
+                    msg->context.size = lwrb_read(&stdout_ring_buf, &msg->payload[1], max_size - 1) + 1;
+                    assert(msg->context.size > 1);
+                    pbsys_bluetooth_link_activity(&central_link, pbdrv_clock_get_ms());
                 }
+
+                pbsys_bluetooth_link_sent(&central_link, pbdrv_clock_get_ms(), msg->context.size);
+
+                msg->context.data = &msg->payload[0];
+                send_busy = true;
+                pbdrv_bluetooth_send(&msg->context);
             }
 
             PROCESS_WAIT_EVENT();
@@ -4,8 +4,43 @@
 #ifndef _PBSYS_SYS_BLUETOOTH_H_
 #define _PBSYS_SYS_BLUETOOTH_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include <pbdrv/bluetooth.h>
+
+/** Time without Pybricks protocol traffic before requesting a long interval. */
+#define PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS 2000
+
+/** Minimum time between two connection interval requests. */
+#define PBSYS_BLUETOOTH_LINK_REQUEST_PERIOD_MS 1000
+
+/** Length of the window used to measure throughput. */
+#define PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS 1000
+
+/** State of the connection manager for the connection with the central. */
+typedef struct {
+    /** The connection interval that is currently wanted. */
+    pbdrv_bluetooth_connection_interval_t interval;
+    /** The connection interval that was last requested from the driver. */
+    pbdrv_bluetooth_connection_interval_t requested_interval;
+    /** Time of the last program download or stdout traffic. */
+    uint32_t last_activity_time;
+    /** Time of the last connection interval request. */
+    uint32_t last_request_time;
+    /** Start time of the current throughput measurement window. */
+    uint32_t window_start_time;
+    /** Number of bytes sent in the current throughput measurement window. */
+    uint32_t window_bytes;
+    /** Throughput of the last complete window in bytes per second. */
+    uint32_t bytes_per_second;
+} pbsys_bluetooth_link_t;
+
+void pbsys_bluetooth_link_reset(pbsys_bluetooth_link_t *link, uint32_t now);
+void pbsys_bluetooth_link_activity(pbsys_bluetooth_link_t *link, uint32_t now);
+void pbsys_bluetooth_link_sent(pbsys_bluetooth_link_t *link, uint32_t now, uint32_t size);
+bool pbsys_bluetooth_link_update(pbsys_bluetooth_link_t *link, uint32_t now, pbdrv_bluetooth_connection_interval_t *interval);
+
 uint32_t pbsys_bluetooth_rx_get_free(void);
 void pbsys_bluetooth_rx_write(const uint8_t *data, uint32_t size);
 
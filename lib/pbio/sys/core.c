@@ -9,6 +9,7 @@
 
 #include <pbsys/battery.h>
 #include <pbsys/bluetooth.h>
+#include <pbsys/usb.h>
 
 #include "core.h"
 #include "hmi.h"
@@ -29,16 +30,13 @@ PROCESS_THREAD(pbsys_system_process, ev, data) {
     etimer_set(&timer, 50);
 
     for (;;) {
-        PROCESS_WAIT_EVENT();
-        pbsys_hmi_handle_event(ev, data);
-        if (ev == PROCESS_EVENT_TIMER && etimer_expired(&timer)) {
-            etimer_reset(&timer);
-            pbsys_battery_poll();
-            pbsys_hmi_poll();
-            pbsys_io_ports_poll();
-            pbsys_supervisor_poll();
-            pbsys_program_stop_poll();
-        }
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&timer));
+        etimer_reset(&timer);
+        pbsys_battery_poll();
+        pbsys_hmi_poll();
+        pbsys_io_ports_poll();
+        pbsys_supervisor_poll();
+        pbsys_program_stop_poll();
     }
 
     PROCESS_END();
@@ -47,7 +45,9 @@ PROCESS_THREAD(pbsys_system_process, ev, data) {
 void pbsys_init(void) {
     pbsys_battery_init();
     pbsys_bluetooth_init();
+    pbsys_usb_init();
     pbsys_hmi_init();
+    pbsys_supervisor_init();
     pbsys_program_load_init();
     process_start(&pbsys_system_process);
 
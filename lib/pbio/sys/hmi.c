@@ -17,7 +17,6 @@
 #include <pbdrv/led.h>
 #include <pbio/button.h>
 #include <pbio/color.h>
-#include <pbio/event.h>
 #include <pbio/light.h>
 #include <pbsys/config.h>
 #include <pbsys/status.h>
@@ -57,27 +56,42 @@ static PT_THREAD(user_program_start(bool button_pressed)) {
     PT_END(pt);
 }
 
-void pbsys_hmi_init(void) {
-    pbsys_status_light_init();
-    pbsys_hub_light_matrix_init();
-    PT_INIT(&user_program_start_pt);
+static void pbsys_hmi_power_button_long_press(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
+    if (set) {
+        pbsys_status_set(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST);
+    }
 }
 
-void pbsys_hmi_handle_event(process_event_t event, process_data_t data) {
-    pbsys_status_light_handle_event(event, data);
-    pbsys_hub_light_matrix_handle_event(event, data);
+// power off when button is held down for 3 seconds
+static pbsys_status_subscriber_t pbsys_hmi_power_button_long_press_subscriber = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED),
+    .debounce = 3000,
+    .callback = pbsys_hmi_power_button_long_press,
+};
 
-    #if PBSYS_CONFIG_BATTERY_CHARGER
+#if PBSYS_CONFIG_BATTERY_CHARGER
+static void pbsys_hmi_power_button_pressed(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
     // On the Technic Large hub, USB can keep the power on even though we are
     // "shutdown", so if the button is pressed again, we reset to turn back on
-    if (
-        pbsys_status_test(PBIO_PYBRICKS_STATUS_SHUTDOWN)
-        && event == PBIO_EVENT_STATUS_SET
-        && (pbio_pybricks_status_t)data == PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED
-        ) {
+    if (set && pbsys_status_test(PBIO_PYBRICKS_STATUS_SHUTDOWN)) {
         pbdrv_reset(PBDRV_RESET_ACTION_RESET);
     }
-    #endif // PBSYS_CONFIG_BATTERY_CHARGER
+}
+
+static pbsys_status_subscriber_t pbsys_hmi_power_button_subscriber = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED),
+    .callback = pbsys_hmi_power_button_pressed,
+};
+#endif // PBSYS_CONFIG_BATTERY_CHARGER
+
+void pbsys_hmi_init(void) {
+    pbsys_status_light_init();
+    pbsys_hub_light_matrix_init();
+    PT_INIT(&user_program_start_pt);
+    pbsys_status_subscribe(&pbsys_hmi_power_button_long_press_subscriber);
+    #if PBSYS_CONFIG_BATTERY_CHARGER
+    pbsys_status_subscribe(&pbsys_hmi_power_button_subscriber);
+    #endif
 }
 
 /**
@@ -92,11 +106,6 @@ void pbsys_hmi_poll(void) {
         if (btn & PBIO_BUTTON_CENTER) {
             pbsys_status_set(PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED);
             user_program_start(true);
-
-            // power off when button is held down for 3 seconds
-            if (pbsys_status_test_debounce(PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED, true, 3000)) {
-                pbsys_status_set(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST);
-            }
         } else {
             pbsys_status_clear(PBIO_PYBRICKS_STATUS_POWER_BUTTON_PRESSED);
             user_program_start(false);
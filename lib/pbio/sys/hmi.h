@@ -7,7 +7,6 @@
 #include <contiki.h>
 
 void pbsys_hmi_init(void);
-void pbsys_hmi_handle_event(process_event_t event, process_data_t data);
 void pbsys_hmi_poll(void);
 
 #endif // _PBSYS_SYS_HMI_H_
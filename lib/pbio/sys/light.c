@@ -11,7 +11,6 @@
 #include <pbdrv/led.h>
 #include <pbio/color.h>
 #include <pbio/error.h>
-#include <pbio/event.h>
 #include <pbio/light.h>
 #include <pbio/util.h>
 #include <pbsys/config.h>
@@ -172,8 +171,11 @@ static const pbio_color_light_funcs_t pbsys_status_light_funcs = {
     .set_hsv = pbsys_status_light_set_hsv,
 };
 
+static pbsys_status_subscriber_t pbsys_status_light_subscriber;
+
 void pbsys_status_light_init(void) {
     pbio_color_light_init(pbsys_status_light, &pbsys_status_light_funcs);
+    pbsys_status_subscribe(&pbsys_status_light_subscriber);
 }
 
 static void pbsys_status_light_handle_status_change(void) {
@@ -231,16 +233,26 @@ static uint32_t default_user_program_light_animation_next(pbio_light_animation_t
     return 40;
 }
 
-void pbsys_status_light_handle_event(process_event_t event, process_data_t data) {
-    if (event == PBIO_EVENT_STATUS_SET || event == PBIO_EVENT_STATUS_CLEARED) {
-        pbsys_status_light_handle_status_change();
-    }
-    if (event == PBIO_EVENT_STATUS_SET && (pbio_pybricks_status_t)(intptr_t)data == PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING) {
+static void pbsys_status_light_handle_status(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
+    pbsys_status_light_handle_status_change();
+
+    if (set && status == PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING) {
         pbio_light_animation_init(&pbsys_status_light->animation, default_user_program_light_animation_next);
         pbio_light_animation_start(&pbsys_status_light->animation);
     }
 }
 
+static pbsys_status_subscriber_t pbsys_status_light_subscriber = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BLE_ADVERTISING)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BLE_LOW_SIGNAL)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BATTERY_LOW_VOLTAGE_WARNING)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BATTERY_HIGH_CURRENT)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_SHUTDOWN)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING),
+    .callback = pbsys_status_light_handle_status,
+};
+
 /**
  * Advances the light to the next state in the pattern.
  *
@@ -11,7 +11,6 @@
 
 #include <pbdrv/led.h>
 #include <pbio/error.h>
-#include <pbio/event.h>
 #include <pbio/light_matrix.h>
 #include <pbio/util.h>
 #include <pbsys/config.h>
@@ -94,9 +93,12 @@ static void pbsys_hub_light_matrix_start_power_animation(void) {
     pbio_light_animation_start(&pbsys_hub_light_matrix->animation);
 }
 
+static pbsys_status_subscriber_t pbsys_hub_light_matrix_subscriber;
+
 void pbsys_hub_light_matrix_init(void) {
     pbio_light_matrix_init(pbsys_hub_light_matrix, 5, &pbsys_hub_light_matrix_funcs);
     pbsys_hub_light_matrix_start_power_animation();
+    pbsys_status_subscribe(&pbsys_hub_light_matrix_subscriber);
 }
 
 // Animation frame for program running animation.
@@ -125,10 +127,8 @@ static uint32_t pbsys_hub_light_matrix_user_program_animation_next(pbio_light_an
     return 40;
 }
 
-void pbsys_hub_light_matrix_handle_event(process_event_t event, process_data_t data) {
-    if (event == PBIO_EVENT_STATUS_SET) {
-        pbio_pybricks_status_t status = (intptr_t)data;
-
+static void pbsys_hub_light_matrix_handle_status(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
+    if (set) {
         if (status == PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING) {
             // The user animation updates only a subset of pixels to save time,
             // so the rest must be cleared before it starts.
@@ -142,9 +142,7 @@ void pbsys_hub_light_matrix_handle_event(process_event_t event, process_data_t d
             // first, which is handled below to avoid a race condition.
             pbsys_hub_light_matrix_start_power_animation();
         }
-    } else if (event == PBIO_EVENT_STATUS_CLEARED) {
-        pbio_pybricks_status_t status = (intptr_t)data;
-
+    } else {
         // The user program has ended.
         if (status == PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING) {
             if (pbsys_status_test(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST)) {
@@ -158,4 +156,10 @@ void pbsys_hub_light_matrix_handle_event(process_event_t event, process_data_t d
     }
 }
 
+static pbsys_status_subscriber_t pbsys_hub_light_matrix_subscriber = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING)
+        | PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST),
+    .callback = pbsys_hub_light_matrix_handle_status,
+};
+
 #endif // PBSYS_CONFIG_HUB_LIGHT_MATRIX
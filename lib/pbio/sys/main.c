@@ -10,6 +10,7 @@
 #include <pbdrv/reset.h>
 #include <pbdrv/usb.h>
 #include <pbio/main.h>
+#include <pbsys/battery.h>
 #include <pbsys/core.h>
 #include <pbsys/main.h>
 #include <pbsys/status.h>
@@ -18,6 +19,7 @@
 #include "program_stop.h"
 #include <pbsys/program_stop.h>
 #include <pbsys/bluetooth.h>
+#include <pbsys/usb.h>
 
 /**
  * Initializes the PBIO library, runs custom main program, and handles shutdown.
@@ -42,6 +44,7 @@ int main(int argc, char **argv) {
         // Prepare pbsys for running the program.
         pbsys_status_set(PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING);
         pbsys_bluetooth_rx_set_callback(pbsys_main_stdin_event);
+        pbsys_usb_rx_set_callback(pbsys_main_stdin_event);
 
         // Handle pending events triggered by the status change, such as
         // starting status light animation.
@@ -54,7 +57,9 @@ int main(int argc, char **argv) {
         // Get system back in idle state.
         pbsys_status_clear(PBIO_PYBRICKS_STATUS_USER_PROGRAM_RUNNING);
         pbsys_bluetooth_rx_set_callback(NULL);
+        pbsys_usb_rx_set_callback(NULL);
         pbsys_program_stop_set_buttons(PBIO_BUTTON_CENTER);
+        pbsys_battery_reset_charger_limits();
         pbio_stop_all(true);
     }
 
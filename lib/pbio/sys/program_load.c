@@ -20,6 +20,11 @@
 
 #include "core.h"
 
+#if PBIO_CONFIG_BATTERY_SOC
+// Value of the layout_magic header field. Change it when the header changes.
+#define LAYOUT_MAGIC (0x4c425031) // "1PBL"
+#endif
+
 /**
  * Map of loaded data.
  */
@@ -82,6 +87,32 @@ pbio_error_t pbsys_program_load_get_user_data(uint32_t offset, uint8_t **data, u
     return PBIO_SUCCESS;
 }
 
+/**
+ * Gets the battery capacity that was saved in a previous session.
+ *
+ * @returns             The capacity in mAh. This is not validated.
+ */
+#if PBIO_CONFIG_BATTERY_SOC
+
+uint32_t pbsys_program_load_get_battery_capacity(void) {
+    return map->header.battery_capacity;
+}
+
+/**
+ * Saves the learned battery capacity. This will be saved during power off.
+ *
+ * @param [in]  capacity    The capacity in mAh.
+ */
+void pbsys_program_load_set_battery_capacity(uint32_t capacity) {
+    if (map->header.battery_capacity == capacity) {
+        return;
+    }
+    map->header.battery_capacity = capacity;
+    update_write_size();
+}
+
+#endif // PBIO_CONFIG_BATTERY_SOC
+
 static bool pbsys_program_load_start_user_program_requested;
 static bool pbsys_program_load_start_repl_requested;
 
@@ -247,6 +278,17 @@ PROCESS_THREAD(pbsys_program_load_process, ev, data) {
         map->header.program_size = 0;
     }
 
+    #if PBIO_CONFIG_BATTERY_SOC
+    // Data stored by firmware with a different header layout can't be used,
+    // since the program would be read from the wrong place.
+    if (map->header.write_size < sizeof(pbsys_program_load_data_header_t) ||
+        map->header.layout_magic != LAYOUT_MAGIC) {
+        map->header.program_size = 0;
+        map->header.layout_magic = LAYOUT_MAGIC;
+        map->header.battery_capacity = 0;
+    }
+    #endif
+
     // Reset write size, so we don't write data if nothing changed.
     map->header.write_size = 0;
 
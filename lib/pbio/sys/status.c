@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2018-2021 The Pybricks Authors
+// Copyright (c) 2018-2023 The Pybricks Authors
 
 // Keeps track of overall system status.
 
@@ -8,18 +8,47 @@
 #include <stdint.h>
 
 #include <contiki.h>
+#include <contiki-lib.h>
 
 #include <pbdrv/clock.h>
 #include <pbio/event.h>
 #include <pbsys/status.h>
 
+PROCESS(pbsys_status_process, "status");
+
+LIST(pbsys_status_subscribers);
+
 static struct {
     /** Status indications as bit flags */
     uint32_t flags;
     /** Timestamp of when status last changed */
     uint32_t changed_time[NUM_PBIO_PYBRICKS_STATUS];
+    /** Ring buffer of the most recent changes */
+    pbsys_status_transition_t history[PBSYS_STATUS_HISTORY_SIZE];
+    /** Total number of changes */
+    uint32_t history_count;
 } pbsys_status;
 
+/**
+ * Gets the status indication that a debounced subscriber is interested in.
+ */
+static pbio_pybricks_status_t pbsys_status_get_debounced_status(pbsys_status_subscriber_t *subscriber) {
+    return __builtin_ctz(subscriber->flags);
+}
+
+/**
+ * (Re)starts the debounce timer of a subscriber.
+ *
+ * @param [in]  subscriber  The subscriber.
+ * @param [in]  elapsed     How long the status indication has already been
+ *                          in its current state.
+ */
+static void pbsys_status_start_debounce(pbsys_status_subscriber_t *subscriber, uint32_t elapsed) {
+    PROCESS_CONTEXT_BEGIN(&pbsys_status_process);
+    etimer_set(&subscriber->timer, elapsed >= subscriber->debounce ? 0 : subscriber->debounce - elapsed);
+    PROCESS_CONTEXT_END(&pbsys_status_process);
+}
+
 static void pbsys_status_update_flag(pbio_pybricks_status_t status, bool set) {
     uint32_t new_flags = set ? pbsys_status.flags | PBIO_PYBRICKS_STATUS_FLAG(status) : pbsys_status.flags & ~PBIO_PYBRICKS_STATUS_FLAG(status);
 
@@ -28,13 +57,59 @@ static void pbsys_status_update_flag(pbio_pybricks_status_t status, bool set) {
         return;
     }
 
+    uint32_t now = pbdrv_clock_get_ms();
+
     pbsys_status.flags = new_flags;
-    pbsys_status.changed_time[status] = pbdrv_clock_get_ms();
+    pbsys_status.changed_time[status] = now;
+
+    pbsys_status_transition_t *transition = &pbsys_status.history[pbsys_status.history_count++ % PBSYS_STATUS_HISTORY_SIZE];
+    transition->time = now;
+    transition->status = status;
+    transition->set = set;
+
+    // Subscribers are notified right away, so they don't miss any changes.
+    for (pbsys_status_subscriber_t *subscriber = list_head(pbsys_status_subscribers); subscriber; subscriber = subscriber->next) {
+        if (!(subscriber->flags & PBIO_PYBRICKS_STATUS_FLAG(status))) {
+            continue;
+        }
+        if (subscriber->debounce) {
+            pbsys_status_start_debounce(subscriber, 0);
+        } else {
+            subscriber->callback(status, set, now, subscriber->context);
+        }
+    }
+
     // REVISIT: this can drop events if event queue is full
     process_post(PROCESS_BROADCAST, set ? PBIO_EVENT_STATUS_SET : PBIO_EVENT_STATUS_CLEARED,
         (process_data_t)status);
 }
 
+PROCESS_THREAD(pbsys_status_process, ev, data) {
+    PROCESS_BEGIN();
+
+    for (;;) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+
+        struct etimer *timer = data;
+
+        // The subscriber may have been removed after the timer expired but
+        // before this event was delivered.
+        if (!etimer_expired(timer)) {
+            continue;
+        }
+
+        for (pbsys_status_subscriber_t *subscriber = list_head(pbsys_status_subscribers); subscriber; subscriber = subscriber->next) {
+            if (&subscriber->timer == timer) {
+                pbio_pybricks_status_t status = pbsys_status_get_debounced_status(subscriber);
+                subscriber->callback(status, pbsys_status_test(status), pbsys_status.changed_time[status], subscriber->context);
+                break;
+            }
+        }
+    }
+
+    PROCESS_END();
+}
+
 /**
  * Sets a system status status indication.
  * @param [in]  status   The status indication to set.
@@ -67,6 +142,9 @@ bool pbsys_status_test(pbio_pybricks_status_t status) {
  * Tests if a status indication has been set or cleared for a specified time
  * without changing.
  *
+ * Code that needs to react to this should use a debounced subscriber instead
+ * of polling this function.
+ *
  * @param [in]  status  The status indication to to test.
  * @param [in]  state   *true* to test if the status indication is set or
  *                      *false* to test if the it is cleared.
@@ -91,3 +169,76 @@ bool pbsys_status_test_debounce(pbio_pybricks_status_t status, bool state, uint3
 uint32_t pbsys_status_get_flags(void) {
     return pbsys_status.flags;
 }
+
+/**
+ * Registers a subscriber that is notified when status indications change.
+ *
+ * Subscribers without debounce are called from ::pbsys_status_set and
+ * ::pbsys_status_clear, so they see every change in order. Debounced
+ * subscribers are called from the event loop once the status indication
+ * has been stable for the debounce time, including for the current state
+ * when subscribing.
+ *
+ * Callbacks must not subscribe or unsubscribe.
+ *
+ * @param [in]  subscriber  The subscriber. It must remain valid until it
+ *                          is unsubscribed.
+ */
+void pbsys_status_subscribe(pbsys_status_subscriber_t *subscriber) {
+    assert(subscriber->callback);
+    // Debounced subscribers have only one timer, so only one flag.
+    assert(!subscriber->debounce || (subscriber->flags && !(subscriber->flags & (subscriber->flags - 1))));
+
+    list_add(pbsys_status_subscribers, subscriber);
+
+    if (subscriber->debounce) {
+        if (!process_is_running(&pbsys_status_process)) {
+            process_start(&pbsys_status_process);
+        }
+        pbio_pybricks_status_t status = pbsys_status_get_debounced_status(subscriber);
+        pbsys_status_start_debounce(subscriber, pbdrv_clock_get_ms() - pbsys_status.changed_time[status]);
+    }
+}
+
+/**
+ * Removes a subscriber.
+ *
+ * @param [in]  subscriber  The subscriber.
+ */
+void pbsys_status_unsubscribe(pbsys_status_subscriber_t *subscriber) {
+    list_remove(pbsys_status_subscribers, subscriber);
+
+    if (subscriber->debounce) {
+        etimer_stop(&subscriber->timer);
+    }
+}
+
+/**
+ * Gets the number of status transitions in the history.
+ *
+ * @return              The number of transitions, at most
+ *                      ::PBSYS_STATUS_HISTORY_SIZE.
+ */
+uint32_t pbsys_status_get_history_count(void) {
+    return pbsys_status.history_count < PBSYS_STATUS_HISTORY_SIZE ?
+           pbsys_status.history_count : PBSYS_STATUS_HISTORY_SIZE;
+}
+
+/**
+ * Gets a status transition from the history.
+ *
+ * @param [in]  index       The index, where 0 is the oldest transition.
+ * @param [out] transition  The transition.
+ * @return                  *true* if @p index is valid, otherwise *false*.
+ */
+bool pbsys_status_get_history(uint32_t index, pbsys_status_transition_t *transition) {
+    uint32_t count = pbsys_status_get_history_count();
+
+    if (index >= count) {
+        return false;
+    }
+
+    *transition = pbsys_status.history[(pbsys_status.history_count - count + index) % PBSYS_STATUS_HISTORY_SIZE];
+
+    return true;
+}
@@ -7,10 +7,41 @@
 // down power on low battery an shutting down motors on overcurrent conditions.
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <pbdrv/watchdog.h>
 #include <pbsys/status.h>
 
+#include "supervisor.h"
+
+static void pbsys_supervisor_request_shutdown(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
+    if (set) {
+        pbsys_status_set(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST);
+    }
+}
+
+// Shut down on low voltage so we don't damage rechargeable batteries
+static pbsys_status_subscriber_t pbsys_supervisor_low_voltage = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BATTERY_LOW_VOLTAGE_SHUTDOWN),
+    .debounce = 3000,
+    .callback = pbsys_supervisor_request_shutdown,
+};
+
+// Shut down if there is no BLE connection made within 3 minutes
+static pbsys_status_subscriber_t pbsys_supervisor_ble_advertising = {
+    .flags = PBIO_PYBRICKS_STATUS_FLAG(PBIO_PYBRICKS_STATUS_BLE_ADVERTISING),
+    .debounce = 3 * 60000,
+    .callback = pbsys_supervisor_request_shutdown,
+};
+
+/**
+ * Initializes the system supervisor.
+ */
+void pbsys_supervisor_init(void) {
+    pbsys_status_subscribe(&pbsys_supervisor_low_voltage);
+    pbsys_status_subscribe(&pbsys_supervisor_ble_advertising);
+}
+
 /**
  * Polls the system supervisor.
  *
@@ -19,11 +50,4 @@
 void pbsys_supervisor_poll(void) {
     // keep the hub from resetting itself
     pbdrv_watchdog_update();
-
-    // Shut down on low voltage so we don't damage rechargeable batteries
-    // or if there is no BLE connection made within 3 minutes
-    if (pbsys_status_test_debounce(PBIO_PYBRICKS_STATUS_BATTERY_LOW_VOLTAGE_SHUTDOWN, true, 3000)
-        || pbsys_status_test_debounce(PBIO_PYBRICKS_STATUS_BLE_ADVERTISING, true, 3 * 60000)) {
-        pbsys_status_set(PBIO_PYBRICKS_STATUS_SHUTDOWN_REQUEST);
-    }
 }
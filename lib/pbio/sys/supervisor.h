@@ -4,6 +4,7 @@
 #ifndef _PBSYS_SYS_SUPERVISOR_H_
 #define _PBSYS_SYS_SUPERVISOR_H_
 
+void pbsys_supervisor_init(void);
 void pbsys_supervisor_poll(void);
 
 #endif // _PBSYS_SYS_SUPERVISOR_H_
@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Pybricks protocol over USB serial.
+//
+// The serial port is a byte stream, so messages are framed as described in
+// ::pbio_pybricks_usb_msg_t. Commands are handled the same way as commands
+// received over Bluetooth, so program downloads use the same code path.
+
+#include <pbsys/config.h>
+
+#if PBSYS_CONFIG_USB
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <contiki.h>
+#include <lwrb/lwrb.h>
+
+#include <pbdrv/usb.h>
+#include <pbio/error.h>
+#include <pbio/int_math.h>
+#include <pbio/protocol.h>
+#include <pbio/util.h>
+#include <pbsys/app.h>
+#include <pbsys/command.h>
+#include <pbsys/program_load.h>
+#include <pbsys/status.h>
+#include <pbsys/usb.h>
+
+#define MAX_MSG_SIZE (PBIO_PYBRICKS_USB_MSG_HEADER_SIZE + PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE)
+
+// Number of responses that can wait for room in the Tx buffer.
+#define MAX_PENDING_RESPONSES 16
+
+static pbsys_usb_stdin_event_callback_t stdin_event_callback;
+static lwrb_t stdin_ring_buf;
+
+// Message that is currently being received.
+static uint8_t rx_msg[MAX_MSG_SIZE];
+static uint32_t rx_msg_size;
+
+// Messages that could not be sent right away because the Tx buffer was full.
+// Responses are queued in the order the commands were received, one byte each.
+static lwrb_t response_ring_buf;
+static bool capabilities_pending;
+static bool status_pending;
+
+PROCESS(pbsys_usb_process, "USB");
+
+/** Initializes USB. */
+void pbsys_usb_init(void) {
+    // enough for one full message + 1 byte for ring buf pointer
+    static uint8_t stdin_buf[PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE + 1];
+    static uint8_t response_buf[MAX_PENDING_RESPONSES + 1];
+
+    lwrb_init(&stdin_ring_buf, stdin_buf, PBIO_ARRAY_SIZE(stdin_buf));
+    lwrb_init(&response_ring_buf, response_buf, PBIO_ARRAY_SIZE(response_buf));
+    process_start(&pbsys_usb_process);
+}
+
+/**
+ * Sends one message if there is room for all of it.
+ * @param [in]  type    The message type.
+ * @param [in]  prefix  Optional byte to put in front of @p data or -1 for none.
+ * @param [in]  data    The rest of the payload.
+ * @param [in]  size    The size of @p data in bytes.
+ * @return              @c true if the message was queued, otherwise @c false.
+ */
+static bool send_msg(pbio_pybricks_usb_msg_t type, int prefix, const uint8_t *data, uint32_t size) {
+    uint8_t header[PBIO_PYBRICKS_USB_MSG_HEADER_SIZE + 1];
+    uint32_t header_size = PBIO_PYBRICKS_USB_MSG_HEADER_SIZE;
+    uint32_t payload_size = size + (prefix >= 0);
+
+    if (pbdrv_usb_tx_get_free() < header_size + payload_size) {
+        return false;
+    }
+
+    header[0] = type;
+    pbio_set_uint16_le(&header[1], payload_size);
+    if (prefix >= 0) {
+        header[header_size++] = prefix;
+    }
+
+    pbdrv_usb_tx(header, header_size);
+    if (size) {
+        pbdrv_usb_tx(data, size);
+    }
+
+    return true;
+}
+
+static bool send_status(void) {
+    uint8_t buf[5];
+    uint32_t size = pbio_pybricks_event_status_report(buf, pbsys_status_get_flags());
+    return send_msg(PBIO_PYBRICKS_USB_MSG_EVENT, -1, buf, size);
+}
+
+static bool send_capabilities(void) {
+    uint8_t buf[PBIO_PYBRICKS_HUB_CAPABILITIES_VALUE_SIZE];
+    pbio_pybricks_hub_capabilities(buf, PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE,
+        PBSYS_APP_HUB_FEATURE_FLAGS, PBSYS_PROGRAM_LOAD_MAX_PROGRAM_SIZE);
+    return send_msg(PBIO_PYBRICKS_USB_MSG_HUB_CAPABILITIES, -1, buf, sizeof(buf));
+}
+
+static void send_pending(void) {
+    if (capabilities_pending && send_capabilities()) {
+        capabilities_pending = false;
+    }
+
+    uint8_t response;
+    while (lwrb_peek(&response_ring_buf, 0, &response, 1) &&
+        send_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE, response, NULL, 0)) {
+        lwrb_skip(&response_ring_buf, 1);
+    }
+
+    if (status_pending && send_status()) {
+        status_pending = false;
+    }
+}
+
+static pbio_pybricks_error_t handle_write_stdin(const uint8_t *data, uint32_t size) {
+    if (lwrb_get_free(&stdin_ring_buf) < size) {
+        return PBIO_PYBRICKS_ERROR_BUSY;
+    }
+
+    if (stdin_event_callback) {
+        // If there is a callback hook, we have to process things one byte at
+        // a time.
+        for (uint32_t i = 0; i < size; i++) {
+            if (!stdin_event_callback(data[i])) {
+                lwrb_write(&stdin_ring_buf, &data[i], 1);
+            }
+        }
+    } else {
+        lwrb_write(&stdin_ring_buf, data, size);
+    }
+
+    return PBIO_PYBRICKS_ERROR_OK;
+}
+
+static void handle_msg(pbio_pybricks_usb_msg_t type, const uint8_t *data, uint32_t size) {
+    if (type != PBIO_PYBRICKS_USB_MSG_COMMAND) {
+        // Other types only go from hub to host.
+        return;
+    }
+
+    // The host should wait for responses before sending more commands. If it
+    // doesn't, drop the command without running it since there would be no
+    // way to tell the host what happened.
+    if (lwrb_get_free(&response_ring_buf) == 0) {
+        return;
+    }
+
+    uint8_t response;
+
+    if (size == 0) {
+        response = PBIO_PYBRICKS_ERROR_INVALID_COMMAND;
+    } else if (data[0] == PBIO_PYBRICKS_COMMAND_WRITE_STDIN) {
+        // USB has its own stdin buffer, so this can't go to pbsys_command().
+        response = handle_write_stdin(&data[1], size - 1);
+    } else {
+        response = pbsys_command(data, size);
+    }
+
+    lwrb_write(&response_ring_buf, &response, 1);
+    send_pending();
+}
+
+static void handle_receive(const uint8_t *data, uint32_t size) {
+    while (size) {
+        // Collect the header first, then as much payload as the header says.
+        uint32_t msg_size = PBIO_PYBRICKS_USB_MSG_HEADER_SIZE;
+        if (rx_msg_size >= PBIO_PYBRICKS_USB_MSG_HEADER_SIZE) {
+            msg_size += pbio_get_uint16_le(&rx_msg[1]);
+        }
+
+        uint32_t copy_size = pbio_int_math_min(msg_size - rx_msg_size, size);
+        memcpy(&rx_msg[rx_msg_size], data, copy_size);
+        rx_msg_size += copy_size;
+        data += copy_size;
+        size -= copy_size;
+
+        if (rx_msg_size < PBIO_PYBRICKS_USB_MSG_HEADER_SIZE) {
+            continue;
+        }
+
+        uint32_t payload_size = pbio_get_uint16_le(&rx_msg[1]);
+
+        if (payload_size > PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE) {
+            // We lost track of the message boundaries. Drop what we have and
+            // hope that the next write from the host starts a new message.
+            rx_msg_size = 0;
+            return;
+        }
+
+        if (rx_msg_size == PBIO_PYBRICKS_USB_MSG_HEADER_SIZE + payload_size) {
+            handle_msg(rx_msg[0], &rx_msg[PBIO_PYBRICKS_USB_MSG_HEADER_SIZE], payload_size);
+            rx_msg_size = 0;
+        }
+    }
+}
+
+static void on_event(void) {
+    process_poll(&pbsys_usb_process);
+}
+
+// drain all buffers and queues and reset global state
+static void reset_all(void) {
+    rx_msg_size = 0;
+    lwrb_reset(&response_ring_buf);
+    capabilities_pending = false;
+    status_pending = false;
+    lwrb_reset(&stdin_ring_buf);
+}
+
+// Public API
+
+/**
+ * Sets the stdin callback function.
+ * @param callback  [in]    The callback or NULL.
+ */
+void pbsys_usb_rx_set_callback(pbsys_usb_stdin_event_callback_t callback) {
+    stdin_event_callback = callback;
+}
+
+/**
+ * Gets the number of bytes currently available to be read from stdin.
+ * @return              The number of bytes.
+ */
+uint32_t pbsys_usb_rx_get_available(void) {
+    return lwrb_get_full(&stdin_ring_buf);
+}
+
+/**
+ * Reads data from the stdin buffer.
+ * @param data  [in]        A buffer to receive a copy of the data.
+ * @param size  [in, out]   The number of bytes to read (@p data must be at least
+ *                          this big). After return @p size contains the number
+ *                          of bytes actually read.
+ * @return                  ::PBIO_SUCCESS if @p data was read, ::PBIO_ERROR_AGAIN
+ *                          if @p data could not be read at this time (i.e. buffer
+ *                          is empty) or ::PBIO_ERROR_INVALID_OP if no USB host
+ *                          has the port open.
+ */
+pbio_error_t pbsys_usb_rx(uint8_t *data, uint32_t *size) {
+    if (!pbdrv_usb_is_connected()) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    if ((*size = lwrb_read(&stdin_ring_buf, data, *size)) == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Flushes data from the stdin buffer.
+ */
+void pbsys_usb_rx_flush(void) {
+    lwrb_reset(&stdin_ring_buf);
+}
+
+/**
+ * Queues stdout data to be sent to the USB host.
+ * @param data  [in]        The data to be sent.
+ * @param size  [in, out]   The size of @p data in bytes. After return, @p size
+ *                          contains the number of bytes actually written.
+ * @return                  ::PBIO_SUCCESS if @p data was queued, ::PBIO_ERROR_AGAIN
+ *                          if @p data could not be queued at this time (e.g. buffer
+ *                          is full) or ::PBIO_ERROR_INVALID_OP if no USB host
+ *                          has the port open.
+ */
+pbio_error_t pbsys_usb_tx(const uint8_t *data, uint32_t *size) {
+    if (!pbdrv_usb_is_connected()) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    // Header + event type + at least one byte of data.
+    uint32_t free = pbdrv_usb_tx_get_free();
+    if (free < PBIO_PYBRICKS_USB_MSG_HEADER_SIZE + 2) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    uint32_t max_size = pbio_int_math_min(free - PBIO_PYBRICKS_USB_MSG_HEADER_SIZE - 1,
+        PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE - 1);
+    if (*size > max_size) {
+        *size = max_size;
+    }
+
+    send_msg(PBIO_PYBRICKS_USB_MSG_EVENT, PBIO_PYBRICKS_EVENT_WRITE_STDOUT, data, *size);
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Tests if all stdout data has been sent to the USB host.
+ *
+ * If no USB host has the port open, this will always return @c true.
+ *
+ * @returns @c true if the condition is met, otherwise @c false.
+ */
+bool pbsys_usb_tx_is_idle(void) {
+    return pbdrv_usb_tx_is_idle();
+}
+
+// Contiki process
+
+PROCESS_THREAD(pbsys_usb_process, ev, data) {
+    static struct etimer timer;
+    static uint32_t old_status_flags;
+
+    PROCESS_BEGIN();
+
+    pbdrv_usb_set_on_event(on_event);
+    pbdrv_usb_set_receive_handler(handle_receive);
+
+    for (;;) {
+        PROCESS_WAIT_UNTIL(pbdrv_usb_is_connected());
+
+        // Let the host know what it is talking to before anything else.
+        reset_all();
+        capabilities_pending = true;
+
+        // This ensures that we always send the current status right after
+        // the port is opened.
+        old_status_flags = ~0;
+        etimer_set(&timer, 500);
+
+        while (pbdrv_usb_is_connected()) {
+            uint32_t new_status_flags = pbsys_status_get_flags();
+
+            // Send status when it changes and periodically like Bluetooth.
+            if (new_status_flags != old_status_flags || etimer_expired(&timer)) {
+                etimer_restart(&timer);
+                old_status_flags = new_status_flags;
+                status_pending = true;
+            }
+
+            send_pending();
+
+            PROCESS_WAIT_EVENT();
+        }
+
+        reset_all();
+    }
+
+    PROCESS_END();
+}
+
+#endif // PBSYS_CONFIG_USB
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Microbenchmark of integer math functions compared to libm, run with
+// `make bench`. Absolute numbers depend on the host, but the ratios give an
+// idea of what to expect on hubs without an FPU or hardware divider.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <pbio/int_math.h>
+
+#define ITERATIONS (10000000)
+
+// Prevents the compiler from optimizing away the benchmarked calls.
+static volatile int32_t sink_int;
+static volatile double sink_double;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(name, expr) do { \
+        double start = now_ns(); \
+        for (int32_t i = 0; i < ITERATIONS; i++) { \
+            expr; \
+        } \
+        printf("%-24s %6.2f ns\n", name, (now_ns() - start) / ITERATIONS); \
+} while (0)
+
+int main(void) {
+    BENCH("pbio_int_math_sin_deg", sink_int = pbio_int_math_sin_deg(i));
+    BENCH("pbio_int_math_sin_mdeg", sink_int = pbio_int_math_sin_mdeg(i));
+    BENCH("sin", sink_double = sin(i * M_PI / 180000));
+
+    BENCH("pbio_int_math_atan2", sink_int = pbio_int_math_atan2(i & 0xfff, 2048 - (i >> 12 & 0xfff)));
+    BENCH("atan2", sink_double = atan2(i & 0xfff, 2048 - (i >> 12 & 0xfff)));
+
+    BENCH("pbio_int_math_sqrt", sink_int = pbio_int_math_sqrt(i * 211));
+    BENCH("sqrt", sink_double = sqrt(i * 211));
+
+    return 0;
+}
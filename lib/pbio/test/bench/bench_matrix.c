@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Accuracy check and microbenchmark of the Q16.16 matrix products used by
+// pybricks.tools.Matrix when built with PYBRICKS_OPT_MATRIX_FIXED_POINT, run
+// with `make bench`. Entries are converted and accumulated the same way as in
+// pb_type_matrix.c and compared against a double precision reference.
+//
+// Timings are for the host, where floats are done in hardware and are faster.
+// They are only useful to compare changes to the fixed point version. On hubs
+// without an FPU, each float operation is a library call instead.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pbio/int_math.h>
+
+#define TRIALS (100000)
+#define ITERATIONS (1000000)
+#define MAX_N (6)
+
+// Prevents the compiler from optimizing away the benchmarked calls.
+static volatile int32_t sink_int;
+static volatile float sink_float;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Product of two n x n matrices, accumulated in Q32.32 and rounded to Q16.16
+// once per entry. Returns false if any entry does not fit.
+static bool mul_q16(int32_t *out, const int32_t *a, const int32_t *b, size_t n) {
+    bool ok = true;
+    for (size_t r = 0; r < n; r++) {
+        for (size_t c = 0; c < n; c++) {
+            int64_t sum = 0;
+            for (size_t k = 0; k < n; k++) {
+                if (__builtin_add_overflow(sum, (int64_t)a[r * n + k] * b[k * n + c], &sum)) {
+                    ok = false;
+                }
+            }
+            if (pbio_int_math_q16_from_q32(sum, &out[r * n + c]) != PBIO_SUCCESS) {
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static void mul_float(float *out, const float *a, const float *b, size_t n) {
+    for (size_t r = 0; r < n; r++) {
+        for (size_t c = 0; c < n; c++) {
+            float sum = 0;
+            for (size_t k = 0; k < n; k++) {
+                sum += a[r * n + k] * b[k * n + c];
+            }
+            out[r * n + c] = sum;
+        }
+    }
+}
+
+static void mul_double(double *out, const double *a, const double *b, size_t n) {
+    for (size_t r = 0; r < n; r++) {
+        for (size_t c = 0; c < n; c++) {
+            double sum = 0;
+            for (size_t k = 0; k < n; k++) {
+                sum += a[r * n + k] * b[k * n + c];
+            }
+            out[r * n + c] = sum;
+        }
+    }
+}
+
+// Uniformly distributed in -range to range.
+static float random_entry(float range) {
+    return range * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+// Compares products of random n x n matrices with entries up to range against
+// a double reference. Returns false if the error exceeds the expected bound.
+static bool check_accuracy(size_t n, float range) {
+    float af[MAX_N * MAX_N], bf[MAX_N * MAX_N];
+    int32_t aq[MAX_N * MAX_N], bq[MAX_N * MAX_N], outq[MAX_N * MAX_N];
+    double ad[MAX_N * MAX_N], bd[MAX_N * MAX_N], outd[MAX_N * MAX_N];
+    double aqd[MAX_N * MAX_N], bqd[MAX_N * MAX_N], outqd[MAX_N * MAX_N];
+
+    // Rounding the result is the only error on top of that of the inputs.
+    const double lsb = 1.0 / PBIO_INT_MATH_Q16_ONE;
+    const double rounding_bound = lsb / 2;
+
+    // Each input is off by up to half an lsb, which is multiplied by the
+    // other factor of each of the n products.
+    const double total_bound = rounding_bound + n * 2 * range * (lsb / 2) + n * (lsb / 2) * (lsb / 2);
+
+    double max_rounding_error = 0;
+    double max_total_error = 0;
+
+    for (int32_t trial = 0; trial < TRIALS; trial++) {
+        for (size_t i = 0; i < n * n; i++) {
+            af[i] = random_entry(range);
+            bf[i] = random_entry(range);
+            if (pbio_int_math_q16_from_float(af[i], &aq[i]) != PBIO_SUCCESS ||
+                pbio_int_math_q16_from_float(bf[i], &bq[i]) != PBIO_SUCCESS) {
+                printf("conversion of %f or %f failed\n", af[i], bf[i]);
+                return false;
+            }
+            ad[i] = af[i];
+            bd[i] = bf[i];
+            aqd[i] = aq[i] * lsb;
+            bqd[i] = bq[i] * lsb;
+        }
+
+        if (!mul_q16(outq, aq, bq, n)) {
+            printf("%zux%zu product out of range\n", n, n);
+            return false;
+        }
+        mul_double(outd, ad, bd, n);
+        mul_double(outqd, aqd, bqd, n);
+
+        for (size_t i = 0; i < n * n; i++) {
+            max_rounding_error = fmax(max_rounding_error, fabs(outq[i] * lsb - outqd[i]));
+            max_total_error = fmax(max_total_error, fabs(outq[i] * lsb - outd[i]));
+        }
+    }
+
+    bool ok = max_rounding_error <= rounding_bound && max_total_error <= total_bound;
+    printf("%zux%zu range %-6g max error %.3g (bound %.3g), rounding %.3g (bound %.3g) %s\n",
+        n, n, range, max_total_error, total_bound, max_rounding_error, rounding_bound, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Products that do not fit must be reported, not wrapped around.
+static bool check_overflow(void) {
+    int32_t a[4], b[4], out[4];
+    pbio_int_math_q16_from_float(200.0f, &a[0]);
+    pbio_int_math_q16_from_float(200.0f, &a[1]);
+    a[2] = a[3] = 0;
+    pbio_int_math_q16_from_float(100.0f, &b[0]);
+    pbio_int_math_q16_from_float(100.0f, &b[2]);
+    b[1] = b[3] = 0;
+
+    // 200 * 100 + 200 * 100 = 40000, which is above 32768.
+    bool ok = !mul_q16(out, a, b, 2);
+
+    // But 200 * 100 - 200 * 100 = 0 fits, even though each product does not.
+    pbio_int_math_q16_from_float(-100.0f, &b[2]);
+    ok = ok && mul_q16(out, a, b, 2) && out[0] == 0;
+
+    printf("overflow %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+#define BENCH(name, n, expr) do { \
+        double start = now_ns(); \
+        for (int32_t i = 0; i < ITERATIONS; i++) { \
+            expr; \
+        } \
+        printf("%-16s %zux%zu %8.2f ns\n", name, (size_t)n, (size_t)n, (now_ns() - start) / ITERATIONS); \
+} while (0)
+
+static void bench(size_t n) {
+    float af[MAX_N * MAX_N], bf[MAX_N * MAX_N], outf[MAX_N * MAX_N];
+    int32_t aq[MAX_N * MAX_N], bq[MAX_N * MAX_N], outq[MAX_N * MAX_N];
+
+    for (size_t i = 0; i < n * n; i++) {
+        af[i] = random_entry(1.0f);
+        bf[i] = random_entry(1.0f);
+        pbio_int_math_q16_from_float(af[i], &aq[i]);
+        pbio_int_math_q16_from_float(bf[i], &bq[i]);
+    }
+
+    BENCH("Q16.16 product", n, { mul_q16(outq, aq, bq, n); sink_int = outq[i % (n * n)]; });
+    BENCH("float product", n, { mul_float(outf, af, bf, n); sink_float = outf[i % (n * n)]; });
+}
+
+int main(void) {
+    bool ok = true;
+
+    srand(1);
+
+    for (size_t n = 2; n <= MAX_N; n++) {
+        ok = check_accuracy(n, 1.0f) && ok;
+        ok = check_accuracy(n, 50.0f) && ok;
+    }
+    ok = check_overflow() && ok;
+
+    for (size_t n = 2; n <= 4; n++) {
+        bench(n);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <stdint.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/util.h>
+#include <test-pbio.h>
+
+#include "../drv/adc/adc_filter.h"
+
+static void test_adc_filter_median(void *env) {
+    static const uint16_t odd[] = { 5, 1, 4, 2, 3 };
+    tt_want_uint_op(pbdrv_adc_filter_median(odd, PBIO_ARRAY_SIZE(odd), 1), ==, 3);
+
+    static const uint16_t even[] = { 10, 40, 20, 30 };
+    tt_want_uint_op(pbdrv_adc_filter_median(even, PBIO_ARRAY_SIZE(even), 1), ==, 25);
+
+    static const uint16_t single[] = { 4095 };
+    tt_want_uint_op(pbdrv_adc_filter_median(single, 1, 1), ==, 4095);
+
+    // every other sample belongs to the channel we want
+    static const uint16_t interleaved[] = { 100, 0, 300, 0, 200, 0 };
+    tt_want_uint_op(pbdrv_adc_filter_median(interleaved, 3, 2), ==, 200);
+    tt_want_uint_op(pbdrv_adc_filter_median(&interleaved[1], 3, 2), ==, 0);
+}
+
+static void test_adc_filter_step(void *env) {
+    pbdrv_adc_filter_t filter;
+    uint16_t block[8];
+
+    pbdrv_adc_filter_init(&filter, 2);
+    tt_want(!filter.ready);
+
+    // first update gives the input right away
+    for (uint32_t i = 0; i < PBIO_ARRAY_SIZE(block); i++) {
+        block[i] = 1000;
+    }
+    pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    tt_want(filter.ready);
+    tt_want_uint_op(pbdrv_adc_filter_get(&filter), ==, 1000);
+
+    // step up, output should rise without overshoot and settle on the input
+    for (uint32_t i = 0; i < PBIO_ARRAY_SIZE(block); i++) {
+        block[i] = 2000;
+    }
+    uint16_t last = 1000;
+    for (uint32_t n = 0; n < 40; n++) {
+        pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+        uint16_t value = pbdrv_adc_filter_get(&filter);
+        tt_want_uint_op(value, >=, last);
+        tt_want_uint_op(value, <=, 2000);
+        last = value;
+    }
+    tt_want_uint_op(last, ==, 2000);
+
+    // about 1 - 1/e of the way after the time constant
+    pbdrv_adc_filter_init(&filter, 2);
+    pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    for (uint32_t i = 0; i < PBIO_ARRAY_SIZE(block); i++) {
+        block[i] = 0;
+    }
+    for (uint32_t n = 0; n < 4; n++) {
+        pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    }
+    tt_want_int_op(pbdrv_adc_filter_get(&filter), >, 500);
+    tt_want_int_op(pbdrv_adc_filter_get(&filter), <, 800);
+
+    // settles all the way down too
+    for (uint32_t n = 0; n < 40; n++) {
+        pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    }
+    tt_want_uint_op(pbdrv_adc_filter_get(&filter), ==, 0);
+
+    // no IIR filter
+    pbdrv_adc_filter_init(&filter, 0);
+    pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    block[0] = block[1] = block[2] = block[3] = block[4] = 123;
+    pbdrv_adc_filter_update(&filter, block, PBIO_ARRAY_SIZE(block), 1);
+    tt_want_uint_op(pbdrv_adc_filter_get(&filter), ==, 123);
+}
+
+// Synthetic trace of interleaved battery voltage (even) and current (odd)
+// samples laid out like the DMA buffer: 8 samples per channel per update. This
+// was not recorded from a hub. The values were made up to resemble a hub under
+// motor load: the voltage is about 2950 with a few samples hit by motor PWM
+// switching spikes, and the current is about 600 with more noise. Traces
+// recorded from hubs should be added next to this one.
+static const uint16_t test_trace[][16] = {
+    { 2951, 602, 2949, 597, 2950, 611, 3391, 588, 2952, 604, 2948, 593, 2950, 615, 2951, 599 },
+    { 2949, 606, 2950, 590, 2512, 607, 2951, 598, 2950, 612, 2949, 587, 2952, 603, 2950, 596 },
+    { 2950, 595, 2951, 609, 2949, 601, 2950, 594, 3402, 606, 2951, 592, 2950, 610, 2948, 600 },
+    { 2952, 591, 2950, 604, 2951, 613, 2949, 598, 2950, 589, 2950, 605, 2487, 597, 2951, 608 },
+    { 2948, 603, 2951, 596, 2950, 607, 2952, 591, 2949, 602, 3380, 598, 2950, 611, 2950, 594 },
+    { 2950, 599, 2949, 612, 2951, 588, 2950, 605, 2950, 597, 2952, 603, 2949, 590, 2951, 609 },
+    { 3395, 607, 2950, 593, 2951, 601, 2948, 610, 2950, 596, 2951, 604, 2950, 599, 2505, 591 },
+    { 2951, 594, 2950, 606, 2949, 600, 2950, 592, 2952, 611, 2950, 597, 2951, 603, 2949, 608 },
+};
+
+static void test_adc_filter_trace(void *env) {
+    pbdrv_adc_filter_t voltage;
+    pbdrv_adc_filter_t current;
+
+    pbdrv_adc_filter_init(&voltage, 2);
+    pbdrv_adc_filter_init(&current, 2);
+
+    for (uint32_t n = 0; n < PBIO_ARRAY_SIZE(test_trace); n++) {
+        pbdrv_adc_filter_update(&voltage, &test_trace[n][0], 8, 2);
+        pbdrv_adc_filter_update(&current, &test_trace[n][1], 8, 2);
+
+        // spikes are rejected completely
+        tt_want_int_op(pbdrv_adc_filter_get(&voltage), >=, 2949);
+        tt_want_int_op(pbdrv_adc_filter_get(&voltage), <=, 2951);
+
+        // noise is reduced to a few counts
+        tt_want_int_op(pbdrv_adc_filter_get(&current), >=, 597);
+        tt_want_int_op(pbdrv_adc_filter_get(&current), <=, 603);
+    }
+}
+
+struct testcase_t pbdrv_adc_tests[] = {
+    PBIO_TEST(test_adc_filter_median),
+    PBIO_TEST(test_adc_filter_step),
+    PBIO_TEST(test_adc_filter_trace),
+    END_OF_TESTCASES
+};
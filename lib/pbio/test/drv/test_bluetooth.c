@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <btstack.h>
 #include <btstack_chipset_cc256x.h>
@@ -13,6 +14,8 @@
 #include <tinytest_macros.h>
 #include <tinytest.h>
 
+#include <pbdrv/bluetooth.h>
+#include <pbio/task.h>
 #include <test-pbio.h>
 
 #include "../../drv/bluetooth/bluetooth_btstack_run_loop_contiki.h"
@@ -333,6 +336,9 @@ static void handle_send(const uint8_t *buffer, uint16_t length) {
                 case 0x200b: // LE Set Scan Parameters
                     queue_command_complete(opcode, 0x00);
                     break;
+                case 0x200c: // LE Set Scan Enable
+                    queue_command_complete(opcode, 0x00);
+                    break;
                 case 0x200f: // LE Read White List Size
                     queue_command_complete(opcode, 0x00, 0x01);
                     break;
@@ -791,8 +797,71 @@ static PT_THREAD(test_btstack_run_loop_contiki_poll(struct pt *pt)) {
     PT_END(pt);
 }
 
+static PT_THREAD(test_btstack_cancel(struct pt *pt)) {
+    static pbio_task_t task, task_2;
+    static pbdrv_bluetooth_scan_and_connect_context_t context;
+    static struct {
+        pbdrv_bluetooth_value_t value;
+        uint8_t data[3];
+    } __attribute__((packed)) msg = {
+        .value.size = 3,
+        .data = { 0x03, 0x00, 0x01 },
+    };
+
+    PT_BEGIN(pt);
+
+    pbdrv_bluetooth_power_on(true);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        hci_get_state() == HCI_STATE_WORKING;
+    }));
+
+    // -- broadcasting can be canceled while waiting for the controller --
+
+    pbdrv_bluetooth_start_broadcasting(&task, &msg.value);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_AGAIN);
+    pbio_task_cancel(&task);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+    pbdrv_bluetooth_stop_broadcasting();
+
+    // -- scanning stops when canceled and tasks queued behind it still run --
+
+    memset(&context, 0, sizeof(context));
+    pbdrv_bluetooth_scan_and_connect(&task, &context);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_AGAIN);
+
+    // the write is queued behind the scan, so it has not sent anything yet
+    pbdrv_bluetooth_write_remote(&task_2, context.peripheral, &msg.value);
+    pbio_task_cancel(&task_2);
+    tt_want_uint_op(task_2.status, ==, PBIO_ERROR_AGAIN);
+
+    pbio_task_cancel(&task);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+    tt_want_uint_op(task_2.status, ==, PBIO_ERROR_CANCELED);
+
+    // canceling freed the peripheral slot
+    pbdrv_bluetooth_scan_and_connect(&task, &context);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_AGAIN);
+    tt_want_uint_op(context.peripheral, ==, 0);
+    pbio_task_cancel(&task);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+
+    // -- writing to a peripheral that is not connected fails right away --
+
+    pbdrv_bluetooth_write_remote(&task_2, 0, &msg.value);
+    tt_want_uint_op(task_2.status, ==, PBIO_ERROR_NO_DEV);
+
+    // let the controller catch up with the commands from above
+    pbio_test_clock_tick(10);
+    PT_YIELD(pt);
+
+    PT_END(pt);
+}
+
 struct testcase_t pbdrv_bluetooth_tests[] = {
     PBIO_PT_THREAD_TEST(test_btstack_run_loop_contiki_timer),
     PBIO_PT_THREAD_TEST(test_btstack_run_loop_contiki_poll),
+    PBIO_PT_THREAD_TEST(test_btstack_cancel),
     END_OF_TESTCASES
 };
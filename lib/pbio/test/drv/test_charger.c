@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbdrv/charger.h>
+#include <test-pbio.h>
+
+#include "../drv/charger/charger_session.h"
+
+// Simulated 2-cell Li-ion battery on a charger with a 1 A constant current
+// phase followed by a constant voltage phase where the current decays.
+typedef struct {
+    pbdrv_charger_session_input_t input;
+    bool enabled;
+} sim_charger_t;
+
+static void sim_init(sim_charger_t *sim, uint16_t voltage) {
+    sim->input = (pbdrv_charger_session_input_t) {
+        .time = 1000,
+        .enable = true,
+        .status = PBDRV_CHARGER_STATUS_CHARGE,
+        .limit = PBDRV_CHARGER_LIMIT_CHARGING,
+        .voltage = voltage,
+        .temperature = 25000,
+    };
+    sim->enabled = false;
+}
+
+// Advances the simulation by one second and feeds the session.
+static bool sim_step(sim_charger_t *sim, pbdrv_charger_session_t *session) {
+    pbdrv_charger_session_input_t *in = &sim->input;
+
+    in->time += 1000;
+
+    if (!in->enable || !sim->enabled) {
+        // MODE is high, so the battery is slowly discharged by the hub.
+        in->status = PBDRV_CHARGER_STATUS_DISCHARGE;
+        in->current = 0;
+        if (in->voltage > 6000) {
+            in->voltage--;
+        }
+    } else if (in->status == PBDRV_CHARGER_STATUS_CHARGE || in->status == PBDRV_CHARGER_STATUS_DISCHARGE) {
+        in->status = PBDRV_CHARGER_STATUS_CHARGE;
+        if (in->voltage < 8300) {
+            in->current = 1000;
+            in->voltage++;
+        } else {
+            // Constant voltage: current decays by 1% per second.
+            in->current = in->current * 99 / 100;
+        }
+    }
+
+    sim->enabled = pbdrv_charger_session_update(session, in);
+    return sim->enabled;
+}
+
+static void test_charger_session_taper(void *env) {
+    static pbdrv_charger_session_t session;
+    sim_charger_t sim;
+
+    pbdrv_charger_session_reset(&session);
+    sim_init(&sim, 7300);
+
+    // first update enables charging, second one starts the session
+    tt_want(sim_step(&sim, &session));
+    tt_want(!session.active);
+    tt_want(sim_step(&sim, &session));
+    tt_want(session.active);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_NONE);
+
+    uint32_t seconds = 0;
+    while (session.active && seconds < 4 * 60 * 60) {
+        sim_step(&sim, &session);
+        seconds++;
+    }
+
+    // The chip never reported complete, so the session ended on the taper.
+    tt_want(!session.active);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_TAPER);
+    tt_want(session.hold_off);
+    tt_want(!sim.enabled);
+    tt_want_uint_op(sim.input.current, <, PBDRV_CHARGER_SESSION_TAPER_MA);
+
+    // 1000 s of constant current at 1 A plus the tail of the decay.
+    tt_want_uint_op(session.charge, >=, 1000 * 1000);
+    tt_want_uint_op(session.charge, <=, 1000 * 1000 + 100 * 1000);
+
+    // The history covers the whole session in fixed memory.
+    tt_want_uint_op(session.num_samples, >, PBDRV_CHARGER_SESSION_HISTORY_SIZE / 2);
+    tt_want_uint_op(session.num_samples, <=, PBDRV_CHARGER_SESSION_HISTORY_SIZE);
+    tt_want_uint_op(session.samples[0].time, ==, 0);
+    tt_want_uint_op(session.samples[0].voltage, ==, 7300);
+    tt_want_int_op(session.samples[0].temperature, ==, 250);
+    tt_want_uint_op(session.samples[1].time, ==, session.interval);
+    tt_want_uint_op(session.samples[session.num_samples - 1].time, <=, session.duration / 1000);
+    tt_want_uint_op(session.samples[session.num_samples - 1].time + session.interval, >, session.duration / 1000);
+    for (uint16_t i = 1; i < session.num_samples; i++) {
+        tt_want_uint_op(session.samples[i].time, >, session.samples[i - 1].time);
+    }
+
+    // Charging stays off until the battery drops below the recharge voltage.
+    uint16_t samples = session.num_samples;
+    while (!sim_step(&sim, &session)) {
+        tt_want_uint_op(sim.input.voltage, >=, PBDRV_CHARGER_SESSION_RECHARGE_MV - 1);
+        if (sim.input.voltage < PBDRV_CHARGER_SESSION_RECHARGE_MV - 1) {
+            break;
+        }
+    }
+    tt_want(!session.hold_off);
+    tt_want_uint_op(session.num_samples, ==, samples);
+
+    // The history of the old session is kept until the new one starts.
+    tt_want(sim_step(&sim, &session));
+    tt_want(session.active);
+    tt_want_uint_op(session.num_samples, ==, 1);
+}
+
+static void test_charger_session_chip_status(void *env) {
+    static pbdrv_charger_session_t session;
+    sim_charger_t sim;
+
+    pbdrv_charger_session_reset(&session);
+    sim_init(&sim, 7300);
+
+    // nothing happens until the chip starts charging
+    sim.input.status = PBDRV_CHARGER_STATUS_COMPLETE;
+    tt_want(sim_step(&sim, &session));
+    tt_want(!session.active);
+
+    // chip reports complete
+    sim.input.status = PBDRV_CHARGER_STATUS_CHARGE;
+    tt_want(sim_step(&sim, &session));
+    tt_want(session.active);
+    sim.input.status = PBDRV_CHARGER_STATUS_COMPLETE;
+    tt_want(sim_step(&sim, &session));
+    tt_want(!session.active);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_COMPLETE);
+    tt_want(!session.hold_off);
+
+    // chip reports a fault
+    sim.input.status = PBDRV_CHARGER_STATUS_CHARGE;
+    tt_want(sim_step(&sim, &session));
+    tt_want(session.active);
+    sim.input.status = PBDRV_CHARGER_STATUS_FAULT;
+    tt_want(sim_step(&sim, &session));
+    tt_want(!session.active);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_FAULT);
+
+    // charger is unplugged
+    sim.input.status = PBDRV_CHARGER_STATUS_CHARGE;
+    tt_want(sim_step(&sim, &session));
+    tt_want(sim_step(&sim, &session));
+    tt_want_uint_op(session.duration, ==, 1000);
+    tt_want_uint_op(session.charge, ==, 1000);
+    sim.input.enable = false;
+    tt_want(!sim_step(&sim, &session));
+    tt_want(!session.active);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_DISCONNECTED);
+}
+
+static void test_charger_session_timeout(void *env) {
+    static pbdrv_charger_session_t session;
+    sim_charger_t sim;
+
+    pbdrv_charger_session_reset(&session);
+    sim_init(&sim, 6000);
+
+    // A battery that never reaches the full voltage times out.
+    uint32_t seconds = 0;
+    while (sim_step(&sim, &session)) {
+        sim.input.voltage = 7000;
+        seconds++;
+    }
+    tt_want_uint_op(seconds, ==, PBDRV_CHARGER_SESSION_MAX_TIME_MS / 1000 + 1);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_TIMEOUT);
+
+    // It is not charged again even if the voltage is low...
+    for (int i = 0; i < 10; i++) {
+        tt_want(!sim_step(&sim, &session));
+    }
+
+    // ...until the charger is reconnected.
+    sim.input.enable = false;
+    tt_want(!sim_step(&sim, &session));
+    tt_want(!session.hold_off);
+    sim.input.enable = true;
+    tt_want(sim_step(&sim, &session));
+}
+
+static void test_charger_session_timeout_limit(void *env) {
+    static pbdrv_charger_session_t session;
+    sim_charger_t sim;
+
+    // The safety limit is only extended for lower currents.
+    tt_want_uint_op(pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_NONE), ==, PBDRV_CHARGER_SESSION_MAX_TIME_MS);
+    tt_want_uint_op(pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_CHARGING), ==, PBDRV_CHARGER_SESSION_MAX_TIME_MS);
+    tt_want_uint_op(pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_CHARGING + 1), ==, PBDRV_CHARGER_SESSION_MAX_TIME_MS);
+
+    // A full charge at 500 mA (4.2 h) plus the constant voltage phase fits.
+    tt_want_uint_op(pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_STD_MAX), ==, 2 * 4200 * 3600);
+    tt_want_uint_op(pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_STD_MIN), ==, 2 * 21000 * 3600);
+
+    pbdrv_charger_session_reset(&session);
+    sim_init(&sim, 6000);
+    sim.input.limit = PBDRV_CHARGER_LIMIT_STD_MIN;
+
+    uint32_t seconds = 0;
+    while (sim_step(&sim, &session)) {
+        sim.input.voltage = 7000;
+        seconds++;
+    }
+    tt_want_uint_op(seconds, ==, pbdrv_charger_session_get_max_time(PBDRV_CHARGER_LIMIT_STD_MIN) / 1000 + 1);
+    tt_want_uint_op(session.end, ==, PBDRV_CHARGER_SESSION_END_TIMEOUT);
+}
+
+struct testcase_t pbdrv_charger_tests[] = {
+    PBIO_TEST(test_charger_session_taper),
+    PBIO_TEST(test_charger_session_chip_status),
+    PBIO_TEST(test_charger_session_timeout),
+    PBIO_TEST(test_charger_session_timeout_limit),
+    END_OF_TESTCASES
+};
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/error.h>
+#include <test-pbio.h>
+
+#include "../drv/uart/uart_ring.h"
+
+static void test_uart_ring_read(void *env) {
+    static pbdrv_uart_ring_t ring;
+    uint8_t buf[PBDRV_UART_RING_SIZE];
+    uint32_t count;
+
+    pbdrv_uart_ring_init(&ring);
+    tt_want_uint_op(pbdrv_uart_ring_in_waiting(&ring), ==, 0);
+    tt_want_int_op(pbdrv_uart_ring_read(&ring, buf, sizeof(buf), &count), ==, PBIO_SUCCESS);
+    tt_want_uint_op(count, ==, 0);
+
+    // bytes come out in order, across the end of the buffer
+    for (int i = 0; i < 3; i++) {
+        for (uint32_t j = 0; j < PBDRV_UART_RING_SIZE / 2; j++) {
+            pbdrv_uart_ring_put(&ring, j);
+        }
+        tt_want_uint_op(pbdrv_uart_ring_in_waiting(&ring), ==, PBDRV_UART_RING_SIZE / 2);
+        tt_want_int_op(pbdrv_uart_ring_read(&ring, buf, 10, &count), ==, PBIO_SUCCESS);
+        tt_want_uint_op(count, ==, 10);
+        tt_want_int_op(pbdrv_uart_ring_read(&ring, &buf[10], sizeof(buf), &count), ==, PBIO_SUCCESS);
+        tt_want_uint_op(count, ==, PBDRV_UART_RING_SIZE / 2 - 10);
+        for (uint32_t j = 0; j < PBDRV_UART_RING_SIZE / 2; j++) {
+            tt_want_uint_op(buf[j], ==, j);
+        }
+    }
+
+    // flush discards everything
+    pbdrv_uart_ring_put(&ring, 1);
+    pbdrv_uart_ring_flush(&ring);
+    tt_want_uint_op(pbdrv_uart_ring_in_waiting(&ring), ==, 0);
+}
+
+static void test_uart_ring_overrun(void *env) {
+    static pbdrv_uart_ring_t ring;
+    uint8_t buf[PBDRV_UART_RING_SIZE];
+    uint32_t count;
+
+    pbdrv_uart_ring_init(&ring);
+
+    // One slot is kept free to tell a full buffer from an empty one.
+    for (uint32_t i = 0; i < PBDRV_UART_RING_SIZE - 1; i++) {
+        pbdrv_uart_ring_put(&ring, i);
+    }
+    tt_want_uint_op(pbdrv_uart_ring_in_waiting(&ring), ==, PBDRV_UART_RING_SIZE - 1);
+    tt_want(!ring.overrun);
+
+    // New bytes are dropped instead of making the buffer look empty.
+    pbdrv_uart_ring_put(&ring, 0xAA);
+    pbdrv_uart_ring_put(&ring, 0xBB);
+    tt_want_uint_op(pbdrv_uart_ring_in_waiting(&ring), ==, PBDRV_UART_RING_SIZE - 1);
+
+    // The loss is reported once and the kept bytes can still be read.
+    tt_want_int_op(pbdrv_uart_ring_read(&ring, buf, sizeof(buf), &count), ==, PBIO_ERROR_IO);
+    tt_want_uint_op(count, ==, 0);
+    tt_want_int_op(pbdrv_uart_ring_read(&ring, buf, sizeof(buf), &count), ==, PBIO_SUCCESS);
+    tt_want_uint_op(count, ==, PBDRV_UART_RING_SIZE - 1);
+    for (uint32_t i = 0; i < PBDRV_UART_RING_SIZE - 1; i++) {
+        tt_want_uint_op(buf[i], ==, i);
+    }
+
+    // flush also clears the overrun
+    for (uint32_t i = 0; i < PBDRV_UART_RING_SIZE; i++) {
+        pbdrv_uart_ring_put(&ring, i);
+    }
+    pbdrv_uart_ring_flush(&ring);
+    tt_want_int_op(pbdrv_uart_ring_read(&ring, buf, sizeof(buf), &count), ==, PBIO_SUCCESS);
+    tt_want_uint_op(count, ==, 0);
+}
+
+struct testcase_t pbdrv_uart_tests[] = {
+    PBIO_TEST(test_uart_ring_read),
+    PBIO_TEST(test_uart_ring_overrun),
+    END_OF_TESTCASES
+};
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Fuzz target for the LEGO UART Message Protocol (LUMP) message parser.
+//
+// Run with libFuzzer using `make fuzz`. The inputs in corpus/lump/ are sync
+// sequences of real sensors and motors, so the fuzzer starts from valid
+// messages instead of random noise.
+//
+// `make fuzz-replay` builds the same target with a plain main() that runs each
+// file given on the command line once. This can be used with AFL or to check
+// the corpus without clang.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <lego_uart.h>
+
+#include <pbio/error.h>
+
+#include "../../drv/legodev/legodev_pup_uart_msg.h"
+
+static uint32_t num_ok;
+static uint32_t num_bad_checksum;
+static uint32_t num_out_of_sync;
+
+// Copies the payload to a buffer the size of the largest one the driver will
+// accept, like the driver does, so that the sanitizers catch any overrun.
+static void consume(const pbdrv_legodev_pup_uart_msg_t *msg) {
+    uint8_t payload[LUMP_MAX_MSG_SIZE];
+
+    if (msg->payload_size > sizeof(payload)) {
+        __builtin_trap();
+    }
+
+    memcpy(payload, msg->payload, msg->payload_size);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    pbdrv_legodev_pup_uart_msg_t msg;
+
+    // Walk the stream the same way the driver does: skip one byte at a time
+    // until a header with a valid size is found, then consume whole messages.
+    while (size) {
+        pbio_error_t err = pbdrv_legodev_pup_uart_msg_parse(data, size, &msg);
+
+        if (err == PBIO_ERROR_AGAIN) {
+            break;
+        }
+
+        if (err == PBIO_ERROR_INVALID_ARG) {
+            num_out_of_sync++;
+            data++;
+            size--;
+            continue;
+        }
+
+        if (msg.size == 0 || msg.size > size) {
+            __builtin_trap();
+        }
+
+        if (err == PBIO_SUCCESS) {
+            num_ok++;
+        } else {
+            num_bad_checksum++;
+        }
+
+        consume(&msg);
+        data += msg.size;
+        size -= msg.size;
+    }
+
+    return 0;
+}
+
+#ifdef PBIO_FUZZ_REPLAY
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    static uint8_t buf[64 * 1024];
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        size_t size = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+
+    printf("%d files: %u messages, %u bad checksums, %u bytes out of sync\n",
+        argc - 1, num_ok, num_bad_checksum, num_out_of_sync);
+
+    return EXIT_SUCCESS;
+}
+
+#endif // PBIO_FUZZ_REPLAY
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+# Copyright (c) 2023 The Pybricks Authors
+
+"""
+Generates the LUMP fuzzing corpus from the logic analyzer captures in
+src/test_uartdev.c.
+
+Each test in that file becomes one corpus file containing the messages the
+device sends to the hub (SIMULATE_RX_MSG), in the order they are sent.
+
+Usage: python3 fuzz/make_lump_corpus.py (from lib/pbio/test)
+"""
+
+import pathlib
+import re
+
+HERE = pathlib.Path(__file__).parent
+SOURCE = HERE / ".." / "src" / "test_uartdev.c"
+CORPUS = HERE / "corpus" / "lump"
+
+ARRAY = re.compile(r"static const uint8_t (\w+)\[\] = \{([^}]*)\};")
+RX = re.compile(r"SIMULATE_RX_MSG\((\w+)\);")
+TEST = re.compile(r"^static PT_THREAD\((test_\w+)\(", re.MULTILINE)
+
+
+def parse_array(body):
+    # Entries are hex literals, optionally or'ed together, e.g. 0xC0 | 0x18.
+    return bytes(
+        eval(value, {"__builtins__": {}}) for value in body.split(",") if value.strip()
+    )
+
+
+def main():
+    source = SOURCE.read_text()
+
+    # Arrays declared outside of a test function are shared by all tests.
+    tests = list(TEST.finditer(source))
+    shared = dict(
+        (m.group(1), parse_array(m.group(2)))
+        for m in ARRAY.finditer(source[: tests[0].start()])
+    )
+
+    CORPUS.mkdir(parents=True, exist_ok=True)
+
+    for test in tests:
+        body = source[test.start() : source.index("PT_END(pt);", test.start())]
+
+        arrays = dict(shared)
+        arrays.update(
+            (m.group(1), parse_array(m.group(2))) for m in ARRAY.finditer(body)
+        )
+
+        data = b"".join(arrays[name] for name in RX.findall(body))
+
+        name = test.group(1).removeprefix("test_")
+        (CORPUS / f"{name}.bin").write_bytes(data)
+        print(f"{name}.bin: {len(data)} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2022 The Pybricks Authors
+// Copyright (c) 2022-2023 The Pybricks Authors
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include <tinytest.h>
@@ -9,8 +10,11 @@
 #include <pbio/battery.h>
 #include <test-pbio.h>
 
-// pbdrv_battery_get_voltage_now() always returns this value
-#define TEST_BATTERY_VOLTAGE 7200
+#include "../drv/battery/battery_test.h"
+#include "../drv/clock/clock_test.h"
+
+// pbdrv_battery_get_voltage_now() returns this value by default
+#define TEST_BATTERY_VOLTAGE PBDRV_BATTERY_TEST_DEFAULT_VOLTAGE
 
 static void test_battery_voltage_to_duty(void *env) {
     pbio_battery_init();
@@ -36,9 +40,150 @@ static void test_battery_voltage_from_duty_pct(void *env) {
     tt_want_int_op(pbio_battery_get_voltage_from_duty_pct(-100), ==, -TEST_BATTERY_VOLTAGE);
 }
 
+// Synthetic Li-ion battery pack for load profiles. It uses the same open
+// circuit voltage curve as the estimator, but the capacity can differ.
+typedef struct {
+    // Actual capacity (mAh).
+    int32_t capacity;
+    // Remaining charge (mA ms).
+    int64_t charge;
+} test_battery_t;
+
+static const int32_t test_battery_cell_ocv[] = { 3000, 3600, 3680, 3730, 3770, 3800, 3840, 3900, 3970, 4050, 4150 };
+
+#define TEST_BATTERY_RESISTANCE 150 // mOhm
+
+static void test_battery_set_soc(test_battery_t *battery, int32_t soc) {
+    battery->charge = (int64_t)battery->capacity * 3600 * 1000 * soc / 100;
+}
+
+static int32_t test_battery_get_soc_permille(test_battery_t *battery) {
+    return battery->charge / ((int64_t)battery->capacity * 3600);
+}
+
+static int32_t test_battery_get_ocv(test_battery_t *battery) {
+    int32_t soc = test_battery_get_soc_permille(battery);
+    int32_t i = soc / 100;
+    if (i >= 10) {
+        return test_battery_cell_ocv[10] * 2;
+    }
+    int32_t cell = test_battery_cell_ocv[i] + (test_battery_cell_ocv[i + 1] - test_battery_cell_ocv[i]) * (soc % 100) / 100;
+    return cell * 2;
+}
+
+// Draws @p current from the battery for @p duration ms while the hub measures
+// @p measured, updating the estimator every 10 ms like the motor process.
+static void test_battery_run(test_battery_t *battery, int32_t current, int32_t measured, uint32_t duration) {
+    for (uint32_t t = 0; t < duration; t += 10) {
+        battery->charge -= current * 10;
+        int32_t voltage = test_battery_get_ocv(battery) - current * TEST_BATTERY_RESISTANCE / 1000;
+        pbdrv_battery_test_set_voltage_and_current(voltage, measured);
+        pbio_test_clock_tick(10);
+        pbio_battery_update();
+    }
+}
+
+static void test_battery_soc_coulomb_counting(void *env) {
+    test_battery_t battery = { .capacity = 2100 };
+
+    // A rested battery at 50% is recognized from its voltage.
+    test_battery_set_soc(&battery, 50);
+    pbdrv_battery_test_set_voltage_and_current(test_battery_get_ocv(&battery), 0);
+    pbio_battery_init();
+    tt_want_int_op(pbio_battery_get_capacity(), ==, 2100);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), ==, 50);
+
+    // 10% of capacity in 6 minutes. Voltage under load says less than 40%.
+    test_battery_run(&battery, 2100, 2100, 6 * 60 * 1000);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), >=, 39);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), <=, 40);
+    tt_want_int_op(pbio_battery_get_average_current(), >=, 2090);
+    tt_want_int_op(pbio_battery_get_average_current(), <=, 2100);
+
+    // Open circuit voltage is corrected for internal resistance.
+    tt_want_int_op(pbio_int_math_abs(pbio_battery_get_open_circuit_voltage() - test_battery_get_ocv(&battery)), <=, 5);
+
+    // Current that would pull 7.54 V down to 6 V through 150 mOhm.
+    tt_want_int_op(pbio_battery_get_max_current(6000), >, 9900);
+    tt_want_int_op(pbio_battery_get_max_current(6000), <, 10400);
+    tt_want_int_op(pbio_battery_get_max_current(8000), ==, 0);
+}
+
+static void test_battery_soc_rest_correction(void *env) {
+    test_battery_t battery = { .capacity = 2100 };
+
+    test_battery_set_soc(&battery, 80);
+    pbdrv_battery_test_set_voltage_and_current(test_battery_get_ocv(&battery), 0);
+    pbio_battery_init();
+    tt_want_int_op(pbio_battery_get_state_of_charge(), ==, 80);
+
+    // Current sensor reads only half of the actual current, so the estimate
+    // drifts by about 10%.
+    test_battery_run(&battery, 2000, 1000, 12 * 60 * 1000);
+    tt_want_int_op(test_battery_get_soc_permille(&battery) / 10, ==, 60);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), >=, 69);
+
+    // No correction until the battery has been at rest for a while.
+    test_battery_run(&battery, 0, 0, 20 * 1000);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), >=, 69);
+
+    // Then it is pulled towards the open circuit voltage.
+    test_battery_run(&battery, 0, 0, 10 * 60 * 1000);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), >=, 60);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), <=, 61);
+}
+
+static void test_battery_soc_learn_capacity(void *env) {
+    // Aged battery with less capacity than the nominal 2100 mAh.
+    test_battery_t battery = { .capacity = 1800 };
+
+    test_battery_set_soc(&battery, 90);
+    pbdrv_battery_test_set_voltage_and_current(test_battery_get_ocv(&battery), 0);
+    pbio_battery_init();
+    tt_want_int_op(pbio_battery_get_capacity(), ==, 2100);
+
+    // Rest, discharge 40% of actual capacity, rest again.
+    test_battery_run(&battery, 0, 0, 40 * 1000);
+    test_battery_run(&battery, 2000, 2000, 720 * 3600 / 2000 * 1000);
+    tt_want_int_op(test_battery_get_soc_permille(&battery), ==, 500);
+    test_battery_run(&battery, 0, 0, 40 * 1000);
+
+    // Takes a step of 1/4 from 2100 towards 1800.
+    tt_want_int_op(pbio_battery_get_capacity(), >=, 2015);
+    tt_want_int_op(pbio_battery_get_capacity(), <=, 2035);
+
+    // Once the correction has settled, the estimate is back on track.
+    test_battery_run(&battery, 0, 0, 10 * 60 * 1000);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), >=, 49);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), <=, 50);
+}
+
+static void test_battery_soc_set_capacity(void *env) {
+    pbdrv_battery_test_set_voltage_and_current(7600, 0);
+    pbio_battery_init();
+    tt_want_int_op(pbio_battery_get_state_of_charge(), ==, 50);
+
+    // Value restored from storage is used if it is plausible.
+    tt_want_int_op(pbio_battery_set_capacity(0), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_battery_set_capacity(0xFFFFFFFF), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_battery_set_capacity(1000), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_battery_get_capacity(), ==, 2100);
+    tt_want_int_op(pbio_battery_set_capacity(1900), ==, PBIO_SUCCESS);
+    tt_want_int_op(pbio_battery_get_capacity(), ==, 1900);
+    tt_want_int_op(pbio_battery_get_state_of_charge(), ==, 50);
+
+    // Learned capacity is kept when reinitialized.
+    pbio_battery_init();
+    tt_want_int_op(pbio_battery_get_capacity(), ==, 1900);
+}
+
 struct testcase_t pbio_battery_tests[] = {
     PBIO_TEST(test_battery_voltage_to_duty),
     PBIO_TEST(test_battery_voltage_from_duty),
     PBIO_TEST(test_battery_voltage_from_duty_pct),
+    PBIO_TEST(test_battery_soc_coulomb_counting),
+    PBIO_TEST(test_battery_soc_rest_correction),
+    PBIO_TEST(test_battery_soc_learn_capacity),
+    PBIO_TEST(test_battery_soc_set_capacity),
     END_OF_TESTCASES
 };
@@ -6,6 +6,7 @@
 #include <math.h>
 
 #include <pbio/int_math.h>
+#include <pbio/util.h>
 #include <test-pbio.h>
 
 #include <tinytest.h>
@@ -32,6 +33,46 @@ static void test_sqrt(void *env) {
     for (int32_t s = 0; s < INT32_MAX - 255; s += 256) {
         tt_want_int_op(pbio_int_math_sqrt(s), ==, sqrt(s));
     }
+
+    // The result only changes at perfect squares, so testing on either side
+    // of all of them covers the full input range.
+    for (int32_t r = 1; r <= 46340; r++) {
+        tt_want_int_op(pbio_int_math_sqrt(r * r), ==, r);
+        tt_want_int_op(pbio_int_math_sqrt(r * r - 1), ==, r - 1);
+    }
+    tt_want_int_op(pbio_int_math_sqrt(INT32_MAX), ==, 46340);
+    tt_want_int_op(pbio_int_math_sqrt(INT32_MIN), ==, 0);
+}
+
+static void test_sin_cos(void *env) {
+
+    // Whole degrees are read from a table, so they should be exact after
+    // rounding, including for negative angles and several turns.
+    for (int32_t x = -1080; x <= 1080; x++) {
+        double rad = x * M_PI / 180;
+        tt_want_int_op(pbio_int_math_sin_deg(x), ==, lround(sin(rad) * 10000));
+        tt_want_int_op(pbio_int_math_cos_deg(x), ==, lround(cos(rad) * 10000));
+    }
+
+    // Millidegrees are interpolated between whole degrees.
+    int32_t max_error = 0;
+    for (int32_t x = -720000; x <= 720000; x++) {
+        double rad = x * M_PI / 180000;
+        int32_t error_sin = pbio_int_math_abs(pbio_int_math_sin_mdeg(x) - lround(sin(rad) * 10000));
+        int32_t error_cos = pbio_int_math_abs(pbio_int_math_cos_mdeg(x) - lround(cos(rad) * 10000));
+        max_error = pbio_int_math_max(max_error, pbio_int_math_max(error_sin, error_cos));
+    }
+    tt_want_int_op(max_error, <=, 1);
+
+    // Whole degrees give the same result either way.
+    for (int32_t x = -360; x <= 360; x++) {
+        tt_want_int_op(pbio_int_math_sin_mdeg(x * 1000), ==, pbio_int_math_sin_deg(x));
+        tt_want_int_op(pbio_int_math_cos_mdeg(x * 1000), ==, pbio_int_math_cos_deg(x));
+    }
+
+    // Extremes must not overflow.
+    tt_want(pbio_test_int_is_close(pbio_int_math_sin_mdeg(INT32_MAX), lround(sin(fmod(INT32_MAX, 360000) * M_PI / 180000) * 10000), 1));
+    tt_want_int_op(pbio_int_math_cos_deg(INT32_MAX), ==, lround(cos(fmod(INT32_MAX, 360) * M_PI / 180) * 10000));
 }
 
 static void test_atan2(void *env) {
@@ -80,6 +121,64 @@ static void test_atan2(void *env) {
             tt_want_int_op(error, <=, 2);
         }
     }
+
+    // Compare with the exact result. Apart from rounding to whole degrees,
+    // the error should be very small for any input size.
+    double max_error = 0;
+    for (int32_t scale = 1; scale <= INT32_MAX / 50; scale *= 7) {
+        for (int32_t x = -50; x <= 50; x++) {
+            for (int32_t y = -50; y <= 50; y++) {
+                if (x == 0 || y == 0) {
+                    continue;
+                }
+                double real = atan2(y, x) / M_PI * 180;
+                double error = fabs(pbio_int_math_atan2(y * scale, x * scale) - real);
+                if (error > 180) {
+                    error = 360 - error;
+                }
+                max_error = error > max_error ? error : max_error;
+            }
+        }
+    }
+    tt_want(max_error <= 0.51);
+
+    // Extremes must not overflow.
+    tt_want_int_op(pbio_int_math_atan2(INT32_MAX, INT32_MAX), ==, 45);
+    tt_want_int_op(pbio_int_math_atan2(INT32_MIN, INT32_MIN), ==, -135);
+    tt_want_int_op(pbio_int_math_atan2(INT32_MIN, INT32_MAX), ==, -45);
+    tt_want_int_op(pbio_int_math_atan2(1, INT32_MIN), ==, 180);
+    tt_want_int_op(pbio_int_math_atan2(1, 1), ==, 45);
+
+    // Large y with a small negative x must stay in the right quadrant, even
+    // though x is rounded to zero when the inputs are scaled down.
+    tt_want_int_op(pbio_int_math_atan2(466535074, -1), ==, 90);
+    tt_want_int_op(pbio_int_math_atan2(-316003627, -1), ==, -90);
+    tt_want_int_op(pbio_int_math_atan2(730651296, -3), ==, 90);
+    tt_want_int_op(pbio_int_math_atan2(INT32_MAX, -1), ==, 90);
+    tt_want_int_op(pbio_int_math_atan2(INT32_MIN, -1), ==, -90);
+    tt_want_int_op(pbio_int_math_atan2(1, -INT32_MAX), ==, 180);
+    tt_want_int_op(pbio_int_math_atan2(-1, INT32_MIN), ==, -180);
+
+    // Same near the other axes, for inputs of all sizes.
+    for (int32_t big = 1 << 8; big > 0 && big <= INT32_MAX / 2; big *= 3) {
+        for (int32_t small = -5; small <= 5; small++) {
+            if (small == 0) {
+                continue;
+            }
+            int32_t angles[][3] = {
+                { big, small, 90 },
+                { -big, small, -90 },
+                { small, big, 0 },
+                { small, -big, small > 0 ? 180 : -180 },
+            };
+            for (uint32_t i = 0; i < PBIO_ARRAY_SIZE(angles); i++) {
+                double real = atan2(angles[i][0], angles[i][1]) / M_PI * 180;
+                int32_t ours = pbio_int_math_atan2(angles[i][0], angles[i][1]);
+                tt_want(fabs(ours - real) <= 0.51);
+                tt_want_int_op(pbio_int_math_abs(ours - angles[i][2]), <=, 1);
+            }
+        }
+    }
 }
 
 static void test_mult_and_scale(void *env) {
@@ -120,10 +219,64 @@ static void test_mult_and_scale(void *env) {
     }
 }
 
+static void test_q16(void *env) {
+    int32_t result;
+
+    // Whole numbers, fractions and rounding to nearest.
+    tt_want_int_op(pbio_int_math_q16_from_float(1.0f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, 65536);
+    tt_want_int_op(pbio_int_math_q16_from_float(-2.5f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, -163840);
+    tt_want_int_op(pbio_int_math_q16_from_float(1.6e-5f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, 1);
+    tt_want_int_op(pbio_int_math_q16_from_float(-1.6e-5f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, -1);
+
+    // Values too small for the resolution become zero.
+    tt_want_int_op(pbio_int_math_q16_from_float(7e-6f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, 0);
+
+    // Limits of the range.
+    tt_want_int_op(pbio_int_math_q16_from_float(32767.99f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, >, 32767 * 65536);
+    tt_want_int_op(pbio_int_math_q16_from_float(-32768.0f, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, INT32_MIN);
+
+    // Out of range values and NaN are errors, not saturated.
+    tt_want_int_op(pbio_int_math_q16_from_float(32768.0f, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(result, ==, 0);
+    tt_want_int_op(pbio_int_math_q16_from_float(-32769.0f, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_float(1e30f, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_float(INFINITY, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_float(NAN, &result), ==, PBIO_ERROR_INVALID_ARG);
+
+    // Products of two Q16.16 values are Q32.32.
+    tt_want_int_op(pbio_int_math_q16_from_q32((int64_t)3 * 65536 * -5 * 65536, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, -15 * 65536);
+    tt_want_int_op(pbio_int_math_q16_from_q32((int64_t)1 << 15, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, 1);
+    tt_want_int_op(pbio_int_math_q16_from_q32(((int64_t)1 << 15) - 1, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, 0);
+
+    // Largest values that still round into range.
+    int64_t max = ((int64_t)INT32_MAX << 16) + (1 << 15) - 1;
+    int64_t min = -((int64_t)1 << 47) - (1 << 15);
+    tt_want_int_op(pbio_int_math_q16_from_q32(max, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, INT32_MAX);
+    tt_want_int_op(pbio_int_math_q16_from_q32(min, &result), ==, PBIO_SUCCESS);
+    tt_want_int_op(result, ==, INT32_MIN);
+    tt_want_int_op(pbio_int_math_q16_from_q32(max + 1, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_q32(min - 1, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_q32(INT64_MAX, &result), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbio_int_math_q16_from_q32(INT64_MIN, &result), ==, PBIO_ERROR_INVALID_ARG);
+}
+
 struct testcase_t pbio_int_math_tests[] = {
     PBIO_TEST(test_atan2),
     PBIO_TEST(test_clamp),
     PBIO_TEST(test_mult_and_scale),
+    PBIO_TEST(test_q16),
+    PBIO_TEST(test_sin_cos),
     PBIO_TEST(test_sqrt),
     END_OF_TESTCASES
 };
@@ -14,6 +14,8 @@
 #include <pbio/task.h>
 #include <test-pbio.h>
 
+#include "../drv/clock/clock_test.h"
+
 static PT_THREAD(no_yield_task_thread(struct pt *pt, pbio_task_t *task)) {
     PT_BEGIN(pt);
 
@@ -68,8 +70,242 @@ static void test_task_cancellation(void *env) {
     tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
 }
 
+// Driver with a transaction that has to be rolled back if it is canceled.
+typedef struct {
+    uint32_t yields;
+    uint32_t cancel_calls;
+    bool in_transaction;
+    bool committed;
+    bool rolled_back;
+} test_driver_t;
+
+// Number of yield points in transaction_task_thread.
+#define TRANSACTION_YIELDS 4
+
+// Yield and check for cancellation when the task runs again.
+#define TRANSACTION_YIELD(pt, task, driver) do { \
+        (driver)->yields++; \
+        PT_YIELD(pt); \
+        if ((task)->cancel) { \
+            goto cancel; \
+        } \
+} while (0)
+
+static PT_THREAD(transaction_task_thread(struct pt *pt, pbio_task_t *task)) {
+    test_driver_t *driver = task->context;
+
+    PT_BEGIN(pt);
+
+    // wait for the driver to be idle
+    TRANSACTION_YIELD(pt, task, driver);
+
+    driver->in_transaction = true;
+    TRANSACTION_YIELD(pt, task, driver);
+    TRANSACTION_YIELD(pt, task, driver);
+    driver->in_transaction = false;
+    driver->committed = true;
+
+    // Waiting for the acknowledgment can't be canceled, like writing a remote
+    // GATT characteristic.
+    driver->yields++;
+    PT_YIELD(pt);
+
+    task->status = PBIO_SUCCESS;
+    PT_EXIT(pt);
+
+cancel:
+    if (driver->in_transaction) {
+        driver->in_transaction = false;
+        driver->rolled_back = true;
+    }
+    task->status = PBIO_ERROR_CANCELED;
+
+    PT_END(pt);
+}
+
+// Like a driver that runs its task right away when it is canceled.
+static void transaction_task_on_cancel(pbio_task_t *task) {
+    test_driver_t *driver = task->context;
+
+    driver->cancel_calls++;
+    pbio_task_run_once(task);
+}
+
+static void transaction_task_start(pbio_task_t *task, test_driver_t *driver) {
+    *driver = (test_driver_t) { 0 };
+    pbio_task_init(task, transaction_task_thread, driver);
+    task->on_cancel = transaction_task_on_cancel;
+}
+
+// Tests cancellation at each yield point of a task.
+static void test_task_cancel_at_each_yield(void *env) {
+    for (uint32_t point = 1; point <= TRANSACTION_YIELDS; point++) {
+        pbio_task_t task;
+        test_driver_t driver;
+
+        transaction_task_start(&task, &driver);
+
+        while (driver.yields < point) {
+            tt_want(!pbio_task_run_once(&task));
+        }
+
+        tt_want_uint_op(task.status, ==, PBIO_ERROR_AGAIN);
+
+        // callback runs the task, so it is done right away
+        pbio_task_cancel(&task);
+        tt_want_uint_op(driver.cancel_calls, ==, 1);
+        tt_want(task.cancel);
+        tt_want(!task.timed_out);
+        tt_want(!driver.in_transaction);
+
+        if (point < TRANSACTION_YIELDS) {
+            tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+            tt_want(!driver.committed);
+            // only yield points inside the transaction need a rollback
+            tt_want(driver.rolled_back == (point > 1));
+        } else {
+            // past the last point where the task can be canceled
+            tt_want_uint_op(task.status, ==, PBIO_SUCCESS);
+            tt_want(driver.committed);
+            tt_want(!driver.rolled_back);
+        }
+
+        // canceling again does nothing
+        pbio_task_cancel(&task);
+        tt_want_uint_op(driver.cancel_calls, ==, 1);
+    }
+
+    // canceling a task that is done does nothing
+    pbio_task_t task;
+    test_driver_t driver;
+    transaction_task_start(&task, &driver);
+    while (!pbio_task_run_once(&task)) {
+    }
+    tt_want_uint_op(task.status, ==, PBIO_SUCCESS);
+    pbio_task_cancel(&task);
+    tt_want(!task.cancel);
+    tt_want_uint_op(driver.cancel_calls, ==, 0);
+}
+
+static PT_THREAD(test_task_deadline(struct pt *pt)) {
+    static pbio_task_t task;
+    static test_driver_t driver;
+
+    PT_BEGIN(pt);
+
+    // task is canceled by the event loop when the deadline passes
+    transaction_task_start(&task, &driver);
+    pbio_task_run_once(&task);
+    pbio_task_run_once(&task);
+    tt_want(driver.in_transaction);
+    pbio_task_set_deadline(&task, 10);
+
+    pbio_test_clock_tick(9);
+    PT_YIELD(pt);
+    PT_YIELD(pt);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_AGAIN);
+
+    pbio_test_clock_tick(1);
+    PT_WAIT_UNTIL(pt, task.status != PBIO_ERROR_AGAIN);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_TIMEDOUT);
+    tt_want(task.timed_out);
+    tt_want(!task.has_deadline);
+    tt_want(driver.rolled_back);
+    tt_want_uint_op(driver.cancel_calls, ==, 1);
+
+    // deadline is stopped when the task completes in time
+    transaction_task_start(&task, &driver);
+    pbio_task_run_once(&task);
+    pbio_task_set_deadline(&task, 10);
+    tt_want(task.has_deadline);
+    while (!pbio_task_run_once(&task)) {
+    }
+    tt_want_uint_op(task.status, ==, PBIO_SUCCESS);
+    tt_want(!task.has_deadline);
+
+    pbio_test_clock_tick(20);
+    PT_YIELD(pt);
+    PT_YIELD(pt);
+    tt_want_uint_op(task.status, ==, PBIO_SUCCESS);
+    tt_want_uint_op(driver.cancel_calls, ==, 0);
+
+    // aborting stops the deadline too
+    transaction_task_start(&task, &driver);
+    pbio_task_run_once(&task);
+    pbio_task_set_deadline(&task, 10);
+    pbio_task_abort(&task);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+    tt_want(!task.has_deadline);
+
+    pbio_test_clock_tick(20);
+    PT_YIELD(pt);
+    PT_YIELD(pt);
+    tt_want_uint_op(task.status, ==, PBIO_ERROR_CANCELED);
+    tt_want(!task.timed_out);
+
+    PT_END(pt);
+}
+
+static PT_THREAD(test_task_group(struct pt *pt)) {
+    static pbio_task_t tasks[PBIO_TASK_GROUP_MAX_TASKS + 1];
+    static test_driver_t drivers[PBIO_TASK_GROUP_MAX_TASKS + 1];
+    static pbio_task_group_t group;
+
+    PT_BEGIN(pt);
+
+    // empty group is done
+    pbio_task_group_init(&group);
+    tt_want_uint_op(pbio_task_group_get_status(&group), ==, PBIO_SUCCESS);
+
+    // group is full after max tasks
+    for (int i = 0; i < PBIO_TASK_GROUP_MAX_TASKS; i++) {
+        transaction_task_start(&tasks[i], &drivers[i]);
+        tt_want_uint_op(pbio_task_group_add(&group, &tasks[i]), ==, PBIO_SUCCESS);
+    }
+    tt_want_uint_op(pbio_task_group_add(&group, &tasks[PBIO_TASK_GROUP_MAX_TASKS]), ==, PBIO_ERROR_INVALID_OP);
+
+    // still running if any task is running
+    for (int i = 0; i < PBIO_TASK_GROUP_MAX_TASKS - 1; i++) {
+        while (!pbio_task_run_once(&tasks[i])) {
+        }
+    }
+    tt_want_uint_op(pbio_task_group_get_status(&group), ==, PBIO_ERROR_AGAIN);
+
+    // canceling the group only cancels running tasks
+    pbio_task_run_once(&tasks[PBIO_TASK_GROUP_MAX_TASKS - 1]);
+    pbio_task_group_cancel(&group);
+    for (int i = 0; i < PBIO_TASK_GROUP_MAX_TASKS - 1; i++) {
+        tt_want_uint_op(drivers[i].cancel_calls, ==, 0);
+        tt_want_uint_op(tasks[i].status, ==, PBIO_SUCCESS);
+    }
+    tt_want_uint_op(drivers[PBIO_TASK_GROUP_MAX_TASKS - 1].cancel_calls, ==, 1);
+    tt_want_uint_op(pbio_task_group_get_status(&group), ==, PBIO_ERROR_CANCELED);
+
+    // deadline for the group cancels the tasks that are still running
+    pbio_task_group_init(&group);
+    for (int i = 0; i < 2; i++) {
+        transaction_task_start(&tasks[i], &drivers[i]);
+        pbio_task_group_add(&group, &tasks[i]);
+        pbio_task_run_once(&tasks[i]);
+    }
+    pbio_task_group_set_deadline(&group, 10);
+    while (!pbio_task_run_once(&tasks[0])) {
+    }
+
+    pbio_test_clock_tick(10);
+    PT_WAIT_UNTIL(pt, pbio_task_group_get_status(&group) != PBIO_ERROR_AGAIN);
+    tt_want_uint_op(tasks[0].status, ==, PBIO_SUCCESS);
+    tt_want_uint_op(tasks[1].status, ==, PBIO_ERROR_TIMEDOUT);
+    tt_want_uint_op(pbio_task_group_get_status(&group), ==, PBIO_ERROR_TIMEDOUT);
+
+    PT_END(pt);
+}
+
 struct testcase_t pbio_task_tests[] = {
     PBIO_TEST(test_no_yield_task),
     PBIO_TEST(test_task_cancellation),
+    PBIO_TEST(test_task_cancel_at_each_yield),
+    PBIO_PT_THREAD_TEST(test_task_deadline),
+    PBIO_PT_THREAD_TEST(test_task_group),
     END_OF_TESTCASES
 };
@@ -21,6 +21,7 @@
 
 #include "../drv/legodev/legodev.h"
 #include "../drv/legodev/legodev_pup_uart.h"
+#include "../drv/legodev/legodev_pup_uart_msg.h"
 #include "../drv/legodev/legodev_test.h"
 
 #include "../src/processes.h"
@@ -1038,11 +1039,95 @@ end:
     PT_END(pt);
 }
 
+static void test_lump_msg_parse(void *env) {
+    pbdrv_legodev_pup_uart_msg_t msg;
+
+    // message sizes from header byte
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_get_size(LUMP_SYS_ACK), ==, 1);
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_get_size(0x40), ==, 3);
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_get_size(0x9A), ==, 11);
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_get_size(0xDE), ==, 10);
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_get_size(0x78), >, PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE);
+
+    // nothing received yet
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(NULL, 0, &msg), ==, PBIO_ERROR_AGAIN);
+
+    // SYS messages have no checksum
+    static const uint8_t ack[] = { LUMP_SYS_ACK };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(ack, sizeof(ack), &msg), ==, PBIO_SUCCESS);
+    tt_want_uint_op(msg.type, ==, LUMP_MSG_TYPE_SYS);
+    tt_want_uint_op(msg.cmd, ==, LUMP_SYS_ACK);
+    tt_want_uint_op(msg.payload_size, ==, 0);
+    tt_want_uint_op(msg.size, ==, 1);
+
+    // INFO_RAW for mode 10 from BOOST Color and Distance Sensor
+    static const uint8_t raw[] = { 0x9A, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x7F, 0x47, 0x83 };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(raw, sizeof(raw), &msg), ==, PBIO_SUCCESS);
+    tt_want_uint_op(msg.type, ==, LUMP_MSG_TYPE_INFO);
+    tt_want_uint_op(msg.cmd, ==, 2);
+    tt_want_uint_op(msg.info, ==, LUMP_INFO_RAW);
+    tt_want(msg.mode_plus_8);
+    tt_want_ptr_op(msg.payload, ==, &raw[2]);
+    tt_want_uint_op(msg.payload_size, ==, 8);
+    tt_want_uint_op(msg.size, ==, sizeof(raw));
+
+    // INFO_FORMAT for mode 2 (no plus 8 flag)
+    static const uint8_t format[] = { 0x92, 0x80, 0x01, 0x02, 0x04, 0x00, 0xEA };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(format, sizeof(format), &msg), ==, PBIO_SUCCESS);
+    tt_want_uint_op(msg.info, ==, LUMP_INFO_FORMAT);
+    tt_want(!msg.mode_plus_8);
+    tt_want_uint_op(msg.payload_size, ==, 4);
+
+    // CMD_SPEED
+    static const uint8_t speed[] = { 0x52, 0x00, 0xC2, 0x01, 0x00, 0x6E };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(speed, sizeof(speed), &msg), ==, PBIO_SUCCESS);
+    tt_want_uint_op(msg.type, ==, LUMP_MSG_TYPE_CMD);
+    tt_want_uint_op(msg.cmd, ==, LUMP_CMD_SPEED);
+    tt_want_ptr_op(msg.payload, ==, &speed[1]);
+    tt_want_uint_op(msg.payload_size, ==, 4);
+
+    // incomplete messages are never read past the end
+    for (uint32_t i = 1; i < sizeof(raw); i++) {
+        tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(raw, i, &msg), ==, PBIO_ERROR_AGAIN);
+    }
+
+    // extra bytes after the message are ignored
+    static const uint8_t two[] = { 0x52, 0x00, 0xC2, 0x01, 0x00, 0x6E, LUMP_SYS_ACK };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(two, sizeof(two), &msg), ==, PBIO_SUCCESS);
+    tt_want_uint_op(msg.size, ==, 6);
+
+    // bad checksum still fills in message
+    uint8_t bad[sizeof(speed)];
+    memcpy(bad, speed, sizeof(speed));
+    bad[sizeof(bad) - 1] ^= 0x01;
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(bad, sizeof(bad), &msg), ==, PBIO_ERROR_IO);
+    tt_want_uint_op(msg.cmd, ==, LUMP_CMD_SPEED);
+
+    // header with invalid size means we are out of sync
+    static const uint8_t invalid[] = { 0x78, 0x00 };
+    tt_want_uint_op(pbdrv_legodev_pup_uart_msg_parse(invalid, sizeof(invalid), &msg), ==, PBIO_ERROR_INVALID_ARG);
+
+    // every header gives a payload that fits in the message
+    uint8_t buf[PBDRV_LEGODEV_PUP_UART_MSG_MAX_SIZE] = { 0 };
+    for (uint32_t header = 0; header < 256; header++) {
+        buf[0] = header;
+        pbio_error_t err = pbdrv_legodev_pup_uart_msg_parse(buf, sizeof(buf), &msg);
+        if (err == PBIO_ERROR_INVALID_ARG) {
+            continue;
+        }
+        tt_want(err == PBIO_SUCCESS || err == PBIO_ERROR_IO);
+        tt_want_uint_op(msg.payload_size, <=, LUMP_MAX_MSG_SIZE);
+        tt_want_uint_op(msg.payload - buf + msg.payload_size, <=, msg.size);
+        tt_want_uint_op(msg.size, <=, sizeof(buf));
+    }
+}
+
 struct testcase_t pbdrv_legodev_tests[] = {
     PBIO_PT_THREAD_TEST(test_boost_color_distance_sensor),
     PBIO_PT_THREAD_TEST(test_boost_interactive_motor),
     PBIO_PT_THREAD_TEST(test_technic_large_motor),
     PBIO_PT_THREAD_TEST(test_technic_xl_motor),
+    PBIO_TEST(test_lump_msg_parse),
     END_OF_TESTCASES
 };
 
@@ -1058,6 +1143,15 @@ void pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart, uint32_t baud) {
 void pbdrv_uart_flush(pbdrv_uart_dev_t *uart_dev) {
 }
 
+uint32_t pbdrv_uart_in_waiting(pbdrv_uart_dev_t *uart_dev) {
+    return 0;
+}
+
+pbio_error_t pbdrv_uart_read_buffered(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uint32_t length, uint32_t *count) {
+    *count = 0;
+    return PBIO_SUCCESS;
+}
+
 extern bool pbio_legodev_test_process_auto_start;
 
 void pbdrv_uart_init(void) {
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <contiki.h>
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbdrv/charger.h>
+#include <pbdrv/usb.h>
+#include <pbsys/battery.h>
+#include <test-pbio.h>
+
+#include "../drv/charger/charger_test.h"
+#include "../drv/usb/usb_test.h"
+
+static void test_battery_charger_limit_validation(void *env) {
+    pbsys_battery_reset_charger_limits();
+
+    // Defaults follow the USB battery charging specification.
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_NONE), ==, PBDRV_CHARGER_LIMIT_NONE);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM), ==, PBDRV_CHARGER_LIMIT_STD_MAX);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING), ==, PBDRV_CHARGER_LIMIT_CHARGING);
+
+    // Limits can be lowered...
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING, PBDRV_CHARGER_LIMIT_STD_MAX), ==, PBIO_SUCCESS);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING), ==, PBDRV_CHARGER_LIMIT_STD_MAX);
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM, PBDRV_CHARGER_LIMIT_NONE), ==, PBIO_SUCCESS);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM), ==, PBDRV_CHARGER_LIMIT_NONE);
+
+    // ...and raised again up to what the port type allows.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING, PBDRV_CHARGER_LIMIT_CHARGING), ==, PBIO_SUCCESS);
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM, PBDRV_CHARGER_LIMIT_STD_MAX), ==, PBIO_SUCCESS);
+
+    // Standard ports can't supply more than 500 mA.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM, PBDRV_CHARGER_LIMIT_CHARGING), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM), ==, PBDRV_CHARGER_LIMIT_STD_MAX);
+
+    // Nothing can be drawn without a charger.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_NONE, PBDRV_CHARGER_LIMIT_STD_MIN), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_NONE, PBDRV_CHARGER_LIMIT_NONE), ==, PBIO_SUCCESS);
+
+    // Values out of range are rejected.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING + 1, PBDRV_CHARGER_LIMIT_NONE), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_NONSTANDARD, PBDRV_CHARGER_LIMIT_CHARGING + 1), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING + 1), ==, PBDRV_CHARGER_LIMIT_NONE);
+
+    // Limits set by a program are undone when it ends.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING, PBDRV_CHARGER_LIMIT_STD_MIN), ==, PBIO_SUCCESS);
+    pbsys_battery_reset_charger_limits();
+    tt_want_int_op(pbsys_battery_get_charger_limit(PBDRV_USB_BCD_DEDICATED_CHARGING), ==, PBDRV_CHARGER_LIMIT_CHARGING);
+}
+
+static PT_THREAD(test_battery_charger_limit_applied(struct pt *pt)) {
+    PT_BEGIN(pt);
+
+    bool enable;
+    pbdrv_charger_limit_t limit;
+
+    pbsys_battery_init();
+
+    // The test USB driver is a standard downstream port when connected.
+    pbio_test_usb_connect(true);
+    pbsys_battery_poll();
+    pbdrv_charger_test_get_enable(&enable, &limit);
+    tt_want(enable);
+    tt_want_int_op(limit, ==, PBDRV_CHARGER_LIMIT_STD_MAX);
+
+    // A lower limit is used on the next poll.
+    tt_want_int_op(pbsys_battery_set_charger_limit(PBDRV_USB_BCD_STANDARD_DOWNSTREAM, PBDRV_CHARGER_LIMIT_STD_MIN), ==, PBIO_SUCCESS);
+    pbsys_battery_poll();
+    pbdrv_charger_test_get_enable(&enable, &limit);
+    tt_want(enable);
+    tt_want_int_op(limit, ==, PBDRV_CHARGER_LIMIT_STD_MIN);
+
+    // Charging stops when unplugged.
+    pbio_test_usb_connect(false);
+    pbsys_battery_poll();
+    pbdrv_charger_test_get_enable(&enable, &limit);
+    tt_want(!enable);
+    tt_want_int_op(limit, ==, PBDRV_CHARGER_LIMIT_NONE);
+
+    PT_END(pt);
+}
+
+struct testcase_t pbsys_battery_tests[] = {
+    PBIO_TEST(test_battery_charger_limit_validation),
+    PBIO_PT_THREAD_TEST(test_battery_charger_limit_applied),
+    END_OF_TESTCASES
+};
@@ -16,6 +16,7 @@
 #include <test-pbio.h>
 
 #include "../drv/clock/clock_test.h"
+#include "../../sys/bluetooth.h"
 
 static PT_THREAD(test_bluetooth(struct pt *pt)) {
     PT_BEGIN(pt);
@@ -106,7 +107,95 @@ static PT_THREAD(test_bluetooth(struct pt *pt)) {
     PT_END(pt);
 }
 
+// Stands in for the driver to record connection interval requests.
+static struct {
+    pbdrv_bluetooth_connection_interval_t interval;
+    uint32_t count;
+} mock_driver;
+
+static void link_update(pbsys_bluetooth_link_t *link, uint32_t now) {
+    pbdrv_bluetooth_connection_interval_t interval;
+
+    if (pbsys_bluetooth_link_update(link, now, &interval)) {
+        mock_driver.interval = interval;
+        mock_driver.count++;
+    }
+}
+
+static void test_bluetooth_link(void *env) {
+    pbsys_bluetooth_link_t link;
+    uint32_t now = 1000;
+
+    mock_driver.count = 0;
+    pbsys_bluetooth_link_reset(&link, now);
+
+    // nothing to request without traffic
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 0);
+
+    // download or stdout traffic should request fast interval right away
+    pbsys_bluetooth_link_activity(&link, now);
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 1);
+    tt_want_uint_op(mock_driver.interval, ==, PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST);
+
+    // ongoing traffic should not repeat the request
+    for (int i = 0; i < 10; i++) {
+        now += PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS / 2;
+        pbsys_bluetooth_link_activity(&link, now);
+        link_update(&link, now);
+    }
+    tt_want_uint_op(mock_driver.count, ==, 1);
+
+    // idle interval should be requested once traffic stops for long enough
+    now += PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS - 1;
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 1);
+    now += 1;
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 2);
+    tt_want_uint_op(mock_driver.interval, ==, PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE);
+
+    // new traffic right after a request has to wait for the rate limit
+    now += 100;
+    pbsys_bluetooth_link_activity(&link, now);
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 2);
+    now += PBSYS_BLUETOOTH_LINK_REQUEST_PERIOD_MS - 100;
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 3);
+    tt_want_uint_op(mock_driver.interval, ==, PBDRV_BLUETOOTH_CONNECTION_INTERVAL_FAST);
+
+    // throughput is measured over one window
+    pbsys_bluetooth_link_reset(&link, now);
+    tt_want_uint_op(link.bytes_per_second, ==, 0);
+    for (int i = 0; i < 10; i++) {
+        pbsys_bluetooth_link_sent(&link, now, 155);
+        now += PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS / 10;
+    }
+    link_update(&link, now);
+    tt_want_uint_op(link.bytes_per_second, ==, 1550 * 1000 / PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS);
+
+    // and drops to 0 when nothing is sent for a whole window
+    now += PBSYS_BLUETOOTH_LINK_THROUGHPUT_WINDOW_MS;
+    link_update(&link, now);
+    tt_want_uint_op(link.bytes_per_second, ==, 0);
+
+    // clock wrapping around should not matter
+    mock_driver.count = 0;
+    now = UINT32_MAX - 10;
+    pbsys_bluetooth_link_reset(&link, now);
+    pbsys_bluetooth_link_activity(&link, now);
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 1);
+    now += PBSYS_BLUETOOTH_LINK_IDLE_TIMEOUT_MS;
+    link_update(&link, now);
+    tt_want_uint_op(mock_driver.count, ==, 2);
+    tt_want_uint_op(mock_driver.interval, ==, PBDRV_BLUETOOTH_CONNECTION_INTERVAL_IDLE);
+}
+
 struct testcase_t pbsys_bluetooth_tests[] = {
     PBIO_PT_THREAD_TEST(test_bluetooth),
+    PBIO_TEST(test_bluetooth_link),
     END_OF_TESTCASES
 };
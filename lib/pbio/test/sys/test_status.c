@@ -1,13 +1,15 @@
 // SPDX-License-Identifier: MIT
-// Copyright (c) 2020-2021 The Pybricks Authors
+// Copyright (c) 2020-2023 The Pybricks Authors
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include <contiki.h>
 #include <tinytest.h>
 #include <tinytest_macros.h>
 
+#include <pbdrv/clock.h>
 #include <pbio/event.h>
 #include <pbsys/status.h>
 #include <test-pbio.h>
@@ -108,7 +110,152 @@ static PT_THREAD(test_status(struct pt *pt)) {
     PT_END(pt);
 }
 
+typedef struct {
+    uint32_t count;
+    pbio_pybricks_status_t status;
+    bool set;
+    uint32_t time;
+} test_subscriber_log_t;
+
+static void test_subscriber_callback(pbio_pybricks_status_t status, bool set, uint32_t time, void *context) {
+    test_subscriber_log_t *log = context;
+    log->count++;
+    log->status = status;
+    log->set = set;
+    log->time = time;
+}
+
+static PT_THREAD(test_status_subscribe(struct pt *pt)) {
+    static const pbio_pybricks_status_t test_flag = NUM_PBIO_PYBRICKS_STATUS - 1;
+    static const pbio_pybricks_status_t other_flag = NUM_PBIO_PYBRICKS_STATUS - 2;
+    static test_subscriber_log_t edge_log;
+    static test_subscriber_log_t debounce_log;
+    static pbsys_status_subscriber_t edge = {
+        .flags = PBIO_PYBRICKS_STATUS_FLAG(test_flag),
+        .callback = test_subscriber_callback,
+        .context = &edge_log,
+    };
+    static pbsys_status_subscriber_t debounce = {
+        .flags = PBIO_PYBRICKS_STATUS_FLAG(test_flag),
+        .debounce = 10,
+        .callback = test_subscriber_callback,
+        .context = &debounce_log,
+    };
+    static uint32_t start;
+
+    PT_BEGIN(pt);
+
+    pbsys_status_subscribe(&edge);
+    pbsys_status_subscribe(&debounce);
+
+    // the debounced subscriber is told about the initial state once it is stable
+    // (events are drained after each tick since broadcasts are queued too)
+    pbio_test_clock_tick(10);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    tt_want_uint_op(debounce_log.count, ==, 1);
+    tt_want(!debounce_log.set);
+    debounce_log.count = 0;
+
+    // edge subscribers are called right away with a timestamp
+    start = pbdrv_clock_get_ms();
+    pbsys_status_set(test_flag);
+    tt_want_uint_op(edge_log.count, ==, 1);
+    tt_want_uint_op(edge_log.status, ==, test_flag);
+    tt_want(edge_log.set);
+    tt_want_uint_op(edge_log.time, ==, start);
+
+    // setting it again is not a change
+    pbsys_status_set(test_flag);
+    tt_want_uint_op(edge_log.count, ==, 1);
+
+    // other flags are filtered out
+    pbsys_status_set(other_flag);
+    pbsys_status_clear(other_flag);
+    tt_want_uint_op(edge_log.count, ==, 1);
+
+    // bouncing restarts the debounce timer
+    pbio_test_clock_tick(9);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    pbsys_status_clear(test_flag);
+    pbsys_status_set(test_flag);
+    tt_want_uint_op(edge_log.count, ==, 3);
+    pbio_test_clock_tick(9);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    tt_want_uint_op(debounce_log.count, ==, 0);
+
+    // the debounced subscriber is called once, with the time of the last change
+    pbio_test_clock_tick(1);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    tt_want_uint_op(debounce_log.count, ==, 1);
+    tt_want(debounce_log.set);
+    tt_want_uint_op(debounce_log.time, ==, start + 9);
+    pbio_test_clock_tick(100);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    tt_want_uint_op(debounce_log.count, ==, 1);
+
+    // unsubscribed subscribers are not called anymore
+    pbsys_status_unsubscribe(&edge);
+    pbsys_status_clear(test_flag);
+    tt_want_uint_op(edge_log.count, ==, 3);
+    pbsys_status_unsubscribe(&debounce);
+    pbio_test_clock_tick(10);
+    PT_YIELD(pt);
+    PT_WAIT_WHILE(pt, process_nevents());
+    tt_want_uint_op(debounce_log.count, ==, 1);
+
+    PT_END(pt);
+}
+
+static void test_status_history(void *env) {
+    pbsys_status_transition_t transition;
+    uint32_t start = pbsys_status_get_history_count();
+
+    // last valid flag
+    pbio_pybricks_status_t test_flag = NUM_PBIO_PYBRICKS_STATUS - 1;
+
+    pbio_test_clock_tick(1);
+    pbsys_status_set(test_flag);
+    pbio_test_clock_tick(1);
+    pbsys_status_clear(test_flag);
+
+    tt_want_uint_op(pbsys_status_get_history_count(), ==, start + 2);
+    tt_want(pbsys_status_get_history(start, &transition));
+    tt_want_uint_op(transition.status, ==, test_flag);
+    tt_want(transition.set);
+    tt_want(pbsys_status_get_history(start + 1, &transition));
+    tt_want(!transition.set);
+    tt_want(!pbsys_status_get_history(start + 2, &transition));
+
+    // only the most recent changes are kept, oldest first
+    for (int i = 0; i < PBSYS_STATUS_HISTORY_SIZE; i++) {
+        pbio_test_clock_tick(1);
+        pbsys_status_set(test_flag);
+        pbsys_status_clear(test_flag);
+    }
+
+    tt_want_uint_op(pbsys_status_get_history_count(), ==, PBSYS_STATUS_HISTORY_SIZE);
+    tt_want(pbsys_status_get_history(0, &transition));
+    tt_want(transition.set);
+    uint32_t time = transition.time;
+    tt_want_uint_op(time, ==, pbdrv_clock_get_ms() - PBSYS_STATUS_HISTORY_SIZE / 2 + 1);
+    for (uint32_t i = 1; i < PBSYS_STATUS_HISTORY_SIZE; i++) {
+        tt_want(pbsys_status_get_history(i, &transition));
+        tt_want_uint_op(transition.time, >=, time);
+        tt_want(transition.set == !(i % 2));
+        time = transition.time;
+    }
+    tt_want_uint_op(time, ==, pbdrv_clock_get_ms());
+    tt_want(!pbsys_status_get_history(PBSYS_STATUS_HISTORY_SIZE, &transition));
+}
+
 struct testcase_t pbsys_status_tests[] = {
     PBIO_PT_THREAD_TEST(test_status),
+    PBIO_PT_THREAD_TEST(test_status_subscribe),
+    PBIO_TEST(test_status_history),
     END_OF_TESTCASES
 };
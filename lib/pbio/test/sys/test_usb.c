@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <contiki.h>
+#include <tinytest_macros.h>
+#include <tinytest.h>
+
+#include <pbio/protocol.h>
+#include <pbio/util.h>
+#include <pbsys/usb.h>
+#include <test-pbio.h>
+
+#include "../drv/clock/clock_test.h"
+#include "../drv/usb/usb_test.h"
+
+static uint8_t msg_type;
+static uint8_t msg_payload[PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE];
+static uint16_t msg_size;
+
+// Reads the next message of the given type that the hub sent to the host,
+// skipping status reports since they can be sent at any time.
+static bool read_msg(pbio_pybricks_usb_msg_t type) {
+    uint8_t header[PBIO_PYBRICKS_USB_MSG_HEADER_SIZE];
+
+    // Messages are always queued as a whole, so no need to wait for the rest
+    // once we have the header.
+    while (pbio_test_usb_host_read(header, sizeof(header)) == sizeof(header)) {
+        msg_type = header[0];
+        msg_size = pbio_get_uint16_le(&header[1]);
+        tt_want_uint_op(msg_size, <=, sizeof(msg_payload));
+        tt_want_uint_op(pbio_test_usb_host_read(msg_payload, msg_size), ==, msg_size);
+
+        if (msg_type == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void write_command(const char *data, uint32_t size) {
+    uint8_t header[PBIO_PYBRICKS_USB_MSG_HEADER_SIZE];
+
+    header[0] = PBIO_PYBRICKS_USB_MSG_COMMAND;
+    pbio_set_uint16_le(&header[1], size);
+
+    // Split the header to check that messages don't need to arrive in one piece.
+    pbio_test_usb_host_write(header, 2);
+    pbio_test_usb_host_write(&header[2], 1);
+    pbio_test_usb_host_write((const uint8_t *)data, size);
+}
+
+static PT_THREAD(test_usb(struct pt *pt)) {
+    PT_BEGIN(pt);
+
+    pbsys_usb_init();
+
+    // nothing should be sent before the host opens the port
+    uint32_t size = 5;
+    tt_want_uint_op(pbsys_usb_tx((const uint8_t *)"hello", &size), ==, PBIO_ERROR_INVALID_OP);
+
+    pbio_test_usb_connect(true);
+
+    // host should get the hub capabilities first, then the status
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_HUB_CAPABILITIES);
+    }));
+    tt_want_uint_op(msg_size, ==, PBIO_PYBRICKS_HUB_CAPABILITIES_VALUE_SIZE);
+    tt_want_uint_op(pbio_get_uint16_le(&msg_payload[0]), ==, PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_EVENT);
+    }));
+    tt_want_uint_op(msg_size, ==, 5);
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_EVENT_STATUS_REPORT);
+
+    // stdin goes to the USB stdin buffer
+    static const char *test_data_1 = "\x06test1\n";
+    write_command(test_data_1, strlen(test_data_1));
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE);
+    }));
+    tt_want_uint_op(msg_size, ==, 1);
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_ERROR_OK);
+
+    static uint8_t rx_data[20];
+    size = PBIO_ARRAY_SIZE(rx_data);
+    tt_want_uint_op(pbsys_usb_rx(rx_data, &size), ==, PBIO_SUCCESS);
+    tt_want_uint_op(size, ==, strlen("test1\n"));
+    tt_want_int_op(strncmp("test1\n", (const char *)rx_data, size), ==, 0);
+
+    // other commands go to the common command handler
+    write_command("\xff", 1);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE);
+    }));
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_ERROR_INVALID_COMMAND);
+
+    // responses wait for room in the Tx buffer and keep their order
+    size = PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE;
+    static uint8_t fill_data[PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE];
+    memset(fill_data, 'x', sizeof(fill_data));
+    while (pbsys_usb_tx(fill_data, &size) == PBIO_SUCCESS) {
+        size = PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE;
+    }
+
+    write_command("\xff", 1);
+    write_command("\x06x", 2);
+    write_command("\xff", 1);
+
+    // let the hub handle all of them before the host reads anything
+    pbio_test_sleep_until(pbsys_usb_rx_get_available() == 1);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE);
+    }));
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_ERROR_INVALID_COMMAND);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE);
+    }));
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_ERROR_OK);
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_RESPONSE);
+    }));
+    tt_want_uint_op(msg_payload[0], ==, PBIO_PYBRICKS_ERROR_INVALID_COMMAND);
+
+    size = PBIO_ARRAY_SIZE(rx_data);
+    tt_want_uint_op(pbsys_usb_rx(rx_data, &size), ==, PBIO_SUCCESS);
+    tt_want_uint_op(size, ==, 1);
+
+    // stdout is sent as events
+    static const char *test_data_2 = "test2\n";
+    size = strlen(test_data_2);
+    tt_want_uint_op(pbsys_usb_tx((const uint8_t *)test_data_2, &size), ==, PBIO_SUCCESS);
+    tt_want_uint_op(size, ==, strlen(test_data_2));
+
+    PT_WAIT_UNTIL(pt, ({
+        pbio_test_clock_tick(1);
+        read_msg(PBIO_PYBRICKS_USB_MSG_EVENT) && msg_payload[0] == PBIO_PYBRICKS_EVENT_WRITE_STDOUT;
+    }));
+    tt_want_uint_op(msg_size, ==, strlen(test_data_2) + 1);
+    tt_want_int_op(strncmp(test_data_2, (const char *)&msg_payload[1], msg_size - 1), ==, 0);
+
+    // large writes are split into messages that fit
+    static uint8_t big_data[PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE * 2];
+    memset(big_data, 'x', sizeof(big_data));
+    size = sizeof(big_data);
+    tt_want_uint_op(pbsys_usb_tx(big_data, &size), ==, PBIO_SUCCESS);
+    tt_want_uint_op(size, ==, PBIO_PYBRICKS_USB_MSG_MAX_PAYLOAD_SIZE - 1);
+
+    pbio_test_usb_connect(false);
+
+    size = strlen(test_data_2);
+    tt_want_uint_op(pbsys_usb_tx((const uint8_t *)test_data_2, &size), ==, PBIO_ERROR_INVALID_OP);
+    tt_want(pbsys_usb_tx_is_idle());
+
+    PT_END(pt);
+}
+
+struct testcase_t pbsys_usb_tests[] = {
+    PBIO_PT_THREAD_TEST(test_usb),
+    END_OF_TESTCASES
+};
@@ -76,8 +76,11 @@ struct testcase_setup_t pbio_test_setup = {
     .cleanup_fn = cleanup,
 };
 
+extern struct testcase_t pbdrv_adc_tests[];
 extern struct testcase_t pbdrv_bluetooth_tests[];
+extern struct testcase_t pbdrv_charger_tests[];
 extern struct testcase_t pbdrv_pwm_tests[];
+extern struct testcase_t pbdrv_uart_tests[];
 extern struct testcase_t pbio_angle_tests[];
 extern struct testcase_t pbio_battery_tests[];
 extern struct testcase_t pbio_color_tests[];
@@ -91,11 +94,16 @@ extern struct testcase_t pbio_task_tests[];
 extern struct testcase_t pbio_trajectory_tests[];
 extern struct testcase_t pbdrv_legodev_tests[];
 extern struct testcase_t pbio_util_tests[];
+extern struct testcase_t pbsys_battery_tests[];
 extern struct testcase_t pbsys_bluetooth_tests[];
 extern struct testcase_t pbsys_status_tests[];
+extern struct testcase_t pbsys_usb_tests[];
 static struct testgroup_t test_groups[] = {
+    { "drv/adc/", pbdrv_adc_tests },
     { "drv/bluetooth/", pbdrv_bluetooth_tests },
+    { "drv/charger/", pbdrv_charger_tests },
     { "drv/pwm/", pbdrv_pwm_tests },
+    { "drv/uart/", pbdrv_uart_tests },
     { "src/angle/", pbio_angle_tests },
     { "src/battery/", pbio_battery_tests },
     { "src/color/", pbio_color_tests },
@@ -109,8 +117,10 @@ static struct testgroup_t test_groups[] = {
     { "src/trajectory/", pbio_trajectory_tests },
     { "src/uartdev/", pbdrv_legodev_tests, },
     { "src/util/", pbio_util_tests, },
+    { "sys/battery/", pbsys_battery_tests, },
     { "sys/bluetooth/", pbsys_bluetooth_tests, },
     { "sys/status/", pbsys_status_tests, },
+    { "sys/usb/", pbsys_usb_tests, },
     END_OF_GROUPS
 };
 
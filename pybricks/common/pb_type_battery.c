@@ -32,6 +32,20 @@ STATIC mp_obj_t battery_current(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(battery_current_obj, battery_current);
 
+#if PBIO_CONFIG_BATTERY_SOC
+
+STATIC mp_obj_t battery_level(void) {
+    return mp_obj_new_int(pbio_battery_get_state_of_charge());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(battery_level_obj, battery_level);
+
+STATIC mp_obj_t battery_capacity(void) {
+    return mp_obj_new_int(pbio_battery_get_capacity());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(battery_capacity_obj, battery_capacity);
+
+#endif // PBIO_CONFIG_BATTERY_SOC
+
 #if !PYBRICKS_HUB_MOVEHUB
 
 STATIC mp_obj_t battery_type(void) {
@@ -63,6 +77,10 @@ STATIC const mp_rom_map_elem_t battery_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_battery)        },
     { MP_ROM_QSTR(MP_QSTR_voltage),     MP_ROM_PTR(&battery_voltage_obj)    },
     { MP_ROM_QSTR(MP_QSTR_current),     MP_ROM_PTR(&battery_current_obj)    },
+    #if PBIO_CONFIG_BATTERY_SOC
+    { MP_ROM_QSTR(MP_QSTR_level),       MP_ROM_PTR(&battery_level_obj)      },
+    { MP_ROM_QSTR(MP_QSTR_capacity),    MP_ROM_PTR(&battery_capacity_obj)   },
+    #endif // PBIO_CONFIG_BATTERY_SOC
     #if !PYBRICKS_HUB_MOVEHUB
     { MP_ROM_QSTR(MP_QSTR_type),        MP_ROM_PTR(&battery_type_obj)       },
     { MP_ROM_QSTR(MP_QSTR_temperature), MP_ROM_PTR(&battery_temperature_obj) },
@@ -7,6 +7,7 @@
 
 #include <pbdrv/charger.h>
 #include <pbdrv/usb.h>
+#include <pbsys/battery.h>
 
 #include "py/obj.h"
 #include "py/runtime.h"
@@ -36,10 +37,91 @@ STATIC mp_obj_t Charger_connected(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(Charger_connected_obj, Charger_connected);
 
+STATIC mp_obj_t Charger_history(mp_obj_t self_in) {
+    const pbdrv_charger_session_t *session;
+    pb_assert(pbdrv_charger_get_session(&session));
+
+    mp_obj_t samples = mp_obj_new_list(0, NULL);
+    for (uint16_t i = 0; i < session->num_samples; i++) {
+        const pbdrv_charger_sample_t *sample = &session->samples[i];
+        mp_obj_t values[] = {
+            mp_obj_new_int(sample->time),
+            mp_obj_new_int(sample->current),
+            mp_obj_new_int(sample->voltage),
+            // Same unit as Battery.temperature().
+            mp_obj_new_int(sample->temperature * 100),
+        };
+        mp_obj_list_append(samples, mp_obj_new_tuple(MP_ARRAY_SIZE(values), values));
+    }
+    return samples;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(Charger_history_obj, Charger_history);
+
+STATIC mp_obj_t Charger_session(mp_obj_t self_in) {
+    const pbdrv_charger_session_t *session;
+    pb_assert(pbdrv_charger_get_session(&session));
+
+    mp_obj_t values[] = {
+        mp_obj_new_bool(session->active),
+        mp_obj_new_int(session->duration / 1000),
+        mp_obj_new_int(session->charge / 3600),
+        MP_OBJ_NEW_SMALL_INT(session->end),
+    };
+    return mp_obj_new_tuple(MP_ARRAY_SIZE(values), values);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(Charger_session_obj, Charger_session);
+
+// Charging current limits in mA.
+STATIC const uint16_t Charger_limit_ma[] = {
+    [PBDRV_CHARGER_LIMIT_NONE] = 0,
+    [PBDRV_CHARGER_LIMIT_STD_MIN] = 100,
+    [PBDRV_CHARGER_LIMIT_STD_MAX] = 500,
+    [PBDRV_CHARGER_LIMIT_CHARGING] = 1500,
+};
+
+STATIC mp_obj_t Charger_limit(size_t n_args, const mp_obj_t *args) {
+    mp_int_t port = mp_obj_get_int(args[1]);
+    if (port < PBDRV_USB_BCD_NONE || port > PBDRV_USB_BCD_DEDICATED_CHARGING) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+
+    // Get the limit for this type of USB port.
+    if (n_args == 2) {
+        return mp_obj_new_int(Charger_limit_ma[pbsys_battery_get_charger_limit(port)]);
+    }
+
+    // Set the limit, which must be one of the supported values.
+    mp_int_t current = mp_obj_get_int(args[2]);
+    for (pbdrv_charger_limit_t limit = 0; limit < MP_ARRAY_SIZE(Charger_limit_ma); limit++) {
+        if (Charger_limit_ma[limit] == current) {
+            pb_assert(pbsys_battery_set_charger_limit(port, limit));
+            return mp_const_none;
+        }
+    }
+    pb_assert(PBIO_ERROR_INVALID_ARG);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(Charger_limit_obj, 2, 3, Charger_limit);
+
 STATIC const mp_rom_map_elem_t Charger_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_connected), MP_ROM_PTR(&Charger_connected_obj) },
     { MP_ROM_QSTR(MP_QSTR_current), MP_ROM_PTR(&Charger_current_obj) },
+    { MP_ROM_QSTR(MP_QSTR_history), MP_ROM_PTR(&Charger_history_obj) },
+    { MP_ROM_QSTR(MP_QSTR_limit), MP_ROM_PTR(&Charger_limit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_session), MP_ROM_PTR(&Charger_session_obj) },
     { MP_ROM_QSTR(MP_QSTR_status), MP_ROM_PTR(&Charger_status_obj) },
+    // USB port types for limit().
+    { MP_ROM_QSTR(MP_QSTR_PORT_NONSTANDARD), MP_ROM_INT(PBDRV_USB_BCD_NONSTANDARD) },
+    { MP_ROM_QSTR(MP_QSTR_PORT_STANDARD), MP_ROM_INT(PBDRV_USB_BCD_STANDARD_DOWNSTREAM) },
+    { MP_ROM_QSTR(MP_QSTR_PORT_CHARGING), MP_ROM_INT(PBDRV_USB_BCD_CHARGING_DOWNSTREAM) },
+    { MP_ROM_QSTR(MP_QSTR_PORT_DEDICATED), MP_ROM_INT(PBDRV_USB_BCD_DEDICATED_CHARGING) },
+    // Reasons why a charge session ended, as given by session().
+    { MP_ROM_QSTR(MP_QSTR_END_NONE), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_NONE) },
+    { MP_ROM_QSTR(MP_QSTR_END_DISCONNECTED), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_DISCONNECTED) },
+    { MP_ROM_QSTR(MP_QSTR_END_COMPLETE), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_COMPLETE) },
+    { MP_ROM_QSTR(MP_QSTR_END_TAPER), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_TAPER) },
+    { MP_ROM_QSTR(MP_QSTR_END_TIMEOUT), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_TIMEOUT) },
+    { MP_ROM_QSTR(MP_QSTR_END_FAULT), MP_ROM_INT(PBDRV_CHARGER_SESSION_END_FAULT) },
 };
 STATIC MP_DEFINE_CONST_DICT(Charger_locals_dict, Charger_locals_dict_table);
 
@@ -73,7 +73,7 @@ STATIC void pb_type_imu_extract_axis(mp_obj_t obj_in, pbio_geometry_xyz_t *vecto
         mp_raise_ValueError(MP_ERROR_TEXT("Axis must be 1x3 or 3x1 matrix."));
     }
     for (uint8_t i = 0; i < MP_ARRAY_SIZE(vector->values); i++) {
-        vector->values[i] = vector_obj->data[i] * vector_obj->scale;
+        vector->values[i] = pb_matrix_scalar_to_float(vector_obj->data[i]) * vector_obj->scale;
     }
 }
 
@@ -39,6 +39,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_0(pb_type_System_reset_reason_obj, pb_type_System
 
 #if PBIO_CONFIG_ENABLE_SYS
 
+#include <pbsys/bluetooth.h>
 #include <pbsys/status.h>
 #include <pbsys/program_stop.h>
 
@@ -122,6 +123,28 @@ STATIC mp_obj_t pb_type_System_storage(size_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pb_type_System_storage_obj, 0, pb_type_System_storage);
 
+STATIC mp_obj_t pb_type_System_status_history(void) {
+    mp_obj_t history = mp_obj_new_list(0, NULL);
+
+    pbsys_status_transition_t transition;
+    for (uint32_t i = 0; pbsys_status_get_history(i, &transition); i++) {
+        mp_obj_t values[] = {
+            mp_obj_new_int_from_uint(transition.time),
+            MP_OBJ_NEW_SMALL_INT(transition.status),
+            mp_obj_new_bool(transition.set),
+        };
+        mp_obj_list_append(history, mp_obj_new_tuple(MP_ARRAY_SIZE(values), values));
+    }
+
+    return history;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(pb_type_System_status_history_obj, pb_type_System_status_history);
+
+STATIC mp_obj_t pb_type_System_bluetooth_throughput(void) {
+    return mp_obj_new_int_from_uint(pbsys_bluetooth_tx_get_throughput());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(pb_type_System_bluetooth_throughput_obj, pb_type_System_bluetooth_throughput);
+
 #endif // PBIO_CONFIG_ENABLE_SYS
 
 // dir(pybricks.common.System)
@@ -131,9 +154,11 @@ STATIC const mp_rom_map_elem_t common_System_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_reset_reason), MP_ROM_PTR(&pb_type_System_reset_reason_obj) },
     #endif // PBDRV_CONFIG_RESET
     #if PBIO_CONFIG_ENABLE_SYS
+    { MP_ROM_QSTR(MP_QSTR_bluetooth_throughput), MP_ROM_PTR(&pb_type_System_bluetooth_throughput_obj) },
     { MP_ROM_QSTR(MP_QSTR_set_stop_button), MP_ROM_PTR(&pb_type_System_set_stop_button_obj) },
     { MP_ROM_QSTR(MP_QSTR_shutdown), MP_ROM_PTR(&pb_type_System_shutdown_obj) },
     { MP_ROM_QSTR(MP_QSTR_storage), MP_ROM_PTR(&pb_type_System_storage_obj) },
+    { MP_ROM_QSTR(MP_QSTR_status_history), MP_ROM_PTR(&pb_type_System_status_history_obj) },
     #endif
 };
 STATIC MP_DEFINE_CONST_DICT(common_System_locals_dict, common_System_locals_dict_table);
@@ -29,6 +29,8 @@
 
 #include "py/mpthread.h"
 
+#include "pbinit.h"
+
 STATIC void sighandler(int signum) {
     // we just want the signal to interrupt system calls
 }
@@ -52,6 +54,24 @@ STATIC mp_obj_t mod_experimental_pthread_raise(mp_obj_t thread_id_in, mp_obj_t e
     return mp_obj_new_int(mp_thread_schedule_exception(thread_id, ex_in));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_experimental_pthread_raise_obj, mod_experimental_pthread_raise);
+
+STATIC mp_obj_t mod_experimental_loop_jitter(size_t n_args, const mp_obj_t *args) {
+    uint32_t count, mean_us, max_us;
+    pybricks_get_loop_jitter(&count, &mean_us, &max_us);
+
+    // Optionally start measuring again from here on.
+    if (n_args > 0 && mp_obj_is_true(args[0])) {
+        pybricks_reset_loop_jitter();
+    }
+
+    mp_obj_t ret[] = {
+        mp_obj_new_int_from_uint(count),
+        mp_obj_new_int_from_uint(mean_us),
+        mp_obj_new_int_from_uint(max_us),
+    };
+    return mp_obj_new_tuple(MP_ARRAY_SIZE(ret), ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_experimental_loop_jitter_obj, 0, 1, mod_experimental_loop_jitter);
 #endif // PYBRICKS_HUB_EV3BRICK
 
 // pybricks.experimental.hello_world
@@ -97,6 +117,7 @@ STATIC const mp_rom_map_elem_t experimental_globals_table[] = {
     #if PYBRICKS_HUB_EV3BRICK
     { MP_ROM_QSTR(MP_QSTR___init__), MP_ROM_PTR(&mod_experimental___init___obj) },
     { MP_ROM_QSTR(MP_QSTR_pthread_raise), MP_ROM_PTR(&mod_experimental_pthread_raise_obj) },
+    { MP_ROM_QSTR(MP_QSTR_loop_jitter), MP_ROM_PTR(&mod_experimental_loop_jitter_obj) },
     #endif // PYBRICKS_HUB_EV3BRICK
     { MP_ROM_QSTR(MP_QSTR_hello_world), MP_ROM_PTR(&experimental_hello_world_obj) },
 };
@@ -35,33 +35,94 @@
 // A overhead of 3 yields a max message size of 20 (=23-3)
 #define LWP3_MAX_MESSAGE_SIZE 20
 
+// Number of received messages that are kept until they are read.
+#define LWP3_NOTIFICATION_QUEUE_SIZE 8
+
+// How long to wait for devices to disconnect at the end of the program.
+#define LWP3_DISCONNECT_TIMEOUT_MS 2000
+
 typedef struct {
     pbio_task_t task;
-    uint8_t buffer[LWP3_MAX_MESSAGE_SIZE];
-    bool notification_received;
+    // Received messages, oldest first, starting at queue_start.
+    uint8_t queue[LWP3_NOTIFICATION_QUEUE_SIZE][LWP3_MAX_MESSAGE_SIZE];
+    uint8_t queue_start;
+    uint8_t queue_count;
+    // Number of messages that were dropped because the queue was full.
+    uint32_t dropped;
+    // Whether this state belongs to an LWP3Device object.
+    bool in_use;
+    // Whether context.peripheral still refers to the connection made for this
+    // state. It is cleared when a later connection gets the same peripheral
+    // slot, so this state never aliases the new connection.
+    bool owns_connection;
     pbdrv_bluetooth_scan_and_connect_context_t context;
 } pb_lwp3device_t;
 
-STATIC pb_lwp3device_t pb_lwp3device_singleton;
+// One state for each peripheral that can be connected at the same time. We
+// are using static memory so that notifications can be stored from the
+// Bluetooth driver without involving the garbage collector.
+STATIC pb_lwp3device_t pb_lwp3devices[PBDRV_BLUETOOTH_NUM_PERIPHERALS];
 
 // Handles LEGO Wireless protocol messages from the LWP3 Device
 STATIC pbio_pybricks_error_t handle_notification(pbdrv_bluetooth_connection_t connection, const uint8_t *value, uint32_t size) {
-    pb_lwp3device_t *lwp3device = &pb_lwp3device_singleton;
+    pb_lwp3device_t *lwp3device = NULL;
 
-    // Each message overwrites the previous received messages
-    // Messages will be lost if they are not read fast enough
-    memcpy(lwp3device->buffer, &value[0], (size < LWP3_MAX_MESSAGE_SIZE) ? size : LWP3_MAX_MESSAGE_SIZE);
+    for (size_t i = 0; i < MP_ARRAY_SIZE(pb_lwp3devices); i++) {
+        if (pb_lwp3devices[i].owns_connection &&
+            PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(pb_lwp3devices[i].context.peripheral) == connection) {
+            lwp3device = &pb_lwp3devices[i];
+            break;
+        }
+    }
 
-    lwp3device->notification_received = true;
+    if (!lwp3device) {
+        return PBIO_PYBRICKS_ERROR_OK;
+    }
+
+    // If the queue is full, the oldest message is dropped to make room for
+    // the new one, since the newest state is usually the most useful.
+    if (lwp3device->queue_count == LWP3_NOTIFICATION_QUEUE_SIZE) {
+        lwp3device->queue_start = (lwp3device->queue_start + 1) % LWP3_NOTIFICATION_QUEUE_SIZE;
+        lwp3device->queue_count--;
+        lwp3device->dropped++;
+    }
+
+    uint8_t *buffer = lwp3device->queue[(lwp3device->queue_start + lwp3device->queue_count) % LWP3_NOTIFICATION_QUEUE_SIZE];
+    memset(buffer, 0, LWP3_MAX_MESSAGE_SIZE);
+    memcpy(buffer, &value[0], (size < LWP3_MAX_MESSAGE_SIZE) ? size : LWP3_MAX_MESSAGE_SIZE);
+    lwp3device->queue_count++;
 
     return PBIO_PYBRICKS_ERROR_OK;
 }
 
-STATIC void lwp3device_connect(const uint8_t hub_kind, const char *name, mp_int_t timeout) {
-    pb_lwp3device_t *lwp3device = &pb_lwp3device_singleton;
+STATIC bool lwp3device_is_connected(pb_lwp3device_t *lwp3device) {
+    return lwp3device->owns_connection &&
+           pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(lwp3device->context.peripheral));
+}
 
-    // REVISIT: for now, we only allow a single connection to a LWP3 device.
-    if (pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3)) {
+// Disconnects if needed and gives the state back. This does not wait for the
+// disconnection to complete, so it can be used from a finaliser.
+STATIC void lwp3device_release(pb_lwp3device_t *lwp3device) {
+    if (lwp3device_is_connected(lwp3device)) {
+        pbdrv_bluetooth_disconnect_remote(lwp3device->context.peripheral);
+    }
+    lwp3device->owns_connection = false;
+    lwp3device->in_use = false;
+}
+
+STATIC pb_lwp3device_t *lwp3device_connect(const uint8_t hub_kind, const char *name, mp_int_t timeout) {
+    pb_lwp3device_t *lwp3device = NULL;
+
+    // States of disconnected devices are kept until their object is closed
+    // or garbage collected, so that queued messages can still be read.
+    for (size_t i = 0; i < MP_ARRAY_SIZE(pb_lwp3devices); i++) {
+        if (!pb_lwp3devices[i].in_use) {
+            lwp3device = &pb_lwp3devices[i];
+            break;
+        }
+    }
+
+    if (!lwp3device) {
         pb_assert(PBIO_ERROR_BUSY);
     }
 
@@ -75,24 +136,74 @@ STATIC void lwp3device_connect(const uint8_t hub_kind, const char *name, mp_int_
     memset(lwp3device, 0, sizeof(*lwp3device));
 
     lwp3device->context.hub_kind = hub_kind;
+    lwp3device->context.notification_handler = handle_notification;
+    // Not a valid slot, in case the driver can't assign one.
+    lwp3device->context.peripheral = PBDRV_BLUETOOTH_NUM_PERIPHERALS;
 
     if (name) {
         strncpy(lwp3device->context.name, name, sizeof(lwp3device->context.name));
     }
 
-    pbdrv_bluetooth_set_notification_handler(handle_notification);
+    // The driver assigns the peripheral slot before returning, so
+    // notifications can be matched to this state from here on. States of
+    // earlier devices that used the same slot no longer apply.
     pbdrv_bluetooth_scan_and_connect(&lwp3device->task, &lwp3device->context);
-    pb_module_tools_pbio_task_do_blocking(&lwp3device->task, timeout);
+    for (size_t i = 0; i < MP_ARRAY_SIZE(pb_lwp3devices); i++) {
+        if (pb_lwp3devices[i].context.peripheral == lwp3device->context.peripheral) {
+            pb_lwp3devices[i].owns_connection = false;
+        }
+    }
+    lwp3device->in_use = true;
+    lwp3device->owns_connection = true;
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        pb_module_tools_pbio_task_do_blocking(&lwp3device->task, timeout);
+        nlr_pop();
+    } else {
+        // The slot was not ours if all slots were busy, and it is freed by
+        // the driver if connecting failed, so just give up the state.
+        lwp3device->owns_connection = false;
+        lwp3device->in_use = false;
+        nlr_jump(nlr.ret_val);
+    }
+
+    return lwp3device;
 }
 
-STATIC void lwp3device_assert_connected(void) {
-    if (!pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3)) {
+STATIC void lwp3device_assert_connected(pb_lwp3device_t *lwp3device) {
+    if (!lwp3device_is_connected(lwp3device)) {
         mp_raise_OSError(MP_ENODEV);
     }
 }
 
+void pb_type_LWP3Device_cleanup(void) {
+    // Start disconnecting all devices at once, then wait for them together.
+    for (size_t i = 0; i < MP_ARRAY_SIZE(pb_lwp3devices); i++) {
+        if (lwp3device_is_connected(&pb_lwp3devices[i])) {
+            pbdrv_bluetooth_disconnect_remote(pb_lwp3devices[i].context.peripheral);
+        }
+    }
+
+    mp_uint_t start = mp_hal_ticks_ms();
+
+    for (size_t i = 0; i < MP_ARRAY_SIZE(pb_lwp3devices); i++) {
+        pb_lwp3device_t *lwp3device = &pb_lwp3devices[i];
+
+        // Don't hang if a device does not respond. The link is dropped by the
+        // supervision timeout in that case.
+        while (lwp3device_is_connected(lwp3device) && mp_hal_ticks_ms() - start < LWP3_DISCONNECT_TIMEOUT_MS) {
+            MICROPY_EVENT_POLL_HOOK
+        }
+
+        lwp3device->owns_connection = false;
+        lwp3device->in_use = false;
+    }
+}
+
 typedef struct _pb_type_iodevices_LWP3Device_obj_t {
     mp_obj_base_t base;
+    pb_lwp3device_t *lwp3device;
 } pb_type_iodevices_LWP3Device_obj_t;
 
 STATIC mp_obj_t pb_type_iodevices_LWP3Device_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
@@ -101,21 +212,33 @@ STATIC mp_obj_t pb_type_iodevices_LWP3Device_make_new(const mp_obj_type_t *type,
         PB_ARG_DEFAULT_NONE(name),
         PB_ARG_DEFAULT_INT(timeout, 10000));
 
-    pb_type_iodevices_LWP3Device_obj_t *self = mp_obj_malloc(pb_type_iodevices_LWP3Device_obj_t, type);
+    // The finaliser gives the state back if the object is not closed.
+    pb_type_iodevices_LWP3Device_obj_t *self = m_new_obj_with_finaliser(pb_type_iodevices_LWP3Device_obj_t);
+    self->base.type = type;
+    self->lwp3device = NULL;
 
     uint8_t hub_kind = pb_obj_get_positive_int(hub_kind_in);
 
     const char *name = name_in == mp_const_none ? NULL : mp_obj_str_get_str(name_in);
     mp_int_t timeout = timeout_in == mp_const_none ? -1 : pb_obj_get_positive_int(timeout_in);
-    lwp3device_connect(hub_kind, name, timeout);
+    self->lwp3device = lwp3device_connect(hub_kind, name, timeout);
 
     return MP_OBJ_FROM_PTR(self);
 }
 
+// Gets the state of an object that was not closed yet.
+STATIC pb_lwp3device_t *lwp3device_get(mp_obj_t self_in) {
+    pb_type_iodevices_LWP3Device_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (!self->lwp3device) {
+        mp_raise_OSError(MP_ENODEV);
+    }
+    return self->lwp3device;
+}
+
 STATIC mp_obj_t lwp3device_name(size_t n_args, const mp_obj_t *args) {
-    pb_lwp3device_t *lwp3device = &pb_lwp3device_singleton;
+    pb_lwp3device_t *lwp3device = lwp3device_get(args[0]);
 
-    lwp3device_assert_connected();
+    lwp3device_assert_connected(lwp3device);
 
     if (n_args == 2) {
         size_t len;
@@ -143,7 +266,7 @@ STATIC mp_obj_t lwp3device_name(size_t n_args, const mp_obj_t *args) {
         memcpy(msg.payload, name, len);
 
         // NB: operation is not cancelable, so timeout is not used
-        pbdrv_bluetooth_write_remote(&lwp3device->task, &msg.value);
+        pbdrv_bluetooth_write_remote(&lwp3device->task, lwp3device->context.peripheral, &msg.value);
         pb_module_tools_pbio_task_do_blocking(&lwp3device->task, -1);
 
         // assuming write was successful instead of reading back from the handset
@@ -158,9 +281,9 @@ STATIC mp_obj_t lwp3device_name(size_t n_args, const mp_obj_t *args) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lwp3device_name_obj, 1, 2, lwp3device_name);
 
 STATIC mp_obj_t lwp3device_write(mp_obj_t self_in, mp_obj_t buf_in) {
-    pb_lwp3device_t *lwp3device = &pb_lwp3device_singleton;
+    pb_lwp3device_t *lwp3device = lwp3device_get(self_in);
 
-    lwp3device_assert_connected();
+    lwp3device_assert_connected(lwp3device);
 
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
@@ -180,40 +303,66 @@ STATIC mp_obj_t lwp3device_write(mp_obj_t self_in, mp_obj_t buf_in) {
     };
     memcpy(msg.payload, bufinfo.buf, bufinfo.len);
 
-    pbdrv_bluetooth_write_remote(&lwp3device->task, &msg.value);
+    pbdrv_bluetooth_write_remote(&lwp3device->task, lwp3device->context.peripheral, &msg.value);
     return pb_module_tools_pbio_task_wait_or_await(&lwp3device->task);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(lwp3device_write_obj, lwp3device_write);
 
 STATIC mp_obj_t lwp3device_read(mp_obj_t self_in) {
-    pb_lwp3device_t *lwp3device = &pb_lwp3device_singleton;
-
-    // wait until a notification is received
-    for (;;) {
-        lwp3device_assert_connected();
-
-        if (lwp3device->notification_received) {
-            lwp3device->notification_received = false;
-            break;
-        }
+    pb_lwp3device_t *lwp3device = lwp3device_get(self_in);
 
+    // wait until a notification is received. Messages that were received
+    // before the device disconnected can still be read.
+    while (!lwp3device->queue_count) {
+        lwp3device_assert_connected(lwp3device);
         MICROPY_EVENT_POLL_HOOK
     }
 
-    size_t len = lwp3device->buffer[0];
+    uint8_t buffer[LWP3_MAX_MESSAGE_SIZE];
+    memcpy(buffer, lwp3device->queue[lwp3device->queue_start], sizeof(buffer));
+    lwp3device->queue_start = (lwp3device->queue_start + 1) % LWP3_NOTIFICATION_QUEUE_SIZE;
+    lwp3device->queue_count--;
+
+    size_t len = buffer[0];
 
     if (len < LWP3_HEADER_SIZE || len > LWP3_MAX_MESSAGE_SIZE) {
         mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("bad data"));
     }
 
-    return mp_obj_new_bytes(lwp3device->buffer, len);
+    return mp_obj_new_bytes(buffer, len);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lwp3device_read_obj, lwp3device_read);
 
+STATIC mp_obj_t lwp3device_in_waiting(mp_obj_t self_in) {
+    return mp_obj_new_int(lwp3device_get(self_in)->queue_count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lwp3device_in_waiting_obj, lwp3device_in_waiting);
+
+STATIC mp_obj_t lwp3device_dropped(mp_obj_t self_in) {
+    return mp_obj_new_int_from_uint(lwp3device_get(self_in)->dropped);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lwp3device_dropped_obj, lwp3device_dropped);
+
+// Disconnects and frees the state for another device. Also called by the
+// garbage collector, so it must not allocate or raise.
+STATIC mp_obj_t lwp3device_close(mp_obj_t self_in) {
+    pb_type_iodevices_LWP3Device_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->lwp3device) {
+        lwp3device_release(self->lwp3device);
+        self->lwp3device = NULL;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lwp3device_close_obj, lwp3device_close);
+
 STATIC const mp_rom_map_elem_t pb_type_iodevices_LWP3Device_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_name), MP_ROM_PTR(&lwp3device_name_obj) },
     { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&lwp3device_write_obj) },
     { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&lwp3device_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_in_waiting), MP_ROM_PTR(&lwp3device_in_waiting_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dropped), MP_ROM_PTR(&lwp3device_dropped_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&lwp3device_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&lwp3device_close_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(pb_type_iodevices_LWP3Device_locals_dict, pb_type_iodevices_LWP3Device_locals_dict_table);
 
@@ -3,7 +3,9 @@
 
 #include "py/mpconfig.h"
 
-#if PYBRICKS_PY_IODEVICES && PYBRICKS_PY_EV3DEVICES
+#if PYBRICKS_PY_IODEVICES && (PYBRICKS_PY_EV3DEVICES || PYBRICKS_PY_PUPDEVICES)
+
+#include <string.h>
 
 #include <pbdrv/legodev.h>
 
@@ -17,6 +19,7 @@
 #include <pybricks/util_mp/pb_kwarg_helper.h>
 #include <pybricks/util_mp/pb_obj_helper.h>
 #include <pybricks/common/pb_type_device.h>
+#include <pybricks/tools/pb_type_awaitable.h>
 #include <pybricks/util_pb/pb_error.h>
 #include <pybricks/util_pb/pb_serial.h>
 
@@ -27,6 +30,28 @@ typedef struct _iodevices_UARTDevice_obj_t {
     pb_type_device_obj_base_t device_base;
     pb_serial_t *serial;
     mp_int_t timeout;
+    mp_int_t baudrate;
+    // State of the read operation in progress. Only one read can be in
+    // progress at a time.
+    mp_obj_t read_obj;
+    vstr_t read_vstr;
+    uint8_t *read_data;
+    size_t read_size;
+    size_t read_count;
+    const uint8_t *read_terminator;
+    size_t read_terminator_size;
+    mp_uint_t read_start_time;
+    pbio_error_t read_err;
+    // State of the write operation in progress. Writes have their own list
+    // of awaitables so that one task can write while another one reads.
+    mp_obj_t write_awaitables;
+    mp_obj_t write_obj;
+    const uint8_t *write_data;
+    size_t write_size;
+    size_t write_count;
+    mp_uint_t write_start_time;
+    mp_uint_t write_timeout;
+    pbio_error_t write_err;
 } iodevices_UARTDevice_obj_t;
 
 // pybricks.iodevices.UARTDevice.__init__
@@ -36,19 +61,69 @@ STATIC mp_obj_t iodevices_UARTDevice_make_new(const mp_obj_type_t *type, size_t
         PB_ARG_REQUIRED(baudrate),
         PB_ARG_DEFAULT_NONE(timeout));
 
-    // Get device, which inits UART port
     iodevices_UARTDevice_obj_t *self = mp_obj_malloc(iodevices_UARTDevice_obj_t, type);
+    #if PYBRICKS_PY_EV3DEVICES
+    // Get device, which inits UART port
     pb_type_device_init_class(&self->device_base, port_in, PBDRV_LEGODEV_TYPE_ID_CUSTOM_UART);
+    #else
+    // There is no LEGO device here, pb_serial_get takes the port's UART.
+    self->device_base.awaitables = mp_obj_new_list(0, NULL);
+    #endif
+    self->write_awaitables = mp_obj_new_list(0, NULL);
 
     // Initialize serial
     self->timeout = timeout_in == mp_const_none ? -1 : pb_obj_get_int(timeout_in);
+    self->baudrate = pb_obj_get_int(baudrate_in);
     pbio_port_id_t port = pb_type_enum_get_value(port_in, &pb_enum_type_Port);
-    pb_assert(pb_serial_get(&self->serial, port, pb_obj_get_int(baudrate_in)));
+    pb_assert(pb_serial_get(&self->serial, port, self->baudrate));
     pb_assert(pb_serial_clear(self->serial));
 
     return MP_OBJ_FROM_PTR(self);
 }
 
+STATIC bool iodevices_UARTDevice_write_test_completion(mp_obj_t self_in, uint32_t end_time) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    while (self->write_count < self->write_size) {
+        size_t written;
+        self->write_err = pb_serial_write(self->serial, &self->write_data[self->write_count],
+            self->write_size - self->write_count, &written);
+        if (self->write_err != PBIO_SUCCESS) {
+            return true;
+        }
+
+        // Previous data is still being sent. The driver wakes up the event
+        // loop when it is done. There is no flow control, so the data can
+        // only fail to go out if the port is stuck. Don't wait for that
+        // forever.
+        if (written == 0) {
+            if (mp_hal_ticks_ms() - self->write_start_time > self->write_timeout) {
+                self->write_err = PBIO_ERROR_TIMEDOUT;
+                return true;
+            }
+            return false;
+        }
+
+        self->write_count += written;
+    }
+
+    return true;
+}
+
+STATIC void iodevices_UARTDevice_write_cancel(mp_obj_t self_in) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->write_obj = MP_OBJ_NULL;
+    self->write_data = NULL;
+}
+
+STATIC mp_obj_t iodevices_UARTDevice_write_return(mp_obj_t self_in) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->write_obj = MP_OBJ_NULL;
+    self->write_data = NULL;
+    pb_assert(self->write_err);
+    return mp_const_none;
+}
+
 // pybricks.iodevices.UARTDevice.write
 STATIC mp_obj_t iodevices_UARTDevice_write(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
@@ -61,13 +136,30 @@ STATIC mp_obj_t iodevices_UARTDevice_write(size_t n_args, const mp_obj_t *pos_ar
         pb_assert(PBIO_ERROR_INVALID_ARG);
     }
 
-    // Get data and length
-    GET_STR_DATA_LEN(data_in, data, data_len);
-
-    // Write data to serial
-    pb_assert(pb_serial_write(self->serial, data, data_len));
+    // Only one write can be in progress, so data is sent in order.
+    pb_type_awaitable_update_all(self->write_awaitables, PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
 
-    return mp_const_none;
+    // Get data and length. Keep a reference to the data while it is written.
+    GET_STR_DATA_LEN(data_in, data, data_len);
+    self->write_obj = data_in;
+    self->write_data = data;
+    self->write_size = data_len;
+    self->write_count = 0;
+    self->write_err = PBIO_SUCCESS;
+
+    // Allow twice the time it takes to send 10 bits per byte, plus a margin
+    // for the driver to start.
+    self->write_start_time = mp_hal_ticks_ms();
+    self->write_timeout = (mp_uint_t)data_len * 10 * 1000 * 2 / self->baudrate + 100;
+
+    return pb_type_awaitable_await_or_wait(
+        MP_OBJ_FROM_PTR(self),
+        self->write_awaitables,
+        pb_type_awaitable_end_time_none,
+        iodevices_UARTDevice_write_test_completion,
+        iodevices_UARTDevice_write_return,
+        iodevices_UARTDevice_write_cancel,
+        PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_UARTDevice_write_obj, 1, iodevices_UARTDevice_write);
 
@@ -80,59 +172,130 @@ STATIC mp_obj_t iodevices_UARTDevice_waiting(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(iodevices_UARTDevice_waiting_obj, iodevices_UARTDevice_waiting);
 
-// pybricks.iodevices.UARTDevice._read_internal
-STATIC mp_obj_t iodevices_UARTDevice_read_internal(iodevices_UARTDevice_obj_t *self, size_t len) {
+STATIC bool iodevices_UARTDevice_read_test_completion(mp_obj_t self_in, uint32_t end_time) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    if (len > UART_MAX_LEN) {
-        pb_assert(PBIO_ERROR_INVALID_ARG);
+    // Errors are raised when getting the return value, so that the awaitable
+    // is released properly.
+    if (self->read_err != PBIO_SUCCESS) {
+        return true;
     }
 
-    // If we don't need to read anything, return empty bytearray
-    if (len < 1) {
-        uint8_t none = 0;
-        return mp_obj_new_bytes(&none, 0);
+    while (self->read_count < self->read_size) {
+        // When looking for a terminator, read one byte at a time so we don't
+        // consume data that comes after it.
+        size_t read_now;
+        size_t count = self->read_terminator ? 1 : self->read_size - self->read_count;
+        self->read_err = pb_serial_read(self->serial, &self->read_data[self->read_count], count, &read_now);
+        if (self->read_err != PBIO_SUCCESS) {
+            return true;
+        }
+
+        if (read_now == 0) {
+            break;
+        }
+
+        self->read_count += read_now;
+
+        if (self->read_terminator && self->read_count >= self->read_terminator_size &&
+            memcmp(&self->read_data[self->read_count - self->read_terminator_size],
+                self->read_terminator, self->read_terminator_size) == 0) {
+            return true;
+        }
+    }
+
+    if (self->read_count == self->read_size) {
+        return true;
     }
 
-    // Read data into buffer
-    uint8_t *buf = m_malloc(len);
-    if (buf == NULL) {
-        pb_assert(PBIO_ERROR_FAILED);
+    // On timeout, return what was read so far so it isn't lost. Only raise
+    // if nothing arrived at all.
+    if (self->timeout >= 0 && mp_hal_ticks_ms() - self->read_start_time > (mp_uint_t)self->timeout) {
+        if (self->read_count == 0) {
+            self->read_err = PBIO_ERROR_TIMEDOUT;
+        }
+        return true;
     }
 
-    // Initial status
-    mp_uint_t time_start = mp_hal_ticks_ms();
-    size_t remaining = len;
+    // Get woken up as soon as more data arrives.
+    pb_serial_request_rx_event(self->serial);
+    return false;
+}
 
-    // Read up to the timeout
-    while (true) {
+STATIC void iodevices_UARTDevice_read_cancel(mp_obj_t self_in) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->read_obj = MP_OBJ_NULL;
+    self->read_data = NULL;
+}
 
-        // Read and keep track of how much was read
-        size_t read_now;
-        pb_assert(pb_serial_read(self->serial, &buf[len - remaining], len, &read_now));
+// Gets the result of read() and read_until().
+STATIC mp_obj_t iodevices_UARTDevice_read_return_bytes(mp_obj_t self_in) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    pbio_error_t err = self->read_err;
+    self->read_obj = MP_OBJ_NULL;
+    self->read_data = NULL;
+    if (err != PBIO_SUCCESS) {
+        vstr_clear(&self->read_vstr);
+        pb_assert(err);
+    }
+    self->read_vstr.len = self->read_count;
+    return mp_obj_new_bytes_from_vstr(&self->read_vstr);
+}
 
-        // Decrement remaining count
-        remaining -= read_now;
+// Gets the result of readinto().
+STATIC mp_obj_t iodevices_UARTDevice_read_return_count(mp_obj_t self_in) {
+    iodevices_UARTDevice_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->read_obj = MP_OBJ_NULL;
+    self->read_data = NULL;
+    pb_assert(self->read_err);
+    return mp_obj_new_int(self->read_count);
+}
 
-        // If there is nothing remaining, we are done
-        if (remaining == 0) {
-            break;
-        }
+// Raises if another task is reading, since there is only one read state.
+STATIC void iodevices_UARTDevice_assert_not_reading(iodevices_UARTDevice_obj_t *self) {
+    pb_type_awaitable_update_all(self->device_base.awaitables, PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
+}
 
-        // If we have timed out, let the user know
-        if (self->timeout >= 0 && mp_hal_ticks_ms() - time_start > (mp_uint_t)self->timeout) {
-            pb_assert(PBIO_ERROR_TIMEDOUT);
-        }
+// Starts reading into the given buffer and returns awaitable or result.
+STATIC mp_obj_t iodevices_UARTDevice_read_start(iodevices_UARTDevice_obj_t *self, uint8_t *data, size_t size, pb_type_awaitable_return_t return_value) {
+    self->read_data = data;
+    self->read_size = size;
+    self->read_count = 0;
+    self->read_start_time = mp_hal_ticks_ms();
+    self->read_err = PBIO_SUCCESS;
+
+    return pb_type_awaitable_await_or_wait(
+        MP_OBJ_FROM_PTR(self),
+        self->device_base.awaitables,
+        pb_type_awaitable_end_time_none,
+        iodevices_UARTDevice_read_test_completion,
+        return_value,
+        iodevices_UARTDevice_read_cancel,
+        PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
+}
+
+// Starts reading into a new bytes object, optionally until a terminator.
+STATIC mp_obj_t iodevices_UARTDevice_read_internal(iodevices_UARTDevice_obj_t *self, size_t len, mp_obj_t terminator_in) {
 
-        // Wait before looking again
-        mp_hal_delay_ms(10);
+    if (len > UART_MAX_LEN) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
     }
 
-    // Convert to bytes
-    mp_obj_t ret = mp_obj_new_bytes(buf, len);
+    iodevices_UARTDevice_assert_not_reading(self);
+
+    // Keep a reference to the terminator while the read is in progress.
+    self->read_obj = terminator_in;
+    self->read_terminator = NULL;
+    self->read_terminator_size = 0;
+    if (terminator_in != MP_OBJ_NULL) {
+        GET_STR_DATA_LEN(terminator_in, terminator, terminator_len);
+        self->read_terminator = terminator;
+        self->read_terminator_size = terminator_len;
+    }
 
-    // Free internal buffer and return bytes
-    m_free(buf, len);
-    return ret;
+    // Data is read directly into the memory of the returned bytes object.
+    vstr_init_len(&self->read_vstr, len);
+    return iodevices_UARTDevice_read_start(self, (uint8_t *)self->read_vstr.buf, len, iodevices_UARTDevice_read_return_bytes);
 }
 
 // pybricks.iodevices.UARTDevice.read
@@ -143,10 +306,50 @@ STATIC mp_obj_t iodevices_UARTDevice_read(size_t n_args, const mp_obj_t *pos_arg
         PB_ARG_DEFAULT_INT(length, 1));
 
     size_t length = mp_obj_get_int(length_in);
-    return iodevices_UARTDevice_read_internal(self, length);
+    return iodevices_UARTDevice_read_internal(self, length, MP_OBJ_NULL);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_UARTDevice_read_obj, 1, iodevices_UARTDevice_read);
 
+// pybricks.iodevices.UARTDevice.readinto
+STATIC mp_obj_t iodevices_UARTDevice_readinto(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        iodevices_UARTDevice_obj_t, self,
+        PB_ARG_REQUIRED(buf));
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+
+    iodevices_UARTDevice_assert_not_reading(self);
+
+    // Keep a reference to the buffer while the read is in progress.
+    self->read_obj = buf_in;
+    self->read_terminator = NULL;
+    self->read_terminator_size = 0;
+    return iodevices_UARTDevice_read_start(self, bufinfo.buf, bufinfo.len, iodevices_UARTDevice_read_return_count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_UARTDevice_readinto_obj, 1, iodevices_UARTDevice_readinto);
+
+// pybricks.iodevices.UARTDevice.read_until
+STATIC mp_obj_t iodevices_UARTDevice_read_until(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        iodevices_UARTDevice_obj_t, self,
+        PB_ARG_DEFAULT_NONE(terminator),
+        PB_ARG_DEFAULT_INT(max_length, 256));
+
+    if (terminator_in == mp_const_none) {
+        terminator_in = mp_obj_new_bytes((const byte *)"\n", 1);
+    }
+
+    if (!mp_obj_is_str_or_bytes(terminator_in) || mp_obj_get_int(mp_obj_len(terminator_in)) == 0) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+
+    return iodevices_UARTDevice_read_internal(self, mp_obj_get_int(max_length_in), terminator_in);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_UARTDevice_read_until_obj, 1, iodevices_UARTDevice_read_until);
+
 // pybricks.iodevices.UARTDevice.read_all
 STATIC mp_obj_t iodevices_UARTDevice_read_all(mp_obj_t self_in) {
 
@@ -155,7 +358,7 @@ STATIC mp_obj_t iodevices_UARTDevice_read_all(mp_obj_t self_in) {
     size_t len;
     pb_assert(pb_serial_in_waiting(self->serial, &len));
 
-    return iodevices_UARTDevice_read_internal(self, len);
+    return iodevices_UARTDevice_read_internal(self, len, MP_OBJ_NULL);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(iodevices_UARTDevice_read_all_obj, iodevices_UARTDevice_read_all);
 
@@ -171,6 +374,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(iodevices_UARTDevice_clear_obj, iodevices_UARTD
 STATIC const mp_rom_map_elem_t iodevices_UARTDevice_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_read),  MP_ROM_PTR(&iodevices_UARTDevice_read_obj) },
     { MP_ROM_QSTR(MP_QSTR_read_all),  MP_ROM_PTR(&iodevices_UARTDevice_read_all_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read_until),  MP_ROM_PTR(&iodevices_UARTDevice_read_until_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto),  MP_ROM_PTR(&iodevices_UARTDevice_readinto_obj) },
     { MP_ROM_QSTR(MP_QSTR_write),  MP_ROM_PTR(&iodevices_UARTDevice_write_obj) },
     { MP_ROM_QSTR(MP_QSTR_waiting), MP_ROM_PTR(&iodevices_UARTDevice_waiting_obj) },
     { MP_ROM_QSTR(MP_QSTR_clear), MP_ROM_PTR(&iodevices_UARTDevice_clear_obj) },
@@ -184,4 +389,4 @@ MP_DEFINE_CONST_OBJ_TYPE(pb_type_iodevices_UARTDevice,
     make_new, iodevices_UARTDevice_make_new,
     locals_dict, &iodevices_UARTDevice_locals_dict);
 
-#endif // PYBRICKS_PY_IODEVICES && PYBRICKS_PY_EV3DEVICES
+#endif // PYBRICKS_PY_IODEVICES && (PYBRICKS_PY_EV3DEVICES || PYBRICKS_PY_PUPDEVICES)
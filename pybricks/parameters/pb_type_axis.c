@@ -14,31 +14,31 @@
 
 #if MICROPY_PY_BUILTINS_FLOAT
 
-STATIC const float pb_type_Axis_X_data[] = {1.0f, 0.0f, 0.0f};
+STATIC const pb_matrix_scalar_t pb_type_Axis_X_data[] = {PB_MATRIX_SCALAR(1.0f), PB_MATRIX_SCALAR(0.0f), PB_MATRIX_SCALAR(0.0f)};
 
 const pb_type_Matrix_obj_t pb_type_Axis_X_obj = {
     {&pb_type_Matrix},
-    .data = (float *)pb_type_Axis_X_data,
+    .data = (pb_matrix_scalar_t *)pb_type_Axis_X_data,
     .scale = 1.0f,
     .m = 3,
     .n = 1,
 };
 
-STATIC const float pb_type_Axis_Y_data[] = {0.0f, 1.0f, 0.0f};
+STATIC const pb_matrix_scalar_t pb_type_Axis_Y_data[] = {PB_MATRIX_SCALAR(0.0f), PB_MATRIX_SCALAR(1.0f), PB_MATRIX_SCALAR(0.0f)};
 
 const pb_type_Matrix_obj_t pb_type_Axis_Y_obj = {
     {&pb_type_Matrix},
-    .data = (float *)pb_type_Axis_Y_data,
+    .data = (pb_matrix_scalar_t *)pb_type_Axis_Y_data,
     .scale = 1.0f,
     .m = 3,
     .n = 1,
 };
 
-STATIC const float pb_type_Axis_Z_data[] = {0.0f, 0.0f, 1.0f};
+STATIC const pb_matrix_scalar_t pb_type_Axis_Z_data[] = {PB_MATRIX_SCALAR(0.0f), PB_MATRIX_SCALAR(0.0f), PB_MATRIX_SCALAR(1.0f)};
 
 const pb_type_Matrix_obj_t pb_type_Axis_Z_obj = {
     {&pb_type_Matrix},
-    .data = (float *)pb_type_Axis_Z_data,
+    .data = (pb_matrix_scalar_t *)pb_type_Axis_Z_data,
     .scale = 1.0f,
     .m = 3,
     .n = 1,
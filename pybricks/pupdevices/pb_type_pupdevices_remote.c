@@ -11,6 +11,7 @@
 #include <lego_lwp3.h>
 
 #include <pbdrv/bluetooth.h>
+#include <pbdrv/clock.h>
 #include <pbio/button.h>
 #include <pbio/color.h>
 #include <pbio/error.h>
@@ -19,6 +20,7 @@
 #include <pybricks/common.h>
 #include <pybricks/parameters.h>
 #include <pybricks/tools.h>
+#include <pybricks/tools/pb_type_awaitable.h>
 #include <pybricks/util_mp/pb_kwarg_helper.h>
 #include <pybricks/util_mp/pb_obj_helper.h>
 #include <pybricks/util_pb/pb_error.h>
@@ -51,20 +53,93 @@ enum {
     STATUS_LIGHT_MODE_RGB_0     = 1,
 };
 
+// Number of button events that are kept until they are read.
+#define REMOTE_EVENT_QUEUE_SIZE 16
+
+// A button press or release.
+typedef struct {
+    uint32_t time;
+    pbio_button_flags_t button;
+    bool pressed;
+} pb_remote_event_t;
+
 typedef struct {
     pbio_task_t task;
     uint8_t left[3];
     uint8_t right[3];
     uint8_t center;
+    // Button events, oldest first, starting at event_start.
+    pb_remote_event_t events[REMOTE_EVENT_QUEUE_SIZE];
+    uint8_t event_start;
+    uint8_t event_count;
     pbdrv_bluetooth_scan_and_connect_context_t context;
 } pb_remote_t;
 
-STATIC pb_remote_t pb_remote_singleton;
+// The peripheral slot is not valid until the remote is connected.
+STATIC pb_remote_t pb_remote_singleton = {
+    .context.peripheral = PBDRV_BLUETOOTH_NUM_PERIPHERALS,
+};
+
+STATIC pbio_button_flags_t remote_get_pressed(pb_remote_t *remote) {
+    pbio_button_flags_t pressed = 0;
+
+    if (remote->left[0]) {
+        pressed |= PBIO_BUTTON_LEFT_UP;
+    }
+    if (remote->left[1]) {
+        pressed |= PBIO_BUTTON_LEFT;
+    }
+    if (remote->left[2]) {
+        pressed |= PBIO_BUTTON_LEFT_DOWN;
+    }
+    if (remote->right[0]) {
+        pressed |= PBIO_BUTTON_RIGHT_UP;
+    }
+    if (remote->right[1]) {
+        pressed |= PBIO_BUTTON_RIGHT;
+    }
+    if (remote->right[2]) {
+        pressed |= PBIO_BUTTON_RIGHT_DOWN;
+    }
+    if (remote->center) {
+        pressed |= PBIO_BUTTON_CENTER;
+    }
+    return pressed;
+}
+
+// Adds an event for each button that changed. If the queue is full, the
+// oldest event is dropped.
+STATIC void remote_push_events(pb_remote_t *remote, pbio_button_flags_t before, pbio_button_flags_t after) {
+    uint32_t now = pbdrv_clock_get_ms();
+    pbio_button_flags_t changed = before ^ after;
+
+    for (pbio_button_flags_t button = 1; changed; button <<= 1) {
+        if (!(changed & button)) {
+            continue;
+        }
+        changed &= ~button;
+
+        if (remote->event_count == REMOTE_EVENT_QUEUE_SIZE) {
+            remote->event_start = (remote->event_start + 1) % REMOTE_EVENT_QUEUE_SIZE;
+            remote->event_count--;
+        }
+
+        pb_remote_event_t *event = &remote->events[(remote->event_start + remote->event_count) % REMOTE_EVENT_QUEUE_SIZE];
+        event->time = now;
+        event->button = button;
+        event->pressed = after & button;
+        remote->event_count++;
+    }
+}
 
 // Handles LEGO Wireless protocol messages from the handset
 STATIC pbio_pybricks_error_t handle_notification(pbdrv_bluetooth_connection_t connection, const uint8_t *value, uint32_t size) {
     pb_remote_t *remote = &pb_remote_singleton;
 
+    // Button edges are recorded here, as soon as they are received, so that
+    // short presses are not lost between two polls of the button state.
+    pbio_button_flags_t before = remote_get_pressed(remote);
+
     if (value[0] == 5 && value[2] == LWP3_MSG_TYPE_HW_NET_CMDS && value[3] == LWP3_HW_NET_CMD_CONNECTION_REQ) {
         // This message is meant for something else, but contains the center button state
         remote->center = value[4];
@@ -77,11 +152,18 @@ STATIC pbio_pybricks_error_t handle_notification(pbdrv_bluetooth_connection_t co
         }
     }
 
+    remote_push_events(remote, before, remote_get_pressed(remote));
+
     return PBIO_PYBRICKS_ERROR_OK;
 }
 
+STATIC bool remote_is_connected(void) {
+    pb_remote_t *remote = &pb_remote_singleton;
+    return pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL(remote->context.peripheral));
+}
+
 STATIC void remote_assert_connected(void) {
-    if (!pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3)) {
+    if (!remote_is_connected()) {
         mp_raise_OSError(MP_ENODEV);
     }
 }
@@ -120,15 +202,16 @@ STATIC mp_obj_t pb_type_pupdevices_Remote_light_on(void *context, const pbio_col
     msg.payload[1] = msg.payload[1] * 3 / 8;
     msg.payload[2] = msg.payload[2] * 3 / 8;
 
-    pbdrv_bluetooth_write_remote(&remote->task, &msg.value);
+    pbdrv_bluetooth_write_remote(&remote->task, remote->context.peripheral, &msg.value);
     return pb_module_tools_pbio_task_wait_or_await(&remote->task);
 }
 
 STATIC void remote_connect(const char *name, mp_int_t timeout) {
     pb_remote_t *remote = &pb_remote_singleton;
 
-    // REVISIT: for now, we only allow a single connection to a LWP3 device.
-    if (pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3)) {
+    // REVISIT: for now, we only allow a single remote. Other LWP3 devices
+    // may be connected in the other peripheral slots.
+    if (remote_is_connected()) {
         pb_assert(PBIO_ERROR_BUSY);
     }
 
@@ -142,12 +225,13 @@ STATIC void remote_connect(const char *name, mp_int_t timeout) {
     memset(remote, 0, sizeof(*remote));
 
     remote->context.hub_kind = LWP3_HUB_KIND_HANDSET;
+    remote->context.notification_handler = handle_notification;
+    remote->context.peripheral = PBDRV_BLUETOOTH_NUM_PERIPHERALS;
 
     if (name) {
         strncpy(remote->context.name, name, sizeof(remote->context.name));
     }
 
-    pbdrv_bluetooth_set_notification_handler(handle_notification);
     pbdrv_bluetooth_scan_and_connect(&remote->task, &remote->context);
     pb_module_tools_pbio_task_do_blocking(&remote->task, timeout);
 
@@ -175,13 +259,13 @@ STATIC void remote_connect(const char *name, mp_int_t timeout) {
 
         // set mode for left buttons
 
-        pbdrv_bluetooth_write_remote(&remote->task, &msg.value);
+        pbdrv_bluetooth_write_remote(&remote->task, remote->context.peripheral, &msg.value);
         pb_module_tools_pbio_task_do_blocking(&remote->task, -1);
 
         // set mode for right buttons
 
         msg.port = REMOTE_PORT_RIGHT_BUTTONS;
-        pbdrv_bluetooth_write_remote(&remote->task, &msg.value);
+        pbdrv_bluetooth_write_remote(&remote->task, remote->context.peripheral, &msg.value);
         pb_module_tools_pbio_task_do_blocking(&remote->task, -1);
 
         // set status light to RGB mode
@@ -189,7 +273,7 @@ STATIC void remote_connect(const char *name, mp_int_t timeout) {
         msg.port = REMOTE_PORT_STATUS_LIGHT;
         msg.mode = STATUS_LIGHT_MODE_RGB_0;
         msg.enable_notifications = 0;
-        pbdrv_bluetooth_write_remote(&remote->task, &msg.value);
+        pbdrv_bluetooth_write_remote(&remote->task, remote->context.peripheral, &msg.value);
         pb_module_tools_pbio_task_do_blocking(&remote->task, -1);
 
         // REVISIT: Could possibly use system color here to make remote match
@@ -201,15 +285,21 @@ STATIC void remote_connect(const char *name, mp_int_t timeout) {
         nlr_pop();
     } else {
         // disconnect if any setup task failed
-        pbdrv_bluetooth_disconnect_remote();
+        pbdrv_bluetooth_disconnect_remote(remote->context.peripheral);
         nlr_jump(nlr.ret_val);
     }
 }
 
 void pb_type_Remote_cleanup(void) {
-    pbdrv_bluetooth_disconnect_remote();
+    pb_remote_t *remote = &pb_remote_singleton;
 
-    while (pbdrv_bluetooth_is_connected(PBDRV_BLUETOOTH_CONNECTION_PERIPHERAL_LWP3)) {
+    if (!remote_is_connected()) {
+        return;
+    }
+
+    pbdrv_bluetooth_disconnect_remote(remote->context.peripheral);
+
+    while (remote_is_connected()) {
         MICROPY_EVENT_POLL_HOOK
     }
 }
@@ -219,29 +309,7 @@ STATIC pbio_error_t remote_button_is_pressed(pbio_button_flags_t *pressed) {
 
     remote_assert_connected();
 
-    *pressed = 0;
-
-    if (remote->left[0]) {
-        *pressed |= PBIO_BUTTON_LEFT_UP;
-    }
-    if (remote->left[1]) {
-        *pressed |= PBIO_BUTTON_LEFT;
-    }
-    if (remote->left[2]) {
-        *pressed |= PBIO_BUTTON_LEFT_DOWN;
-    }
-    if (remote->right[0]) {
-        *pressed |= PBIO_BUTTON_RIGHT_UP;
-    }
-    if (remote->right[1]) {
-        *pressed |= PBIO_BUTTON_RIGHT;
-    }
-    if (remote->right[2]) {
-        *pressed |= PBIO_BUTTON_RIGHT_DOWN;
-    }
-    if (remote->center) {
-        *pressed |= PBIO_BUTTON_CENTER;
-    }
+    *pressed = remote_get_pressed(remote);
     return PBIO_SUCCESS;
 }
 
@@ -249,6 +317,7 @@ typedef struct _pb_type_pupdevices_Remote_obj_t {
     mp_obj_base_t base;
     mp_obj_t buttons;
     mp_obj_t light;
+    mp_obj_t awaitables;
 } pb_type_pupdevices_Remote_obj_t;
 
 STATIC const pb_obj_enum_member_t *remote_buttons[] = {
@@ -274,9 +343,60 @@ STATIC mp_obj_t pb_type_pupdevices_Remote_make_new(const mp_obj_type_t *type, si
 
     self->buttons = pb_type_Keypad_obj_new(MP_ARRAY_SIZE(remote_buttons), remote_buttons, remote_button_is_pressed);
     self->light = pb_type_ColorLight_external_obj_new(NULL, pb_type_pupdevices_Remote_light_on);
+    self->awaitables = mp_obj_new_list(0, NULL);
     return MP_OBJ_FROM_PTR(self);
 }
 
+STATIC bool remote_button_event_test_completion(mp_obj_t self_in, uint32_t end_time) {
+    pb_remote_t *remote = &pb_remote_singleton;
+
+    // Also done on disconnect, so the return value can raise.
+    return remote->event_count || !remote_is_connected();
+}
+
+STATIC mp_obj_t remote_button_event_return_value(mp_obj_t self_in) {
+    pb_remote_t *remote = &pb_remote_singleton;
+
+    // Events that were received before disconnecting can still be read.
+    if (!remote->event_count) {
+        remote_assert_connected();
+    }
+
+    pb_remote_event_t *event = &remote->events[remote->event_start];
+    remote->event_start = (remote->event_start + 1) % REMOTE_EVENT_QUEUE_SIZE;
+    remote->event_count--;
+
+    mp_obj_t button = mp_const_none;
+    for (size_t i = 0; i < MP_ARRAY_SIZE(remote_buttons); i++) {
+        if (remote_buttons[i]->value == event->button) {
+            button = MP_OBJ_FROM_PTR(remote_buttons[i]);
+            break;
+        }
+    }
+
+    mp_obj_t ret[] = {
+        button,
+        mp_obj_new_bool(event->pressed),
+        mp_obj_new_int_from_uint(event->time),
+    };
+    return mp_obj_new_tuple(MP_ARRAY_SIZE(ret), ret);
+}
+
+// pybricks.pupdevices.Remote.button_event
+STATIC mp_obj_t remote_button_event(mp_obj_t self_in) {
+    pb_type_pupdevices_Remote_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    return pb_type_awaitable_await_or_wait(
+        MP_OBJ_FROM_PTR(self),
+        self->awaitables,
+        pb_type_awaitable_end_time_none,
+        remote_button_event_test_completion,
+        remote_button_event_return_value,
+        pb_type_awaitable_cancel_none,
+        PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(remote_button_event_obj, remote_button_event);
+
 STATIC mp_obj_t remote_name(size_t n_args, const mp_obj_t *args) {
     pb_remote_t *remote = &pb_remote_singleton;
 
@@ -308,7 +428,7 @@ STATIC mp_obj_t remote_name(size_t n_args, const mp_obj_t *args) {
         memcpy(msg.payload, name, len);
 
         // NB: operation is not cancelable, so timeout is not used
-        pbdrv_bluetooth_write_remote(&remote->task, &msg.value);
+        pbdrv_bluetooth_write_remote(&remote->task, remote->context.peripheral, &msg.value);
         pb_module_tools_pbio_task_do_blocking(&remote->task, -1);
 
         // assuming write was successful instead of reading back from the handset
@@ -330,6 +450,7 @@ STATIC const pb_attr_dict_entry_t pb_type_pupdevices_Remote_attr_dict[] = {
 
 STATIC const mp_rom_map_elem_t pb_type_pupdevices_Remote_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_name), MP_ROM_PTR(&remote_name_obj) },
+    { MP_ROM_QSTR(MP_QSTR_button_event), MP_ROM_PTR(&remote_button_event_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(pb_type_pupdevices_Remote_locals_dict, pb_type_pupdevices_Remote_locals_dict_table);
 
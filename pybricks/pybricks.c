@@ -14,10 +14,12 @@
 
 #include <pybricks/common.h>
 #include <pybricks/hubs.h>
+#include <pybricks/iodevices.h>
 #include <pybricks/parameters.h>
 #include <pybricks/pupdevices.h>
 #include <pybricks/common/pb_type_device.h>
 #include <pybricks/tools.h>
+#include <pybricks/util_pb/pb_serial.h>
 
 #include "genhdr/mpversion.h"
 
@@ -135,4 +137,10 @@ void pb_package_pybricks_deinit(void) {
     #if PYBRICKS_PY_PUPDEVICES
     pb_type_Remote_cleanup();
     #endif // PYBRICKS_PY_PUPDEVICES
+    // Disconnect from other LWP3 devices and give serial ports back to device
+    // detection.
+    #if PYBRICKS_PY_IODEVICES && PYBRICKS_PY_PUPDEVICES
+    pb_type_LWP3Device_cleanup();
+    pb_serial_close_all();
+    #endif
 }
@@ -84,7 +84,9 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pb_module_tools_wait_obj, 0, pb_module_tools_w
 /**
  * Waits for a task to complete.
  *
- * If an exception is raised while waiting, then the task is canceled.
+ * If an exception is raised while waiting, then the task is canceled. If the
+ * timeout expires, the task is canceled by the event loop and this raises
+ * OSError(ETIMEDOUT) once the driver has cleaned up.
  *
  * @param [in]  task    The task
  * @param [in]  timeout The timeout in milliseconds or -1 to wait forever.
@@ -96,20 +98,16 @@ void pb_module_tools_pbio_task_do_blocking(pbio_task_t *task, mp_int_t timeout)
     nlr_buf_t nlr;
 
     if (nlr_push(&nlr) == 0) {
-        mp_uint_t start = mp_hal_ticks_ms();
+        if (timeout >= 0) {
+            pbio_task_set_deadline(task, timeout);
+        }
 
-        while (timeout < 0 || mp_hal_ticks_ms() - start < (mp_uint_t)timeout) {
+        while (task->status == PBIO_ERROR_AGAIN) {
             MICROPY_EVENT_POLL_HOOK
-
-            if (task->status != PBIO_ERROR_AGAIN) {
-                nlr_pop();
-                pb_assert(task->status);
-                return;
-            }
         }
 
-        mp_raise_OSError(MP_ETIMEDOUT);
-        MP_UNREACHABLE
+        nlr_pop();
+        pb_assert(task->status);
     } else {
         pbio_task_cancel(task);
 
@@ -140,6 +138,12 @@ STATIC bool pb_module_tools_pbio_task_test_completion(mp_obj_t obj, uint32_t end
     return true;
 }
 
+// Called when the awaitable is closed, e.g. when the program is stopped.
+STATIC void pb_module_tools_pbio_task_cancel(mp_obj_t obj) {
+    pbio_task_t *task = MP_OBJ_TO_PTR(obj);
+    pbio_task_cancel(task);
+}
+
 mp_obj_t pb_module_tools_pbio_task_wait_or_await(pbio_task_t *task) {
     return pb_type_awaitable_await_or_wait(
         MP_OBJ_FROM_PTR(task),
@@ -147,7 +151,7 @@ mp_obj_t pb_module_tools_pbio_task_wait_or_await(pbio_task_t *task) {
         pb_type_awaitable_end_time_none,
         pb_module_tools_pbio_task_test_completion,
         pb_type_awaitable_return_none,
-        pb_type_awaitable_cancel_none,
+        pb_module_tools_pbio_task_cancel,
         PB_TYPE_AWAITABLE_OPT_RAISE_ON_BUSY);
 }
 
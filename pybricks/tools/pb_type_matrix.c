@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <pbio/int_math.h>
+
 #include <pybricks/tools/pb_type_matrix.h>
 
 #include <pybricks/util_mp/pb_kwarg_helper.h>
@@ -53,7 +55,7 @@ STATIC mp_obj_t pb_type_Matrix_make_new(const mp_obj_type_t *type, size_t n_args
     pb_type_Matrix_obj_t *self = mp_obj_malloc(pb_type_Matrix_obj_t, type);
     self->m = m;
     self->n = n;
-    self->data = m_new(float, m * n);
+    self->data = m_new(pb_matrix_scalar_t, m * n);
 
     // Iterate through each of the rows to get the scalars
     for (size_t r = 0; r < m; r++) {
@@ -67,13 +69,14 @@ STATIC mp_obj_t pb_type_Matrix_make_new(const mp_obj_type_t *type, size_t n_args
 
         // Unpack the scalars
         for (size_t c = 0; c < n2; c++) {
-            self->data[r * n2 + c] = mp_obj_get_float_to_f(scalar_objs[c]);
+            self->data[r * n2 + c] = pb_matrix_scalar_from_float(mp_obj_get_float_to_f(scalar_objs[c]));
         }
     }
 
     // Modifiers that allow basic modifications without moving data around
     self->scale = 1;
     self->transposed = false;
+    self->writable = true;
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -155,7 +158,7 @@ void pb_type_Matrix_print(const mp_print_t *print, mp_obj_t self_in, mp_print_ki
             size_t idx = self->transposed ? c * self->m + r : r * self->n + c;
 
             // Get character representation of said value
-            print_float(buf + col_start, self->data[idx] * self->scale);
+            print_float(buf + col_start, pb_matrix_scalar_to_float(self->data[idx]) * self->scale);
 
             // Append ", " or "]," after the last value
             if (c < self->n - 1) {
@@ -177,8 +180,264 @@ void pb_type_Matrix_print(const mp_print_t *print, mp_obj_t self_in, mp_print_ki
     mp_print_str(print, "])");
 }
 
+// Raises OverflowError if a result did not fit in a matrix entry.
+static void pb_type_Matrix_assert_range(bool overflow) {
+    if (overflow) {
+        mp_raise_msg(&mp_type_OverflowError, MP_ERROR_TEXT("matrix entry out of range"));
+    }
+}
+
+#if PYBRICKS_OPT_MATRIX_FIXED_POINT
+
+pb_matrix_scalar_t pb_matrix_scalar_from_float(float x) {
+    pb_matrix_scalar_t result;
+    pb_type_Matrix_assert_range(pbio_int_math_q16_from_float(x, &result) != PBIO_SUCCESS);
+    return result;
+}
+
+// Like pb_matrix_scalar_from_float, but only sets the overflow flag so that
+// kernels can finish before raising.
+static inline pb_matrix_scalar_t pb_matrix_scalar_from_float_checked(float x, bool *overflow) {
+    pb_matrix_scalar_t result;
+    if (pbio_int_math_q16_from_float(x, &result) != PBIO_SUCCESS) {
+        *overflow = true;
+    }
+    return result;
+}
+
+// Products are accumulated in 64 bits (Q32.32) so no precision is lost until
+// the final result is converted back to a matrix entry.
+typedef int64_t pb_matrix_acc_t;
+
+static inline pb_matrix_acc_t pb_matrix_mul(pb_matrix_scalar_t a, pb_matrix_scalar_t b) {
+    return (int64_t)a * b;
+}
+
+// Each product is up to 2**62, so the sum of a few can overflow too.
+static inline pb_matrix_acc_t pb_matrix_acc_add(pb_matrix_acc_t acc, pb_matrix_acc_t x, bool *overflow) {
+    pb_matrix_acc_t sum;
+    if (__builtin_add_overflow(acc, x, &sum)) {
+        *overflow = true;
+    }
+    return sum;
+}
+
+static inline pb_matrix_scalar_t pb_matrix_acc_to_scalar(pb_matrix_acc_t acc, bool *overflow) {
+    pb_matrix_scalar_t result;
+    if (pbio_int_math_q16_from_q32(acc, &result) != PBIO_SUCCESS) {
+        *overflow = true;
+    }
+    return result;
+}
+
+#else
+
+static inline pb_matrix_scalar_t pb_matrix_scalar_from_float_checked(float x, bool *overflow) {
+    return x;
+}
+
+typedef float pb_matrix_acc_t;
+
+static inline pb_matrix_acc_t pb_matrix_mul(pb_matrix_scalar_t a, pb_matrix_scalar_t b) {
+    return a * b;
+}
+
+static inline pb_matrix_acc_t pb_matrix_acc_add(pb_matrix_acc_t acc, pb_matrix_acc_t x, bool *overflow) {
+    return acc + x;
+}
+
+static inline pb_matrix_scalar_t pb_matrix_acc_to_scalar(pb_matrix_acc_t acc, bool *overflow) {
+    return acc;
+}
+
+#endif // PYBRICKS_OPT_MATRIX_FIXED_POINT
+
+// Data may be stored as transposed, so entry (i, j) is at index
+// i * row_stride + j * col_stride, where the strides are:
+// regular:    (n, 1)
+// transposed: (1, m)
+#define ROW_STRIDE(mat) ((mat)->transposed ? 1 : (mat)->n)
+#define COL_STRIDE(mat) ((mat)->transposed ? (mat)->m : 1)
+
+// Entry (r, c) of operand x, using the strides x_rs and x_cs.
+#define EL(x, r, c) (x[(r) * x##_rs + (c) * x##_cs])
+
+// Inner product of the r'th row of a and the c'th column of b.
+#define MUL(r, k, c) pb_matrix_mul(EL(a, r, k), EL(b, k, c))
+#define DOT2(r, c) pb_matrix_acc_add(MUL(r, 0, c), MUL(r, 1, c), overflow)
+#define DOT3(r, c) pb_matrix_acc_add(DOT2(r, c), MUL(r, 2, c), overflow)
+#define DOT4(r, c) pb_matrix_acc_add(DOT3(r, c), MUL(r, 3, c), overflow)
+
+// Stores the inner product as entry i of the result.
+#define SET(i, dot) (out[i] = pb_matrix_acc_to_scalar(dot, overflow))
+
+#define MUL_KERNEL_ARGS \
+    pb_matrix_scalar_t *out, \
+    const pb_matrix_scalar_t *a, size_t a_rs, size_t a_cs, \
+    const pb_matrix_scalar_t *b, size_t b_rs, size_t b_cs, \
+    bool *overflow
+
+// Unrolled products of square matrices. These are the most common sizes for
+// rotations and state space models, and avoid most of the loop and indexing
+// overhead of the generic version below. The result is the same since the
+// products are accumulated in the same order.
+
+static void pb_type_Matrix_mul_2x2(MUL_KERNEL_ARGS) {
+    SET(0, DOT2(0, 0));
+    SET(1, DOT2(0, 1));
+    SET(2, DOT2(1, 0));
+    SET(3, DOT2(1, 1));
+}
+
+static void pb_type_Matrix_mul_3x3(MUL_KERNEL_ARGS) {
+    SET(0, DOT3(0, 0));
+    SET(1, DOT3(0, 1));
+    SET(2, DOT3(0, 2));
+    SET(3, DOT3(1, 0));
+    SET(4, DOT3(1, 1));
+    SET(5, DOT3(1, 2));
+    SET(6, DOT3(2, 0));
+    SET(7, DOT3(2, 1));
+    SET(8, DOT3(2, 2));
+}
+
+static void pb_type_Matrix_mul_4x4(MUL_KERNEL_ARGS) {
+    SET(0, DOT4(0, 0));
+    SET(1, DOT4(0, 1));
+    SET(2, DOT4(0, 2));
+    SET(3, DOT4(0, 3));
+    SET(4, DOT4(1, 0));
+    SET(5, DOT4(1, 1));
+    SET(6, DOT4(1, 2));
+    SET(7, DOT4(1, 3));
+    SET(8, DOT4(2, 0));
+    SET(9, DOT4(2, 1));
+    SET(10, DOT4(2, 2));
+    SET(11, DOT4(2, 3));
+    SET(12, DOT4(3, 0));
+    SET(13, DOT4(3, 1));
+    SET(14, DOT4(3, 2));
+    SET(15, DOT4(3, 3));
+}
+
+// Computes the unscaled product of lhs and rhs into out, stored row by row.
+// The output must not overlap with the data of either operand. Sets overflow
+// if any entry of the result does not fit.
+static void pb_type_Matrix_mul_kernel(pb_matrix_scalar_t *out, const pb_type_Matrix_obj_t *lhs, const pb_type_Matrix_obj_t *rhs, bool *overflow) {
+
+    const pb_matrix_scalar_t *a = lhs->data;
+    size_t a_rs = ROW_STRIDE(lhs);
+    size_t a_cs = COL_STRIDE(lhs);
+
+    const pb_matrix_scalar_t *b = rhs->data;
+    size_t b_rs = ROW_STRIDE(rhs);
+    size_t b_cs = COL_STRIDE(rhs);
+
+    // Use unrolled version for small square matrices.
+    if (lhs->m == lhs->n && rhs->m == rhs->n && lhs->n == rhs->n) {
+        switch (lhs->n) {
+            case 2:
+                pb_type_Matrix_mul_2x2(out, a, a_rs, a_cs, b, b_rs, b_cs, overflow);
+                return;
+            case 3:
+                pb_type_Matrix_mul_3x3(out, a, a_rs, a_cs, b, b_rs, b_cs, overflow);
+                return;
+            case 4:
+                pb_type_Matrix_mul_4x4(out, a, a_rs, a_cs, b, b_rs, b_cs, overflow);
+                return;
+            default:
+                break;
+        }
+    }
+
+    // Otherwise loop over rows and columns of the result.
+    for (size_t r = 0; r < lhs->m; r++) {
+        for (size_t c = 0; c < rhs->n; c++) {
+            // This entry is obtained as the sum of the products of the entries
+            // of the r'th row of lhs and the c'th column of rhs, so size lhs->n.
+            pb_matrix_acc_t sum = 0;
+            for (size_t k = 0; k < lhs->n; k++) {
+                sum = pb_matrix_acc_add(sum, MUL(r, k, c), overflow);
+            }
+            SET(rhs->n * r + c, sum);
+        }
+    }
+}
+
+// Computes lhs + rhs or lhs - rhs into out, stored row by row with a scale
+// of 1. The output may be the data of lhs, provided that it is not transposed.
+// Sets overflow if any entry of the result does not fit.
+static void pb_type_Matrix_add_kernel(pb_matrix_scalar_t *out, const pb_type_Matrix_obj_t *lhs, const pb_type_Matrix_obj_t *rhs, bool add, bool *overflow) {
+
+    // Add the matrices by looping over rows and columns
+    for (size_t r = 0; r < lhs->m; r++) {
+        for (size_t c = 0; c < lhs->n; c++) {
+            // This entry is obtained as the sum of scalars of both matrices
+            // First find the index of sources and destination.
+            size_t ret_idx = r * lhs->n + c;
+            size_t lhs_idx = lhs->transposed ? c * lhs->m + r : ret_idx;
+            size_t rhs_idx = rhs->transposed ? c * lhs->m + r : ret_idx;
+
+            #if PYBRICKS_OPT_MATRIX_FIXED_POINT
+            // If neither side is scaled, we can stay in fixed point.
+            if (lhs->scale == 1 && rhs->scale == 1) {
+                int64_t sum = add ?
+                    (int64_t)lhs->data[lhs_idx] + rhs->data[rhs_idx] :
+                    (int64_t)lhs->data[lhs_idx] - rhs->data[rhs_idx];
+                if (sum > INT32_MAX || sum < INT32_MIN) {
+                    *overflow = true;
+                }
+                out[ret_idx] = sum;
+                continue;
+            }
+            #endif
+
+            float lhs_val = pb_matrix_scalar_to_float(lhs->data[lhs_idx]) * lhs->scale;
+            float rhs_val = pb_matrix_scalar_to_float(rhs->data[rhs_idx]) * rhs->scale;
+
+            // Either add or subtract to get result.
+            out[ret_idx] = pb_matrix_scalar_from_float_checked(add ? lhs_val + rhs_val : lhs_val - rhs_val, overflow);
+        }
+    }
+}
+
+// Marks that the data of this matrix is now shared with a view.
+static void pb_type_Matrix_share(pb_type_Matrix_obj_t *self) {
+    // Constant matrices are never writable, so only clear it if set.
+    if (self->writable) {
+        self->writable = false;
+    }
+}
+
+// Number of entries of in-place results that are computed on the stack.
+#define INPLACE_BUF_LEN (16)
+
+// Gets storage for the result of an in-place operation on lhs, which is
+// computed separately when the operands are needed until the end or when the
+// result may not fit. Uses buf if the result has no more than INPLACE_BUF_LEN
+// entries, otherwise the heap.
+static pb_matrix_scalar_t *pb_type_Matrix_inplace_begin(pb_type_Matrix_obj_t *lhs, pb_matrix_scalar_t *buf) {
+    size_t len = lhs->m * lhs->n;
+    return len <= INPLACE_BUF_LEN ? buf : m_new(pb_matrix_scalar_t, len);
+}
+
+// Copies the result of an in-place operation into lhs, unless it did not fit,
+// in which case lhs is left unchanged and OverflowError is raised.
+static void pb_type_Matrix_inplace_end(pb_type_Matrix_obj_t *lhs, pb_matrix_scalar_t *result, pb_matrix_scalar_t *buf, bool overflow) {
+    size_t len = lhs->m * lhs->n;
+    if (!overflow) {
+        memcpy(lhs->data, result, len * sizeof(pb_matrix_scalar_t));
+    }
+    if (result != buf) {
+        m_del(pb_matrix_scalar_t, result, len);
+    }
+    pb_type_Matrix_assert_range(overflow);
+}
+
 // pybricks.tools.Matrix._add
-STATIC mp_obj_t pb_type_Matrix__add(mp_obj_t lhs_obj, mp_obj_t rhs_obj, bool add) {
+STATIC mp_obj_t pb_type_Matrix__add(mp_obj_t lhs_obj, mp_obj_t rhs_obj, bool add, bool inplace) {
+
+    pb_assert_type(rhs_obj, &pb_type_Matrix);
 
     // Get left and right matrices
     pb_type_Matrix_obj_t *lhs = MP_OBJ_TO_PTR(lhs_obj);
@@ -189,40 +448,43 @@ STATIC mp_obj_t pb_type_Matrix__add(mp_obj_t lhs_obj, mp_obj_t rhs_obj, bool add
         pb_assert(PBIO_ERROR_INVALID_ARG);
     }
 
-    // Result has same shape as both sides
+    bool overflow = false;
+
+    // For += and -=, store the result in lhs if we may modify it.
+    if (inplace && lhs->writable && !lhs->transposed) {
+        #if PYBRICKS_OPT_MATRIX_FIXED_POINT
+        // Entries may not fit, so check all of them before modifying lhs.
+        pb_matrix_scalar_t buf[INPLACE_BUF_LEN];
+        pb_matrix_scalar_t *result = pb_type_Matrix_inplace_begin(lhs, buf);
+        pb_type_Matrix_add_kernel(result, lhs, rhs, add, &overflow);
+        pb_type_Matrix_inplace_end(lhs, result, buf, overflow);
+        #else
+        pb_type_Matrix_add_kernel(lhs->data, lhs, rhs, add, &overflow);
+        #endif
+        lhs->scale = 1;
+        return lhs_obj;
+    }
+
+    // Otherwise the result is a new matrix with same shape as both sides.
     pb_type_Matrix_obj_t *ret = mp_obj_malloc(pb_type_Matrix_obj_t, &pb_type_Matrix);
     ret->m = lhs->m;
     ret->n = rhs->n;
-    ret->data = m_new(float, ret->m * ret->n);
+    ret->data = m_new(pb_matrix_scalar_t, ret->m * ret->n);
+    pb_type_Matrix_add_kernel(ret->data, lhs, rhs, add, &overflow);
+    pb_type_Matrix_assert_range(overflow);
 
     // Scale must be reset; it has been and multiplied out above
     ret->scale = 1;
     ret->transposed = false;
-
-    // Add the matrices by looping over rows and columns
-    for (size_t r = 0; r < ret->m; r++) {
-        for (size_t c = 0; c < ret->n; c++) {
-            // This entry is obtained as the sum of scalars of both matrices
-            // First find the index of sources and destination.
-            size_t ret_idx = r * ret->n + c;
-            size_t lhs_idx = lhs->transposed ? c * ret->m + r : ret_idx;
-            size_t rhs_idx = rhs->transposed ? c * ret->m + r : ret_idx;
-
-            // Either add or subtract to get result.
-            if (add) {
-                ret->data[ret_idx] = lhs->data[lhs_idx] * lhs->scale + rhs->data[rhs_idx] * rhs->scale;
-            } else {
-                ret->data[ret_idx] = lhs->data[lhs_idx] * lhs->scale - rhs->data[rhs_idx] * rhs->scale;
-            }
-
-        }
-    }
+    ret->writable = true;
 
     return MP_OBJ_FROM_PTR(ret);
 }
 
 // pybricks.tools.Matrix._mul
-STATIC mp_obj_t pb_type_Matrix__mul(mp_obj_t lhs_in, mp_obj_t rhs_in) {
+STATIC mp_obj_t pb_type_Matrix__mul(mp_obj_t lhs_in, mp_obj_t rhs_in, bool inplace) {
+
+    pb_assert_type(rhs_in, &pb_type_Matrix);
 
     // Get left and right matrices
     pb_type_Matrix_obj_t *lhs = MP_OBJ_TO_PTR(lhs_in);
@@ -233,48 +495,56 @@ STATIC mp_obj_t pb_type_Matrix__mul(mp_obj_t lhs_in, mp_obj_t rhs_in) {
         pb_assert(PBIO_ERROR_INVALID_ARG);
     }
 
+    bool overflow = false;
+
+    // For *= and @=, store the result in lhs if we may modify it and if the
+    // shape stays the same, which is when rhs is square.
+    if (inplace && lhs->writable && !lhs->transposed && rhs->m == rhs->n) {
+
+        // The operands are needed until the end, so compute the result
+        // separately. Use the stack for matrices up to 4x4.
+        pb_matrix_scalar_t buf[INPLACE_BUF_LEN];
+        pb_matrix_scalar_t *result = pb_type_Matrix_inplace_begin(lhs, buf);
+        pb_type_Matrix_mul_kernel(result, lhs, rhs, &overflow);
+        pb_type_Matrix_inplace_end(lhs, result, buf, overflow);
+        lhs->scale *= rhs->scale;
+        return lhs_in;
+    }
+
     // Result has as many rows as left hand side and as many columns as right hand side.
     pb_type_Matrix_obj_t *ret = mp_obj_malloc(pb_type_Matrix_obj_t, &pb_type_Matrix);
     ret->m = lhs->m;
     ret->n = rhs->n;
-    ret->data = m_new(float, ret->m * ret->n);
+    ret->data = m_new(pb_matrix_scalar_t, ret->m * ret->n);
+    pb_type_Matrix_mul_kernel(ret->data, lhs, rhs, &overflow);
+    pb_type_Matrix_assert_range(overflow);
 
     // Scale is commutative, so we can do it separately
     ret->scale = lhs->scale * rhs->scale;
     ret->transposed = false;
-
-    // Multiply the matrices by looping over rows and columns
-    for (size_t r = 0; r < ret->m; r++) {
-        for (size_t c = 0; c < ret->n; c++) {
-            // This entry is obtained as the sum of the products of the entries
-            // of the r'th row of lhs and the c'th column of rhs, so size lhs->n.
-            float sum = 0;
-            for (size_t k = 0; k < lhs->n; k++) {
-                // k'th entry on the r'th row (i = r, j = k)
-                size_t lhs_idx = lhs->transposed ? k * lhs->m + r : r * lhs->n + k;
-                // k'th entry on the c'th column  (i = k, j = c)
-                size_t rhs_idx = rhs->transposed ? c * rhs->m + k : k * rhs->n + c;
-                sum += lhs->data[lhs_idx] * rhs->data[rhs_idx];
-            }
-            ret->data[ret->n * r + c] = sum;
-        }
-    }
+    ret->writable = true;
 
     // If the result is a 1x1, return as scalar. This solves all the
     // usual matrix library problems where you have to type things like
     // C[0][0] just to get the scalar, such as for the inner product of two
     // vectors. The same is done for 1x1 initialization above.
     if (ret->m == 1 && ret->n == 1) {
-        return mp_obj_new_float_from_f(ret->data[0] * ret->scale);
+        return mp_obj_new_float_from_f(pb_matrix_scalar_to_float(ret->data[0]) * ret->scale);
     }
 
     return MP_OBJ_FROM_PTR(ret);
 }
 
 // pybricks.tools.Matrix._scale
-STATIC mp_obj_t pb_type_Matrix__scale(mp_obj_t self_in, float scale) {
+STATIC mp_obj_t pb_type_Matrix__scale(mp_obj_t self_in, float scale, bool inplace) {
     pb_type_Matrix_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
+    // For *= and /= with a scalar, only the scale of this object changes.
+    if (inplace && self->writable) {
+        self->scale *= scale;
+        return self_in;
+    }
+
     pb_type_Matrix_obj_t *copy = mp_obj_malloc(pb_type_Matrix_obj_t, &pb_type_Matrix);
 
     // Point to the same data instead of copying
@@ -283,6 +553,8 @@ STATIC mp_obj_t pb_type_Matrix__scale(mp_obj_t self_in, float scale) {
     copy->m = self->m;
     copy->scale = self->scale * scale;
     copy->transposed = self->transposed;
+    copy->writable = false;
+    pb_type_Matrix_share(self);
 
     return MP_OBJ_FROM_PTR(copy);
 }
@@ -296,7 +568,7 @@ float pb_type_Matrix_get_scalar(mp_obj_t self_in, size_t r, size_t c) {
     }
 
     size_t idx = self->transposed ? c * self->m + r : r * self->n + c;
-    return self->data[idx] * self->scale;
+    return pb_matrix_scalar_to_float(self->data[idx]) * self->scale;
 }
 
 // pybricks.tools.Matrix._T
@@ -311,6 +583,8 @@ STATIC mp_obj_t pb_type_Matrix__T(mp_obj_t self_in) {
     copy->m = self->n;
     copy->scale = self->scale;
     copy->transposed = !self->transposed;
+    copy->writable = false;
+    pb_type_Matrix_share(self);
 
     return MP_OBJ_FROM_PTR(copy);
 }
@@ -351,7 +625,7 @@ STATIC mp_obj_t pb_type_Matrix_unary_op(mp_unary_op_t op, mp_obj_t o_in) {
             return o_in;
         // Negative returns a scaled copy
         case MP_UNARY_OP_NEGATIVE:
-            return pb_type_Matrix__scale(o_in, -1);
+            return pb_type_Matrix__scale(o_in, -1, false);
         // Get absolute vale (magnitude)
         case MP_UNARY_OP_ABS: {
             // For vectors, this is the norm
@@ -359,7 +633,8 @@ STATIC mp_obj_t pb_type_Matrix_unary_op(mp_unary_op_t op, mp_obj_t o_in) {
                 size_t len = self->m * self->n;
                 float squares = 0;
                 for (size_t i = 0; i < len; i++) {
-                    squares += self->data[i] * self->data[i];
+                    float value = pb_matrix_scalar_to_float(self->data[i]);
+                    squares += value * value;
                 }
                 return mp_obj_new_float_from_f(sqrtf(squares) * self->scale);
             }
@@ -374,28 +649,36 @@ STATIC mp_obj_t pb_type_Matrix_unary_op(mp_unary_op_t op, mp_obj_t o_in) {
 
 STATIC mp_obj_t pb_type_Matrix_binary_op(mp_binary_op_t op, mp_obj_t lhs_in, mp_obj_t rhs_in) {
 
+    // In-place operators store the result in the left hand side if possible,
+    // which saves allocating a new matrix for operations like x += A @ b.
+    bool inplace = op >= MP_BINARY_OP_INPLACE_OR && op <= MP_BINARY_OP_INPLACE_POWER;
+
     switch (op) {
         case MP_BINARY_OP_ADD:
         case MP_BINARY_OP_INPLACE_ADD:
-            return pb_type_Matrix__add(lhs_in, rhs_in, true);
+            return pb_type_Matrix__add(lhs_in, rhs_in, true, inplace);
         case MP_BINARY_OP_SUBTRACT:
         case MP_BINARY_OP_INPLACE_SUBTRACT:
-            return pb_type_Matrix__add(lhs_in, rhs_in, false);
+            return pb_type_Matrix__add(lhs_in, rhs_in, false, inplace);
         case MP_BINARY_OP_MULTIPLY:
         case MP_BINARY_OP_INPLACE_MULTIPLY:
             // If right of operand is a number, just scale to be faster
             if (mp_obj_is_float(rhs_in) || mp_obj_is_int(rhs_in)) {
-                return pb_type_Matrix__scale(lhs_in, mp_obj_get_float_to_f(rhs_in));
+                return pb_type_Matrix__scale(lhs_in, mp_obj_get_float_to_f(rhs_in), inplace);
             }
             // Otherwise we have to do full multiplication.
-            return pb_type_Matrix__mul(lhs_in, rhs_in);
+            return pb_type_Matrix__mul(lhs_in, rhs_in, inplace);
+        case MP_BINARY_OP_MAT_MULTIPLY:
+        case MP_BINARY_OP_INPLACE_MAT_MULTIPLY:
+            // Same as A * B, but only for matrices.
+            return pb_type_Matrix__mul(lhs_in, rhs_in, inplace);
         case MP_BINARY_OP_REVERSE_MULTIPLY:
             // This gets called for c*A, so scale A by c (rhs/lhs is meaningless here)
-            return pb_type_Matrix__scale(lhs_in, mp_obj_get_float_to_f(rhs_in));
+            return pb_type_Matrix__scale(lhs_in, mp_obj_get_float_to_f(rhs_in), false);
         case MP_BINARY_OP_TRUE_DIVIDE:
         case MP_BINARY_OP_INPLACE_TRUE_DIVIDE:
             // Scalar division by c is scalar multiplication by 1/c
-            return pb_type_Matrix__scale(lhs_in, 1 / mp_obj_get_float_to_f(rhs_in));
+            return pb_type_Matrix__scale(lhs_in, 1 / mp_obj_get_float_to_f(rhs_in), inplace);
         default:
             // Other operations not supported
             return MP_OBJ_NULL;
@@ -458,7 +741,7 @@ STATIC mp_obj_t pb_type_Matrix_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_ob
         }
 
         // Return result
-        return mp_obj_new_float_from_f(self->scale * self->data[idx]);
+        return mp_obj_new_float_from_f(self->scale * pb_matrix_scalar_to_float(self->data[idx]));
     }
     return MP_OBJ_NULL;
 }
@@ -478,7 +761,7 @@ STATIC mp_obj_t pb_type_Matrix_it_iternext(mp_obj_t self_in) {
     pb_type_Matrix_obj_t *matrix = MP_OBJ_TO_PTR(self->matrix);
 
     if (self->cur < matrix->m * matrix->n) {
-        return mp_obj_new_float_from_f(matrix->data[self->cur++] * matrix->scale);
+        return mp_obj_new_float_from_f(pb_matrix_scalar_to_float(matrix->data[self->cur++]) * matrix->scale);
     }
 
     return MP_OBJ_STOP_ITERATION;
@@ -489,7 +772,7 @@ STATIC mp_obj_t pb_type_Matrix_it_iterprev(mp_obj_t self_in) {
     pb_type_Matrix_obj_t *matrix = MP_OBJ_TO_PTR(self->matrix);
 
     if (self->cur > 0) {
-        return mp_obj_new_float_from_f(matrix->data[--self->cur] * matrix->scale);
+        return mp_obj_new_float_from_f(pb_matrix_scalar_to_float(matrix->data[--self->cur]) * matrix->scale);
     }
 
     return MP_OBJ_STOP_ITERATION;
@@ -532,15 +815,17 @@ mp_obj_t pb_type_Matrix_make_vector(size_t m, float *data, bool normalize) {
     pb_type_Matrix_obj_t *mat = mp_obj_malloc(pb_type_Matrix_obj_t, &pb_type_Matrix);
     mat->m = m;
     mat->n = 1;
-    mat->data = m_new(float, m);
+    mat->data = m_new(pb_matrix_scalar_t, m);
 
     // Copy data and compute norm
     float squares = 0;
     for (size_t i = 0; i < m; i++) {
-        mat->data[i] = data[i];
+        mat->data[i] = pb_matrix_scalar_from_float(data[i]);
         squares += data[i] * data[i];
     }
     mat->scale = normalize ? 1 / sqrtf(squares) : 1;
+    mat->transposed = false;
+    mat->writable = true;
 
     return MP_OBJ_FROM_PTR(mat);
 }
@@ -553,10 +838,12 @@ mp_obj_t pb_type_Matrix_make_bitmap(size_t m, size_t n, float scale, uint32_t sr
     mat->m = m;
     mat->n = n;
     mat->scale = scale;
-    mat->data = m_new(float, m * n);
+    mat->transposed = false;
+    mat->writable = true;
+    mat->data = m_new(pb_matrix_scalar_t, m * n);
 
     for (size_t i = 0; i < m * n; i++) {
-        mat->data[m * n - i - 1] = (src & (1 << i)) != 0;
+        mat->data[m * n - i - 1] = (src & (1 << i)) ? PB_MATRIX_SCALAR(1) : 0;
     }
 
     return MP_OBJ_FROM_PTR(mat);
@@ -592,13 +879,18 @@ STATIC mp_obj_t pb_type_matrix_cross(mp_obj_t a_in, mp_obj_t b_in) {
     pb_type_Matrix_obj_t *c = mp_obj_malloc(pb_type_Matrix_obj_t, &pb_type_Matrix);
     c->m = 3;
     c->n = 1;
-    c->data = m_new(float, 3);
-
-    // Evaluate cross product
-    c->data[0] = a->data[1] * b->data[2] - a->data[2] * b->data[1];
-    c->data[1] = a->data[2] * b->data[0] - a->data[0] * b->data[2];
-    c->data[2] = a->data[0] * b->data[1] - a->data[1] * b->data[0];
+    c->data = m_new(pb_matrix_scalar_t, 3);
+
+    // Evaluate cross product. The difference of two products always fits in
+    // the accumulator, but the result may not fit in a matrix entry.
+    bool overflow = false;
+    c->data[0] = pb_matrix_acc_to_scalar(pb_matrix_mul(a->data[1], b->data[2]) - pb_matrix_mul(a->data[2], b->data[1]), &overflow);
+    c->data[1] = pb_matrix_acc_to_scalar(pb_matrix_mul(a->data[2], b->data[0]) - pb_matrix_mul(a->data[0], b->data[2]), &overflow);
+    c->data[2] = pb_matrix_acc_to_scalar(pb_matrix_mul(a->data[0], b->data[1]) - pb_matrix_mul(a->data[1], b->data[0]), &overflow);
+    pb_type_Matrix_assert_range(overflow);
     c->scale = a->scale * b->scale;
+    c->transposed = false;
+    c->writable = true;
 
     return MP_OBJ_FROM_PTR(c);
 }
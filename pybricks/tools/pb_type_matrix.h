@@ -8,17 +8,60 @@
 
 #if MICROPY_PY_BUILTINS_FLOAT
 
+#include <stdint.h>
+
 #include "py/obj.h"
 
 extern const mp_obj_type_t pb_type_Matrix;
 
+#if PYBRICKS_OPT_MATRIX_FIXED_POINT
+
+// Number of fractional bits of the Q16.16 scalars.
+#define PB_MATRIX_Q (16)
+
+// Matrix entries are stored as Q16.16 fixed point numbers, which is much
+// faster than software floating point on hubs without an FPU. This is opt-in
+// per hub since it changes results: entries are limited to -32768 to 32768
+// with a resolution of 2**-16, and OverflowError is raised for results that
+// do not fit.
+typedef int32_t pb_matrix_scalar_t;
+
+// Converts a constant to a matrix entry, for use in static initializers.
+#define PB_MATRIX_SCALAR(x) ((pb_matrix_scalar_t)((x) * (1 << PB_MATRIX_Q)))
+
+static inline float pb_matrix_scalar_to_float(pb_matrix_scalar_t x) {
+    return x * (1.0f / (1 << PB_MATRIX_Q));
+}
+
+pb_matrix_scalar_t pb_matrix_scalar_from_float(float x);
+
+#else
+
+typedef float pb_matrix_scalar_t;
+
+#define PB_MATRIX_SCALAR(x) (x)
+
+static inline float pb_matrix_scalar_to_float(pb_matrix_scalar_t x) {
+    return x;
+}
+
+static inline pb_matrix_scalar_t pb_matrix_scalar_from_float(float x) {
+    return x;
+}
+
+#endif // PYBRICKS_OPT_MATRIX_FIXED_POINT
+
 typedef struct _pb_type_Matrix_obj_t {
     mp_obj_base_t base;
-    float *data;
+    pb_matrix_scalar_t *data;
     float scale;
     size_t m;
     size_t n;
     bool transposed;
+    // Data is on the heap and not shared with any other object, so in-place
+    // operators may modify it. False for constants, for transposed or scaled
+    // copies that share data, and for the matrices they were made from.
+    bool writable;
 } pb_type_Matrix_obj_t;
 
 mp_obj_t pb_type_Matrix_make_vector(size_t m, float *data, bool normalize);
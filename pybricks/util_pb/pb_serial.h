@@ -11,10 +11,14 @@ typedef struct _pb_serial_t pb_serial_t;
 
 pbio_error_t pb_serial_get(pb_serial_t **_ser, pbio_port_id_t port, int baudrate);
 
-pbio_error_t pb_serial_write(pb_serial_t *ser, const void *buf, size_t count);
+pbio_error_t pb_serial_write(pb_serial_t *ser, const void *buf, size_t count, size_t *written);
 
 pbio_error_t pb_serial_in_waiting(pb_serial_t *ser, size_t *waiting);
 
 pbio_error_t pb_serial_read(pb_serial_t *ser, uint8_t *buf, size_t count, size_t *received);
 
 pbio_error_t pb_serial_clear(pb_serial_t *ser);
+
+void pb_serial_request_rx_event(pb_serial_t *ser);
+
+void pb_serial_close_all(void);
@@ -14,6 +14,8 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include <glib-unix.h>
+
 #include <pbio/error.h>
 #include <pbio/util.h>
 
@@ -29,6 +31,8 @@ static const char *const TTY_PATH[] = {
 struct _pb_serial_t {
     int file;
     int timeout;
+    // Source that wakes up the main loop when data arrives, or 0 if none.
+    guint rx_event_source;
 };
 
 pb_serial_t pb_serials[PBIO_ARRAY_SIZE(TTY_PATH)];
@@ -152,6 +156,12 @@ pbio_error_t pb_serial_get(pb_serial_t **_ser, pbio_port_id_t port, int baudrate
     pbio_error_t err;
     pb_serial_t *ser = &pb_serials[port - PBIO_PORT_ID_1];
 
+    // Don't keep watching a file from a previous program.
+    if (ser->rx_event_source) {
+        g_source_remove(ser->rx_event_source);
+        ser->rx_event_source = 0;
+    }
+
     // Open pb_serial port
     err = pb_serial_open(ser, TTY_PATH[port - PBIO_PORT_ID_1]);
     if (err != PBIO_SUCCESS) {
@@ -170,10 +180,17 @@ pbio_error_t pb_serial_get(pb_serial_t **_ser, pbio_port_id_t port, int baudrate
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pb_serial_write(pb_serial_t *ser, const void *buf, size_t count) {
-    if (write(ser->file, buf, count) != (int)count) {
+pbio_error_t pb_serial_write(pb_serial_t *ser, const void *buf, size_t count, size_t *written) {
+    // The file is non-blocking, so this may write only part of the data.
+    int ret = write(ser->file, buf, count);
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            *written = 0;
+            return PBIO_SUCCESS;
+        }
         return PBIO_ERROR_IO;
     }
+    *written = ret;
     return PBIO_SUCCESS;
 }
 
@@ -205,4 +222,38 @@ pbio_error_t pb_serial_clear(pb_serial_t *ser) {
     return PBIO_SUCCESS;
 }
 
+static gboolean pb_serial_rx_event(gint fd, GIOCondition condition, gpointer user_data) {
+    pb_serial_t *ser = user_data;
+    // One shot. Nothing else to do here, this just makes the main loop
+    // iteration in MICROPY_EVENT_POLL_HOOK return so that readers can check
+    // for new data right away.
+    ser->rx_event_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Requests that the event loop wakes up as soon as there is data to read.
+ *
+ * This is a one shot request. Call it again each time after reading all data
+ * that was available.
+ *
+ * @param [in]  ser     The serial port.
+ */
+void pb_serial_request_rx_event(pb_serial_t *ser) {
+    if (ser->rx_event_source) {
+        return;
+    }
+    ser->rx_event_source = g_unix_fd_add(ser->file, G_IO_IN, pb_serial_rx_event, ser);
+}
+
+void pb_serial_close_all(void) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(pb_serials); i++) {
+        pb_serial_t *ser = &pb_serials[i];
+        if (ser->rx_event_source) {
+            g_source_remove(ser->rx_event_source);
+            ser->rx_event_source = 0;
+        }
+    }
+}
+
 #endif // PYBRICKS_RUNS_ON_EV3DEV
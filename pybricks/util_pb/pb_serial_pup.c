@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2023 The Pybricks Authors
+
+// Serial port on the I/O ports of Powered Up hubs.
+//
+// The port is taken away from device detection and its UART is used directly.
+// Received data is kept in the ring buffer of the UART driver, which is filled
+// by its interrupt handler. Writes are sent in the background from a copy of
+// the data. Neither reads nor writes wait, so callers can await them.
+
+#include "py/mpconfig.h"
+
+#if PYBRICKS_PY_IODEVICES && PYBRICKS_PY_PUPDEVICES
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <pbdrv/legodev.h>
+#include <pbdrv/uart.h>
+#include <pbio/error.h>
+#include <pbio/util.h>
+
+#include "py/mphal.h"
+#include "py/runtime.h"
+
+#include <pybricks/util_pb/pb_serial.h>
+
+// The UART driver writes at most this many bytes at once.
+#define TX_BUF_SIZE (UINT8_MAX)
+
+struct _pb_serial_t {
+    pbdrv_uart_dev_t *uart;
+    uint32_t baudrate;
+    bool writing;
+    uint8_t tx_buf[TX_BUF_SIZE];
+};
+
+// Ports A to F. Ports that a hub doesn't have can't be claimed.
+static pb_serial_t pb_serials[PBIO_PORT_ID_F - PBIO_PORT_ID_A + 1];
+
+pbio_error_t pb_serial_get(pb_serial_t **_ser, pbio_port_id_t port, int baudrate) {
+
+    if (port < PBIO_PORT_ID_A || port - PBIO_PORT_ID_A >= (int)PBIO_ARRAY_SIZE(pb_serials) || baudrate <= 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    pb_serial_t *ser = &pb_serials[port - PBIO_PORT_ID_A];
+
+    // Port may already be ours if it was used before in this program.
+    if (!ser->uart) {
+        pbio_error_t err = pbdrv_legodev_claim_uart(port, &ser->uart);
+        if (err != PBIO_SUCCESS) {
+            ser->uart = NULL;
+            return err;
+        }
+    }
+
+    ser->baudrate = baudrate;
+    pbdrv_uart_set_baud_rate(ser->uart, baudrate);
+
+    *_ser = ser;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Starts sending as much data as possible without waiting.
+ *
+ * The data is copied, so the caller may reuse it right away. Nothing is
+ * written while the previous write is still busy. The driver posts an event
+ * when it is done, which wakes up the event loop so callers can try again.
+ *
+ * @param [in]  ser         The serial port.
+ * @param [in]  buf         The data.
+ * @param [in]  count       The size of @p buf.
+ * @param [out] written     How many bytes were accepted, possibly 0.
+ * @return                  Error of the previous write or of starting this one.
+ */
+pbio_error_t pb_serial_write(pb_serial_t *ser, const void *buf, size_t count, size_t *written) {
+    pbio_error_t err;
+
+    *written = 0;
+
+    if (ser->writing) {
+        err = pbdrv_uart_write_end(ser->uart);
+        if (err == PBIO_ERROR_AGAIN) {
+            return PBIO_SUCCESS;
+        }
+        ser->writing = false;
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+    }
+
+    if (!count) {
+        return PBIO_SUCCESS;
+    }
+
+    uint8_t size = count < TX_BUF_SIZE ? count : TX_BUF_SIZE;
+    memcpy(ser->tx_buf, buf, size);
+
+    // Allow twice the time it takes to send 10 bits per byte.
+    uint32_t timeout = size * 10 * 1000 * 2 / ser->baudrate + 10;
+
+    // The driver may need another moment to clean up after the last write.
+    err = pbdrv_uart_write_begin(ser->uart, ser->tx_buf, size, timeout);
+    if (err == PBIO_ERROR_AGAIN) {
+        return PBIO_SUCCESS;
+    }
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    ser->writing = true;
+    *written = size;
+
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pb_serial_in_waiting(pb_serial_t *ser, size_t *waiting) {
+    *waiting = pbdrv_uart_in_waiting(ser->uart);
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pb_serial_read(pb_serial_t *ser, uint8_t *buf, size_t count, size_t *received) {
+    uint32_t read;
+    pbio_error_t err = pbdrv_uart_read_buffered(ser->uart, buf, count, &read);
+    *received = read;
+    return err;
+}
+
+pbio_error_t pb_serial_clear(pb_serial_t *ser) {
+    pbdrv_uart_flush(ser->uart);
+    return PBIO_SUCCESS;
+}
+
+void pb_serial_request_rx_event(pb_serial_t *ser) {
+    // Nothing to do. The UART driver polls its process for every byte it
+    // receives, which already wakes up the event loop.
+}
+
+void pb_serial_close_all(void) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(pb_serials); i++) {
+        pb_serial_t *ser = &pb_serials[i];
+
+        if (!ser->uart) {
+            continue;
+        }
+
+        // Cancel only sets the result, so the write must also be ended to
+        // release the driver for the next user.
+        if (ser->writing) {
+            pbdrv_uart_write_cancel(ser->uart);
+            (void)pbdrv_uart_write_end(ser->uart);
+            ser->writing = false;
+        }
+
+        pbdrv_legodev_release_uart(PBIO_PORT_ID_A + i);
+        ser->uart = NULL;
+    }
+}
+
+#endif // PYBRICKS_PY_IODEVICES && PYBRICKS_PY_PUPDEVICES
@@ -0,0 +1,40 @@
+# Test EV3 mailbox message framing
+
+from messaging_c import pack, unpack
+
+# logic message
+msg = pack("logic", b"\x01")
+print(msg)
+print(unpack(msg[2:]))
+
+# text messages can be given as str
+msg = pack("text", "hi\0")
+print(msg)
+print(unpack(msg[2:]))
+
+# empty payload
+print(unpack(pack("empty", b"")[2:]))
+
+# bad command type
+try:
+    unpack(b"\x01\x00\x01\x9e\x01\x00\x00\x00")
+except ValueError as ex:
+    print(ex)
+
+# bad command
+try:
+    unpack(b"\x01\x00\x81\x01\x01\x00\x00\x00")
+except ValueError as ex:
+    print(ex)
+
+# truncated message
+try:
+    unpack(b"\x01\x00\x81\x9e\x10abc")
+except ValueError as ex:
+    print(ex)
+
+# payload too long
+try:
+    pack("long", bytes(1025))
+except ValueError as ex:
+    print(ex)
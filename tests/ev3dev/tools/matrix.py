@@ -100,3 +100,82 @@ except ValueError:
 # iterator
 print(*B)
 print(*B.T)
+
+
+# In-place operators store the result in the left hand side if possible, and
+# give the same result as the regular operators. The expected values are not
+# computed with E * 3 and such, because then E would share its data.
+def close(X, Y):
+    return max(abs(x - y) for x, y in zip(X, Y)) < 1e-4
+
+
+E = Matrix([[1, 2], [3, 4]])
+F = Matrix([[0.5, -1], [2, 0.25]])
+E_id = id(E)
+
+expected = [e + f for e, f in zip(E, F)]
+E += F
+print("E += F:", id(E) == E_id, close(E, expected))
+
+expected = [e - 2 * f for e, f in zip(E, F)]
+E -= F * 2
+print("E -= F * 2:", id(E) == E_id, close(E, expected))
+
+expected = [3 * e for e in E]
+E *= 3
+print("E *= 3:", id(E) == E_id, close(E, expected))
+
+expected = E @ F
+E @= F
+print("E @= F:", id(E) == E_id, close(E, expected))
+
+expected = E * E
+E *= E
+print("E *= E:", id(E) == E_id, close(E, expected))
+
+expected = [e / 4 for e in E]
+E /= 4
+print("E /= 4:", id(E) == E_id, close(E, expected))
+
+# Transposed and scaled matrices share data, so they are not modified.
+G = E.T
+expected = list(G)
+E += F
+print("E += F with view:", id(E) == E_id, close(G, expected))
+
+# Shape changes, so a new matrix is made.
+D_id = id(D)
+D @= D.T
+print("D @= D.T:", id(D) == D_id, D.shape)
+
+# Other names for the same matrix see the in-place change, like for lists.
+H = Matrix([[1, 2], [3, 4]])
+K = H
+H += F
+print("K is H after H += F:", K is H, close(K, H))
+H = H + F
+print("K is H after H = H + F:", K is H)
+
+# Constants are never modified.
+X = Axis.X
+X += vector(0, 1, 0)
+print("Axis.X:", list(Axis.X), list(X))
+
+
+# Products of (transposed) matrices compared to plain Python.
+def reference(a, b, n):
+    return [sum(a[r][k] * b[k][c] for k in range(n)) for r in range(n) for c in range(n)]
+
+
+for n in range(2, 6):
+    a = [[(r * n + c) % 7 - 3.5 for c in range(n)] for r in range(n)]
+    b = [[(r + 2 * c) % 5 * 0.25 for c in range(n)] for r in range(n)]
+    at = [[a[c][r] for c in range(n)] for r in range(n)]
+    A = Matrix(a)
+    B = Matrix(b)
+    print(
+        n,
+        close(A * B, reference(a, b, n)),
+        close(A.T @ B, reference(at, b, n)),
+        close(B.T.T * A.T, reference(b, at, n)),
+    )
@@ -0,0 +1,50 @@
+"""
+Hardware Module: All hubs with floating point support.
+
+Description: Benchmark for Matrix arithmetic, comparing regular operators to
+in-place operators that reuse the left hand side. Results are printed in
+microseconds per operation.
+"""
+
+from pybricks.tools import Matrix, StopWatch
+
+LOOPS = 1000
+
+watch = StopWatch()
+
+
+def benchmark(name, func):
+    start = watch.time()
+    func()
+    duration = watch.time() - start
+    print("{:<12} {:>6} us".format(name, duration * 1000 // LOOPS))
+
+
+for n in range(2, 6):
+    A = Matrix([[(r * n + c) % 7 * 0.1 for c in range(n)] for r in range(n)])
+    B = Matrix([[(r + c) % 3 * 0.1 for c in range(n)] for r in range(n)])
+
+    print("{0}x{0}:".format(n))
+
+    def add():
+        for i in range(LOOPS):
+            C = A + B
+
+    def add_inplace():
+        C = A + B
+        for i in range(LOOPS):
+            C += B
+
+    def mul():
+        for i in range(LOOPS):
+            C = A @ B
+
+    def mul_inplace():
+        C = A + B
+        for i in range(LOOPS):
+            C @= B
+
+    benchmark("A + B", add)
+    benchmark("C += B", add_inplace)
+    benchmark("A @ B", mul)
+    benchmark("C @= B", mul_inplace)
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Measures how long pybricks-micropython takes to start on the EV3.
+#
+# Run this on the brick from the console (or with `brickrun -r --`) so that
+# graphics can be initialized. Each case is run a number of times and the
+# average wall time is printed.
+#
+# Usage: ev3dev-startup-time.sh [runs] [path/to/pybricks-micropython]
+
+set -e
+
+RUNS=${1:-10}
+MICROPYTHON=${2:-pybricks-micropython}
+
+measure() {
+    name=$1
+    code=$2
+
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$MICROPYTHON" -c "$code" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+
+    echo "$name: $(((end - start) / RUNS / 1000000)) ms"
+}
+
+measure "empty program" "pass"
+measure "import modules" "from pybricks.hubs import EV3Brick; from pybricks.ev3devices import Motor; from pybricks.tools import wait"
+measure "create brick" "from pybricks.hubs import EV3Brick; EV3Brick()"
+measure "create motor" "from pybricks.ev3devices import Motor; from pybricks.parameters import Port; Motor(Port.A)"